@@ -233,7 +233,7 @@ static void uhd_sleep_mode(enum uhd_uotghs_state_enum new_state)
 		SLEEPMGR_WAIT,      // UHD_STATE_NO_VBUS
 		SLEEPMGR_WAIT,      // UHD_STATE_DISCONNECT
 		SLEEPMGR_WAIT,      // UHD_STATE_SUSPEND
-		SLEEPMGR_ACTIVE,    // UHD_STATE_IDLE
+		SLEEPMGR_SLEEP_WFI, // UHD_STATE_IDLE
 	};
 
 	static enum uhd_uotghs_state_enum uhd_state = UHD_STATE_OFF;
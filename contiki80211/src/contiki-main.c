@@ -65,6 +65,7 @@
 #define DEBUG 1
 #include "uip-debug.h"
 #include "contiki-main.h"
+#include "sys/mt-pool.h"
 
 #ifdef WITH_AR9170_WIFI_SUPPORT
 #ifdef WITH_USB_SUPPORT
@@ -170,7 +171,68 @@ static void configure_led_debug_pins() {
 }
 #endif
 
-
+#ifdef WITH_TICKLESS_IDLE
+/*
+ * Puts the CPU to sleep until the earliest etimer or rtimer deadline, when
+ * no events or polls are pending. Callback timers run on etimers, so they 
+ * are covered as well. Any interrupt, e.g. from the USB host, wakes it up.
+ */
+static void contiki_idle(void)
+{
+	clock_time_t now, ticks = 0;
+	rtimer_clock_t rt_next, rt_now;
+	unsigned char owner;
+	
+	cpu_irq_disable();
+	
+	if (process_nevents() > 0) {
+		cpu_irq_enable();
+		return;
+	}
+	
+	/* Some driver, e.g. the USB host while it waits for the ID pin, 
+	 * does not even allow the core clock to stop. */
+	if (sleepmgr_get_sleep_mode() == SLEEPMGR_ACTIVE) {
+		cpu_irq_enable();
+		return;
+	}
+	
+	now = clock_time();
+	if (etimer_pending()) {
+		ticks = etimer_next_expiration_time() - now;
+		if (ticks == 0 || ticks > ((clock_time_t)~0 >> 1)) {
+			/* Due already; the etimer poll is about to arrive. */
+			cpu_irq_enable();
+			return;
+		}
+	}
+	
+	if (rtimer_next_expiration(&rt_next)) {
+		rt_now = RTIMER_NOW();
+		if (rt_next <= rt_now) {
+			cpu_irq_enable();
+			return;
+		}
+		rt_next = ((rt_next - rt_now) * CLOCK_SECOND) / RTIMER_SECOND;
+		if (rt_next == 0) {
+			/* Less than a tick away; not worth sleeping for. */
+			cpu_irq_enable();
+			return;
+		}
+		if (ticks == 0 || rt_next < ticks) {
+			ticks = (clock_time_t)rt_next;
+		}
+	}
+	
+	owner = ENERGEST_CPU_ENTER(ENERGEST_CPU_IDLE);
+	ENERGEST_OFF(ENERGEST_TYPE_CPU);
+	ENERGEST_ON(ENERGEST_TYPE_LPM);
+	clock_idle(ticks);
+	ENERGEST_OFF(ENERGEST_TYPE_LPM);
+	ENERGEST_ON(ENERGEST_TYPE_CPU);
+	ENERGEST_CPU_LEAVE(owner);
+}
+#endif
 
 /*! \brief Main function. Execution starts here.
  */
@@ -209,10 +271,14 @@ int main(void)
 	rtimer_init();
 	
 	/* etimer_process should be initialized before ctimer */
+	process_set_cpu(&etimer_process, ENERGEST_CPU_KERNEL);
 	process_start(&etimer_process, NULL);
 	
 	/* Initialize the ctimer process */ 
 	ctimer_init();	
+	
+	/* Threads for blocking driver routines */
+	mt_pool_init();
 #ifdef WITH_LED_DEBUGGING
 	configure_led_debug_pins();
 #ifdef WITH_AR9170_WIFI_SUPPORT
@@ -231,6 +297,7 @@ int main(void)
 	
 	/* Initialize energy estimation routines */
 	energest_init();
+	ENERGEST_ON(ENERGEST_TYPE_CPU);
 		
 	/* Initialize watch-dog process */
 	watchdog_start();  
@@ -293,5 +360,10 @@ int main(void)
 		
 		/* Contiki Polling System */
 		process_run();
+		
+#ifdef WITH_TICKLESS_IDLE
+		/* Sleep until the next timer, if nothing else is pending */
+		contiki_idle();
+#endif
 	}	
 }
\ No newline at end of file
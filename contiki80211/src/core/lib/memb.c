@@ -47,57 +47,105 @@
 #include "contiki.h"
 #include "lib/memb.h"
 
+#if MEMB_STATS
+#include <stdio.h>
+#endif /* MEMB_STATS */
+
+#if MEMB_STATS
+/* Registered pools, most recent first, and the first one registered,
+   which ends the list. */
+static struct memb *registry;
+static struct memb *registry_last;
+
+static void
+memb_register(struct memb *m)
+{
+  if(m->next != NULL || m == registry_last) {
+    return;
+  }
+  if(registry_last == NULL) {
+    registry_last = m;
+  }
+  m->next = registry;
+  registry = m;
+}
+#endif /* MEMB_STATS */
 /*---------------------------------------------------------------------------*/
 void
 memb_init(struct memb *m)
 {
-  memset(m->count, 0, m->num);
+  memset(m->used, 0, ((m->num + 31) / 32) * sizeof(uint32_t));
   memset(m->mem, 0, m->size * m->num);
+#if MEMB_STATS
+  m->inuse = 0;
+  m->peak = 0;
+  m->fails = 0;
+  memb_register(m);
+#endif /* MEMB_STATS */
 }
 /*---------------------------------------------------------------------------*/
 void *
 memb_alloc(struct memb *m)
 {
-  int i;
+  int w, i;
+  uint32_t free_bits;
 
-  for(i = 0; i < m->num; ++i) {
-    if(m->count[i] == 0) {
-      /* If this block was unused, we increase the reference count to
-	 indicate that it now is used and return a pointer to the
-	 memory block. */
-      ++(m->count[i]);
+  /* Find the first word with a clear bit, then the lowest clear bit in
+     it: one word per 32 blocks. */
+  for(w = 0; w < (m->num + 31) / 32; ++w) {
+    free_bits = ~m->used[w];
+    if(free_bits != 0) {
+      i = w * 32 + __builtin_ctz(free_bits);
+      if(i >= m->num) {
+        /* Only the unused tail of the last word is clear. */
+        break;
+      }
+      m->used[w] |= 1UL << (i & 31);
+#if MEMB_STATS
+      memb_register(m);
+      if(++m->inuse > m->peak) {
+        m->peak = m->inuse;
+      }
+#endif /* MEMB_STATS */
       return (void *)((char *)m->mem + (i * m->size));
     }
   }
 
   /* No free block was found, so we return NULL to indicate failure to
      allocate block. */
+#if MEMB_STATS
+  memb_register(m);
+  m->fails++;
+#endif /* MEMB_STATS */
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
 char
 memb_free(struct memb *m, void *ptr)
 {
-  int i;
-  char *ptr2;
+  unsigned int offset, i;
+  uint32_t bit;
 
-  /* Walk through the list of blocks and try to find the block to
-     which the pointer "ptr" points to. */
-  ptr2 = (char *)m->mem;
-  for(i = 0; i < m->num; ++i) {
-    
-    if(ptr2 == (char *)ptr) {
-      /* We've found to block to which "ptr" points so we decrease the
-	 reference count and return the new value of it. */
-      if(m->count[i] > 0) {
-	/* Make sure that we don't deallocate free memory. */
-	--(m->count[i]);
-      }
-      return m->count[i];
-    }
-    ptr2 += m->size;
+  /* The index follows from the offset; anything outside the pool or not
+     at the start of a block is not a legal block. */
+  if(!memb_inmemb(m, ptr)) {
+    return -1;
+  }
+  offset = (char *)ptr - (char *)m->mem;
+  i = offset / m->size;
+  if(i * m->size != offset) {
+    return -1;
   }
-  return -1;
+
+  bit = 1UL << (i & 31);
+  if(m->used[i / 32] & bit) {
+    /* Make sure that we don't deallocate free memory. */
+    m->used[i / 32] &= ~bit;
+#if MEMB_STATS
+    m->inuse--;
+#endif /* MEMB_STATS */
+  }
+  return 0;
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -107,5 +155,24 @@ memb_inmemb(struct memb *m, void *ptr)
     (char *)ptr < (char *)m->mem + (m->num * m->size);
 }
 /*---------------------------------------------------------------------------*/
+#if MEMB_STATS
+struct memb *
+memb_stats_list(void)
+{
+  return registry;
+}
+/*---------------------------------------------------------------------------*/
+void
+memb_print_stats(void)
+{
+  struct memb *m;
+
+  for(m = registry; m != NULL; m = m->next) {
+    printf("memb %-16s %3u x %4u bytes, %3u used, peak %3u, %u failed\n",
+           m->name, m->num, m->size, m->inuse, m->peak, m->fails);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* MEMB_STATS */
 
 /** @} */
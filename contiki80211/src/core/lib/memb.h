@@ -64,6 +64,15 @@
 #define MEMB_H_
 
 #include "sys/cc.h"
+#include "contiki-conf.h"
+#include <stdint.h>
+
+/* Per-pool occupancy counters and a registry of pools [1 to enable]. */
+#ifdef MEMB_CONF_STATS
+#define MEMB_STATS MEMB_CONF_STATS
+#else
+#define MEMB_STATS 0
+#endif /* MEMB_CONF_STATS */
 
 /**
  * Declare a memory block.
@@ -86,18 +95,37 @@ MEMB(connections, struct connection, 16);
  * \param num The total number of memory chunks in the block.
  *
  */
+#if MEMB_STATS
 #define MEMB(name, structure, num) \
-        static char CC_CONCAT(name,_memb_count)[num]; \
+        static uint32_t CC_CONCAT(name,_memb_used)[((num) + 31) / 32]; \
         static structure CC_CONCAT(name,_memb_mem)[num]; \
         static struct memb name = {sizeof(structure), num, \
-                                          CC_CONCAT(name,_memb_count), \
+                                          CC_CONCAT(name,_memb_used), \
+                                          (void *)CC_CONCAT(name,_memb_mem), \
+                                          #name, NULL, 0, 0, 0}
+#else /* MEMB_STATS */
+#define MEMB(name, structure, num) \
+        static uint32_t CC_CONCAT(name,_memb_used)[((num) + 31) / 32]; \
+        static structure CC_CONCAT(name,_memb_mem)[num]; \
+        static struct memb name = {sizeof(structure), num, \
+                                          CC_CONCAT(name,_memb_used), \
                                           (void *)CC_CONCAT(name,_memb_mem)}
+#endif /* MEMB_STATS */
 
 struct memb {
   unsigned short size;
   unsigned short num;
-  char *count;
+  /* One bit per block, set while it is allocated. All clear, as in a
+     zero-initialized pool, means all blocks free. */
+  uint32_t *used;
   void *mem;
+#if MEMB_STATS
+  const char *name;
+  struct memb *next;      /* Registry link, see memb_stats_list() */
+  unsigned short inuse;
+  unsigned short peak;
+  unsigned short fails;
+#endif /* MEMB_STATS */
 };
 
 /**
@@ -130,6 +158,20 @@ char  memb_free(struct memb *m, void *ptr);
 
 int memb_inmemb(struct memb *m, void *ptr);
 
+#if MEMB_STATS
+/**
+ * Pools that have been initialized or allocated from, most recent
+ * first; follow the next field for the rest.
+ */
+struct memb *memb_stats_list(void);
+
+/**
+ * Print the name, size, use, peak and failed allocations of every
+ * registered pool.
+ */
+void memb_print_stats(void);
+#endif /* MEMB_STATS */
+
 
 /** @} */
 /** @} */
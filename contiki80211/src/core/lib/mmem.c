@@ -47,7 +47,9 @@
 #include "mmem.h"
 #include "list.h"
 #include "contiki-conf.h"
+#include "contiki.h"
 #include <string.h>
+#include <stdint.h>
 
 #ifdef MMEM_CONF_SIZE
 #define MMEM_SIZE MMEM_CONF_SIZE
@@ -55,10 +57,189 @@
 #define MMEM_SIZE 4096
 #endif
 
-LIST(mmemlist);
+/* Bytes the compaction process may move per event; one block is always
+   moved, however large. */
+#ifdef MMEM_CONF_COMPACT_SLICE
+#define MMEM_COMPACT_SLICE MMEM_CONF_COMPACT_SLICE
+#else
+#define MMEM_COMPACT_SLICE 256
+#endif
+
+/* Every block, live or free, starts with a header, so the arena can be
+   walked in address order. A block without an owner is a hole. */
+struct block {
+  struct mmem *owner;
+  unsigned int size;            /* Including the header */
+};
+
+/* Holes are kept in doubly linked lists by size class. */
+struct hole {
+  struct block b;
+  struct hole *next;
+  struct hole *prev;
+};
+
+#define ALIGN           8
+#define HDR             sizeof(struct block)
+#define MIN_BLOCK       sizeof(struct hole)
+#define NUM_CLASSES     8
+#define BLOCK_AT(off)   ((struct block *)(arena + (off)))
+#define OFFSET(b)       ((unsigned int)((char *)(b) - arena))
+
 unsigned int avail_memory;
-static char memory[MMEM_SIZE];
+static uint64_t memory[MMEM_SIZE / 8];
+#define arena ((char *)memory)
+#define ARENA_SIZE (sizeof(memory))
+
+/* Everything from top up is free. */
+static unsigned int top;
+/* No hole lies below this offset. */
+static unsigned int cursor;
+static unsigned int num_holes;
+static unsigned long moved;
+/* A compaction slice is queued. */
+static unsigned char compacting;
+static struct hole *classes[NUM_CLASSES];
+
+PROCESS(mmem_compact_process, "mmem compaction");
+
+/*---------------------------------------------------------------------------*/
+static int
+size_class(unsigned int size)
+{
+  /* Classes double from MIN_BLOCK: 16-31, 32-63, ..., 2048 and more. */
+  int c = 31 - __builtin_clz(size / MIN_BLOCK);
+  return c < NUM_CLASSES ? c : NUM_CLASSES - 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hole_link(struct hole *h, unsigned int size)
+{
+  int c = size_class(size);
+
+  h->b.owner = NULL;
+  h->b.size = size;
+  h->prev = NULL;
+  h->next = classes[c];
+  if(h->next != NULL) {
+    h->next->prev = h;
+  }
+  classes[c] = h;
+  num_holes++;
+  if(OFFSET(h) < cursor) {
+    cursor = OFFSET(h);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+hole_unlink(struct hole *h)
+{
+  if(h->prev != NULL) {
+    h->prev->next = h->next;
+  } else {
+    classes[size_class(h->b.size)] = h->next;
+  }
+  if(h->next != NULL) {
+    h->next->prev = h->prev;
+  }
+  num_holes--;
+}
+/*---------------------------------------------------------------------------*/
+/* Move holes up by sliding the live blocks above them down, merging
+   holes that meet and folding the last one into the space above top.
+   Stops once about budget bytes have been moved; returns non-zero if
+   holes remain. */
+static int
+compact(unsigned long budget)
+{
+  struct block *b, *n;
+  struct hole *h;
+  unsigned int size;
+
+  while(num_holes > 0) {
+    if(cursor >= top) {
+      /* Holes are only created below top; rescan. */
+      cursor = 0;
+    }
+    b = BLOCK_AT(cursor);
+    if(b->owner != NULL) {
+      cursor += b->size;
+      budget = budget > HDR ? budget - HDR : 0;
+      if(budget == 0) {
+        return 1;
+      }
+      continue;
+    }
+
+    if(cursor + b->size == top) {
+      /* The hole meets the free space above top. */
+      hole_unlink((struct hole *)b);
+      top = cursor;
+      cursor = 0;
+      continue;
+    }
+
+    n = BLOCK_AT(cursor + b->size);
+    if(n->owner == NULL) {
+      /* Two holes meet; merge them. */
+      size = b->size + n->size;
+      hole_unlink((struct hole *)n);
+      hole_unlink((struct hole *)b);
+      hole_link((struct hole *)b, size);
+      continue;
+    }
+
+    /* Slide the live block down over the hole; the hole moves above it
+       and is looked at again next. */
+    if(n->size > budget && budget < MMEM_COMPACT_SLICE) {
+      return 1;
+    }
+    size = b->size;
+    hole_unlink((struct hole *)b);
+    memmove(b, n, n->size);
+    b->owner->ptr = (char *)b + HDR;
+    moved += b->size;
+    budget = budget > b->size ? budget - b->size : 0;
+    h = (struct hole *)((char *)b + b->size);
+    hole_link(h, size);
+    cursor = OFFSET(h);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mmem_compact_process, ev, data)
+{
+  PROCESS_BEGIN();
 
+  /* One slice per event, posted to ourselves in the normal lane, so
+     that everything else queued runs in between. */
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE);
+    if(!compact(MMEM_COMPACT_SLICE) ||
+       process_post(&mmem_compact_process, PROCESS_EVENT_CONTINUE,
+                    NULL) != PROCESS_ERR_OK) {
+      compacting = 0;
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Queue a compaction slice unless one is queued already. */
+static void
+compact_schedule(void)
+{
+  if(compacting) {
+    return;
+  }
+  if(!process_is_running(&mmem_compact_process)) {
+    process_start(&mmem_compact_process, NULL);
+  }
+  if(process_post(&mmem_compact_process, PROCESS_EVENT_CONTINUE,
+                  NULL) == PROCESS_ERR_OK) {
+    compacting = 1;
+  }
+}
 /*---------------------------------------------------------------------------*/
 /**
  * \brief      Allocate a managed memory block
@@ -78,28 +259,69 @@ static char memory[MMEM_SIZE];
  *             macro MMEM_PTR() is used to get a pointer to the
  *             allocated memory.
  *
+ *             A hole of the right size class is reused if there is
+ *             one; otherwise the block goes on top. If the free space
+ *             is only there in pieces, live blocks are compacted here
+ *             until it fits, so pointers obtained with MMEM_PTR()
+ *             before the call may be stale after it.
+ *
  */
 int
 mmem_alloc(struct mmem *m, unsigned int size)
 {
+  struct hole *h = NULL;
+  struct block *b;
+  unsigned int need;
+  int c;
+
+  need = (size + HDR + ALIGN - 1) & ~(ALIGN - 1);
+  if(need < MIN_BLOCK) {
+    need = MIN_BLOCK;
+  }
+
   /* Check if we have enough memory left for this allocation. */
-  if(avail_memory < size) {
+  if(avail_memory < need) {
     return 0;
   }
 
-  /* We had enough memory so we add this memory block to the end of
-     the list of allocated memory blocks. */
-  list_add(mmemlist, m);
+  /* Any hole of a higher class fits; in the first class, look for
+     one. */
+  c = size_class(need);
+  for(h = classes[c]; h != NULL && h->b.size < need; h = h->next);
+  for(c++; h == NULL && c < NUM_CLASSES; c++) {
+    h = classes[c];
+  }
 
-  /* Set up the pointer so that it points to the first available byte
-     in the memory block. */
-  m->ptr = &memory[MMEM_SIZE - avail_memory];
+  if(h != NULL) {
+    hole_unlink(h);
+    b = &h->b;
+    if(h->b.size - need >= MIN_BLOCK) {
+      /* Split; the rest stays a hole. */
+      hole_link((struct hole *)((char *)h + need), h->b.size - need);
+    } else {
+      need = h->b.size;
+    }
+  } else {
+    /* The space is there, but in holes; gather enough of it on top
+       now. This moves at most the blocks above the holes, once each. */
+    while(ARENA_SIZE - top < need && compact(MMEM_COMPACT_SLICE));
+    if(ARENA_SIZE - top < need) {
+      return 0;
+    }
+    b = BLOCK_AT(top);
+    top += need;
+  }
+
+  b->owner = m;
+  b->size = need;
+  m->next = NULL;
+  m->ptr = (char *)b + HDR;
 
   /* Remember the size of this memory block. */
   m->size = size;
 
   /* Decrease the amount of available memory. */
-  avail_memory -= size;
+  avail_memory -= need;
 
   /* Return non-zero to indicate that we were able to allocate
      memory. */
@@ -114,29 +336,41 @@ mmem_alloc(struct mmem *m, unsigned int size)
  *             This function deallocates a managed memory block that
  *             previously has been allocated with mmem_alloc().
  *
+ *             The block becomes a hole, merged with a hole right
+ *             above it; no memory is moved here. The compaction
+ *             process later moves the holes to the top in slices of
+ *             bounded length.
+ *
  */
 void
 mmem_free(struct mmem *m)
 {
-  struct mmem *n;
-
-  if(m->next != NULL) {
-    /* Compact the memory after the allocation that is to be removed
-       by moving it downwards. */
-    memmove(m->ptr, m->next->ptr,
-	    &memory[MMEM_SIZE - avail_memory] - (char *)m->next->ptr);
-    
-    /* Update all the memory pointers that points to memory that is
-       after the allocation that is to be removed. */
-    for(n = m->next; n != NULL; n = n->next) {
-      n->ptr = (void *)((char *)n->ptr - m->size);
-    }
+  struct block *b = (struct block *)((char *)m->ptr - HDR);
+  struct block *n;
+  unsigned int size;
+
+  if(b->owner != m) {
+    /* Not allocated, or freed already. */
+    return;
   }
+  size = b->size;
+  avail_memory += size;
 
-  avail_memory += m->size;
+  if(OFFSET(b) + size == top) {
+    top -= size;
+    if(num_holes == 0) {
+      return;
+    }
+  } else {
+    n = BLOCK_AT(OFFSET(b) + size);
+    if(n->owner == NULL) {
+      hole_unlink((struct hole *)n);
+      size += n->size;
+    }
+    hole_link((struct hole *)b, size);
+  }
 
-  /* Remove the memory block from the list. */
-  list_remove(mmemlist, m);
+  compact_schedule();
 }
 /*---------------------------------------------------------------------------*/
 /**
@@ -151,8 +385,41 @@ mmem_free(struct mmem *m)
 void
 mmem_init(void)
 {
-  list_init(mmemlist);
-  avail_memory = MMEM_SIZE;
+  memset(classes, 0, sizeof(classes));
+  top = 0;
+  cursor = 0;
+  num_holes = 0;
+  moved = 0;
+  compacting = 0;
+  avail_memory = ARENA_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief      Get the arena usage
+ * \param stats Filled in with the current figures.
+ *
+ *             Fragmentation shows as a largest contiguous free space
+ *             well below the total free space.
+ *
+ */
+void
+mmem_get_stats(struct mmem_stats *stats)
+{
+  struct hole *h;
+  int c;
+
+  stats->used = ARENA_SIZE - avail_memory;
+  stats->free = avail_memory;
+  stats->holes = num_holes;
+  stats->largest = ARENA_SIZE - top;
+  stats->moved = moved;
+  for(c = 0; c < NUM_CLASSES; c++) {
+    for(h = classes[c]; h != NULL; h = h->next) {
+      if(h->b.size > stats->largest) {
+        stats->largest = h->b.size;
+      }
+    }
+  }
 }
 /*---------------------------------------------------------------------------*/
 
@@ -43,6 +43,8 @@
  * the managed memory module cannot be sure that allocated memory
  * stays in place. Therefore, a level of indirection is used: access
  * to allocated memory must always be done using a special macro.
+ * Blocks are moved by the compaction process, and by mmem_alloc()
+ * when the free space is only there in holes.
  *
  * \note This module has not been heavily tested.
  * @{
@@ -75,17 +77,31 @@
 #define MMEM_PTR(m) (struct mmem *)(m)->ptr
 
 struct mmem {
-  struct mmem *next;
+  struct mmem *next;    /* Unused; blocks are found through the arena */
   unsigned int size;
   void *ptr;
 };
 
+/**
+ * Arena usage. The free space is split between holes left by freed
+ * blocks, which the compaction process moves to the top of the arena,
+ * and the contiguous space above the top block.
+ */
+struct mmem_stats {
+  unsigned int used;        /* Bytes in live blocks, headers included */
+  unsigned int free;        /* Bytes in holes and above the top */
+  unsigned int holes;
+  unsigned int largest;     /* Largest contiguous free space */
+  unsigned long moved;      /* Bytes moved by compaction since init */
+};
+
 /* XXX: tagga minne med "interrupt usage", vilke gr att man r
    speciellt varsam under free(). */
 
 int  mmem_alloc(struct mmem *m, unsigned int size);
 void mmem_free(struct mmem *);
 void mmem_init(void);
+void mmem_get_stats(struct mmem_stats *stats);
 
 #endif /* MMEM_H_ */
 //#endif /* __MMEM_H__ */
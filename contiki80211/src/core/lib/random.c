@@ -33,22 +33,147 @@
 
 #include "lib/random.h"
 #include "sys/clock.h"
+#include "sys/cc.h"
 
-#include <stdlib.h>
+#include <string.h>
 
+/*
+ * The generator is xoshiro128** (Blackman/Vigna): 128 bits of state,
+ * a handful of shifts and rotates per 32-bit output and no divisions,
+ * which suits the Cortex-M3. Entropy from a hardware source (e.g. the
+ * AR9170 RNG register) is folded into the state with
+ * random_add_entropy(), so nodes that were booted with the same seed
+ * diverge as soon as the radio is up.
+ */
+
+#ifdef RANDOM_CONF_RESEED_INTERVAL
+#define RANDOM_RESEED_INTERVAL RANDOM_CONF_RESEED_INTERVAL
+#else
+#define RANDOM_RESEED_INTERVAL 1024
+#endif
+
+static uint32_t s[4] = {
+  0x9e3779b9UL, 0x243f6a88UL, 0xb7e15162UL, 0x6a09e667UL
+};
+
+/* Number of outputs generated since entropy was last mixed in. */
+static unsigned short outputs_since_reseed = RANDOM_RESEED_INTERVAL;
+
+/*---------------------------------------------------------------------------*/
+static CC_INLINE uint32_t
+rotl(uint32_t x, int k)
+{
+  return (x << k) | (x >> (32 - k));
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+next(void)
+{
+  uint32_t result, t;
+
+  result = rotl(s[1] * 5, 7) * 9;
+  t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 11);
+
+  if(outputs_since_reseed < RANDOM_RESEED_INTERVAL) {
+    outputs_since_reseed++;
+  }
+  return result;
+}
+/*---------------------------------------------------------------------------*/
+/* splitmix32 step, used to spread a short seed over the whole state. */
+static uint32_t
+splitmix(uint32_t *x)
+{
+  uint32_t z;
+
+  z = (*x += 0x9e3779b9UL);
+  z = (z ^ (z >> 16)) * 0x85ebca6bUL;
+  z = (z ^ (z >> 13)) * 0xc2b2ae35UL;
+  return z ^ (z >> 16);
+}
 /*---------------------------------------------------------------------------*/
 void
 random_init(unsigned short seed)
 {
-  srand(seed);
+  uint32_t x = seed;
+  int i;
+
+  for(i = 0; i < 4; i++) {
+    s[i] = splitmix(&x);
+  }
+  outputs_since_reseed = RANDOM_RESEED_INTERVAL;
 }
 /*---------------------------------------------------------------------------*/
 unsigned short
 random_rand(void)
 {
-/* In gcc int rand() uses RAND_MAX and long random() uses RANDOM_MAX=0x7FFFFFFF */
-/* RAND_MAX varies depending on the architecture */
+  /* The upper bits of xoshiro128** are the strongest ones. */
+  return (unsigned short)(next() >> 16);
+}
+/*---------------------------------------------------------------------------*/
+void
+random_fill(void *buf, unsigned short len)
+{
+  uint8_t *p = buf;
+  uint32_t r;
+
+  while(len >= sizeof(r)) {
+    r = next();
+    memcpy(p, &r, sizeof(r));
+    p += sizeof(r);
+    len -= sizeof(r);
+  }
+  if(len > 0) {
+    r = next();
+    memcpy(p, &r, len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+random_add_entropy(const void *data, unsigned short len)
+{
+  const uint8_t *p = data;
+  uint32_t x = 0;
+  unsigned short i;
+  int j;
+
+  if(len == 0) {
+    return;
+  }
+
+  /* Fold the input into the state word by word, then stir. */
+  for(i = 0; i < len; i++) {
+    x = (x << 8) | p[i];
+    if((i & 3) == 3 || i == len - 1) {
+      s[(i >> 2) & 3] ^= splitmix(&x);
+      x = 0;
+    }
+  }
+
+  /* The all-zero state is the only fixed point of the generator. */
+  if((s[0] | s[1] | s[2] | s[3]) == 0) {
+    x = len;
+    for(j = 0; j < 4; j++) {
+      s[j] = splitmix(&x);
+    }
+  }
 
-  return (unsigned short)rand();
+  for(j = 0; j < 8; j++) {
+    next();
+  }
+  outputs_since_reseed = 0;
 }
-/*---------------------------------------------------------------------------*/ 
+/*---------------------------------------------------------------------------*/
+int
+random_entropy_needed(void)
+{
+  return outputs_since_reseed >= RANDOM_RESEED_INTERVAL;
+}
+/*---------------------------------------------------------------------------*/
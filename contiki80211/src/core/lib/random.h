@@ -44,8 +44,27 @@ void random_init(unsigned short seed);
  */
 unsigned short random_rand(void);
 
-/* In gcc int rand() uses RAND_MAX and long random() uses RANDOM_MAX */
-/* Since random_rand casts to unsigned short, we'll use this maxmimum */
+/*
+ * Fill a buffer with pseudo-random bytes. Cheaper than repeated calls
+ * to random_rand() for nonces, keys and other bulk users.
+ */
+void random_fill(void *buf, unsigned short len);
+
+/*
+ * Mix entropy, typically read from a hardware random source, into the
+ * generator state.
+ */
+void random_add_entropy(const void *data, unsigned short len);
+
+/*
+ * Check whether the generator has produced RANDOM_CONF_RESEED_INTERVAL
+ * outputs since entropy was last added (or has never been reseeded).
+ *
+ * \return Non-zero if fresh entropy should be added.
+ */
+int random_entropy_needed(void);
+
+/* random_rand returns the upper 16 bits of a 32-bit output. */
 #define RANDOM_RAND_MAX 65535U
 
 #endif /* RANDOM_H_ */
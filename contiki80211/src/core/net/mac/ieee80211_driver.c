@@ -50,6 +50,10 @@
 #include "ieee80211.h"
 #include "uip.h"
 #include "ibss_main.h"
+#include "ieee80211_ibss.h"
+#include "queuebuf.h"
+#include "lib/list.h"
+#include "lib/memb.h"
 
 #define IEEE80211_DRIVER_DEBUG	1
 #define IEEE80211_DRIVER_DEBUG_DEEP	0
@@ -70,6 +74,69 @@ struct seqno {
 #endif /* NETSTACK_CONF_MAC_SEQNO_HISTORY */
 static struct seqno received_seqnos[MAX_SEQNOS];
 
+/* Packets sent by the upper layers before the IBSS is joined are held
+ * here, and released in order once it starts beaconing.
+ */
+#ifdef IEEE80211_DRIVER_CONF_HOLD_NUM
+#define HOLD_NUM IEEE80211_DRIVER_CONF_HOLD_NUM
+#else /* IEEE80211_DRIVER_CONF_HOLD_NUM */
+#define HOLD_NUM 2
+#endif /* IEEE80211_DRIVER_CONF_HOLD_NUM */
+
+struct held_packet {
+	struct held_packet *next;
+	struct queuebuf *buf;
+	mac_callback_t sent;
+	void *ptr;
+};
+
+MEMB(held_memb, struct held_packet, HOLD_NUM);
+LIST(held_list);
+
+
+/*---------------------------------------------------------------------------*/
+static void
+hold_packet(mac_callback_t sent, void *ptr)
+{
+	struct held_packet *h = memb_alloc(&held_memb);
+	
+	if (h != NULL) {
+		/* The payload may only be referenced, e.g. in uip_buf. */
+		if (packetbuf_is_reference())
+			packetbuf_compact();
+		h->buf = queuebuf_new_from_packetbuf();
+		if (h->buf == NULL) {
+			memb_free(&held_memb, h);
+			h = NULL;
+		}
+	}
+	if (h == NULL) {
+		PRINTF("IEEE80211driver: hold queue full; packet dropped.\n");
+		sent(NULL, false, 0);
+		return;
+	}
+	h->sent = sent;
+	h->ptr = ptr;
+	list_add(held_list, h);
+}
+
+/*---------------------------------------------------------------------------*/
+void
+ieee80211_driver_release_held(void)
+{
+	struct held_packet *h;
+	
+	while ((h = list_pop(held_list)) != NULL) {
+		/* Transmit straight from the queuebuf; the payload is
+		 * copied into the frame before ieee80211_drv_tx returns.
+		 */
+		queuebuf_to_packetbuf_reference(h->buf);
+		ieee80211_drv_tx(h->sent, h->ptr);
+		queuebuf_free(h->buf);
+		memb_free(&held_memb, h);
+	}
+}
+
 
 /*---------------------------------------------------------------------------*/
 static void
@@ -88,6 +155,15 @@ send_packet(mac_callback_t sent, void *ptr) {
 	if (local_dest_address == NULL) {
 		printf("ERROR: Could not send packet to a NULL MAC destination address.\n");
 		sent(NULL, false, 0);
+		return;
+	}
+	
+	/* uIP starts before the radio is up. Hold its packets until the
+	 * IBSS is there, and keep them in order behind the ones held.
+	 */
+	if (!ieee80211_is_ibss_joined() || list_head(held_list) != NULL) {
+		hold_packet(sent, ptr);
+		return;
 	}
 			
 	/* Send it here by calling the IBSS Kernel stack routines.
@@ -167,6 +243,9 @@ mac_frame_input(void)
 static void
 init(void)
 {
+	memb_init(&held_memb);
+	list_init(held_list);
+	
 	/* Start the process that will handle the MAC initialization. */
 	process_start(&ieee80211_iface_setup_process, NULL);
 }
@@ -47,5 +47,8 @@
 
 extern const struct mac_driver ieee80211_driver;
 
+/* Send the packets held while the IBSS was not joined. */
+void ieee80211_driver_release_held(void);
+
 
 #endif /* IEEE80211_DRIVER_H_ */
\ No newline at end of file
@@ -0,0 +1,317 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "ibss_cache.h"
+#include "ieee80211_ibss.h"
+#include "ieee80211_debug.h"
+#include "etherdevice.h"
+#include "string.h"
+#include <stdio.h>
+#include "interrupt\interrupt_sam_nvic.h"
+
+/* Gain of the RSSI moving average: new = old + (sample - old) / 2^gain */
+#define IBSS_CACHE_RSSI_GAIN	2
+
+/* The last joined [or created] IBSS. */
+static struct ibss_cache_entry joined;
+
+/* The most recent scan results; one entry per BSSID. */
+static struct ibss_cache_entry scan_results[IBSS_CACHE_SCAN_ENTRIES];
+
+/* The neighbors heard beaconing in the joined IBSS. */
+static struct ibss_cache_neighbor neighbors[IBSS_CACHE_NEIGHBORS];
+
+
+/*---------------------------------------------------------------------------*/
+static U16 ibss_cache_hw_value_to_freq(U16 hw_value)
+{
+	/* 2.4 GHz band only; channel 14 is the odd one out. */
+	if (hw_value == 13)
+		return 2484;
+	return 2412 + 5 * hw_value;
+}
+
+/*---------------------------------------------------------------------------*/
+static bool ibss_cache_is_stale(clock_time_t last_seen, clock_time_t lifetime)
+{
+	return (clock_time_t)(clock_time() - last_seen) > lifetime;
+}
+
+/*---------------------------------------------------------------------------*/
+static struct ibss_cache_entry* ibss_cache_lookup(const U8* bssid)
+{
+	int i;
+	for (i=0; i<IBSS_CACHE_SCAN_ENTRIES; i++) {
+		if (scan_results[i].valid && ether_addr_equal(scan_results[i].bssid, bssid))
+			return &scan_results[i];
+	}
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+static struct ibss_cache_entry* ibss_cache_alloc(void)
+{
+	int i;
+	struct ibss_cache_entry* oldest = &scan_results[0];
+	
+	/* Prefer an empty slot, otherwise evict the least recently heard one. */
+	for (i=0; i<IBSS_CACHE_SCAN_ENTRIES; i++) {
+		if (!scan_results[i].valid)
+			return &scan_results[i];
+		if ((clock_time_t)(clock_time() - scan_results[i].last_seen) > 
+			(clock_time_t)(clock_time() - oldest->last_seen)) {
+			oldest = &scan_results[i];
+		}
+	}
+	return oldest;
+}
+
+/*---------------------------------------------------------------------------*/
+static void ibss_cache_update_neighbor(const U8* addr)
+{
+	int i;
+	struct ibss_cache_neighbor* slot = NULL;
+	
+	for (i=0; i<IBSS_CACHE_NEIGHBORS; i++) {
+		if (neighbors[i].valid && ether_addr_equal(neighbors[i].addr, addr)) {
+			neighbors[i].last_seen = clock_time();
+			return;
+		}
+		if (slot == NULL && (!neighbors[i].valid || 
+			ibss_cache_is_stale(neighbors[i].last_seen, IBSS_CACHE_SCAN_LIFETIME))) {
+			slot = &neighbors[i];
+		}
+	}
+	if (slot == NULL) {
+		#if IBSS_CACHE_DEBUG_DEEP
+		printf("DEBUG: IBSS_CACHE; Neighbor list full.\n");
+		#endif
+		return;
+	}
+	memcpy(slot->addr, addr, ETH_ALEN);
+	slot->last_seen = clock_time();
+	slot->valid = true;
+}
+
+/*---------------------------------------------------------------------------*/
+void ibss_cache_store_join(void)
+{
+	if (ibss_info == NULL || unique_vif == NULL || hw == NULL) {
+		printf("WARNING: IBSS_CACHE; Nothing to store.\n");
+		return;
+	}
+	
+	irqflags_t flags = cpu_irq_save();
+	
+	if (!ether_addr_equal(joined.bssid, ibss_info->ibss_bssid)) {
+		/* A different network; forget the neighbors of the old one. */
+		memset(neighbors, 0, sizeof(neighbors));
+		joined.tsf = 0;
+		joined.rssi = IBSS_CACHE_RSSI_UNKNOWN;
+	}
+	memcpy(joined.bssid, ibss_info->ibss_bssid, ETH_ALEN);
+	memcpy(joined.name, ibss_info->ibss_name, ETH_ALEN);
+	joined.hw_value = hw->conf.channel->hw_value;
+	joined.center_freq = hw->conf.channel->center_freq;
+	joined.beacon_int = unique_vif->bss_conf.beacon_int;
+	joined.atim_window = unique_vif->bss_conf.atim_window;
+	joined.last_seen = clock_time();
+	joined.valid = true;
+	
+	cpu_irq_restore(flags);
+	
+	#if IBSS_CACHE_DEBUG
+	printf("INFO: IBSS_CACHE; Stored IBSS on channel %u [BCN: %u, ATIM: %u].\n",
+		joined.hw_value + 1, joined.beacon_int, joined.atim_window);
+	#endif
+}
+
+/*---------------------------------------------------------------------------*/
+void ibss_cache_update_beacon(const U8* bssid, const U8* sa, const U8* name, 
+	U16 hw_value, U16 beacon_int, U16 atim_window, U64 tsf)
+{
+	irqflags_t flags = cpu_irq_save();
+	
+	struct ibss_cache_entry* entry = ibss_cache_lookup(bssid);
+	
+	if (entry == NULL) {
+		entry = ibss_cache_alloc();
+		memset(entry, 0, sizeof(struct ibss_cache_entry));
+		memcpy(entry->bssid, bssid, ETH_ALEN);
+		entry->rssi = IBSS_CACHE_RSSI_UNKNOWN;
+		entry->valid = true;
+		#if IBSS_CACHE_DEBUG_DEEP
+		printf("DEBUG: IBSS_CACHE; New IBSS %02x:%02x:%02x:%02x:%02x:%02x.\n",
+			bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+		#endif
+	}
+	if (name != NULL)
+		memcpy(entry->name, name, ETH_ALEN);
+	entry->hw_value = hw_value;
+	entry->center_freq = ibss_cache_hw_value_to_freq(hw_value);
+	entry->beacon_int = beacon_int;
+	entry->atim_window = atim_window;
+	entry->tsf = tsf;
+	entry->tsf_local = clock_time();
+	entry->last_seen = entry->tsf_local;
+	
+	/* Beacons of the joined IBSS keep its record alive. */
+	if (joined.valid && ether_addr_equal(joined.bssid, bssid)) {
+		joined.beacon_int = beacon_int;
+		joined.atim_window = atim_window;
+		joined.rssi = entry->rssi;
+		joined.tsf = tsf;
+		joined.tsf_local = entry->tsf_local;
+		joined.last_seen = entry->last_seen;
+		ibss_cache_update_neighbor(sa);
+	}
+	
+	cpu_irq_restore(flags);
+}
+
+/*---------------------------------------------------------------------------*/
+void ibss_cache_update_rssi(const U8* bssid, int signal)
+{
+	irqflags_t flags = cpu_irq_save();
+	
+	struct ibss_cache_entry* entry = ibss_cache_lookup(bssid);
+	
+	if (entry != NULL) {
+		if (entry->rssi == IBSS_CACHE_RSSI_UNKNOWN) {
+			entry->rssi = (int8_t)signal;
+		} else {
+			entry->rssi += (int8_t)((signal - entry->rssi) / (1 << IBSS_CACHE_RSSI_GAIN));
+		}
+	}
+	cpu_irq_restore(flags);
+}
+
+/*---------------------------------------------------------------------------*/
+bool ibss_cache_is_fresh(void)
+{
+	return joined.valid && !ibss_cache_is_stale(joined.last_seen, IBSS_CACHE_REJOIN_LIFETIME);
+}
+
+/*---------------------------------------------------------------------------*/
+bool ibss_cache_apply(void)
+{
+	if (!ibss_cache_is_fresh())
+		return false;
+	
+	if (ibss_info == NULL || unique_vif == NULL || hw == NULL) {
+		printf("ERROR: IBSS_CACHE; IEEE80211 structures not allocated.\n");
+		return false;
+	}
+	/* Tune directly to the cached channel. */
+	ibss_info->ibss_channel->hw_value = joined.hw_value;
+	ibss_info->ibss_channel->center_freq = joined.center_freq;
+	
+	/* Network identity and beaconing parameters. */
+	memcpy(ibss_info->ibss_bssid, joined.bssid, ETH_ALEN);
+	memcpy(ibss_info->ibss_name, joined.name, ETH_ALEN);
+	unique_vif->bss_conf.beacon_int = joined.beacon_int;
+	unique_vif->bss_conf.atim_window = joined.atim_window;
+	
+	#if IBSS_CACHE_DEBUG
+	printf("INFO: IBSS_CACHE; Rejoining on channel %u, last heard %lu ms ago.\n",
+		joined.hw_value + 1, (clock_time() - joined.last_seen) * 1000 / CLOCK_SECOND);
+	#endif
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+U64 ibss_cache_estimate_tsf(void)
+{
+	if (!joined.valid || joined.tsf == 0)
+		return 0;
+	
+	return joined.tsf + (U64)(clock_time() - joined.tsf_local) * 1000000 / CLOCK_SECOND;
+}
+
+/*---------------------------------------------------------------------------*/
+const struct ibss_cache_entry* ibss_cache_get_joined(void)
+{
+	return joined.valid ? &joined : NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+const struct ibss_cache_entry* ibss_cache_get_scan_result(U8 index)
+{
+	if (index >= IBSS_CACHE_SCAN_ENTRIES || !scan_results[index].valid ||
+		ibss_cache_is_stale(scan_results[index].last_seen, IBSS_CACHE_SCAN_LIFETIME))
+		return NULL;
+	
+	return &scan_results[index];
+}
+
+/*---------------------------------------------------------------------------*/
+U8 ibss_cache_get_neighbors(U8 (*addrs)[ETH_ALEN], U8 max)
+{
+	int i;
+	U8 count = 0;
+	
+	for (i=0; i<IBSS_CACHE_NEIGHBORS && count < max; i++) {
+		if (neighbors[i].valid && 
+			!ibss_cache_is_stale(neighbors[i].last_seen, IBSS_CACHE_SCAN_LIFETIME)) {
+			memcpy(addrs[count++], neighbors[i].addr, ETH_ALEN);
+		}
+	}
+	return count;
+}
+
+/*---------------------------------------------------------------------------*/
+void ibss_cache_print(void)
+{
+	int i;
+	const struct ibss_cache_entry* entry;
+	
+	for (i=0; i<IBSS_CACHE_SCAN_ENTRIES; i++) {
+		entry = ibss_cache_get_scan_result(i);
+		if (entry == NULL)
+			continue;
+		printf("IBSS %02x:%02x:%02x:%02x:%02x:%02x CH: %u RSSI: %d AGE: %lu %s\n",
+			entry->bssid[0], entry->bssid[1], entry->bssid[2],
+			entry->bssid[3], entry->bssid[4], entry->bssid[5],
+			entry->hw_value + 1, entry->rssi, 
+			(clock_time() - entry->last_seen) / CLOCK_SECOND,
+			(joined.valid && ether_addr_equal(joined.bssid, entry->bssid)) ? "[joined]" : "");
+	}
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "compiler.h"
+#include "if_ether.h"
+#include "contiki-conf.h"
+#include "clock.h"
+#include <stdint-gcc.h>
+#include <stdbool.h>
+
+
+#ifndef IBSS_CACHE_H_
+#define IBSS_CACHE_H_
+
+/*
+ * The IBSS cache keeps the parameters of the last joined IBSS and the 
+ * most recent scan results in static memory, outside the AR9170 device
+ * and the IEEE80211 structures. These are all freed when the WLAN USB
+ * device is unplugged [or reset], while the cache is not, so a replug
+ * can re-tune to the cached channel and join on the first beacon heard
+ * instead of repeating the full scan.
+ */
+
+/* Number of distinct IBSS networks remembered from scanning. */
+#ifdef IBSS_CACHE_CONF_SCAN_ENTRIES
+#define IBSS_CACHE_SCAN_ENTRIES		IBSS_CACHE_CONF_SCAN_ENTRIES
+#else
+#define IBSS_CACHE_SCAN_ENTRIES		4
+#endif
+
+/* Number of neighbors remembered for the joined IBSS. */
+#ifdef IBSS_CACHE_CONF_NEIGHBORS
+#define IBSS_CACHE_NEIGHBORS		IBSS_CACHE_CONF_NEIGHBORS
+#else
+#define IBSS_CACHE_NEIGHBORS		8
+#endif
+
+/* Scan results [and neighbors] not refreshed for so long are stale. */
+#ifdef IBSS_CACHE_CONF_SCAN_LIFETIME
+#define IBSS_CACHE_SCAN_LIFETIME	IBSS_CACHE_CONF_SCAN_LIFETIME
+#else
+#define IBSS_CACHE_SCAN_LIFETIME	(60 * CLOCK_SECOND)
+#endif
+
+/* The joined IBSS is used for fast rejoin, if heard within this time. */
+#ifdef IBSS_CACHE_CONF_REJOIN_LIFETIME
+#define IBSS_CACHE_REJOIN_LIFETIME	IBSS_CACHE_CONF_REJOIN_LIFETIME
+#else
+#define IBSS_CACHE_REJOIN_LIFETIME	(600 * CLOCK_SECOND)
+#endif
+
+/* RSSI value of an entry whose beacon signal has not been measured yet. */
+#define IBSS_CACHE_RSSI_UNKNOWN		(-128)
+
+/* One IBSS network as seen through its beacons. */
+struct ibss_cache_entry {
+	/* The BSSID and network name advertised in the beacon. */
+	U8		bssid[ETH_ALEN];
+	U8		name[ETH_ALEN];
+	/* The channel the beacon was heard on. */
+	U16		center_freq;
+	U16		hw_value;
+	/* Beacon interval and ATIM window [TU]. */
+	U16		beacon_int;
+	U16		atim_window;
+	/* Smoothed beacon signal [dBm]. */
+	int8_t	rssi;
+	bool	valid;
+	/* Local time the last beacon was processed. */
+	clock_time_t	last_seen;
+	/* Beacon timestamp [us] and local time it was taken at. */
+	U64		tsf;
+	clock_time_t	tsf_local;
+};
+
+/* A neighbor of the joined IBSS, learned from its beacons. */
+struct ibss_cache_neighbor {
+	U8		addr[ETH_ALEN];
+	bool	valid;
+	clock_time_t	last_seen;
+};
+
+/* Records the parameters of the IBSS that has just been joined or created. */
+void ibss_cache_store_join(void);
+
+/* Updates the scan results [and the neighbors of the joined IBSS] with a
+ * received beacon. Called from process context.
+ */
+void ibss_cache_update_beacon(const U8* bssid, const U8* sa, const U8* name, 
+	U16 hw_value, U16 beacon_int, U16 atim_window, U64 tsf);
+
+/* Updates the smoothed RSSI of an already cached IBSS. May be called from 
+ * the RX interrupt context.
+ */
+void ibss_cache_update_rssi(const U8* bssid, int signal);
+
+/* Returns true if the last joined IBSS has been heard recently enough. */
+bool ibss_cache_is_fresh(void);
+
+/* Applies the cached IBSS parameters to the freshly allocated IEEE80211 
+ * structures, before the device is started. Returns true if it did. 
+ */
+bool ibss_cache_apply(void);
+
+/* Returns the estimated current TSF of the joined IBSS, or 0 if unknown. */
+U64 ibss_cache_estimate_tsf(void);
+
+/* Returns the last joined IBSS, or NULL if none is cached. */
+const struct ibss_cache_entry* ibss_cache_get_joined(void);
+
+/* Returns the scan result at the given index, or NULL if the slot is empty
+ * or stale.
+ */
+const struct ibss_cache_entry* ibss_cache_get_scan_result(U8 index);
+
+/* Copies the fresh neighbor addresses into the given buffer. Returns the
+ * number of addresses copied.
+ */
+U8 ibss_cache_get_neighbors(U8 (*addrs)[ETH_ALEN], U8 max);
+
+/* Prints the contents of the cache. */
+void ibss_cache_print(void);
+
+#endif /* IBSS_CACHE_H_ */
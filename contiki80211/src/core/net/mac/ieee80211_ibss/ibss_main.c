@@ -50,6 +50,7 @@
 #include "mac.h"
 #include "packetbuf.h"
 #include "ieee80211_ibss.h"
+#include "ieee80211_iface_setup_process.h"
 
 
 void ieee80211_drv_tx(mac_callback_t sent, void* ptr)
@@ -69,8 +70,13 @@ void ieee80211_drv_tx(mac_callback_t sent, void* ptr)
 		printf("ERROR: Could not allocate memory for socket buffer creation.\n");
 		goto _err;
 	}	
-	/* Extract packet and assign it to the socket buffer. */
-	skb->data = packetbuf_dataptr(); 
+	/* Extract packet and assign it to the socket buffer. The
+	 * payload may be referenced from a queuebuf instead of copied.
+	 */
+	if (packetbuf_is_reference())
+		skb->data = packetbuf_reference_ptr();
+	else
+		skb->data = packetbuf_dataptr(); 
 	skb->len =  packetbuf_datalen();
 	
 	#if IEEE80211_IBSS_DEBUG_DEEP
@@ -92,6 +98,7 @@ void ieee80211_drv_tx(mac_callback_t sent, void* ptr)
 	
 	if (dest_addr == NULL || next_addr == NULL) {
 		printf("ERROR: Next-hop or final destination address is null.\n");
+		sfree(skb);
 		goto _err;
 	}	
 	/* Send packet to MAC processing and eventually down to the driver queue. */
@@ -116,6 +123,7 @@ void ieee80211_drv_tx(mac_callback_t sent, void* ptr)
 		
 	} else {
 		/* Inform the UIP that the packet was stored in the driver queue. */
+		ieee80211_bringup_stage_end(BRINGUP_FIRST_TX);
 		sent(NULL, true, 0);
 	}
 	return;	
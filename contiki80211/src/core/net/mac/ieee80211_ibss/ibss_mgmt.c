@@ -43,6 +43,7 @@
 #include "ieee80211.h"
 #include <stdint-gcc.h>
 #include "skbuff.h"
+#include "smalloc.h"
 
 
 struct sk_buff* ibss_create_atim(struct ieee80211_vif vif)
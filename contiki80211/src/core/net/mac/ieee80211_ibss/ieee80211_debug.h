@@ -63,5 +63,9 @@
 #define IEEE80211_IBSS_DEBUG		1
 #define IEEE80211_IBSS_DEBUG_DEEP	0
 
+/* IBSS Cache */
+#define IBSS_CACHE_DEBUG			1
+#define IBSS_CACHE_DEBUG_DEEP		0
+
 
 #endif /* IEEE80211_DEBUG_H_ */
\ No newline at end of file
@@ -83,7 +83,9 @@
 #include "smalloc.h"
 #include "ar9170_debug.h"
 #include "ieee80211_mh_psm.h"
+#include "ibss_cache.h"
 #include "platform-conf.h"
+#include "sys/trace.h"
 
 /* Flag indicating whether the default IBSS is operating [joined or created] */
 static volatile bool ieee80211_is_ibss_joined_flag;
@@ -583,6 +585,10 @@ void ieee80211_sta_create_ibss()
 	
 	/* Update indicator flag that IBSS is joined */
 	ieee80211_is_ibss_joined_flag = true;
+	
+	/* Remember the network, for a fast rejoin after a device reset. */
+	ibss_cache_store_join();
+	TRACE(TRACE_IBSS_JOIN, ibss_info->ibss_channel->center_freq, 1);
 }
 
 
@@ -616,6 +622,10 @@ void ieee80211_sta_join_ibss(U16 _beacon_interval, U16 _atim_window, U8* _name)
 	/* Update indicator flag that IBSS is joined */
 	ieee80211_is_ibss_joined_flag = true;
 	
+	/* Remember the network, for a fast rejoin after a device reset. */
+	ibss_cache_store_join();
+	TRACE(TRACE_IBSS_JOIN, ibss_info->ibss_channel->center_freq, 0);
+	
 	/* We could let the IBSS_SETUP_PROCESS event timer
 	 * to simply expire, and update the status of the 
 	 * IBSS, however, we prefer to force it to stop 
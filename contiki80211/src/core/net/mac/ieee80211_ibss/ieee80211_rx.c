@@ -48,6 +48,7 @@
 #include "ieee80211_ibss.h"
 #include "etherdevice.h"
 #include "ibss_util.h"
+#include "ibss_cache.h"
 #include "ieee80211_mh_psm.h"
 #include "mac80211.h"
 #include "if_ether.h"
@@ -58,6 +59,8 @@
 #include "rimeaddr.h"
 #include "interrupt\interrupt_sam_nvic.h"
 #include <stdint-gcc.h>
+#include "sys/trace.h"
+#include "smalloc.h"
 
 
 
@@ -242,20 +245,9 @@ void ieee80211_rx_process_beacon(struct ieee80211_mgmt* mgmt, size_t len) {
 		mgmt->da[2], mgmt->da[3], mgmt->da[4], mgmt->da[5]);		
 	#endif
 	
-	/* Process --ONLY-- beacons from the default IBSS [BSSID]. */
-	if(!ether_addr_equal(mgmt->bssid, unique_vif->bss_conf.bssid)) {
-		
-		/* Beacon Not from the default IBSS. */
-		#if IEEE80211_IBSS_DEBUG_DEEP
-		printf("DEBUG: IBSS; BCN not from default network.\n");
-		#endif
-		return;
-	}
-	
 	size_t baselen;
 	struct ieee802_11_elems elems;
 	
-	/* Process beacon from the current [default] IBSS */
 	baselen = (U8 *) mgmt->u.beacon.variable - (U8 *) mgmt;
 	if (baselen > len) {
 		printf("WARNING: Received beacon too small.\n");
@@ -264,6 +256,29 @@ void ieee80211_rx_process_beacon(struct ieee80211_mgmt* mgmt, size_t len) {
 	/* Parse the elements sent with the currently received beacon. */		
 	ieee802_11_parse_elems(mgmt->u.beacon.variable, len - baselen, &elems);
 	
+	/* Every beacon heard is a scan result; keep it in the IBSS cache. The 
+	 * channel is the advertised one, if any, otherwise the one we are on.
+	 */
+	ibss_cache_update_beacon(mgmt->bssid, mgmt->sa, 
+		(elems.ssid_len >= ETH_ALEN) ? elems.ssid : NULL,
+		(elems.ds_params && elems.ds_params_len) ? elems.ds_params[0] - 1 : hw->conf.channel->hw_value,
+		le16_to_cpu(mgmt->u.beacon.beacon_int), 
+		elems.ibss_params ? ((U16*)elems.ibss_params)[0] : 0,
+		mgmt->u.beacon.timestamp);
+	
+	TRACE(TRACE_IBSS_BEACON, mgmt->u.beacon.timestamp, 
+		ether_addr_equal(mgmt->bssid, unique_vif->bss_conf.bssid));
+	
+	/* Process --ONLY-- beacons from the default IBSS [BSSID]. */
+	if(!ether_addr_equal(mgmt->bssid, unique_vif->bss_conf.bssid)) {
+		
+		/* Beacon Not from the default IBSS. */
+		#if IEEE80211_IBSS_DEBUG_DEEP
+		printf("DEBUG: IBSS; BCN not from default network.\n");
+		#endif
+		return;
+	}
+	
 	U8* ssid = elems.ssid;
 	#if IBSS_RX_DEBUG_DEEP	
 	printf("SSID: %02x:%02x:%02x:%02x:%02x:%02x\n",ssid[0],ssid[1],ssid[2],ssid[3],ssid[4],ssid[5]);	
@@ -436,6 +451,17 @@ void ieee80211_rx_process_data_mpdu(struct sk_buff* skb)
 		 * cc2420.c file.
 		 */
 		
+		/* Parse the frame into a buffer of its own, so the one
+		 * selected, which may hold a packet under transmission,
+		 * is left alone. If the pool is empty, use the selected
+		 * buffer as before.
+		 */
+		struct packetbuf* rx_buf = pb_alloc();
+		struct packetbuf* prev_buf = NULL;
+		
+		if (rx_buf != NULL)
+			prev_buf = packetbuf_select(rx_buf);
+		
 		/* Clear the packet buffer in case of existing trash. */
 		packetbuf_clear();
 
@@ -490,6 +516,11 @@ void ieee80211_rx_process_data_mpdu(struct sk_buff* skb)
 		 * receiver. By default, this is the ieee80211 driver.
 		 */
 		NETSTACK_MAC.input();
+		
+		if (rx_buf != NULL) {
+			packetbuf_select(prev_buf);
+			pb_free(rx_buf);
+		}
 	
 	} else {
 		printf("WARNING: Packet contained no data payload.\n");
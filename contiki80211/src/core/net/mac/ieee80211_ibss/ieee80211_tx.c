@@ -52,16 +52,87 @@
 #include "smalloc.h"
 #include "ieee80211_psm.h"
 #include "cc.h"
+#include "etherdevice.h"
+#include "string.h"
+#include "interrupt\interrupt_sam_nvic.h"
 
 /* Global counter for sequence number generation */
 volatile le16_t tx_packets_sent = 0;
 
 
 
+/* Fixed-point reciprocal of a symbol divisor: ceil(2^32 / d). */
+#define IEEE80211_AIRTIME_RECIP(d)	((U32)((0xFFFFFFFFULL + (d)) / (d)))
+
+/* Symbol-time coefficients of a rate. For DSSS/CCK the divisor is the rate
+ * itself [in 100 kbps, so the dividend is scaled by 10], and the quotient is
+ * in microseconds. For OFDM the divisor is the number of data bits per
+ * symbol, N_DBPS = DATARATE x 4, and the quotient is in 4 usec symbols.
+ */
+struct ieee80211_airtime_rate {
+	U16 bitrate;
+	U16 divisor;
+	U32 reciprocal;
+};
+
+static const struct ieee80211_airtime_rate ieee80211_airtime_dsss[] = {
+	{ 10,	10,		IEEE80211_AIRTIME_RECIP(10) },
+	{ 20,	20,		IEEE80211_AIRTIME_RECIP(20) },
+	{ 55,	55,		IEEE80211_AIRTIME_RECIP(55) },
+	{ 110,	110,	IEEE80211_AIRTIME_RECIP(110) },
+};
+
+static const struct ieee80211_airtime_rate ieee80211_airtime_ofdm[] = {
+	{ 60,	24,		IEEE80211_AIRTIME_RECIP(24) },
+	{ 90,	36,		IEEE80211_AIRTIME_RECIP(36) },
+	{ 120,	48,		IEEE80211_AIRTIME_RECIP(48) },
+	{ 180,	72,		IEEE80211_AIRTIME_RECIP(72) },
+	{ 240,	96,		IEEE80211_AIRTIME_RECIP(96) },
+	{ 360,	144,	IEEE80211_AIRTIME_RECIP(144) },
+	{ 480,	192,	IEEE80211_AIRTIME_RECIP(192) },
+	{ 540,	216,	IEEE80211_AIRTIME_RECIP(216) },
+};
+
+/* Fixed per-frame overhead [usec], including SIFS; see below. */
+#define IEEE80211_AIRTIME_OFDM_OVERHEAD		(16 + 16 + 4 + 20)
+#define IEEE80211_AIRTIME_DSSS_OVERHEAD(short_preamble) \
+	(10 + ((short_preamble) ? (72 + 24) : (144 + 48)))
+
+/* Ceiling of n / r->divisor, as a multiply and shift. The reciprocal is
+ * rounded up, so the product is either the floor or the ceiling; a single
+ * compare tells which. 
+ */
+static inline U32 ieee80211_airtime_div_round_up(U32 n, const struct ieee80211_airtime_rate* r)
+{
+	U32 q = (U32)(((U64)n * r->reciprocal) >> 32);
+	
+	if (q * r->divisor < n)
+		q++;
+	return q;
+}
+
+static const struct ieee80211_airtime_rate* ieee80211_airtime_lookup(bool ofdm, int rate)
+{
+	int i;
+	
+	if (ofdm) {
+		for (i=0; i<sizeof(ieee80211_airtime_ofdm) / sizeof(ieee80211_airtime_ofdm[0]); i++)
+			if (ieee80211_airtime_ofdm[i].bitrate == rate)
+				return &ieee80211_airtime_ofdm[i];
+	} else {
+		for (i=0; i<sizeof(ieee80211_airtime_dsss) / sizeof(ieee80211_airtime_dsss[0]); i++)
+			if (ieee80211_airtime_dsss[i].bitrate == rate)
+				return &ieee80211_airtime_dsss[i];
+	}
+	return NULL;
+}
+
 int ieee80211_frame_duration(enum ieee80211_band band, size_t len,
 			     int rate, int erp, int short_preamble)
 {
 	int dur;
+	const struct ieee80211_airtime_rate* r;
+	bool ofdm = (band == IEEE80211_BAND_5GHZ || erp);
 
 	/* calculate duration (in microseconds, rounded up to next higher
 	 * integer if it includes a fractional microsecond) to send frame of
@@ -69,10 +140,12 @@ int ieee80211_frame_duration(enum ieee80211_band band, size_t len,
 	 * also include SIFS.
 	 *
 	 * rate is in 100 kbps, so divident is multiplied by 10 in the
-	 * DIV_ROUND_UP() operations.
+	 * DIV_ROUND_UP() operations. For the standard rates the division
+	 * is replaced by the precomputed tables above.
 	 */
+	r = ieee80211_airtime_lookup(ofdm, rate);
 
-	if (band == IEEE80211_BAND_5GHZ || erp) {
+	if (ofdm) {
 		/*
 		 * OFDM:
 		 *
@@ -85,14 +158,16 @@ int ieee80211_frame_duration(enum ieee80211_band band, size_t len,
 		 * 802.11a - 17.5.2: aSIFSTime = 16 usec
 		 * 802.11g - 19.8.4: aSIFSTime = 10 usec +
 		 *	signal ext = 6 usec
+		 *
+		 * The overhead is SIFS + signal ext [16], T_PREAMBLE [16] and
+		 * T_SIGNAL [4], plus 20 usec of extra margin.
 		 */
-		dur = 16; /* SIFS + signal ext */
-		dur += 16; /* 17.3.2.3: T_PREAMBLE = 16 usec */
-		dur += 4; /* 17.3.2.3: T_SIGNAL = 4 usec */
-		dur += 4 * DIV_ROUND_UP((16 + 8 * (len + 4) + 6) * 10,
+		dur = IEEE80211_AIRTIME_OFDM_OVERHEAD;
+		if (not_expected(r == NULL))
+			dur += 4 * DIV_ROUND_UP((16 + 8 * (len + 4) + 6) * 10,
 					4 * rate); /* T_SYM x N_SYM */
-		// XXX XXX
-		dur += 20;
+		else
+			dur += 4 * ieee80211_airtime_div_round_up(16 + 8 * (len + 4) + 6, r);
 		
 	} else {
 		/*
@@ -105,13 +180,11 @@ int ieee80211_frame_duration(enum ieee80211_band band, size_t len,
 		 * aPreambleLength = 144 usec or 72 usec with short preamble
 		 * aPLCPHeaderLength = 48 usec or 24 usec with short preamble
 		 */
-		dur = 10; /* aSIFSTime = 10 usec */
-		dur += short_preamble ? (72 + 24) : (144 + 48);
-
-		dur += DIV_ROUND_UP(8 * (len + 4) * 10, rate);
-		
-		//XXX XXX
-		//dur += 200;
+		dur = IEEE80211_AIRTIME_DSSS_OVERHEAD(short_preamble);
+		if (not_expected(r == NULL))
+			dur += DIV_ROUND_UP(8 * (len + 4) * 10, rate);
+		else
+			dur += ieee80211_airtime_div_round_up(8 * (len + 4) * 10, r);
 	}
 
 	return dur;
@@ -136,8 +209,8 @@ le16_t ieee80211_duration( struct sk_buff* skb, int group_addr )
 	}
 	
 	/* Manually setting the rate FIXME - automate it TODO */
-	rate = 10;
-	erp = 0;	
+	rate = IEEE80211_TX_RATE;
+	erp = IEEE80211_TX_ERP;	
 	
 	/* Don't calculate ACKs for QoS Frames with NoAck Policy set */
 	if (ieee80211_is_data_qos(hdr->frame_control) &&
@@ -158,6 +231,166 @@ le16_t ieee80211_duration( struct sk_buff* skb, int group_addr )
 
 
 
+/* Per-destination airtime accounting. */
+static struct ieee80211_airtime_stats airtime_stats[IEEE80211_AIRTIME_NEIGHBORS];
+
+/* The destination of the data frame awaiting its TX status. */
+static struct ieee80211_airtime_stats* airtime_pending;
+static U32 airtime_pending_us;
+
+/* Airtime [usec] of a single transmission attempt of a frame of len bytes
+ * [without FCS] at the default rate, including the SIFS and ACK, if any.
+ */
+U32 ieee80211_airtime(size_t len, bool ack)
+{
+	bool short_preamble = unique_vif->bss_conf.use_short_preamble;
+	enum ieee80211_band band = ibss_info->ibss_channel->band;
+	U32 airtime;
+	
+	airtime = ieee80211_frame_duration(band, len, IEEE80211_TX_RATE, 
+		IEEE80211_TX_ERP, short_preamble);
+	
+	if (ack) {
+		airtime += ieee80211_frame_duration(band, IEEE80211_ACK_LEN, IEEE80211_TX_RATE, 
+			IEEE80211_TX_ERP, short_preamble);
+	}
+	return airtime;
+}
+
+static struct ieee80211_airtime_stats* ieee80211_airtime_lookup_da(const U8* da)
+{
+	int i;
+	struct ieee80211_airtime_stats* slot = NULL;
+	
+	for (i=0; i<IEEE80211_AIRTIME_NEIGHBORS; i++) {
+		if (airtime_stats[i].valid) {
+			if (ether_addr_equal(airtime_stats[i].addr, da))
+				return &airtime_stats[i];
+		
+		} else if (slot == NULL) {
+			slot = &airtime_stats[i];
+		}
+	}
+	if (slot != NULL) {
+		memset(slot, 0, sizeof(struct ieee80211_airtime_stats));
+		memcpy(slot->addr, da, ETH_ALEN);
+		slot->valid = true;
+	}
+	return slot;
+}
+
+/* Charges the first transmission attempt of a data frame to its destination.
+ * Called when the frame is handed to the device.
+ */
+void ieee80211_airtime_account(const U8* da, size_t len)
+{
+	irqflags_t flags = cpu_irq_save();
+	
+	struct ieee80211_airtime_stats* stats = ieee80211_airtime_lookup_da(da);
+	
+	if (stats == NULL) {
+		#if IBSS_TX_DEBUG_DEEP
+		printf("DEBUG: Airtime table full.\n");
+		#endif
+		airtime_pending = NULL;
+		cpu_irq_restore(flags);
+		return;
+	}
+	/* Group addressed frames are not acknowledged. */
+	airtime_pending_us = ieee80211_airtime(len, !(da[0] & 0x01));
+	airtime_pending = stats;
+	
+	stats->current_us += airtime_pending_us;
+	stats->total_us += airtime_pending_us;
+	stats->current_frames++;
+	
+	cpu_irq_restore(flags);
+}
+
+/* Charges the retransmissions reported in the TX status to the destination
+ * of the last data frame. Called from the interrupt context.
+ */
+void ieee80211_airtime_account_retries(U8 tries)
+{
+	irqflags_t flags = cpu_irq_save();
+	
+	if (airtime_pending != NULL) {
+		airtime_pending->current_us += tries * airtime_pending_us;
+		airtime_pending->total_us += tries * airtime_pending_us;
+		airtime_pending->current_retries += tries;
+		airtime_pending = NULL;
+	}
+	cpu_irq_restore(flags);
+}
+
+/* Closes the accounting period. Called at every TBTT. */
+void ieee80211_airtime_new_interval(void)
+{
+	int i;
+	irqflags_t flags = cpu_irq_save();
+	
+	for (i=0; i<IEEE80211_AIRTIME_NEIGHBORS; i++) {
+		if (!airtime_stats[i].valid)
+			continue;
+		airtime_stats[i].last_us = airtime_stats[i].current_us;
+		airtime_stats[i].last_frames = airtime_stats[i].current_frames;
+		airtime_stats[i].last_retries = airtime_stats[i].current_retries;
+		airtime_stats[i].current_us = 0;
+		airtime_stats[i].current_frames = 0;
+		airtime_stats[i].current_retries = 0;
+	}
+	cpu_irq_restore(flags);
+}
+
+const struct ieee80211_airtime_stats* ieee80211_airtime_get_stats(U8 index)
+{
+	if (index >= IEEE80211_AIRTIME_NEIGHBORS || !airtime_stats[index].valid)
+		return NULL;
+	
+	return &airtime_stats[index];
+}
+
+/* Returns the share [per-mille] of the data window of the last beacon interval
+ * that was consumed by the given destination. In PSM, the data window is the
+ * beacon interval after the ATIM window. 
+ */
+U16 ieee80211_airtime_get_share(U8 index)
+{
+	U32 window_us;
+	const struct ieee80211_airtime_stats* stats = ieee80211_airtime_get_stats(index);
+	
+	if (stats == NULL)
+		return 0;
+	
+	window_us = unique_vif->bss_conf.beacon_int;
+	if (hw->conf.flags & IEEE80211_CONF_PS)
+		window_us -= unique_vif->bss_conf.atim_window;
+	window_us *= 1024;
+	
+	if (window_us == 0)
+		return 0;
+	
+	return (U16)(((U64)stats->last_us * 1000) / window_us);
+}
+
+void ieee80211_airtime_print(void)
+{
+	int i;
+	
+	for (i=0; i<IEEE80211_AIRTIME_NEIGHBORS; i++) {
+		if (!airtime_stats[i].valid)
+			continue;
+		printf("%02x:%02x:%02x:%02x:%02x:%02x %lu us [%u/1000] F: %u R: %u T: %lu us\n",
+			airtime_stats[i].addr[0], airtime_stats[i].addr[1], airtime_stats[i].addr[2],
+			airtime_stats[i].addr[3], airtime_stats[i].addr[4], airtime_stats[i].addr[5],
+			airtime_stats[i].last_us, ieee80211_airtime_get_share(i), 
+			airtime_stats[i].last_frames, airtime_stats[i].last_retries,
+			airtime_stats[i].total_us);
+	}
+}
+
+
+
 static void __ieee80211_tx_atim(struct sk_buff* atim) {
 	
 	/* Obtain a reference to the AR9170 structure */
@@ -421,7 +654,10 @@ bool ieee80211_start_xmit( struct sk_buff *skb, U8* da, U8* next_hop, bool free_
 	return ieee80211_tx(skb);
 
 error_free:
-	free(skb->data);
+	/* The payload is only ours to release if the caller said so. */
+	if (free_buf) {
+		free(skb->data);
+	}
 	free(skb);
 	return false;
 }
\ No newline at end of file
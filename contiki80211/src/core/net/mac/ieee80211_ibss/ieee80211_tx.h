@@ -41,6 +41,8 @@
 #include "skbuff.h"
 #include "compiler.h"
 #include "ar9170.h"
+#include "if_ether.h"
+#include "cfg80211.h"
 
 
 #ifndef IEEE80211_TX_H_
@@ -48,6 +50,45 @@
 
 #define ENCAPS_LEN		6
 
+/* Transmission rate [100 kbps] and ERP flag assumed for NAV and airtime. */
+#define IEEE80211_TX_RATE		10
+#define IEEE80211_TX_ERP		0
+
+/* Length of an ACK frame without FCS, as passed to the duration tables. */
+#define IEEE80211_ACK_LEN		10
+
+/* Number of destinations tracked by the airtime accounting. */
+#ifdef IEEE80211_AIRTIME_CONF_NEIGHBORS
+#define IEEE80211_AIRTIME_NEIGHBORS		IEEE80211_AIRTIME_CONF_NEIGHBORS
+#else
+#define IEEE80211_AIRTIME_NEIGHBORS		8
+#endif
+
+/* Airtime consumed by the frames sent to one destination. */
+struct ieee80211_airtime_stats {
+	U8		addr[ETH_ALEN];
+	bool	valid;
+	/* Airtime [usec] in the current and in the last beacon interval. */
+	U32		current_us;
+	U32		last_us;
+	/* Airtime [usec] since the entry was created. */
+	U32		total_us;
+	/* Frames and retries in the last beacon interval. */
+	U16		last_frames;
+	U16		last_retries;
+	U16		current_frames;
+	U16		current_retries;
+};
+
+int ieee80211_frame_duration(enum ieee80211_band band, size_t len, int rate, int erp, int short_preamble);
+U32 ieee80211_airtime(size_t len, bool ack);
+void ieee80211_airtime_account(const U8* da, size_t len);
+void ieee80211_airtime_account_retries(U8 tries);
+void ieee80211_airtime_new_interval(void);
+const struct ieee80211_airtime_stats* ieee80211_airtime_get_stats(U8 index);
+U16 ieee80211_airtime_get_share(U8 index);
+void ieee80211_airtime_print(void);
+
 bool ieee80211_start_xmit(struct sk_buff *skb, U8* da, U8* next_hop, bool free_buf);
 bool ieee80211_tx( struct sk_buff * skb );
 le16_t ieee80211_duration(struct sk_buff* skb, int group_addr);
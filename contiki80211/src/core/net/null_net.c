@@ -47,6 +47,7 @@
 #include "null_net.h"
 #include "uipopt.h"
 #include "uip.h"
+#include "uip-chksum.h"
 #include "packetbuf.h"
 #include "uip_arp.h"
 #include "ieee80211_ibss.h"
@@ -100,11 +101,24 @@ static void input(void) {
 	#if NULL_NET_DEBUG
 	PRINTF("NULL_NET: Packet received [%u].\n",packetbuf_datalen());
 	#endif
-	/* First, copy the packet to the "uip_buf" buffer. */
-	memcpy((uint8_t *)UIP_IP_BUF, (uint8_t*)(packetbuf_dataptr()), packetbuf_datalen());
-	//memcpy(uip_buf, (uint8_t*)(packetbuf_dataptr()), packetbuf_datalen());
+	uint8_t *data = (uint8_t*)(packetbuf_dataptr());
+	uint16_t len = packetbuf_datalen();
+	
+	/* First, copy the packet to the "uip_buf" buffer. The bytes after
+	 * the IPv6 header are summed on the way, so the transport checksum
+	 * check does not read them again.
+	 */
+	if (len > UIP_IPH_LEN) {
+		memcpy((uint8_t *)UIP_IP_BUF, data, UIP_IPH_LEN);
+		uip_rx_chksum = uip_chksum_copy(0, (uint8_t *)UIP_IP_BUF + UIP_IPH_LEN,
+			data + UIP_IPH_LEN, len - UIP_IPH_LEN);
+		uip_rx_chksum_len = len - UIP_IPH_LEN;
+	} else {
+		memcpy((uint8_t *)UIP_IP_BUF, data, len);
+		uip_rx_chksum_len = 0;
+	}
 	/* Update the length of the UIP buffer. */
-	uip_len = packetbuf_datalen();
+	uip_len = len;
 		
 	/* Deliver the packet to the "uip" layer. */
 	tcpip_input();		
@@ -127,12 +141,6 @@ static uint8_t output(uip_lladdr_t *localdest) {
 	/* A temporary stack variable holding the broadcast destination address.*/
 	uint8_t local_broadcast_eth_address[UIP_LLADDR_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 		
-	/* Clear the packet buffer. */
-	packetbuf_clear();
-	
-	/* Assign a reference to the beginning of the payload. */
-	uint8_t* pkt_data_ptr = packetbuf_dataptr();
-	
 	if (localdest == NULL) {
 		/* If the local address is NULL, we are sending a broadcast packet. */
 		memcpy(local_dest_address.addr, local_broadcast_eth_address, UIP_LLADDR_LEN);
@@ -166,11 +174,12 @@ static uint8_t output(uip_lladdr_t *localdest) {
 		#endif
 	}
 	
-	/* Copy the UIP payload to the packet buffer. */
-	memcpy(pkt_data_ptr, uip_buf, uip_len);
-	
-	/* Update the data length of the packet buffer. */
-	packetbuf_set_datalen(uip_len);
+	/* Let the packet buffer reference the UIP payload instead of
+	 * copying it. The MAC copies it once, into the 802.11 frame,
+	 * before the send call returns; a packet held for later is
+	 * compacted into the packet buffer first.
+	 */
+	packetbuf_reference(uip_buf, uip_len);
 	
 	/* Set the destination address as an attribute in the packet buffer. 
 	 * Note that we only use a 6-byte Ethernet address, so this might be
@@ -47,22 +47,21 @@
 #include "contiki-net.h"
 #include "net/packetbuf.h"
 #include "net/rime.h"
+#include "lib/memb.h"
 
-struct packetbuf_attr packetbuf_attrs[PACKETBUF_NUM_ATTRS];
-struct packetbuf_addr packetbuf_addrs[PACKETBUF_NUM_ADDRS];
+/* The buffer used until another one is selected. The buffers are
+   aligned on an even 16-bit boundary by their struct. On some
+   platforms (most notably the msp430), having a potentially misaligned
+   packet buffer may lead to problems when accessing 16-bit values. */
+static struct packetbuf packetbuf_default;
 
+#if PACKETBUF_NUM > 1
+MEMB(packetbuf_memb, struct packetbuf, PACKETBUF_NUM - 1);
+#endif /* PACKETBUF_NUM > 1 */
 
-static uint16_t buflen, bufptr;
-static uint8_t hdrptr;
+struct packetbuf *packetbuf_current = &packetbuf_default;
 
-/* The declarations below ensure that the packet buffer is aligned on
-   an even 16-bit boundary. On some platforms (most notably the
-   msp430), having apotentially misaligned packet buffer may lead to
-   problems when accessing 16-bit values. */
-static uint16_t packetbuf_aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE) / 2 + 1];
-static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
-
-static uint8_t *packetbufptr;
+#define BUF(p) ((uint8_t *)(p)->aligned)
 
 #define DEBUG 0
 #if DEBUG
@@ -72,242 +71,386 @@ static uint8_t *packetbufptr;
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+struct packetbuf *
+pb_alloc(void)
+{
+  struct packetbuf *p = NULL;
+
+#if PACKETBUF_NUM > 1
+  p = memb_alloc(&packetbuf_memb);
+  if(p != NULL) {
+    pb_clear(p);
+  }
+#endif /* PACKETBUF_NUM > 1 */
+  return p;
+}
 /*---------------------------------------------------------------------------*/
 void
-packetbuf_clear(void)
+pb_free(struct packetbuf *p)
 {
-  buflen = bufptr = 0;
-  hdrptr = PACKETBUF_HDR_SIZE;
+  if(p == packetbuf_current) {
+    packetbuf_current = &packetbuf_default;
+  }
+#if PACKETBUF_NUM > 1
+  memb_free(&packetbuf_memb, p);
+#endif /* PACKETBUF_NUM > 1 */
+}
+/*---------------------------------------------------------------------------*/
+struct packetbuf *
+packetbuf_select(struct packetbuf *p)
+{
+  struct packetbuf *old = packetbuf_current;
 
-  packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
-  packetbuf_attr_clear();
+  packetbuf_current = p != NULL ? p : &packetbuf_default;
+  return old;
 }
 /*---------------------------------------------------------------------------*/
 void
-packetbuf_clear_hdr(void)
+pb_clear(struct packetbuf *p)
 {
-  hdrptr = PACKETBUF_HDR_SIZE;
+  p->buflen = p->bufptr = 0;
+  p->hdrptr = PACKETBUF_HDR_SIZE;
+
+  p->ptr = &BUF(p)[PACKETBUF_HDR_SIZE];
+  pb_attr_clear(p);
+}
+/*---------------------------------------------------------------------------*/
+void
+pb_clear_hdr(struct packetbuf *p)
+{
+  p->hdrptr = PACKETBUF_HDR_SIZE;
 }
 /*---------------------------------------------------------------------------*/
 int
-packetbuf_copyfrom(const void *from, uint16_t len)
+pb_copyfrom(struct packetbuf *p, const void *from, uint16_t len)
 {
   uint16_t l;
 
-  packetbuf_clear();
+  pb_clear(p);
   l = len > PACKETBUF_SIZE? PACKETBUF_SIZE: len;
-  memcpy(packetbufptr, from, l);
-  buflen = l;
+  memcpy(p->ptr, from, l);
+  p->buflen = l;
   return l;
 }
 /*---------------------------------------------------------------------------*/
 void
-packetbuf_compact(void)
+pb_compact(struct packetbuf *p)
 {
   int i, len;
 
-  if(packetbuf_is_reference()) {
-    memcpy(&packetbuf[PACKETBUF_HDR_SIZE], packetbuf_reference_ptr(),
-	   packetbuf_datalen());
-  } else if(bufptr > 0) {
-    len = packetbuf_datalen() + PACKETBUF_HDR_SIZE;
+  if(pb_is_reference(p)) {
+    memcpy(&BUF(p)[PACKETBUF_HDR_SIZE], p->ptr + p->bufptr, p->buflen);
+    p->ptr = &BUF(p)[PACKETBUF_HDR_SIZE];
+    p->bufptr = 0;
+  } else if(p->bufptr > 0) {
+    len = p->buflen + PACKETBUF_HDR_SIZE;
     for(i = PACKETBUF_HDR_SIZE; i < len; i++) {
-      packetbuf[i] = packetbuf[bufptr + i];
+      BUF(p)[i] = BUF(p)[p->bufptr + i];
     }
 
-    bufptr = 0;
+    p->bufptr = 0;
   }
 }
 /*---------------------------------------------------------------------------*/
 int
-packetbuf_copyto_hdr(uint8_t *to)
+pb_copyto_hdr(struct packetbuf *p, uint8_t *to)
 {
-#if DEBUG_LEVEL > 0
-  {
-    int i;
-    PRINTF("packetbuf_write_hdr: header:\n");
-    for(i = hdrptr; i < PACKETBUF_HDR_SIZE; ++i) {
-      PRINTF("0x%02x, ", packetbuf[i]);
-    }
-    PRINTF(" \n");
-  }
-#endif /* DEBUG_LEVEL */
-  memcpy(to, packetbuf + hdrptr, PACKETBUF_HDR_SIZE - hdrptr);
-  return PACKETBUF_HDR_SIZE - hdrptr;
+  memcpy(to, BUF(p) + p->hdrptr, PACKETBUF_HDR_SIZE - p->hdrptr);
+  return PACKETBUF_HDR_SIZE - p->hdrptr;
 }
 /*---------------------------------------------------------------------------*/
 int
-packetbuf_copyto(void *to)
+pb_copyto(struct packetbuf *p, void *to)
 {
-#if DEBUG_LEVEL > 0
-  {
-    int i;
-    char buffer[1000];
-    char *bufferptr = buffer;
-    
-    bufferptr[0] = 0;
-    for(i = hdrptr; i < PACKETBUF_HDR_SIZE; ++i) {
-      bufferptr += sprintf(bufferptr, "0x%02x, ", packetbuf[i]);
-    }
-    PRINTF("packetbuf_write: header: %s\n", buffer);
-    bufferptr = buffer;
-    bufferptr[0] = 0;
-    for(i = bufptr; i < buflen + bufptr; ++i) {
-      bufferptr += sprintf(bufferptr, "0x%02x, ", packetbufptr[i]);
-    }
-    PRINTF("packetbuf_write: data: %s\n", buffer);
-  }
-#endif /* DEBUG_LEVEL */
-  if(PACKETBUF_HDR_SIZE - hdrptr + buflen > PACKETBUF_SIZE) {
+  if(PACKETBUF_HDR_SIZE - p->hdrptr + p->buflen > PACKETBUF_SIZE) {
     /* Too large packet */
     return 0;
   }
-  memcpy(to, packetbuf + hdrptr, PACKETBUF_HDR_SIZE - hdrptr);
-  memcpy((uint8_t *)to + PACKETBUF_HDR_SIZE - hdrptr, packetbufptr + bufptr,
-	 buflen);
-  return PACKETBUF_HDR_SIZE - hdrptr + buflen;
+  memcpy(to, BUF(p) + p->hdrptr, PACKETBUF_HDR_SIZE - p->hdrptr);
+  memcpy((uint8_t *)to + PACKETBUF_HDR_SIZE - p->hdrptr,
+         p->ptr + p->bufptr, p->buflen);
+  return PACKETBUF_HDR_SIZE - p->hdrptr + p->buflen;
 }
 /*---------------------------------------------------------------------------*/
 int
-packetbuf_hdralloc(int size)
+pb_hdralloc(struct packetbuf *p, int size)
 {
-  if(hdrptr >= size && packetbuf_totlen() + size <= PACKETBUF_SIZE) {
-    hdrptr -= size;
+  if(p->hdrptr >= size && pb_totlen(p) + size <= PACKETBUF_SIZE) {
+    p->hdrptr -= size;
     return 1;
   }
   return 0;
 }
 /*---------------------------------------------------------------------------*/
 void
-packetbuf_hdr_remove(int size)
+pb_hdr_remove(struct packetbuf *p, int size)
 {
-  hdrptr += size;
+  p->hdrptr += size;
 }
 /*---------------------------------------------------------------------------*/
 int
-packetbuf_hdrreduce(int size)
+pb_hdrreduce(struct packetbuf *p, int size)
 {
-  if(buflen < size) {
+  if(p->buflen < size) {
     return 0;
   }
 
-  bufptr += size;
-  buflen -= size;
+  p->bufptr += size;
+  p->buflen -= size;
   return 1;
 }
 /*---------------------------------------------------------------------------*/
 void
-packetbuf_set_datalen(uint16_t len)
+pb_set_datalen(struct packetbuf *p, uint16_t len)
 {
   PRINTF("packetbuf_set_len: len %d\n", len);
-  buflen = len;
+  p->buflen = len;
+}
+/*---------------------------------------------------------------------------*/
+void *
+pb_dataptr(struct packetbuf *p)
+{
+  return (void *)(&BUF(p)[p->bufptr + PACKETBUF_HDR_SIZE]);
+}
+/*---------------------------------------------------------------------------*/
+void *
+pb_hdrptr(struct packetbuf *p)
+{
+  return (void *)(&BUF(p)[p->hdrptr]);
+}
+/*---------------------------------------------------------------------------*/
+void
+pb_reference(struct packetbuf *p, void *ptr, uint16_t len)
+{
+  pb_clear(p);
+  p->ptr = ptr;
+  p->buflen = len;
+}
+/*---------------------------------------------------------------------------*/
+int
+pb_is_reference(struct packetbuf *p)
+{
+  return p->ptr != &BUF(p)[PACKETBUF_HDR_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+void *
+pb_reference_ptr(struct packetbuf *p)
+{
+  return p->ptr;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+pb_datalen(struct packetbuf *p)
+{
+  return p->buflen;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+pb_hdrlen(struct packetbuf *p)
+{
+  return PACKETBUF_HDR_SIZE - p->hdrptr;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+pb_totlen(struct packetbuf *p)
+{
+  return pb_hdrlen(p) + pb_datalen(p);
+}
+/*---------------------------------------------------------------------------*/
+void
+pb_attr_clear(struct packetbuf *p)
+{
+  int i;
+  for(i = 0; i < PACKETBUF_NUM_ATTRS; ++i) {
+    p->attrs[i].val = 0;
+  }
+  for(i = 0; i < PACKETBUF_NUM_ADDRS; ++i) {
+    rimeaddr_copy(&p->addrs[i].addr, &rimeaddr_null);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+pb_set_attr(struct packetbuf *p, uint8_t type, const packetbuf_attr_t val)
+{
+  p->attrs[type].val = val;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+packetbuf_attr_t
+pb_attr(struct packetbuf *p, uint8_t type)
+{
+  return p->attrs[type].val;
+}
+/*---------------------------------------------------------------------------*/
+int
+pb_set_addr(struct packetbuf *p, uint8_t type, const rimeaddr_t *addr)
+{
+  rimeaddr_copy(&p->addrs[type - PACKETBUF_ADDR_FIRST].addr, addr);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+const rimeaddr_t *
+pb_addr(struct packetbuf *p, uint8_t type)
+{
+  return &p->addrs[type - PACKETBUF_ADDR_FIRST].addr;
+}
+/*---------------------------------------------------------------------------*/
+/* The packetbuf_*() functions work on the selected buffer. */
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_clear(void)
+{
+  pb_clear(packetbuf_current);
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_clear_hdr(void)
+{
+  pb_clear_hdr(packetbuf_current);
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_copyfrom(const void *from, uint16_t len)
+{
+  return pb_copyfrom(packetbuf_current, from, len);
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_compact(void)
+{
+  pb_compact(packetbuf_current);
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_copyto_hdr(uint8_t *to)
+{
+  return pb_copyto_hdr(packetbuf_current, to);
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_copyto(void *to)
+{
+  return pb_copyto(packetbuf_current, to);
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_hdralloc(int size)
+{
+  return pb_hdralloc(packetbuf_current, size);
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_hdr_remove(int size)
+{
+  pb_hdr_remove(packetbuf_current, size);
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_hdrreduce(int size)
+{
+  return pb_hdrreduce(packetbuf_current, size);
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_set_datalen(uint16_t len)
+{
+  pb_set_datalen(packetbuf_current, len);
 }
 /*---------------------------------------------------------------------------*/
 void *
 packetbuf_dataptr(void)
 {
-  return (void *)(&packetbuf[bufptr + PACKETBUF_HDR_SIZE]);
+  return pb_dataptr(packetbuf_current);
 }
 /*---------------------------------------------------------------------------*/
 void *
 packetbuf_hdrptr(void)
 {
-  return (void *)(&packetbuf[hdrptr]);
+  return pb_hdrptr(packetbuf_current);
 }
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_reference(void *ptr, uint16_t len)
 {
-  packetbuf_clear();
-  packetbufptr = ptr;
-  buflen = len;
+  pb_reference(packetbuf_current, ptr, len);
 }
 /*---------------------------------------------------------------------------*/
 int
 packetbuf_is_reference(void)
 {
-  return packetbufptr != &packetbuf[PACKETBUF_HDR_SIZE];
+  return pb_is_reference(packetbuf_current);
 }
 /*---------------------------------------------------------------------------*/
 void *
 packetbuf_reference_ptr(void)
 {
-  return packetbufptr;
+  return pb_reference_ptr(packetbuf_current);
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
 packetbuf_datalen(void)
 {
-  return buflen;
+  return pb_datalen(packetbuf_current);
 }
 /*---------------------------------------------------------------------------*/
 uint8_t
 packetbuf_hdrlen(void)
 {
-  return PACKETBUF_HDR_SIZE - hdrptr;
+  return pb_hdrlen(packetbuf_current);
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
 packetbuf_totlen(void)
 {
-  return packetbuf_hdrlen() + packetbuf_datalen();
+  return pb_totlen(packetbuf_current);
 }
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_attr_clear(void)
 {
-  int i;
-  for(i = 0; i < PACKETBUF_NUM_ATTRS; ++i) {
-    packetbuf_attrs[i].val = 0;
-  }
-  for(i = 0; i < PACKETBUF_NUM_ADDRS; ++i) {
-    rimeaddr_copy(&packetbuf_addrs[i].addr, &rimeaddr_null);
-  }
+  pb_attr_clear(packetbuf_current);
 }
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_attr_copyto(struct packetbuf_attr *attrs,
 		    struct packetbuf_addr *addrs)
 {
-  memcpy(attrs, packetbuf_attrs, sizeof(packetbuf_attrs));
-  memcpy(addrs, packetbuf_addrs, sizeof(packetbuf_addrs));
+  memcpy(attrs, packetbuf_current->attrs, sizeof(packetbuf_current->attrs));
+  memcpy(addrs, packetbuf_current->addrs, sizeof(packetbuf_current->addrs));
 }
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_attr_copyfrom(struct packetbuf_attr *attrs,
 		      struct packetbuf_addr *addrs)
 {
-  memcpy(packetbuf_attrs, attrs, sizeof(packetbuf_attrs));
-  memcpy(packetbuf_addrs, addrs, sizeof(packetbuf_addrs));
+  memcpy(packetbuf_current->attrs, attrs, sizeof(packetbuf_current->attrs));
+  memcpy(packetbuf_current->addrs, addrs, sizeof(packetbuf_current->addrs));
 }
 /*---------------------------------------------------------------------------*/
 #if !PACKETBUF_CONF_ATTRS_INLINE
 int
 packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
 {
-/*   packetbuf_attrs[type].type = type; */
-  packetbuf_attrs[type].val = val;
-  return 1;
+  return pb_set_attr(packetbuf_current, type, val);
 }
 /*---------------------------------------------------------------------------*/
 packetbuf_attr_t
 packetbuf_attr(uint8_t type)
 {
-  return packetbuf_attrs[type].val;
+  return pb_attr(packetbuf_current, type);
 }
 /*---------------------------------------------------------------------------*/
 int
 packetbuf_set_addr(uint8_t type, const rimeaddr_t *addr)
 {
-/*   packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].type = type; */
-  rimeaddr_copy(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr, addr);
-  return 1;
+  return pb_set_addr(packetbuf_current, type, addr);
 }
 /*---------------------------------------------------------------------------*/
 const rimeaddr_t *
 packetbuf_addr(uint8_t type)
 {
-  return &packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr;
+  return pb_addr(packetbuf_current, type);
 }
 /*---------------------------------------------------------------------------*/
 #endif /* PACKETBUF_CONF_ATTRS_INLINE */
@@ -75,6 +75,16 @@
 #define PACKETBUF_HDR_SIZE 48
 #endif
 
+/**
+ * \brief      The number of packet buffers, counting the one the
+ *             packetbuf_*() functions work on by default
+ */
+#ifdef PACKETBUF_CONF_NUM
+#define PACKETBUF_NUM PACKETBUF_CONF_NUM
+#else
+#define PACKETBUF_NUM 1
+#endif
+
 /**
  * \brief      Clear and reset the packetbuf
  *
@@ -381,10 +391,70 @@ enum {
 
 #define PACKETBUF_IS_ADDR(type) ((type) >= PACKETBUF_ADDR_FIRST)
 
-#if PACKETBUF_CONF_ATTRS_INLINE
+/**
+ * A packet buffer. The packetbuf_*() functions work on the selected
+ * one, see packetbuf_select(); the pb_*() functions take the buffer
+ * as their first argument and otherwise behave the same. The other
+ * buffers are taken from a pool of PACKETBUF_NUM - 1, so that a packet
+ * can be parsed or built while another one is still in use.
+ */
+struct packetbuf {
+  uint16_t buflen, bufptr;
+  uint8_t hdrptr;
+  uint8_t *ptr;                 /* The data, or the referenced data */
+  struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
+  struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+  uint16_t aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE) / 2 + 1];
+};
 
-extern struct packetbuf_attr packetbuf_attrs[];
-extern struct packetbuf_addr packetbuf_addrs[];
+extern struct packetbuf *packetbuf_current;
+
+/**
+ * \brief      Take a packet buffer from the pool
+ * \return     A cleared buffer, or NULL if the pool is empty
+ */
+struct packetbuf *pb_alloc(void);
+
+/**
+ * \brief      Return a packet buffer to the pool
+ *
+ *             If the buffer is selected, the default buffer is
+ *             selected instead.
+ */
+void pb_free(struct packetbuf *p);
+
+/**
+ * \brief      Select the buffer the packetbuf_*() functions work on
+ * \param p    The buffer, or NULL for the default buffer
+ * \return     The buffer selected before, to restore afterwards
+ */
+struct packetbuf *packetbuf_select(struct packetbuf *p);
+
+void pb_clear(struct packetbuf *p);
+void pb_clear_hdr(struct packetbuf *p);
+void pb_hdr_remove(struct packetbuf *p, int bytes);
+void *pb_dataptr(struct packetbuf *p);
+void *pb_hdrptr(struct packetbuf *p);
+uint8_t pb_hdrlen(struct packetbuf *p);
+uint16_t pb_datalen(struct packetbuf *p);
+uint16_t pb_totlen(struct packetbuf *p);
+void pb_set_datalen(struct packetbuf *p, uint16_t len);
+void pb_reference(struct packetbuf *p, void *ptr, uint16_t len);
+int pb_is_reference(struct packetbuf *p);
+void *pb_reference_ptr(struct packetbuf *p);
+void pb_compact(struct packetbuf *p);
+int pb_copyfrom(struct packetbuf *p, const void *from, uint16_t len);
+int pb_copyto(struct packetbuf *p, void *to);
+int pb_copyto_hdr(struct packetbuf *p, uint8_t *to);
+int pb_hdralloc(struct packetbuf *p, int size);
+int pb_hdrreduce(struct packetbuf *p, int size);
+void pb_attr_clear(struct packetbuf *p);
+int pb_set_attr(struct packetbuf *p, uint8_t type, const packetbuf_attr_t val);
+packetbuf_attr_t pb_attr(struct packetbuf *p, uint8_t type);
+int pb_set_addr(struct packetbuf *p, uint8_t type, const rimeaddr_t *addr);
+const rimeaddr_t *pb_addr(struct packetbuf *p, uint8_t type);
+
+#if PACKETBUF_CONF_ATTRS_INLINE
 
 static int               packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val);
 static packetbuf_attr_t    packetbuf_attr(uint8_t type);
@@ -394,28 +464,27 @@ static const rimeaddr_t *packetbuf_addr(uint8_t type);
 static inline int
 packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
 {
-/*   packetbuf_attrs[type].type = type; */
-  packetbuf_attrs[type].val = val;
+  packetbuf_current->attrs[type].val = val;
   return 1;
 }
 static inline packetbuf_attr_t
 packetbuf_attr(uint8_t type)
 {
-  return packetbuf_attrs[type].val;
+  return packetbuf_current->attrs[type].val;
 }
 
 static inline int
 packetbuf_set_addr(uint8_t type, const rimeaddr_t *addr)
 {
-/*   packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].type = type; */
-  rimeaddr_copy(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr, addr);
+  rimeaddr_copy(&packetbuf_current->addrs[type - PACKETBUF_ADDR_FIRST].addr,
+                addr);
   return 1;
 }
 
 static inline const rimeaddr_t *
 packetbuf_addr(uint8_t type)
 {
-  return &packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr;
+  return &packetbuf_current->addrs[type - PACKETBUF_ADDR_FIRST].addr;
 }
 #else /* PACKETBUF_CONF_ATTRS_INLINE */
 int               packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val);
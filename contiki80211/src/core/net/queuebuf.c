@@ -55,15 +55,27 @@
 #define QUEUEBUF_REF_NUM 2
 #endif
 
+/* Handles beyond QUEUEBUF_NUM, for queuebufs made with queuebuf_share() */
+#ifdef QUEUEBUF_CONF_SHARE_NUM
+#define QUEUEBUF_SHARE_NUM QUEUEBUF_CONF_SHARE_NUM
+#else
+#define QUEUEBUF_SHARE_NUM 0
+#endif
+
 /* Structure pointing to a buffer either stored
-   in RAM or swapped in CFS */
+   in RAM or swapped in CFS. The payload and the attributes may be
+   shared with other queuebufs; the attributes are copied when one of
+   them changes its own. */
 struct queuebuf {
-#if QUEUEBUF_DEBUG
+#if QUEUEBUF_DEBUG || WITH_SWAP
   struct queuebuf *next;
+#endif /* QUEUEBUF_DEBUG || WITH_SWAP */
+#if QUEUEBUF_DEBUG
   const char *file;
   int line;
   clock_time_t time;
 #endif /* QUEUEBUF_DEBUG */
+  struct queuebuf_attrs *attrs;
 #if WITH_SWAP
   enum {IN_RAM, IN_CFS} location;
   union {
@@ -75,10 +87,16 @@ struct queuebuf {
 #endif
 };
 
-/* The actual queuebuf data */
+/* The actual queuebuf data. A payload swapped to CFS is shared by
+   counting it in the usage of its file instead. */
 struct queuebuf_data {
   uint16_t len;
+  uint8_t refs;
   uint8_t data[PACKETBUF_SIZE];
+};
+
+struct queuebuf_attrs {
+  uint8_t refs;
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
 };
@@ -90,9 +108,13 @@ struct queuebuf_ref {
   uint8_t hdrlen;
 };
 
-MEMB(bufmem, struct queuebuf, QUEUEBUF_NUM);
+MEMB(bufmem, struct queuebuf, QUEUEBUF_NUM + QUEUEBUF_SHARE_NUM);
 MEMB(refbufmem, struct queuebuf_ref, QUEUEBUF_REF_NUM);
 MEMB(buframmem, struct queuebuf_data, QUEUEBUFRAM_NUM);
+/* One set of attributes per queuebuf, so a copy on write never fails */
+MEMB(attrmem, struct queuebuf_attrs, QUEUEBUF_NUM + QUEUEBUF_SHARE_NUM);
+
+static struct queuebuf_stats stats;
 
 #if WITH_SWAP
 
@@ -105,6 +127,43 @@ MEMB(buframmem, struct queuebuf_data, QUEUEBUFRAM_NUM);
 #define QBUF_FILE_SIZE (NQBUF_PER_FILE*sizeof(struct queuebuf_data))
 #define NQBUF_ID (NQBUF_PER_FILE * NQBUF_FILES)
 
+/* Besides swapping a new queuebuf when RAM is out, the swap process
+   spills the oldest data packets once QUEUEBUF_SPILL_HIGH payloads
+   are in RAM, until QUEUEBUF_SPILL_LOW are left, at most
+   QUEUEBUF_SPILL_BATCH per run. Once fewer than QUEUEBUF_SPILL_LOW are
+   in RAM, it reads spilled packets back, oldest first, so they are in
+   RAM by the time the MAC gets to them. No more than
+   QUEUEBUF_FLASH_MAX queuebufs are spilled. */
+#ifdef QUEUEBUF_CONF_SPILL_HIGH
+#define QUEUEBUF_SPILL_HIGH QUEUEBUF_CONF_SPILL_HIGH
+#else
+#define QUEUEBUF_SPILL_HIGH QUEUEBUFRAM_NUM
+#endif
+
+#ifdef QUEUEBUF_CONF_SPILL_LOW
+#define QUEUEBUF_SPILL_LOW QUEUEBUF_CONF_SPILL_LOW
+#else
+#define QUEUEBUF_SPILL_LOW (QUEUEBUFRAM_NUM / 2)
+#endif
+
+#ifdef QUEUEBUF_CONF_SPILL_BATCH
+#define QUEUEBUF_SPILL_BATCH QUEUEBUF_CONF_SPILL_BATCH
+#else
+#define QUEUEBUF_SPILL_BATCH 4
+#endif
+
+#ifdef QUEUEBUF_CONF_FLASH_MAX
+#define QUEUEBUF_FLASH_MAX QUEUEBUF_CONF_FLASH_MAX
+#else
+#define QUEUEBUF_FLASH_MAX (QUEUEBUF_NUM - QUEUEBUFRAM_NUM)
+#endif
+
+#if QUEUEBUF_SPILL_LOW >= QUEUEBUF_SPILL_HIGH
+#error "QUEUEBUF_CONF_SPILL_LOW must be below QUEUEBUF_CONF_SPILL_HIGH"
+#endif
+
+PROCESS(queuebuf_swap_process, "queuebuf swap");
+
 struct qbuf_file {
   int fd;
   int usage;
@@ -113,8 +172,9 @@ struct qbuf_file {
 
 /* A statically allocated queuebuf used as a cache for swapped qbufs */
 static struct queuebuf_data tmpdata;
-/* A pointer to the qbuf associated to the data in tmpdata */
-static struct queuebuf *tmpdata_qbuf = NULL;
+/* The swap id of the data in tmpdata. Swapped data never changes, so
+   the cache stays valid until the id is handed out again. */
+static int tmpdata_id = -1;
 /* The swap id counter */
 static int next_swap_id = 0;
 /* The swap files */
@@ -124,10 +184,11 @@ static struct ctimer renew_timer;
 
 #endif
 
-#if QUEUEBUF_DEBUG
+#if QUEUEBUF_DEBUG || WITH_SWAP
 #include "lib/list.h"
+/* Queuebufs, oldest first */
 LIST(queuebuf_list);
-#endif /* QUEUEBUF_DEBUG */
+#endif /* QUEUEBUF_DEBUG || WITH_SWAP */
 
 #define DEBUG 0
 #if DEBUG
@@ -196,10 +257,6 @@ queuebuf_remove_from_file(int swap_id)
       /* This file is renewable, set a timer to renew files */
       ctimer_set(&renew_timer, 0, qbuf_renew_all, NULL);
     }
-
-    if(tmpdata_qbuf->swap_id == swap_id) {
-      tmpdata_qbuf->swap_id = -1;
-    }
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -222,32 +279,70 @@ get_new_swap_id(void)
   return swap_id;
 }
 /*---------------------------------------------------------------------------*/
-/* Flush tmpdata to CFS */
+/* Write data to CFS under a new swap id, counted once in the usage of
+   its file. Ids are handed out in order, so a file is only ever
+   appended to. Returns the id, or -1. */
+static int
+queuebuf_write_swap(struct queuebuf_data *data)
+{
+  int fileid, fd, ret, swap_id;
+  cfs_offset_t offset;
+  swap_id = get_new_swap_id();
+  if(swap_id == -1) {
+    return -1;
+  }
+  if(swap_id == tmpdata_id) {
+    tmpdata_id = -1;
+  }
+  fileid = swap_id / NQBUF_PER_FILE;
+  offset = (swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
+  fd = qbuf_files[fileid].fd;
+  ret = cfs_seek(fd, offset, CFS_SEEK_SET);
+  if(ret == -1) {
+    PRINTF("queuebuf_write_swap: cfs seek error\n");
+    queuebuf_remove_from_file(swap_id);
+    return -1;
+  }
+  ret = cfs_write(fd, data, sizeof(struct queuebuf_data));
+  if(ret == -1) {
+    PRINTF("queuebuf_write_swap: cfs write error\n");
+    queuebuf_remove_from_file(swap_id);
+    return -1;
+  }
+  return swap_id;
+}
+/*---------------------------------------------------------------------------*/
+/* Read the data stored under a swap id */
 static int
-queuebuf_flush_tmpdata(void)
+queuebuf_read_swap(int swap_id, struct queuebuf_data *data)
 {
   int fileid, fd, ret;
   cfs_offset_t offset;
-  if(tmpdata_qbuf) {
-    queuebuf_remove_from_file(tmpdata_qbuf->swap_id);
-    tmpdata_qbuf->swap_id = get_new_swap_id();
-    if(tmpdata_qbuf->swap_id == -1) {
-      return -1;
-    }
-    fileid = tmpdata_qbuf->swap_id / NQBUF_PER_FILE;
-    offset = (tmpdata_qbuf->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
-    fd = qbuf_files[fileid].fd;
-    ret = cfs_seek(fd, offset, CFS_SEEK_SET);
-    if(ret == -1) {
-      PRINTF("queuebuf_flush_tmpdata: cfs seek error\n");
-      return -1;
-    }
-    ret = cfs_write(fd, &tmpdata, sizeof(struct queuebuf_data));
-    if(ret == -1) {
-      PRINTF("queuebuf_flush_tmpdata: cfs write error\n");
-      return -1;
-    }
+  fileid = swap_id / NQBUF_PER_FILE;
+  offset = (swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
+  fd = qbuf_files[fileid].fd;
+  ret = cfs_seek(fd, offset, CFS_SEEK_SET);
+  if(ret == -1) {
+    PRINTF("queuebuf_read_swap: cfs seek error\n");
+    return -1;
   }
+  ret = cfs_read(fd, data, sizeof(struct queuebuf_data));
+  if(ret == -1) {
+    PRINTF("queuebuf_read_swap: cfs read error\n");
+    return -1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Flush tmpdata to CFS as the data of b */
+static int
+queuebuf_flush_tmpdata(struct queuebuf *b)
+{
+  b->swap_id = queuebuf_write_swap(&tmpdata);
+  if(b->swap_id == -1) {
+    return -1;
+  }
+  tmpdata_id = b->swap_id;
   return 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -255,31 +350,156 @@ queuebuf_flush_tmpdata(void)
 static struct queuebuf_data *
 queuebuf_load_to_ram(struct queuebuf *b)
 {
-  int fileid, fd, ret;
-  cfs_offset_t offset;
   if(b->location == IN_RAM) { /* the qbuf is loacted in RAM */
     return b->ram_ptr;
   } else { /* the qbuf is located in CFS */
-    if(tmpdata_qbuf && tmpdata_qbuf->swap_id == b->swap_id) { /* the qbuf is already in tmpdata */
+    if(tmpdata_id == b->swap_id) { /* the qbuf is already in tmpdata */
       return &tmpdata;
     } else { /* the qbuf needs to be loaded from CFS */
-      tmpdata_qbuf = b;
+      tmpdata_id = b->swap_id;
       /* read the qbuf from CFS */
-      fileid = b->swap_id / NQBUF_PER_FILE;
-      offset = (b->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
-      fd = qbuf_files[fileid].fd;
-      ret = cfs_seek(fd, offset, CFS_SEEK_SET);
-      if(ret == -1) {
-        PRINTF("queuebuf_load_to_ram: cfs seek error\n");
-      }
-      ret = cfs_read(fd, &tmpdata, sizeof(struct queuebuf_data));
-      if(ret == -1) {
-        PRINTF("queuebuf_load_to_ram: cfs read error\n");
+      if(queuebuf_read_swap(b->swap_id, &tmpdata) == -1) {
+        tmpdata_id = -1;
       }
       return &tmpdata;
     }
   }
 }
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ticks_to_us(rtimer_clock_t ticks)
+{
+  return (unsigned long)(((uint64_t)ticks * 1000000) / RTIMER_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+/* Move the payload of b, and of the queuebufs sharing it, to CFS */
+static int
+queuebuf_spill(struct queuebuf *b)
+{
+  struct queuebuf_data *d = b->ram_ptr;
+  struct queuebuf *q;
+  rtimer_clock_t start = RTIMER_NOW();
+  unsigned long us;
+  int swap_id, n = 0;
+
+  swap_id = queuebuf_write_swap(d);
+  if(swap_id == -1) {
+    return 0;
+  }
+  for(q = list_head(queuebuf_list); q != NULL; q = list_item_next(q)) {
+    if(q->location == IN_RAM && q->ram_ptr == d) {
+      q->location = IN_CFS;
+      q->swap_id = swap_id;
+      n++;
+    }
+  }
+  /* Each queuebuf holding the data counts in the usage of the file. */
+  qbuf_files[swap_id / NQBUF_PER_FILE].usage += n - 1;
+  stats.flash += n;
+  memb_free(&buframmem, d);
+  stats.data--;
+
+  us = ticks_to_us(RTIMER_NOW() - start);
+  stats.spills++;
+  stats.spill_us += us;
+  if(us > stats.spill_us_max) {
+    stats.spill_us_max = us;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Read the payload of b, and of the queuebufs sharing it, back to RAM */
+static int
+queuebuf_reload(struct queuebuf *b)
+{
+  struct queuebuf_data *d;
+  struct queuebuf *q;
+  rtimer_clock_t start = RTIMER_NOW();
+  unsigned long us;
+  int swap_id = b->swap_id;
+
+  d = memb_alloc(&buframmem);
+  if(d == NULL) {
+    return 0;
+  }
+  if(queuebuf_read_swap(swap_id, d) == -1) {
+    memb_free(&buframmem, d);
+    return 0;
+  }
+  d->refs = 0;
+  for(q = list_head(queuebuf_list); q != NULL; q = list_item_next(q)) {
+    if(q->location == IN_CFS && q->swap_id == swap_id) {
+      queuebuf_remove_from_file(swap_id);
+      q->location = IN_RAM;
+      q->ram_ptr = d;
+      d->refs++;
+      stats.flash--;
+    }
+  }
+  if(++stats.data > stats.data_max) {
+    stats.data_max = stats.data;
+  }
+
+  us = ticks_to_us(RTIMER_NOW() - start);
+  stats.reloads++;
+  stats.reload_us += us;
+  if(us > stats.reload_us_max) {
+    stats.reload_us_max = us;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Spill or reload a batch; returns non-zero if there is more to do */
+static int
+queuebuf_swap_batch(void)
+{
+  struct queuebuf *q;
+  int n;
+
+  for(n = 0; n < QUEUEBUF_SPILL_BATCH; n++) {
+    if(stats.data > QUEUEBUF_SPILL_LOW && stats.flash < QUEUEBUF_FLASH_MAX &&
+       (stats.data >= QUEUEBUF_SPILL_HIGH || n > 0)) {
+      /* The oldest data packet in RAM; others are sent first. */
+      for(q = list_head(queuebuf_list); q != NULL; q = list_item_next(q)) {
+        if(q->location == IN_RAM &&
+           q->attrs->attrs[PACKETBUF_ATTR_PACKET_TYPE].val ==
+           PACKETBUF_ATTR_PACKET_TYPE_DATA) {
+          break;
+        }
+      }
+      if(q == NULL || !queuebuf_spill(q)) {
+        return 0;
+      }
+    } else if(stats.data < QUEUEBUF_SPILL_LOW && stats.flash > 0) {
+      for(q = list_head(queuebuf_list); q != NULL; q = list_item_next(q)) {
+        if(q->location == IN_CFS) {
+          break;
+        }
+      }
+      if(q == NULL || !queuebuf_reload(q)) {
+        return 0;
+      }
+    } else {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(queuebuf_swap_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+    if(queuebuf_swap_batch()) {
+      /* Let the others run between batches. */
+      process_poll(&queuebuf_swap_process);
+    }
+  }
+
+  PROCESS_END();
+}
 #else /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
 static struct queuebuf_data *
@@ -289,6 +509,36 @@ queuebuf_load_to_ram(struct queuebuf *b)
 }
 #endif /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
+/* Drop the reference of b to its payload */
+static void
+queuebuf_release_data(struct queuebuf *b)
+{
+#if WITH_SWAP
+  if(b->location == IN_CFS) {
+    queuebuf_remove_from_file(b->swap_id);
+    stats.flash--;
+    return;
+  }
+#endif
+  if(--b->ram_ptr->refs == 0) {
+    memb_free(&buframmem, b->ram_ptr);
+    stats.data--;
+#if WITH_SWAP
+    if(stats.data < QUEUEBUF_SPILL_LOW && stats.flash > 0) {
+      process_poll(&queuebuf_swap_process);
+    }
+#endif
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+queuebuf_release_attrs(struct queuebuf_attrs *a)
+{
+  if(--a->refs == 0) {
+    memb_free(&attrmem, a);
+  }
+}
+/*---------------------------------------------------------------------------*/
 void
 queuebuf_init(void)
 {
@@ -302,6 +552,11 @@ queuebuf_init(void)
   memb_init(&buframmem);
   memb_init(&bufmem);
   memb_init(&refbufmem);
+  memb_init(&attrmem);
+  memset(&stats, 0, sizeof(stats));
+#if WITH_SWAP
+  process_start(&queuebuf_swap_process, NULL);
+#endif
 #if QUEUEBUF_STATS
   queuebuf_max_len = QUEUEBUF_NUM;
 #endif /* QUEUEBUF_STATS */
@@ -335,12 +590,13 @@ queuebuf_new_from_packetbuf(void)
     struct queuebuf_data *buframptr;
     buf = memb_alloc(&bufmem);
     if(buf != NULL) {
-#if QUEUEBUF_DEBUG
-      list_add(queuebuf_list, buf);
-      buf->file = file;
-      buf->line = line;
-      buf->time = clock_time();
-#endif /* QUEUEBUF_DEBUG */
+      buf->attrs = memb_alloc(&attrmem);
+      if(buf->attrs == NULL) {
+        PRINTF("queuebuf_new_from_packetbuf: could not allocate attributes\n");
+        memb_free(&bufmem, buf);
+        stats.failed++;
+        return NULL;
+      }
       buf->ram_ptr = memb_alloc(&buframmem);
 #if WITH_SWAP
       /* If the allocation failed, store the qbuf in swap files */
@@ -350,81 +606,157 @@ queuebuf_new_from_packetbuf(void)
       } else {
         buf->location = IN_CFS;
         buf->swap_id = -1;
-        tmpdata_qbuf = buf;
+        tmpdata_id = -1;
         buframptr = &tmpdata;
       }
 #else
       if(buf->ram_ptr == NULL) {
         PRINTF("queuebuf_new_from_packetbuf: could not queuebuf data\n");
+        memb_free(&attrmem, buf->attrs);
+        memb_free(&bufmem, buf);
+        stats.failed++;
         return NULL;
       }
       buframptr = buf->ram_ptr;
 #endif
 
       buframptr->len = packetbuf_copyto(buframptr->data);
-      packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
+      buframptr->refs = 1;
+      buf->attrs->refs = 1;
+      packetbuf_attr_copyto(buf->attrs->attrs, buf->attrs->addrs);
 
 #if WITH_SWAP
       if(buf->location == IN_CFS) {
-        if(queuebuf_flush_tmpdata() == -1) {
+        if(queuebuf_flush_tmpdata(buf) == -1) {
           /* We were unable to write the data in the swap */
+          memb_free(&attrmem, buf->attrs);
           memb_free(&bufmem, buf);
+          stats.failed++;
           return NULL;
         }
+        stats.flash++;
+      } else
+#endif
+      if(++stats.data > stats.data_max) {
+        stats.data_max = stats.data;
+      }
+      if(++stats.bufs > stats.bufs_max) {
+        stats.bufs_max = stats.bufs;
+      }
+#if WITH_SWAP
+      if(stats.data >= QUEUEBUF_SPILL_HIGH) {
+        process_poll(&queuebuf_swap_process);
       }
 #endif
 
+#if QUEUEBUF_DEBUG || WITH_SWAP
+      list_add(queuebuf_list, buf);
+#endif /* QUEUEBUF_DEBUG || WITH_SWAP */
+#if QUEUEBUF_DEBUG
+      buf->file = file;
+      buf->line = line;
+      buf->time = clock_time();
+#endif /* QUEUEBUF_DEBUG */
+
 #if QUEUEBUF_STATS
       ++queuebuf_len;
       PRINTF("queuebuf len %d\n", queuebuf_len);
       printf("#A q=%d\n", queuebuf_len);
       if(queuebuf_len == queuebuf_max_len + 1) {
-  memb_free(&bufmem, buf);
-  queuebuf_len--;
+  queuebuf_free(buf);
   return NULL;
       }
 #endif /* QUEUEBUF_STATS */
 
     } else {
       PRINTF("queuebuf_new_from_packetbuf: could not allocate a queuebuf\n");
+      stats.failed++;
     }
     return buf;
   }
 }
 /*---------------------------------------------------------------------------*/
+struct queuebuf *
+queuebuf_share(struct queuebuf *b)
+{
+  struct queuebuf *buf;
+  struct queuebuf_ref *rbuf;
+
+  if(memb_inmemb(&bufmem, b)) {
+    buf = memb_alloc(&bufmem);
+    if(buf == NULL) {
+      PRINTF("queuebuf_share: could not allocate a queuebuf\n");
+      stats.failed++;
+      return NULL;
+    }
+    *buf = *b;
+#if WITH_SWAP
+    if(buf->location == IN_CFS) {
+      qbuf_files[buf->swap_id / NQBUF_PER_FILE].usage++;
+      stats.flash++;
+    } else
+#endif
+    buf->ram_ptr->refs++;
+    buf->attrs->refs++;
+#if QUEUEBUF_DEBUG || WITH_SWAP
+    list_add(queuebuf_list, buf);
+#endif /* QUEUEBUF_DEBUG || WITH_SWAP */
+#if QUEUEBUF_STATS
+    ++queuebuf_len;
+#endif /* QUEUEBUF_STATS */
+    if(++stats.bufs > stats.bufs_max) {
+      stats.bufs_max = stats.bufs;
+    }
+    stats.shares++;
+    return buf;
+  } else if(memb_inmemb(&refbufmem, b)) {
+    /* A reference queuebuf only holds the header; copy it. */
+    rbuf = memb_alloc(&refbufmem);
+    if(rbuf != NULL) {
+#if QUEUEBUF_STATS
+      ++queuebuf_ref_len;
+#endif /* QUEUEBUF_STATS */
+      memcpy(rbuf, b, sizeof(struct queuebuf_ref));
+    }
+    return (struct queuebuf *)rbuf;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 void
 queuebuf_update_attr_from_packetbuf(struct queuebuf *buf)
 {
-  struct queuebuf_data *buframptr = queuebuf_load_to_ram(buf);
-  packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
-#if WITH_SWAP
-  if(buf->location == IN_CFS) {
-    queuebuf_flush_tmpdata();
+  struct queuebuf_attrs *a = buf->attrs;
+
+  if(a->refs > 1) {
+    /* Shared; the other queuebufs keep the old attributes. */
+    a = memb_alloc(&attrmem);
+    if(a == NULL) {
+      return;
+    }
+    queuebuf_release_attrs(buf->attrs);
+    a->refs = 1;
+    buf->attrs = a;
+    stats.attr_copies++;
   }
-#endif
+  packetbuf_attr_copyto(a->attrs, a->addrs);
 }
 /*---------------------------------------------------------------------------*/
 void
 queuebuf_free(struct queuebuf *buf)
 {
   if(memb_inmemb(&bufmem, buf)) {
-#if WITH_SWAP
-    if(buf->location == IN_RAM) {
-      memb_free(&buframmem, buf->ram_ptr);
-    } else {
-      queuebuf_remove_from_file(buf->swap_id);
-    }
-#else
-    memb_free(&buframmem, buf->ram_ptr);
-#endif
+    queuebuf_release_data(buf);
+    queuebuf_release_attrs(buf->attrs);
     memb_free(&bufmem, buf);
+    stats.bufs--;
 #if QUEUEBUF_STATS
     --queuebuf_len;
     printf("#A q=%d\n", queuebuf_len);
 #endif /* QUEUEBUF_STATS */
-#if QUEUEBUF_DEBUG
+#if QUEUEBUF_DEBUG || WITH_SWAP
     list_remove(queuebuf_list, buf);
-#endif /* QUEUEBUF_DEBUG */
+#endif /* QUEUEBUF_DEBUG || WITH_SWAP */
   } else if(memb_inmemb(&refbufmem, buf)) {
     memb_free(&refbufmem, buf);
 #if QUEUEBUF_STATS
@@ -440,7 +772,7 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
     packetbuf_copyfrom(buframptr->data, buframptr->len);
-    packetbuf_attr_copyfrom(buframptr->attrs, buframptr->addrs);
+    packetbuf_attr_copyfrom(b->attrs->attrs, b->attrs->addrs);
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
     packetbuf_clear();
@@ -450,6 +782,20 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+queuebuf_to_packetbuf_reference(struct queuebuf *b)
+{
+  struct queuebuf_data *buframptr;
+
+  if(!memb_inmemb(&bufmem, b)) {
+    queuebuf_to_packetbuf(b);
+    return;
+  }
+  buframptr = queuebuf_load_to_ram(b);
+  packetbuf_reference(buframptr->data, buframptr->len);
+  packetbuf_attr_copyfrom(b->attrs->attrs, b->attrs->addrs);
+}
+/*---------------------------------------------------------------------------*/
 void *
 queuebuf_dataptr(struct queuebuf *b)
 {
@@ -475,15 +821,19 @@ queuebuf_datalen(struct queuebuf *b)
 rimeaddr_t *
 queuebuf_addr(struct queuebuf *b, uint8_t type)
 {
-  struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
-  return &buframptr->addrs[type - PACKETBUF_ADDR_FIRST].addr;
+  return &b->attrs->addrs[type - PACKETBUF_ADDR_FIRST].addr;
 }
 /*---------------------------------------------------------------------------*/
 packetbuf_attr_t
 queuebuf_attr(struct queuebuf *b, uint8_t type)
 {
-  struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
-  return buframptr->attrs[type].val;
+  return b->attrs->attrs[type].val;
+}
+/*---------------------------------------------------------------------------*/
+void
+queuebuf_get_stats(struct queuebuf_stats *s)
+{
+  *s = stats;
 }
 /*---------------------------------------------------------------------------*/
 void
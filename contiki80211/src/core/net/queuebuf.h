@@ -87,6 +87,27 @@
 
 struct queuebuf;
 
+/**
+ * \brief      Occupancy of the queuebuf pools
+ */
+struct queuebuf_stats {
+  unsigned int bufs;           /* Queuebufs allocated                 */
+  unsigned int bufs_max;       /* Most queuebufs allocated at once    */
+  unsigned int data;           /* Payloads held in RAM                */
+  unsigned int data_max;       /* Most payloads held in RAM at once   */
+  unsigned long shares;        /* Queuebufs made by queuebuf_share()  */
+  unsigned long attr_copies;   /* Attributes copied on write          */
+  unsigned long failed;        /* Allocations that failed             */
+  /* Swap only; zero without it */
+  unsigned int flash;          /* Queuebufs with their payload in CFS */
+  unsigned long spills;        /* Payloads moved to CFS in background */
+  unsigned long reloads;       /* Payloads read back in background    */
+  unsigned long spill_us;      /* Time spent spilling, us             */
+  unsigned long spill_us_max;  /* Longest single spill, us            */
+  unsigned long reload_us;     /* Time spent reloading, us            */
+  unsigned long reload_us_max; /* Longest single reload, us           */
+};
+
 void queuebuf_init(void);
 
 #if QUEUEBUF_DEBUG
@@ -97,7 +118,35 @@ struct queuebuf *queuebuf_new_from_packetbuf(void);
 #endif /* QUEUEBUF_DEBUG */
 void queuebuf_update_attr_from_packetbuf(struct queuebuf *b);
 
+/**
+ * \brief      Make another queuebuf holding the same packet
+ * \param b    The queuebuf to share
+ * \return     The new queuebuf, or NULL if none was free
+ *
+ *             The payload is not copied, but reference counted, and
+ *             stays until the last queuebuf holding it is freed. The
+ *             attributes are shared too until
+ *             queuebuf_update_attr_from_packetbuf() is called on
+ *             either queuebuf, which then gets its own copy. This
+ *             serves retransmissions and sending the same packet to
+ *             several receivers. The new queuebuf comes from the
+ *             QUEUEBUF_NUM pool, plus QUEUEBUF_CONF_SHARE_NUM extra
+ *             handles where a platform reserves them.
+ */
+struct queuebuf *queuebuf_share(struct queuebuf *b);
+
 void queuebuf_to_packetbuf(struct queuebuf *b);
+
+/**
+ * \brief      Point the packetbuf at the payload of a queuebuf
+ * \param b    The queuebuf
+ *
+ *             Like queuebuf_to_packetbuf(), but the payload is not
+ *             copied. The queuebuf must not be freed, nor, with
+ *             swapping, another queuebuf read, until the driver has
+ *             taken the packet out of the packetbuf.
+ */
+void queuebuf_to_packetbuf_reference(struct queuebuf *b);
 void queuebuf_free(struct queuebuf *b);
 
 void *queuebuf_dataptr(struct queuebuf *b);
@@ -106,6 +155,8 @@ int queuebuf_datalen(struct queuebuf *b);
 rimeaddr_t *queuebuf_addr(struct queuebuf *b, uint8_t type);
 packetbuf_attr_t queuebuf_attr(struct queuebuf *b, uint8_t type);
 
+void queuebuf_get_stats(struct queuebuf_stats *stats);
+
 void queuebuf_debug_print(void);
 
 #endif /* QUEUEBUF_H_ */
@@ -49,6 +49,8 @@
 #include "net/uip-icmp6.h"
 #include "net/rpl/rpl-private.h"
 #include "net/packetbuf.h"
+#include "sys/trace.h"
+#include "sys/energest.h"
 
 #include <limits.h>
 #include <string.h>
@@ -401,6 +403,7 @@ dio_input(void)
   RPL_DEBUG_DIO_INPUT(&from, &dio);
 #endif
 
+  TRACE(TRACE_RPL_DIO_IN, dio.rank, dio.version);
   rpl_process_dio(&from, &dio);
 }
 /*---------------------------------------------------------------------------*/
@@ -532,12 +535,14 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
     PRINTF("RPL: LEAF ONLY sending unicast-DIO from multicast-DIO\n");
   }
 #endif /* DEBUG_PRINT */
+  TRACE(TRACE_RPL_DIO_OUT, dag->rank, 1);
   PRINTF("RPL: Sending unicast-DIO with rank %u to ",
       (unsigned)dag->rank);
   PRINT6ADDR(uc_addr);
   PRINTF("\n");
   uip_icmp6_send(uc_addr, ICMP6_RPL, RPL_CODE_DIO, pos);
 #else /* RPL_LEAF_ONLY */
+  TRACE(TRACE_RPL_DIO_OUT, instance->current_dag->rank, uc_addr != NULL);
   /* Unicast requests get unicast replies! */
   if(uc_addr == NULL) {
     PRINTF("RPL: Sending a multicast-DIO with rank %u\n",
@@ -649,6 +654,8 @@ dao_input(void)
     }
   }
 
+  TRACE(TRACE_RPL_DAO_IN, lifetime, sequence);
+
   PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
           (unsigned)lifetime, (unsigned)prefixlen);
   PRINT6ADDR(&prefix);
@@ -868,6 +875,7 @@ dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
   PRINTF("\n");
 
   if(rpl_get_parent_ipaddr(parent) != NULL) {
+    TRACE(TRACE_RPL_DAO_OUT, lifetime, dao_sequence);
     uip_icmp6_send(rpl_get_parent_ipaddr(parent), ICMP6_RPL, RPL_CODE_DAO, pos);
   }
 }
@@ -918,6 +926,8 @@ dao_ack_output(rpl_instance_t *instance, uip_ipaddr_t *dest, uint8_t sequence)
 void
 uip_rpl_input(void)
 {
+  unsigned char owner = ENERGEST_CPU_ENTER(ENERGEST_CPU_RPL);
+
   PRINTF("Received an RPL control message\n");
   switch(UIP_ICMP_BUF->icode) {
   case RPL_CODE_DIO:
@@ -938,5 +948,6 @@ uip_rpl_input(void)
   }
 
   uip_len = 0;
+  ENERGEST_CPU_LEAVE(owner);
 }
 #endif /* UIP_CONF_IPV6 */
\ No newline at end of file
@@ -43,6 +43,7 @@
 #include "net/rpl/rpl-private.h"
 #include "lib/random.h"
 #include "sys/ctimer.h"
+#include "sys/energest.h"
 
 #if UIP_CONF_IPV6
 
@@ -65,6 +66,8 @@ static uint8_t dio_send_ok;
 static void
 handle_periodic_timer(void *ptr)
 {
+  unsigned char owner = ENERGEST_CPU_ENTER(ENERGEST_CPU_RPL);
+
   rpl_purge_routes();
   rpl_recalculate_ranks();
 
@@ -77,6 +80,7 @@ handle_periodic_timer(void *ptr)
   }
 #endif
   ctimer_reset(&periodic_timer);
+  ENERGEST_CPU_LEAVE(owner);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -128,6 +132,7 @@ static void
 handle_dio_timer(void *ptr)
 {
   rpl_instance_t *instance;
+  unsigned char owner = ENERGEST_CPU_ENTER(ENERGEST_CPU_RPL);
 
   instance = (rpl_instance_t *)ptr;
 
@@ -138,6 +143,7 @@ handle_dio_timer(void *ptr)
     } else {
       PRINTF("RPL: Postponing DIO transmission since link local address is not ok\n");
       ctimer_set(&instance->dio_timer, CLOCK_SECOND, &handle_dio_timer, instance);
+      ENERGEST_CPU_LEAVE(owner);
       return;
     }
   }
@@ -165,6 +171,7 @@ handle_dio_timer(void *ptr)
     }
     new_dio_interval(instance);
   }
+  ENERGEST_CPU_LEAVE(owner);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -220,12 +227,14 @@ static void
 handle_dao_timer(void *ptr)
 {
   rpl_instance_t *instance;
+  unsigned char owner = ENERGEST_CPU_ENTER(ENERGEST_CPU_RPL);
 
   instance = (rpl_instance_t *)ptr;
 
   if(!dio_send_ok && uip_ds6_get_link_local(ADDR_PREFERRED) == NULL) {
     PRINTF("RPL: Postpone DAO transmission\n");
     ctimer_set(&instance->dao_timer, CLOCK_SECOND, handle_dao_timer, instance);
+    ENERGEST_CPU_LEAVE(owner);
     return;
   }
 
@@ -243,6 +252,7 @@ handle_dao_timer(void *ptr)
   if(etimer_expired(&instance->dao_lifetime_timer.etimer)) {
     set_dao_lifetime_timer(instance);
   }
+  ENERGEST_CPU_LEAVE(owner);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -51,6 +51,7 @@
 
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
+#include "sys/trace.h"
 
 #if UIP_LOGGING
 #include <stdio.h>
@@ -180,6 +181,19 @@ check_for_tcp_syn(void)
 #endif /* UIP_TCP || UIP_CONF_IP_FORWARD */
 }
 /*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_CONF_IPV6 && UIP_TCP_WINDOW > 1
+/* uIP sends one segment per call. While the application of a
+   connection can fill more of the send window, poll it again instead
+   of waiting for the periodic timer. */
+#define tcp_window_poll(conn) do {                  \
+    if((conn) != NULL && uip_tcp_sendable(conn)) {  \
+      tcpip_poll_tcp(conn);                         \
+    }                                               \
+  } while(0)
+#else /* UIP_TCP && UIP_CONF_IPV6 && UIP_TCP_WINDOW > 1 */
+#define tcp_window_poll(conn)
+#endif /* UIP_TCP && UIP_CONF_IPV6 && UIP_TCP_WINDOW > 1 */
+/*---------------------------------------------------------------------------*/
 static void
 packet_input(void)
 {
@@ -221,6 +235,7 @@ packet_input(void)
 #endif
 #endif /* UIP_CONF_TCP_SPLIT */
     }
+    tcp_window_poll(uip_conn);
   }
 #endif /* UIP_CONF_IP_FORWARD */
 }
@@ -413,7 +428,7 @@ eventhandler(process_event_t ev, process_data_t data)
         for(cptr = &uip_udp_conns[0];
             cptr < &uip_udp_conns[UIP_UDP_CONNS]; ++cptr) {
           if(cptr->appstate.p == p) {
-            cptr->lport = 0;
+            uip_udp_remove(cptr);
           }
         }
       }
@@ -435,7 +450,12 @@ eventhandler(process_event_t ev, process_data_t data)
               etimer_restart(&periodic);
               uip_periodic(i);
 #if UIP_CONF_IPV6
+#if UIP_CONF_TCP_SPLIT
+              uip_split_output();
+#else /* UIP_CONF_TCP_SPLIT */
               tcpip_ipv6_output();
+#endif /* UIP_CONF_TCP_SPLIT */
+              tcp_window_poll(&uip_conns[i]);
 #else
               if(uip_len > 0) {
                 PRINTF("tcpip_output from periodic len %d\n", uip_len);
@@ -492,7 +512,12 @@ eventhandler(process_event_t ev, process_data_t data)
       if(data != NULL) {
         uip_poll_conn(data);
 #if UIP_CONF_IPV6
+#if UIP_CONF_TCP_SPLIT
+        uip_split_output();
+#else /* UIP_CONF_TCP_SPLIT */
         tcpip_ipv6_output();
+#endif /* UIP_CONF_TCP_SPLIT */
+        tcp_window_poll((struct uip_conn *)data);
 #else /* UIP_CONF_IPV6 */
         if(uip_len > 0) {
           PRINTF("tcpip_output from tcp poll len %d\n", uip_len);
@@ -528,6 +553,7 @@ eventhandler(process_event_t ev, process_data_t data)
 void
 tcpip_input(void)
 {
+  TRACE(TRACE_UIP_IN, uip_len, UIP_IP_BUF->proto);
   process_post_synch(&tcpip_process, PACKET_INPUT, NULL);
   uip_len = 0;
 #if UIP_CONF_IPV6
@@ -558,6 +584,8 @@ tcpip_ipv6_output(void)
     return;
   }
 
+  TRACE(TRACE_UIP_OUT, uip_len, UIP_IP_BUF->proto);
+
   if(!uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
     /* Next hop determination */
     nbr = NULL;
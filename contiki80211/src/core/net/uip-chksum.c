@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *         Internet checksum over 32-bit words.
+ *
+ *         The one's complement sum does not depend on byte order: words
+ *         are read in host order and the folded sum is swapped at the
+ *         end. Data that starts on an odd address is summed as if it
+ *         were preceded by a zero byte, which swaps the bytes of the
+ *         sum once more.
+ */
+#include "net/uip-chksum.h"
+#include "net/uip.h"
+#include <string.h>
+
+#define SWAP16(x) ((uint16_t)(((x) << 8) | ((x) >> 8)))
+
+/*---------------------------------------------------------------------------*/
+static uint16_t
+fold(uint64_t acc)
+{
+  acc = (acc & 0xffffffff) + (acc >> 32);
+  acc = (acc & 0xffffffff) + (acc >> 32);
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
+  return (uint16_t)acc;
+}
+/*---------------------------------------------------------------------------*/
+/* Add the folded host order sum of a buffer to a host byte order sum */
+static uint16_t
+finish(uint16_t sum, uint64_t acc, uint8_t odd)
+{
+  uint16_t t = fold(acc);
+  if(odd) {
+    t = SWAP16(t);
+  }
+  t = UIP_HTONS(t);
+  sum += t;
+  if(sum < t) {
+    sum++;      /* carry */
+  }
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+/* The first byte of an odd-aligned buffer, as the second byte of a word */
+static uint16_t
+odd_head(uint8_t b)
+{
+  union { uint8_t u8[2]; uint16_t u16; } w;
+  w.u8[0] = 0;
+  w.u8[1] = b;
+  return w.u16;
+}
+/*---------------------------------------------------------------------------*/
+/* The last byte of a buffer, padded with zero */
+static uint16_t
+tail(uint8_t b)
+{
+  union { uint8_t u8[2]; uint16_t u16; } w;
+  w.u8[0] = b;
+  w.u8[1] = 0;
+  return w.u16;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint64_t acc = 0;
+  uint8_t odd = 0;
+  const uint32_t *w;
+
+  if(len == 0) {
+    return sum;
+  }
+  if((uintptr_t)data & 1) {
+    acc += odd_head(*data);
+    data++;
+    len--;
+    odd = 1;
+  }
+  if(((uintptr_t)data & 2) && len >= 2) {
+    acc += *(const uint16_t *)data;
+    data += 2;
+    len -= 2;
+  }
+
+  w = (const uint32_t *)data;
+  while(len >= 16) {
+    acc += w[0];
+    acc += w[1];
+    acc += w[2];
+    acc += w[3];
+    w += 4;
+    len -= 16;
+  }
+  while(len >= 4) {
+    acc += *w++;
+    len -= 4;
+  }
+
+  data = (const uint8_t *)w;
+  if(len >= 2) {
+    acc += *(const uint16_t *)data;
+    data += 2;
+    len -= 2;
+  }
+  if(len == 1) {
+    acc += tail(*data);
+  }
+  return finish(sum, acc, odd);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_copy(uint16_t sum, uint8_t *dst, const uint8_t *src, uint16_t len)
+{
+  uint64_t acc = 0;
+  uint8_t odd = 0;
+  const uint32_t *s;
+  uint32_t *d;
+
+  if(((uintptr_t)dst ^ (uintptr_t)src) & 3) {
+    /* The buffers cannot be walked word by word together. */
+    memcpy(dst, src, len);
+    return uip_chksum_add(sum, dst, len);
+  }
+  if(len == 0) {
+    return sum;
+  }
+  if((uintptr_t)src & 1) {
+    acc += odd_head(*src);
+    *dst++ = *src++;
+    len--;
+    odd = 1;
+  }
+  if(((uintptr_t)src & 2) && len >= 2) {
+    acc += *(const uint16_t *)src;
+    *(uint16_t *)dst = *(const uint16_t *)src;
+    src += 2;
+    dst += 2;
+    len -= 2;
+  }
+
+  s = (const uint32_t *)src;
+  d = (uint32_t *)dst;
+  while(len >= 16) {
+    acc += d[0] = s[0];
+    acc += d[1] = s[1];
+    acc += d[2] = s[2];
+    acc += d[3] = s[3];
+    s += 4;
+    d += 4;
+    len -= 16;
+  }
+  while(len >= 4) {
+    acc += *d++ = *s++;
+    len -= 4;
+  }
+
+  src = (const uint8_t *)s;
+  dst = (uint8_t *)d;
+  if(len >= 2) {
+    acc += *(const uint16_t *)src;
+    *(uint16_t *)dst = *(const uint16_t *)src;
+    src += 2;
+    dst += 2;
+    len -= 2;
+  }
+  if(len == 1) {
+    acc += tail(*src);
+    *dst = *src;
+  }
+  return finish(sum, acc, odd);
+}
+/*---------------------------------------------------------------------------*/
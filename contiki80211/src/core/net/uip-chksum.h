@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *         Internet checksum (RFC 1071) over 32-bit words, and a copy
+ *         that checksums what it copies.
+ */
+#ifndef UIP_CHKSUM_H_
+#define UIP_CHKSUM_H_
+
+#include <stdint.h>
+
+/*
+ * Add the 16-bit big-endian words of data to sum, with end-around
+ * carry. An odd last byte is padded with zero. The sum is in host byte
+ * order.
+ */
+uint16_t uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len);
+
+/*
+ * Copy len bytes from src to dst and return sum with the copied bytes
+ * added, as uip_chksum_add() would. The buffers must not overlap.
+ */
+uint16_t uip_chksum_copy(uint16_t sum, uint8_t *dst, const uint8_t *src,
+                         uint16_t len);
+
+#endif /* UIP_CHKSUM_H_ */
@@ -49,6 +49,15 @@
 #define UIP_SPLIT_SIZE UIP_TCP_MSS
 #endif /* UIP_SPLIT_CONF_SIZE */
 
+#if UIP_CONF_IPV6
+/* Sending the first packet may leave something else in uip_buf: a
+   neighbor solicitation, or a packet that was queued waiting for the
+   neighbor. The headers and the second half of the data are kept
+   here meanwhile. */
+static uint8_t split_buf[UIP_TCPIP_HLEN +
+                         (UIP_BUFSIZE - UIP_LLH_LEN - UIP_TCPIP_HLEN + 1) / 2];
+#endif /* UIP_CONF_IPV6 */
+
 /*-----------------------------------------------------------------------------*/
 void
 uip_split_output(void)
@@ -70,6 +79,11 @@ uip_split_output(void)
       ++len2;
     }
 
+#if UIP_CONF_IPV6
+    memcpy(split_buf, BUF, UIP_TCPIP_HLEN);
+    memcpy(split_buf + UIP_TCPIP_HLEN, (uint8_t *)uip_appdata + len1, len2);
+#endif /* UIP_CONF_IPV6 */
+
     /* Create the first packet. This is done by altering the length
        field of the IP header and updating the checksums. */
     uip_len = len1 + UIP_TCPIP_HLEN;
@@ -108,6 +122,7 @@ uip_split_output(void)
        packet (len1). */
     uip_len = len2 + UIP_TCPIP_HLEN;
 #if UIP_CONF_IPV6
+    memcpy(BUF, split_buf, uip_len);
     /* For IPv6, the IP length field does not include the IPv6 IP header
        length. */
     BUF->len[0] = ((uip_len - UIP_IPH_LEN) >> 8);
@@ -115,10 +130,10 @@ uip_split_output(void)
 #else /* UIP_CONF_IPV6 */
     BUF->len[0] = uip_len >> 8;
     BUF->len[1] = uip_len & 0xff;
-#endif /* UIP_CONF_IPV6 */
     
     /*    uip_appdata += len1;*/
-    memcpy(uip_appdata, (uint8_t *)uip_appdata + len1, len2);
+    memmove(uip_appdata, (uint8_t *)uip_appdata + len1, len2);
+#endif /* UIP_CONF_IPV6 */
 
     uip_add32(BUF->seqno, len1);
     BUF->seqno[0] = uip_acc32[0];
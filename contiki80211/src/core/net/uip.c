@@ -74,6 +74,7 @@
 #include "net/uipopt.h"
 #include "net/uip_arp.h"
 #include "net/uip_arch.h"
+#include "net/uip-chksum.h"
 
 #if !UIP_CONF_IPV6 /* If UIP_CONF_IPV6 is defined, we compile the
                       uip6.c file instead of this one. Therefore
@@ -266,37 +267,8 @@ uip_add32(uint8_t *op32, uint16_t op16)
 #endif /* UIP_ARCH_ADD32 */
 
 #if ! UIP_ARCH_CHKSUM
-/*---------------------------------------------------------------------------*/
-static uint16_t
-chksum(uint16_t sum, const uint8_t *data, uint16_t len)
-{
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-  
-  while(dataptr < last_byte) {        /* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;                /* carry */
-    }
-    dataptr += 2;
-  }
-  
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;                /* carry */
-    }
-  }
-
-  /* Return sum in host byte order. */
-  return sum;
-}
+/* Sums 32-bit words; returns the sum in host byte order. */
+#define chksum(sum, data, len) uip_chksum_add(sum, data, len)
 /*---------------------------------------------------------------------------*/
 uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
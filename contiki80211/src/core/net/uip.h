@@ -445,7 +445,7 @@ void uip_setipid(uint16_t id);
     uip_process(UIP_UDP_TIMER); } while(0)
 #endif /* UIP_UDP */
 
-/** \brief Abandon the reassembly of the current packet */
+/** \brief Abandon the reassembly of the oldest packet, if its time is up */
 void uip_reass_over(void);
 
 /**
@@ -573,6 +573,21 @@ struct uip_conn *uip_connect(uip_ipaddr_t *ripaddr, uint16_t port);
  */
 #define uip_outstanding(conn) ((conn)->len)
 
+#if UIP_TCP_WINDOW > 1
+/**
+ * \internal
+ *
+ * Check if the application of a connection is waiting to hear that
+ * its data has been sent, and the send window has room for more.
+ *
+ * The stack uses this to poll the connection again right away, so
+ * that the window fills up without waiting for the periodic timer.
+ *
+ * \param conn A pointer to the uip_conn structure for the connection.
+ */
+int uip_tcp_sendable(struct uip_conn *conn);
+#endif /* UIP_TCP_WINDOW > 1 */
+
 /**
  * Send data on the current connection.
  *
@@ -828,6 +843,28 @@ CCIF void uip_send(const void *data, int len);
  */
 struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
 
+#if UIP_CONF_IPV6
+/**
+ * Remove a UDP connection.
+ *
+ * The local port of a UDP connection must only be changed with
+ * uip_udp_remove() and uip_udp_bind(), which keep the demultiplexing
+ * table up to date.
+ *
+ * \param conn A pointer to the uip_udp_conn structure for the connection.
+ */
+void uip_udp_remove(struct uip_udp_conn *conn);
+
+/**
+ * Bind a UDP connection to a local port.
+ *
+ * \param conn A pointer to the uip_udp_conn structure for the
+ * connection.
+ *
+ * \param port The local port number, in network byte order.
+ */
+void uip_udp_bind(struct uip_udp_conn *conn, uint16_t port);
+#else /* UIP_CONF_IPV6 */
 /**
  * Remove a UDP connection.
  *
@@ -848,6 +885,7 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
  * \hideinitializer
  */
 #define uip_udp_bind(conn, port) (conn)->lport = port
+#endif /* UIP_CONF_IPV6 */
 
 /**
  * Send a UDP datagram of length len on the current connection.
@@ -1278,6 +1316,17 @@ CCIF extern uint16_t uip_len;
  * The length of the extension headers
  */
 extern uint8_t uip_ext_len;
+
+#if UIP_CONF_IPV6
+/**
+ * The sum of the bytes after the IPv6 header of the packet in uip_buf,
+ * as returned by uip_chksum_add(), and the number of bytes it covers.
+ * A link layer that checksums the packet while copying it in sets
+ * these before uip_input(); the transport checksum check then only
+ * sums the pseudo header. uip_process() clears them.
+ */
+extern uint16_t uip_rx_chksum, uip_rx_chksum_len;
+#endif /* UIP_CONF_IPV6 */
 /** @} */
 
 #if UIP_URGDATA > 0
@@ -1320,6 +1369,13 @@ struct uip_conn {
   uint8_t timer;         /**< The retransmission timer. */
   uint8_t nrtx;          /**< The number of retransmissions for the last
 			 segment sent. */
+#if UIP_TCP_WINDOW > 1
+  uint16_t snd_wnd;      /**< The window last advertised by the remote
+			 host. */
+  uint8_t sndflags;      /**< State of the retransmission buffer. */
+  uint8_t dupacks;       /**< The number of duplicate ACKs received in a
+			 row. */
+#endif /* UIP_TCP_WINDOW > 1 */
 
   /** The application state. */
   uip_tcp_appstate_t appstate;
@@ -1462,6 +1518,20 @@ struct uip_stats {
     uip_stats_t recv;     /**< Number of recived ND6 packets */
     uip_stats_t sent;     /**< Number of sent ND6 packets */
   } nd6;
+#if UIP_CONF_IPV6_REASSEMBLY
+  struct {
+    uip_stats_t done;     /**< Number of packets reassembled. */
+    uip_stats_t timeout;  /**< Number of packets dropped because not
+			     all fragments came in time. */
+    uip_stats_t evicted;  /**< Number of packets dropped to make room
+			     for a newer one. */
+    uip_stats_t toolong;  /**< Number of packets dropped because they
+			     did not fit the reassembly buffer. */
+    uip_stats_t badlen;   /**< Number of packets dropped because of a
+			     fragment length that is not a multiple
+			     of 8. */
+  } reass;                /**< IPv6 reassembly statistics. */
+#endif /* UIP_CONF_IPV6_REASSEMBLY */
 #endif /*UIP_CONF_IPV6*/
 };
 
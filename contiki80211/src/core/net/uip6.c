@@ -75,6 +75,7 @@
 #include "net/uip-icmp6.h"
 #include "net/uip-nd6.h"
 #include "net/uip-ds6.h"
+#include "net/uip-chksum.h"
 
 #include <string.h>
 
@@ -133,6 +134,8 @@ uint8_t uip_ext_bitmap = 0;
  * a header
  */
 uint8_t uip_ext_len = 0;
+/** \brief sum of the upper layer data summed by the link layer, and its length */
+uint16_t uip_rx_chksum, uip_rx_chksum_len;
 /** \brief length of the header options read */
 uint8_t uip_ext_opt_offset = 0;
 /** @} */
@@ -143,7 +146,7 @@ uint8_t uip_ext_opt_offset = 0;
 /** \name Buffer defines
  *  @{
  */
-#define FBUF                             ((struct uip_tcpip_hdr *)&uip_reassbuf[0])
+#define FBUF(r)                          ((struct uip_tcpip_hdr *)&(r)->buf[0])
 #define UIP_IP_BUF                          ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define UIP_ICMP_BUF                      ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
 #define UIP_UDP_BUF                        ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
@@ -199,6 +202,87 @@ struct uip_conn *uip_conn;
 static uint8_t c;
 #endif
 
+#if (UIP_TCP || UIP_UDP)
+/*
+ * Demultiplexing tables. Each table chains the entries of a connection
+ * array by a hash of their key, in array order, so that the first
+ * entry that matches a packet is the same as with a scan of the whole
+ * array. UDP connections are hashed by local port, TCP connections by
+ * local port, remote port and remote address, and listening ports by
+ * port. The chains only change where the keys are set.
+ */
+#ifdef UIP_CONF_DEMUX_BUCKETS
+#define UIP_DEMUX_BUCKETS UIP_CONF_DEMUX_BUCKETS
+#else
+#define UIP_DEMUX_BUCKETS 16
+#endif
+
+#if UIP_DEMUX_BUCKETS & (UIP_DEMUX_BUCKETS - 1)
+#error "UIP_CONF_DEMUX_BUCKETS must be a power of two"
+#endif
+
+#define DEMUX_NONE 0xff
+
+#if UIP_CONNS >= DEMUX_NONE || UIP_LISTENPORTS >= DEMUX_NONE || \
+    UIP_UDP_CONNS >= DEMUX_NONE
+#error "Too many connections for the demultiplexing tables"
+#endif
+
+struct demux {
+  uint8_t *head;    /* First entry of each bucket */
+  uint8_t *next;    /* Next entry in the bucket of each entry */
+  uint8_t *bucket;  /* Bucket of each entry, or DEMUX_NONE */
+  uint8_t num;
+};
+
+#define DEMUX(name, num)                                        \
+  static uint8_t name##_head[UIP_DEMUX_BUCKETS];                \
+  static uint8_t name##_next[num], name##_bucket[num];          \
+  static const struct demux name = { name##_head, name##_next,  \
+                                     name##_bucket, num }
+
+/*---------------------------------------------------------------------------*/
+static uint8_t
+demux_hash(uint16_t lport, uint16_t rport, const uip_ipaddr_t *ripaddr)
+{
+  uint16_t h = lport ^ rport;
+  if(ripaddr != NULL) {
+    h ^= ripaddr->u16[7];
+  }
+  return (h ^ (h >> 8)) & (UIP_DEMUX_BUCKETS - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+demux_init(const struct demux *d)
+{
+  memset(d->head, DEMUX_NONE, UIP_DEMUX_BUCKETS);
+  memset(d->bucket, DEMUX_NONE, d->num);
+}
+/*---------------------------------------------------------------------------*/
+static void
+demux_remove(const struct demux *d, uint8_t i)
+{
+  uint8_t *p;
+  if(d->bucket[i] == DEMUX_NONE) {
+    return;
+  }
+  for(p = &d->head[d->bucket[i]]; *p != i; p = &d->next[*p]);
+  *p = d->next[i];
+  d->bucket[i] = DEMUX_NONE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+demux_add(const struct demux *d, uint8_t i, uint8_t bucket)
+{
+  uint8_t *p;
+  demux_remove(d, i);
+  for(p = &d->head[bucket]; *p != DEMUX_NONE && *p < i; p = &d->next[*p]);
+  d->next[i] = *p;
+  *p = i;
+  d->bucket[i] = bucket;
+}
+#endif /* UIP_TCP || UIP_UDP */
+
 #if UIP_ACTIVE_OPEN || UIP_UDP
 /* Keeps track of the last port used for a new connection. */
 static uint16_t lastport;
@@ -233,9 +317,30 @@ static uint16_t lastport;
 /* The uip_conns array holds all TCP connections. */
 struct uip_conn uip_conns[UIP_CONNS];
 
+#if UIP_TCP_WINDOW > 1
+/* Flags in uip_conn->sndflags. */
+#define SND_ACKED   0x01 /* The application's last data has been buffered,
+                            but the application has not been told. */
+#define SND_REFUSED 0x02 /* The application's last data did not fit and
+                            is to be sent again. */
+#define SND_RTT     0x04 /* The oldest segment is timed for the RTT. */
+#define SND_RECOVER 0x08 /* Lost data is being retransmitted. */
+#define SND_FIN     0x10 /* The application has closed the connection. */
+
+#define UIP_TCP_SNDBUF (UIP_TCP_WINDOW * UIP_TCP_MSS)
+
+/* The retransmission buffer of each connection holds the ->len bytes
+   from ->snd_nxt on that are yet to be acknowledged. */
+static uint8_t uip_sndbuf[UIP_CONNS][UIP_TCP_SNDBUF];
+#define SNDBUF(conn) uip_sndbuf[(conn) - uip_conns]
+#endif /* UIP_TCP_WINDOW > 1 */
+
 /* The uip_listenports list all currently listning ports. */
 uint16_t uip_listenports[UIP_LISTENPORTS];
 
+DEMUX(tcp_demux, UIP_CONNS);
+DEMUX(listen_demux, UIP_LISTENPORTS);
+
 /* The iss variable is used for the TCP initial sequence number. */
 static uint8_t iss[4];
 
@@ -252,6 +357,11 @@ static uint16_t tmp16;
 #if UIP_UDP
 struct uip_udp_conn *uip_udp_conn;
 struct uip_udp_conn uip_udp_conns[UIP_UDP_CONNS];
+
+DEMUX(udp_demux, UIP_UDP_CONNS);
+/* Connected UDP connections that were last matched for a remote port
+   and address; cleared whenever a local port changes. */
+static uint8_t udp_flow[UIP_DEMUX_BUCKETS];
 #endif /* UIP_UDP */
 /** @} */
 
@@ -298,37 +408,8 @@ uip_add32(uint8_t *op32, uint16_t op16)
 #endif /* UIP_ARCH_ADD32 && UIP_TCP */
 
 #if ! UIP_ARCH_CHKSUM
-/*---------------------------------------------------------------------------*/
-static uint16_t
-chksum(uint16_t sum, const uint8_t *data, uint16_t len)
-{
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-  
-  while(dataptr < last_byte) {   /* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
-    }
-    dataptr += 2;
-  }
-  
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
-    }
-  }
-
-  /* Return sum in host byte order. */
-  return sum;
-}
+/* Sums 32-bit words; returns the sum in host byte order. */
+#define chksum(sum, data, len) uip_chksum_add(sum, data, len)
 /*---------------------------------------------------------------------------*/
 uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
@@ -381,6 +462,32 @@ upper_layer_chksum(uint8_t proto)
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
 /*---------------------------------------------------------------------------*/
+/* Checksum of a received packet. If the link layer has summed exactly
+   the upper layer data while copying the packet in, only the pseudo
+   header is summed here. The link layer sum is used once. */
+static uint16_t
+upper_layer_rx_chksum(uint8_t proto)
+{
+  uint16_t upper_layer_len;
+  uint16_t sum;
+
+  upper_layer_len = ((uint16_t)(UIP_IP_BUF->len[0]) << 8) + UIP_IP_BUF->len[1];
+  if(uip_ext_len != 0 || upper_layer_len == 0 ||
+     uip_rx_chksum_len != upper_layer_len) {
+    uip_rx_chksum_len = 0;
+    return upper_layer_chksum(proto);
+  }
+  uip_rx_chksum_len = 0;
+
+  sum = upper_layer_len + proto;
+  sum = chksum(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
+  sum += uip_rx_chksum;
+  if(sum < uip_rx_chksum) {
+    sum++;      /* carry */
+  }
+  return (sum == 0) ? 0xffff : uip_htons(sum);
+}
+/*---------------------------------------------------------------------------*/
 uint16_t
 uip_icmp6chksum(void)
 {
@@ -403,6 +510,26 @@ uip_udpchksum(void)
   return upper_layer_chksum(UIP_PROTO_UDP);
 }
 #endif /* UIP_UDP && UIP_UDP_CHECKSUMS */
+#else /* UIP_ARCH_CHKSUM */
+/*---------------------------------------------------------------------------*/
+/* The architecture checksum does not use the link layer sum. */
+static uint16_t
+upper_layer_rx_chksum(uint8_t proto)
+{
+  uip_rx_chksum_len = 0;
+  switch(proto) {
+#if UIP_TCP
+  case UIP_PROTO_TCP:
+    return uip_tcpchksum();
+#endif /* UIP_TCP */
+#if UIP_UDP && UIP_UDP_CHECKSUMS
+  case UIP_PROTO_UDP:
+    return uip_udpchksum();
+#endif /* UIP_UDP && UIP_UDP_CHECKSUMS */
+  default:
+    return uip_icmp6chksum();
+  }
+}
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
 void
@@ -418,6 +545,8 @@ uip_init(void)
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = UIP_CLOSED;
   }
+  demux_init(&tcp_demux);
+  demux_init(&listen_demux);
 #endif /* UIP_TCP */
 
 #if UIP_ACTIVE_OPEN || UIP_UDP
@@ -428,6 +557,8 @@ uip_init(void)
   for(c = 0; c < UIP_UDP_CONNS; ++c) {
     uip_udp_conns[c].lport = 0;
   }
+  demux_init(&udp_demux);
+  memset(udp_flow, DEMUX_NONE, sizeof(udp_flow));
 #endif /* UIP_UDP */
 }
 /*---------------------------------------------------------------------------*/
@@ -494,9 +625,15 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
   conn->rto = UIP_RTO;
   conn->sa = 0;
   conn->sv = 16;   /* Initial value of the RTT variance. */
+#if UIP_TCP_WINDOW > 1
+  conn->snd_wnd = 0;
+  conn->sndflags = conn->dupacks = 0;
+#endif /* UIP_TCP_WINDOW > 1 */
   conn->lport = uip_htons(lastport);
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
+  demux_add(&tcp_demux, conn - uip_conns,
+            demux_hash(conn->lport, conn->rport, &conn->ripaddr));
   
   return conn;
 }
@@ -567,9 +704,28 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
     uip_ipaddr_copy(&conn->ripaddr, ripaddr);
   }
   conn->ttl = uip_ds6_if.cur_hop_limit;
+  uip_udp_bind(conn, conn->lport);
   
   return conn;
 }
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_bind(struct uip_udp_conn *conn, uint16_t port)
+{
+  conn->lport = port;
+  if(port == 0) {
+    demux_remove(&udp_demux, conn - uip_udp_conns);
+  } else {
+    demux_add(&udp_demux, conn - uip_udp_conns, demux_hash(port, 0, NULL));
+  }
+  memset(udp_flow, DEMUX_NONE, sizeof(udp_flow));
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_remove(struct uip_udp_conn *conn)
+{
+  uip_udp_bind(conn, 0);
+}
 #endif /* UIP_UDP */
 /*---------------------------------------------------------------------------*/
 #if UIP_TCP
@@ -579,6 +735,7 @@ uip_unlisten(uint16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == port) {
       uip_listenports[c] = 0;
+      demux_remove(&listen_demux, c);
       return;
     }
   }
@@ -590,6 +747,7 @@ uip_listen(uint16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == 0) {
       uip_listenports[c] = port;
+      demux_add(&listen_demux, c, demux_hash(port, 0, NULL));
       return;
     }
   }
@@ -600,19 +758,36 @@ uip_listen(uint16_t port)
 #if UIP_CONF_IPV6_REASSEMBLY
 #define UIP_REASS_BUFSIZE (UIP_BUFSIZE - UIP_LLH_LEN)
 
-static uint8_t uip_reassbuf[UIP_REASS_BUFSIZE];
+/*
+ * Up to UIP_CONF_IPV6_REASS_NUM packets are reassembled at once, each
+ * in its own context identified by source, destination and fragment
+ * id. When a fragment of a new packet comes in and all contexts are
+ * in use, the oldest packet is dropped. uip_reass_timer is set to the
+ * earliest deadline.
+ */
+struct uip_reass_ctx {
+  uint8_t buf[UIP_REASS_BUFSIZE];
+  /*the first byte of an IP fragment is aligned on an 8-byte boundary */
+  uint8_t bitmap[UIP_REASS_BUFSIZE / (8 * 8)];
+  clock_time_t deadline;
+  uint32_t id; /* For every packet that is to be fragmented, the source
+                  node generates an Identification value that is present
+                  in all the fragments */
+  uint16_t len;
+  uint8_t flags;
+};
 
-static uint8_t uip_reassbitmap[UIP_REASS_BUFSIZE / (8 * 8)];
-/*the first byte of an IP fragment is aligned on an 8-byte boundary */
+static struct uip_reass_ctx uip_reass_ctxs[UIP_CONF_IPV6_REASS_NUM];
 
 static const uint8_t bitmap_bits[8] = {0xff, 0x7f, 0x3f, 0x1f,
                                     0x0f, 0x07, 0x03, 0x01};
-static uint16_t uip_reasslen;
+/* Flags of the last fragment processed */
 static uint8_t uip_reassflags;
 
 #define UIP_REASS_FLAG_LASTFRAG 0x01
 #define UIP_REASS_FLAG_FIRSTFRAG 0x02
 #define UIP_REASS_FLAG_ERROR_MSG 0x04
+#define UIP_REASS_FLAG_ON 0x08
 
 
 /*
@@ -626,155 +801,210 @@ static uint8_t uip_reassflags;
 
 
 struct etimer uip_reass_timer; /* timer for reassembly */
-uint8_t uip_reass_on; /* equal to 1 if we are currently reassembling a packet */
+uint8_t uip_reass_on; /* number of packets being reassembled */
 
-static uint32_t uip_id; /* For every packet that is to be fragmented, the source
-                        node generates an Identification value that is present
-                        in all the fragments */
 #define IP_MF   0x0001
 
+/*---------------------------------------------------------------------------*/
+/* The context with the earliest deadline, or NULL */
+static struct uip_reass_ctx *
+uip_reass_oldest(void)
+{
+  struct uip_reass_ctx *r, *oldest = NULL;
+  for(r = uip_reass_ctxs; r < &uip_reass_ctxs[UIP_CONF_IPV6_REASS_NUM]; ++r) {
+    if((r->flags & UIP_REASS_FLAG_ON) &&
+       (oldest == NULL || (long)(r->deadline - oldest->deadline) < 0)) {
+      oldest = r;
+    }
+  }
+  return oldest;
+}
+/*---------------------------------------------------------------------------*/
+static void
+uip_reass_set_timer(void)
+{
+  struct uip_reass_ctx *oldest = uip_reass_oldest();
+  clock_time_t now = clock_time();
+
+  if(oldest == NULL) {
+    etimer_stop(&uip_reass_timer);
+  } else if((long)(oldest->deadline - now) > 0) {
+    etimer_set(&uip_reass_timer, oldest->deadline - now);
+  } else {
+    etimer_set(&uip_reass_timer, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+uip_reass_free(struct uip_reass_ctx *r)
+{
+  r->flags = 0;
+  uip_reass_on--;
+  uip_reass_set_timer();
+}
+/*---------------------------------------------------------------------------*/
+/* The context of the packet the fragment in uip_buf belongs to. A new
+   one is started if there is none. */
+static struct uip_reass_ctx *
+uip_reass_ctx(void)
+{
+  struct uip_reass_ctx *r, *free = NULL;
+
+  for(r = uip_reass_ctxs; r < &uip_reass_ctxs[UIP_CONF_IPV6_REASS_NUM]; ++r) {
+    if(!(r->flags & UIP_REASS_FLAG_ON)) {
+      free = r;
+    } else if(uip_ipaddr_cmp(&FBUF(r)->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
+              uip_ipaddr_cmp(&FBUF(r)->destipaddr, &UIP_IP_BUF->destipaddr) &&
+              UIP_FRAG_BUF->id == r->id) {
+      return r;
+    }
+  }
+
+  if(free == NULL) {
+    /* Make room by dropping the oldest packet. */
+    free = uip_reass_oldest();
+    PRINTF("Dropping oldest reassembly\n");
+    UIP_STAT(++uip_stat.reass.evicted);
+    uip_reass_on--;
+  }
+  r = free;
+
+  PRINTF("Starting reassembly\n");
+  /* We first write the unfragmentable part of IP header into the
+     reassembly buffer. The reset the other reassembly variables. */
+  memcpy(FBUF(r), UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
+  /* temporary in case we do not receive the fragment with offset 0 first */
+  r->deadline = clock_time() + UIP_REASS_MAXAGE * CLOCK_SECOND;
+  r->flags = UIP_REASS_FLAG_ON;
+  r->id = UIP_FRAG_BUF->id;
+  /* Clear the bitmap. */
+  memset(r->bitmap, 0, sizeof(r->bitmap));
+  uip_reass_on++;
+  uip_reass_set_timer();
+  return r;
+}
+/*---------------------------------------------------------------------------*/
 static uint16_t
 uip_reass(void)
 {
+  struct uip_reass_ctx *r;
   uint16_t offset=0;
   uint16_t len;
   uint16_t i;
+
+  uip_reassflags = 0;
+  r = uip_reass_ctx();
+
+  len = uip_len - uip_ext_len - UIP_IPH_LEN - UIP_FRAGH_LEN;
+  offset = (uip_ntohs(UIP_FRAG_BUF->offsetresmore) & 0xfff8);
+  /* in byte, originaly in multiple of 8 bytes*/
+  PRINTF("len %d\n", len);
+  PRINTF("offset %d\n", offset);
+  if(offset == 0){
+    r->flags |= UIP_REASS_FLAG_FIRSTFRAG;
+    /*
+     * The Next Header field of the last header of the Unfragmentable
+     * Part is obtained from the Next Header field of the first
+     * fragment's Fragment header.
+     */
+    *uip_next_hdr = UIP_FRAG_BUF->next;
+    memcpy(FBUF(r), UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
+    PRINTF("src ");
+    PRINT6ADDR(&FBUF(r)->srcipaddr);
+    PRINTF("dest ");
+    PRINT6ADDR(&FBUF(r)->destipaddr);
+    PRINTF("next %d\n", UIP_IP_BUF->proto);
+    
+  }
   
-  /* If ip_reasstmr is zero, no packet is present in the buffer */
-  /* We first write the unfragmentable part of IP header into the reassembly
-     buffer. The reset the other reassembly variables. */
-  if(uip_reass_on == 0) {
-    PRINTF("Starting reassembly\n");
-    memcpy(FBUF, UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
-    /* temporary in case we do not receive the fragment with offset 0 first */
-    etimer_set(&uip_reass_timer, UIP_REASS_MAXAGE*CLOCK_SECOND);
-    uip_reass_on = 1;
-    uip_reassflags = 0;
-    uip_id = UIP_FRAG_BUF->id;
-    /* Clear the bitmap. */
-    memset(uip_reassbitmap, 0, sizeof(uip_reassbitmap));
+  /* If the offset or the offset + fragment length overflows the
+     reassembly buffer, we discard the entire packet. */
+  if(offset > UIP_REASS_BUFSIZE ||
+     offset + len > UIP_REASS_BUFSIZE) {
+    UIP_STAT(++uip_stat.reass.toolong);
+    uip_reass_free(r);
+    return 0;
   }
-  /*
-   * Check if the incoming fragment matches the one currently present
-   * in the reasembly buffer. If so, we proceed with copying the fragment
-   * into the buffer.
-   */
-  if(uip_ipaddr_cmp(&FBUF->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
-     uip_ipaddr_cmp(&FBUF->destipaddr, &UIP_IP_BUF->destipaddr) &&
-     UIP_FRAG_BUF->id == uip_id) {
-    len = uip_len - uip_ext_len - UIP_IPH_LEN - UIP_FRAGH_LEN;
-    offset = (uip_ntohs(UIP_FRAG_BUF->offsetresmore) & 0xfff8);
-    /* in byte, originaly in multiple of 8 bytes*/
-    PRINTF("len %d\n", len);
-    PRINTF("offset %d\n", offset);
-    if(offset == 0){
-      uip_reassflags |= UIP_REASS_FLAG_FIRSTFRAG;
-      /*
-       * The Next Header field of the last header of the Unfragmentable
-       * Part is obtained from the Next Header field of the first
-       * fragment's Fragment header.
-       */
-      *uip_next_hdr = UIP_FRAG_BUF->next;
-      memcpy(FBUF, UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
-      PRINTF("src ");
-      PRINT6ADDR(&FBUF->srcipaddr);
-      PRINTF("dest ");
-      PRINT6ADDR(&FBUF->destipaddr);
-      PRINTF("next %d\n", UIP_IP_BUF->proto);
-      
-    }
-    
-    /* If the offset or the offset + fragment length overflows the
-       reassembly buffer, we discard the entire packet. */
-    if(offset > UIP_REASS_BUFSIZE ||
-       offset + len > UIP_REASS_BUFSIZE) {
-      uip_reass_on = 0;
-      etimer_stop(&uip_reass_timer);
-      return 0;
-    }
 
-    /* If this fragment has the More Fragments flag set to zero, it is the
-       last fragment*/
-    if((uip_ntohs(UIP_FRAG_BUF->offsetresmore) & IP_MF) == 0) {
-      uip_reassflags |= UIP_REASS_FLAG_LASTFRAG;
-      /*calculate the size of the entire packet*/
-      uip_reasslen = offset + len;
-      PRINTF("LAST FRAGMENT reasslen %d\n", uip_reasslen);
-    } else {
-      /* If len is not a multiple of 8 octets and the M flag of that fragment
-         is 1, then that fragment must be discarded and an ICMP Parameter
-         Problem, Code 0, message should be sent to the source of the fragment,
-         pointing to the Payload Length field of the fragment packet. */
-      if(len % 8 != 0){
-        uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, 4);
-        uip_reassflags |= UIP_REASS_FLAG_ERROR_MSG;
-        /* not clear if we should interrupt reassembly, but it seems so from
-           the conformance tests */
-        uip_reass_on = 0;
-        etimer_stop(&uip_reass_timer);
-        return uip_len;
-      }
+  /* If this fragment has the More Fragments flag set to zero, it is the
+     last fragment*/
+  if((uip_ntohs(UIP_FRAG_BUF->offsetresmore) & IP_MF) == 0) {
+    r->flags |= UIP_REASS_FLAG_LASTFRAG;
+    /*calculate the size of the entire packet*/
+    r->len = offset + len;
+    PRINTF("LAST FRAGMENT reasslen %d\n", r->len);
+  } else {
+    /* If len is not a multiple of 8 octets and the M flag of that fragment
+       is 1, then that fragment must be discarded and an ICMP Parameter
+       Problem, Code 0, message should be sent to the source of the fragment,
+       pointing to the Payload Length field of the fragment packet. */
+    if(len % 8 != 0){
+      uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, 4);
+      uip_reassflags |= UIP_REASS_FLAG_ERROR_MSG;
+      UIP_STAT(++uip_stat.reass.badlen);
+      /* not clear if we should interrupt reassembly, but it seems so from
+         the conformance tests */
+      uip_reass_free(r);
+      return uip_len;
     }
-    
-    /* Copy the fragment into the reassembly buffer, at the right
-       offset. */
-    memcpy((uint8_t *)FBUF + UIP_IPH_LEN + uip_ext_len + offset,
-           (uint8_t *)UIP_FRAG_BUF + UIP_FRAGH_LEN, len);
-    
-    /* Update the bitmap. */
-    if(offset >> 6 == (offset + len) >> 6) {
-      uip_reassbitmap[offset >> 6] |=
-        bitmap_bits[(offset >> 3) & 7] &
-        ~bitmap_bits[((offset + len) >> 3)  & 7];
-    } else {
-      /* If the two endpoints are in different bytes, we update the
-         bytes in the endpoints and fill the stuff inbetween with
-         0xff. */
-      uip_reassbitmap[offset >> 6] |= bitmap_bits[(offset >> 3) & 7];
- 
-      for(i = (1 + (offset >> 6)); i < ((offset + len) >> 6); ++i) {
-        uip_reassbitmap[i] = 0xff;
-      }
-      uip_reassbitmap[(offset + len) >> 6] |=
-        ~bitmap_bits[((offset + len) >> 3) & 7];
+  }
+  
+  /* Copy the fragment into the reassembly buffer, at the right
+     offset. */
+  memcpy((uint8_t *)FBUF(r) + UIP_IPH_LEN + uip_ext_len + offset,
+         (uint8_t *)UIP_FRAG_BUF + UIP_FRAGH_LEN, len);
+  
+  /* Update the bitmap. */
+  if(offset >> 6 == (offset + len) >> 6) {
+    r->bitmap[offset >> 6] |=
+      bitmap_bits[(offset >> 3) & 7] &
+      ~bitmap_bits[((offset + len) >> 3)  & 7];
+  } else {
+    /* If the two endpoints are in different bytes, we update the
+       bytes in the endpoints and fill the stuff inbetween with
+       0xff. */
+    r->bitmap[offset >> 6] |= bitmap_bits[(offset >> 3) & 7];
+
+    for(i = (1 + (offset >> 6)); i < ((offset + len) >> 6); ++i) {
+      r->bitmap[i] = 0xff;
     }
+    r->bitmap[(offset + len) >> 6] |=
+      ~bitmap_bits[((offset + len) >> 3) & 7];
+  }
+
+  /* Finally, we check if we have a full packet in the buffer. We do
+     this by checking if we have the last fragment and if all bits
+     in the bitmap are set. */
   
-    /* Finally, we check if we have a full packet in the buffer. We do
-       this by checking if we have the last fragment and if all bits
-       in the bitmap are set. */
-    
-    if(uip_reassflags & UIP_REASS_FLAG_LASTFRAG) {
-      /* Check all bytes up to and including all but the last byte in
-         the bitmap. */
-      for(i = 0; i < (uip_reasslen >> 6); ++i) {
-        if(uip_reassbitmap[i] != 0xff) {
-          return 0;
-        }
-      }
-      /* Check the last byte in the bitmap. It should contain just the
-         right amount of bits. */
-      if(uip_reassbitmap[uip_reasslen >> 6] !=
-         (uint8_t)~bitmap_bits[(uip_reasslen >> 3) & 7]) {
+  if(r->flags & UIP_REASS_FLAG_LASTFRAG) {
+    /* Check all bytes up to and including all but the last byte in
+       the bitmap. */
+    for(i = 0; i < (r->len >> 6); ++i) {
+      if(r->bitmap[i] != 0xff) {
         return 0;
       }
-
-     /* If we have come this far, we have a full packet in the
-         buffer, so we copy it to uip_buf. We also reset the timer. */
-      uip_reass_on = 0;
-      etimer_stop(&uip_reass_timer);
-
-      uip_reasslen += UIP_IPH_LEN + uip_ext_len;
-      memcpy(UIP_IP_BUF, FBUF, uip_reasslen);
-      UIP_IP_BUF->len[0] = ((uip_reasslen - UIP_IPH_LEN) >> 8);
-      UIP_IP_BUF->len[1] = ((uip_reasslen - UIP_IPH_LEN) & 0xff);
-      PRINTF("REASSEMBLED PAQUET %d (%d)\n", uip_reasslen,
-             (UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]);
-   
-      return uip_reasslen;
-      
     }
-  } else {
-    PRINTF("Already reassembling another paquet\n");
+    /* Check the last byte in the bitmap. It should contain just the
+       right amount of bits. */
+    if(r->bitmap[r->len >> 6] !=
+       (uint8_t)~bitmap_bits[(r->len >> 3) & 7]) {
+      return 0;
+    }
+
+   /* If we have come this far, we have a full packet in the
+       buffer, so we copy it to uip_buf. We also reset the timer. */
+    uip_reass_free(r);
+    UIP_STAT(++uip_stat.reass.done);
+
+    len = r->len + UIP_IPH_LEN + uip_ext_len;
+    memcpy(UIP_IP_BUF, FBUF(r), len);
+    UIP_IP_BUF->len[0] = ((len - UIP_IPH_LEN) >> 8);
+    UIP_IP_BUF->len[1] = ((len - UIP_IPH_LEN) & 0xff);
+    PRINTF("REASSEMBLED PAQUET %d (%d)\n", len,
+           (UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]);
+ 
+    return len;
+    
   }
   return 0;
 }
@@ -782,12 +1012,21 @@ uip_reass(void)
 void
 uip_reass_over(void)
 {
-   /* to late, we abandon the reassembly of the packet */
+  struct uip_reass_ctx *r = uip_reass_oldest();
+  uint8_t flags;
+
+  uip_len = 0;
+  if(r == NULL || (long)(r->deadline - clock_time()) > 0) {
+    uip_reass_set_timer();
+    return;
+  }
 
-  uip_reass_on = 0;
-  etimer_stop(&uip_reass_timer);
+  /* to late, we abandon the reassembly of the packet */
+  UIP_STAT(++uip_stat.reass.timeout);
+  flags = r->flags;
+  uip_reass_free(r);
 
-  if(uip_reassflags & UIP_REASS_FLAG_FIRSTFRAG){
+  if(flags & UIP_REASS_FLAG_FIRSTFRAG){
     PRINTF("FRAG INTERRUPTED TOO LATE\n");
     /* If the first fragment has been received, an ICMP Time Exceeded
        -- Fragment Reassembly Time Exceeded message should be sent to the
@@ -800,8 +1039,8 @@ uip_reass_over(void)
      */
     uip_len = 0;
     uip_ext_len = 0;
-    memcpy(UIP_IP_BUF, FBUF, UIP_IPH_LEN); /* copy the header for src
-                                              and dest address*/
+    memcpy(UIP_IP_BUF, FBUF(r), UIP_IPH_LEN); /* copy the header for src
+                                                 and dest address*/
     uip_icmp6_error_output(ICMP6_TIME_EXCEEDED, ICMP6_TIME_EXCEED_REASSEMBLY, 0);
     
     UIP_STAT(++uip_stat.ip.sent);
@@ -822,6 +1061,60 @@ uip_add_rcv_nxt(uint16_t n)
   uip_conn->rcv_nxt[2] = uip_acc32[2];
   uip_conn->rcv_nxt[3] = uip_acc32[3];
 }
+/*---------------------------------------------------------------------------*/
+static void
+uip_tcp_rtt(struct uip_conn *conn)
+{
+  signed char m;
+
+  m = conn->rto - conn->timer;
+  /* This is taken directly from VJs original code in his paper */
+  m = m - (conn->sa >> 3);
+  conn->sa += m;
+  if(m < 0) {
+    m = -m;
+  }
+  m = m - (conn->sv >> 2);
+  conn->sv += m;
+  conn->rto = (conn->sa >> 3) + conn->sv;
+}
+#if UIP_TCP_WINDOW > 1
+/*---------------------------------------------------------------------------*/
+static uint32_t
+uip_tcp_seq(const uint8_t *seq)
+{
+  return ((uint32_t)seq[0] << 24) | ((uint32_t)seq[1] << 16) |
+    ((uint32_t)seq[2] << 8) | seq[3];
+}
+/*---------------------------------------------------------------------------*/
+/* The number of bytes the application may add to the data in flight. */
+static uint16_t
+uip_tcp_sndroom(struct uip_conn *conn)
+{
+  uint16_t wnd;
+
+  /* Nothing new goes out while lost data is being resent: peers that
+     drop out-of-order segments, like uIP itself, would drop it too. */
+  if(conn->sndflags & (SND_FIN | SND_RECOVER)) {
+    return 0;
+  }
+  wnd = conn->snd_wnd < UIP_TCP_SNDBUF ? conn->snd_wnd : UIP_TCP_SNDBUF;
+  if(conn->len == 0 && wnd < conn->mss) {
+    /* With nothing in flight, a full segment is always allowed; into
+       a closed window it acts as a probe, as in plain uIP. */
+    return conn->mss;
+  }
+  return wnd > conn->len ? wnd - conn->len : 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+uip_tcp_sendable(struct uip_conn *conn)
+{
+  return (conn->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+    (conn->sndflags & (SND_ACKED | SND_REFUSED)) != 0 &&
+    uip_tcp_sndroom(conn) >= conn->mss;
+}
+#endif /* UIP_TCP_WINDOW > 1 */
 #endif
 /*---------------------------------------------------------------------------*/
 
@@ -915,6 +1208,17 @@ uip_process(uint8_t flag)
 #if UIP_TCP
   register struct uip_conn *uip_connr = uip_conn;
 #endif /* UIP_TCP */
+#if UIP_UDP
+  uint8_t flow;
+#endif /* UIP_UDP */
+#if UIP_TCP_WINDOW > 1
+  uint32_t acked;
+  uint8_t rexmit = 0;
+#endif /* UIP_TCP_WINDOW > 1 */
+  if(flag != UIP_DATA) {
+    /* The link layer sum only belongs to a packet being received. */
+    uip_rx_chksum_len = 0;
+  }
 #if UIP_UDP
   if(flag == UIP_UDP_SEND_CONN) {
     goto udp_send;
@@ -926,11 +1230,16 @@ uip_process(uint8_t flag)
      particular connection. */
   if(flag == UIP_POLL_REQUEST) {
 #if UIP_TCP
+#if UIP_TCP_WINDOW > 1
+    if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+      goto tcp_offer;
+#else /* UIP_TCP_WINDOW > 1 */
     if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
        !uip_outstanding(uip_connr)) {
       uip_flags = UIP_POLL;
       UIP_APPCALL();
       goto appsend;
+#endif /* UIP_TCP_WINDOW > 1 */
 #if UIP_ACTIVE_OPEN
     } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_SYN_SENT) {
       /* In the SYN_SENT state, we retransmit out SYN. */
@@ -1023,6 +1332,16 @@ uip_process(uint8_t flag)
 #endif /* UIP_ACTIVE_OPEN */
                      
             case UIP_ESTABLISHED:
+#if UIP_TCP_WINDOW > 1
+              /*
+               * With a send window, the data is resent from the
+               * retransmission buffer without the application.
+               */
+              uip_connr->sndflags = (uip_connr->sndflags & ~SND_RTT) |
+                SND_RECOVER;
+              uip_connr->dupacks = 0;
+              goto tcp_rexmit;
+#else /* UIP_TCP_WINDOW > 1 */
               /*
                * In the ESTABLISHED state, we call upon the application
                * to do the actual retransmit after which we jump into
@@ -1032,6 +1351,7 @@ uip_process(uint8_t flag)
               uip_flags = UIP_REXMIT;
               UIP_APPCALL();
               goto apprexmit;
+#endif /* UIP_TCP_WINDOW > 1 */
                      
             case UIP_FIN_WAIT_1:
             case UIP_CLOSING:
@@ -1040,6 +1360,16 @@ uip_process(uint8_t flag)
               goto tcp_send_finack;
           }
         }
+#if UIP_TCP_WINDOW > 1
+      }
+      if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+        /*
+         * Whether or not data is in flight, the application may fill
+         * up the rest of the window.
+         */
+        goto tcp_offer;
+      }
+#else /* UIP_TCP_WINDOW > 1 */
       } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
         /*
          * If there was no need for a retransmission, we poll the
@@ -1049,6 +1379,7 @@ uip_process(uint8_t flag)
         UIP_APPCALL();
         goto appsend;
       }
+#endif /* UIP_TCP_WINDOW > 1 */
     }
     goto drop;
 #endif /* UIP_TCP */
@@ -1322,6 +1653,7 @@ uip_process(uint8_t flag)
 #if UIP_CONF_IPV6_REASSEMBLY
         PRINTF("Processing frag header\n");
         uip_len = uip_reass();
+        uip_rx_chksum_len = 0;
         if(uip_len == 0) {
           goto drop;
         }
@@ -1366,7 +1698,7 @@ uip_process(uint8_t flag)
 
 #if UIP_CONF_IPV6_CHECKS
   /* Compute and check the ICMP header checksum */
-  if(uip_icmp6chksum() != 0xffff) {
+  if(upper_layer_rx_chksum(UIP_PROTO_ICMP6) != 0xffff) {
     UIP_STAT(++uip_stat.icmp.drop);
     UIP_STAT(++uip_stat.icmp.chkerr);
     UIP_LOG("icmpv6: bad checksum.");
@@ -1473,7 +1805,8 @@ uip_process(uint8_t flag)
      0. This is to be able to debug code that for one reason or
      another miscomputes UDP checksums. The reception of zero UDP
      checksums should be turned into a configration option. */
-  if(UIP_UDP_BUF->udpchksum != 0 && uip_udpchksum() != 0xffff) {
+  if(UIP_UDP_BUF->udpchksum != 0 &&
+     upper_layer_rx_chksum(UIP_PROTO_UDP) != 0xffff) {
     UIP_STAT(++uip_stat.udp.drop);
     UIP_STAT(++uip_stat.udp.chkerr);
     PRINTF("udp: bad checksum 0x%04x 0x%04x\n", UIP_UDP_BUF->udpchksum,
@@ -1490,10 +1823,22 @@ uip_process(uint8_t flag)
     goto drop;
   }
 
-  /* Demultiplex this UDP packet between the UDP "connections". */
-  for(uip_udp_conn = &uip_udp_conns[0];
-      uip_udp_conn < &uip_udp_conns[UIP_UDP_CONNS];
-      ++uip_udp_conn) {
+  /* Demultiplex this UDP packet between the UDP "connections". A
+     connected connection that got the last packet from this remote
+     port and address is tried first. */
+  flow = demux_hash(UIP_UDP_BUF->destport, UIP_UDP_BUF->srcport,
+                    &UIP_IP_BUF->srcipaddr);
+  if(udp_flow[flow] != DEMUX_NONE) {
+    uip_udp_conn = &uip_udp_conns[udp_flow[flow]];
+    if(UIP_UDP_BUF->destport == uip_udp_conn->lport &&
+       UIP_UDP_BUF->srcport == uip_udp_conn->rport &&
+       uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &uip_udp_conn->ripaddr)) {
+      goto udp_found;
+    }
+  }
+  for(c = udp_demux.head[demux_hash(UIP_UDP_BUF->destport, 0, NULL)];
+      c != DEMUX_NONE; c = udp_demux.next[c]) {
+    uip_udp_conn = &uip_udp_conns[c];
     /* If the local UDP port is non-zero, the connection is considered
        to be used. If so, the local port number is checked against the
        destination port number in the received packet. If the two port
@@ -1507,6 +1852,10 @@ uip_process(uint8_t flag)
         UIP_UDP_BUF->srcport == uip_udp_conn->rport) &&
        (uip_is_addr_unspecified(&uip_udp_conn->ripaddr) ||
         uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &uip_udp_conn->ripaddr))) {
+      if(uip_udp_conn->rport != 0 &&
+         !uip_is_addr_unspecified(&uip_udp_conn->ripaddr)) {
+        udp_flow[flow] = c;
+      }
       goto udp_found;
     }
   }
@@ -1582,8 +1931,8 @@ uip_process(uint8_t flag)
   PRINTF("Receiving TCP packet\n");
   /* Start of TCP input header processing code. */
   
-  if(uip_tcpchksum() != 0xffff) {   /* Compute and check the TCP
-                                       checksum. */
+  /* Compute and check the TCP checksum. */
+  if(upper_layer_rx_chksum(UIP_PROTO_TCP) != 0xffff) {
     UIP_STAT(++uip_stat.tcp.drop);
     UIP_STAT(++uip_stat.tcp.chkerr);
     PRINTF("tcp: bad checksum 0x%04x 0x%04x\n", UIP_TCP_BUF->tcpchksum,
@@ -1599,8 +1948,11 @@ uip_process(uint8_t flag)
 
   /* Demultiplex this segment. */
   /* First check any active connections. */
-  for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
-      ++uip_connr) {
+  for(c = tcp_demux.head[demux_hash(UIP_TCP_BUF->destport,
+                                    UIP_TCP_BUF->srcport,
+                                    &UIP_IP_BUF->srcipaddr)];
+      c != DEMUX_NONE; c = tcp_demux.next[c]) {
+    uip_connr = &uip_conns[c];
     if(uip_connr->tcpstateflags != UIP_CLOSED &&
        UIP_TCP_BUF->destport == uip_connr->lport &&
        UIP_TCP_BUF->srcport == uip_connr->rport &&
@@ -1619,7 +1971,8 @@ uip_process(uint8_t flag)
   
   tmp16 = UIP_TCP_BUF->destport;
   /* Next, check listening connections. */
-  for(c = 0; c < UIP_LISTENPORTS; ++c) {
+  for(c = listen_demux.head[demux_hash(tmp16, 0, NULL)];
+      c != DEMUX_NONE; c = listen_demux.next[c]) {
     if(tmp16 == uip_listenports[c]) {
       goto found_listen;
     }
@@ -1720,9 +2073,16 @@ uip_process(uint8_t flag)
   uip_connr->sa = 0;
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
+#if UIP_TCP_WINDOW > 1
+  uip_connr->snd_wnd = 0;
+  uip_connr->sndflags = uip_connr->dupacks = 0;
+#endif /* UIP_TCP_WINDOW > 1 */
   uip_connr->lport = UIP_TCP_BUF->destport;
   uip_connr->rport = UIP_TCP_BUF->srcport;
   uip_ipaddr_copy(&uip_connr->ripaddr, &UIP_IP_BUF->srcipaddr);
+  demux_add(&tcp_demux, uip_connr - uip_conns,
+            demux_hash(uip_connr->lport, uip_connr->rport,
+                       &uip_connr->ripaddr));
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
 
   uip_connr->snd_nxt[0] = iss[0];
@@ -1843,6 +2203,57 @@ uip_process(uint8_t flag)
      data. If so, we update the sequence number, reset the length of
      the outstanding data, calculate RTT estimations, and reset the
      retransmission timer. */
+#if UIP_TCP_WINDOW > 1
+  /* With a send window, an ACK may cover any part of the data in
+     flight. The application was told about the data when it was
+     buffered, so an ACK only frees room in the retransmission
+     buffer. */
+  if((UIP_TCP_BUF->flags & TCP_ACK) &&
+     (uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+    tmp16 = ((uint16_t)UIP_TCP_BUF->wnd[0] << 8) + (uint16_t)UIP_TCP_BUF->wnd[1];
+    if(uip_outstanding(uip_connr)) {
+      acked = uip_tcp_seq(UIP_TCP_BUF->ackno) - uip_tcp_seq(uip_connr->snd_nxt);
+      if(acked > 0 && acked <= uip_connr->len) {
+        /* Only the first segment sent with nothing in flight gives a
+           usable RTT sample: the timer restarts with every ACK. */
+        if(uip_connr->sndflags & SND_RTT) {
+          uip_tcp_rtt(uip_connr);
+          uip_connr->sndflags &= ~SND_RTT;
+        }
+        uip_connr->len -= acked;
+        memmove(SNDBUF(uip_connr), SNDBUF(uip_connr) + acked, uip_connr->len);
+        uip_add32(uip_connr->snd_nxt, acked);
+        uip_connr->snd_nxt[0] = uip_acc32[0];
+        uip_connr->snd_nxt[1] = uip_acc32[1];
+        uip_connr->snd_nxt[2] = uip_acc32[2];
+        uip_connr->snd_nxt[3] = uip_acc32[3];
+        uip_connr->timer = uip_connr->rto;
+        uip_connr->nrtx = 0;
+        uip_connr->dupacks = 0;
+        if(uip_connr->len == 0) {
+          uip_connr->sndflags &= ~SND_RECOVER;
+        } else if((uip_connr->sndflags & SND_RECOVER) && uip_len == 0) {
+          /* A partial ACK after a retransmission means that the next
+             segment was lost as well. */
+          rexmit = 1;
+        }
+      } else if(acked == 0 && uip_len == 0 &&
+                (UIP_TCP_BUF->flags & (TCP_SYN | TCP_FIN)) == 0 &&
+                tmp16 == uip_connr->snd_wnd &&
+                ++uip_connr->dupacks == UIP_TCP_DUPACKS) {
+        /* Fast retransmit: the peer keeps asking for the oldest
+           segment, so it has been lost. */
+        uip_connr->sndflags = (uip_connr->sndflags & ~SND_RTT) | SND_RECOVER;
+        rexmit = 1;
+      }
+    }
+    uip_connr->snd_wnd = tmp16;
+    if(rexmit) {
+      UIP_STAT(++uip_stat.tcp.rexmit);
+      goto tcp_rexmit;
+    }
+  } else
+#endif /* UIP_TCP_WINDOW > 1 */
   if((UIP_TCP_BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
     uip_add32(uip_connr->snd_nxt, uip_connr->len);
 
@@ -1858,18 +2269,7 @@ uip_process(uint8_t flag)
    
       /* Do RTT estimation, unless we have done retransmissions. */
       if(uip_connr->nrtx == 0) {
-        signed char m;
-        m = uip_connr->rto - uip_connr->timer;
-        /* This is taken directly from VJs original code in his paper */
-        m = m - (uip_connr->sa >> 3);
-        uip_connr->sa += m;
-        if(m < 0) {
-          m = -m;
-        }
-        m = m - (uip_connr->sv >> 2);
-        uip_connr->sv += m;
-        uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
-
+        uip_tcp_rtt(uip_connr);
       }
       /* Set the acknowledged flag. */
       uip_flags = UIP_ACKDATA;
@@ -1984,6 +2384,31 @@ uip_process(uint8_t flag)
          state. We require that there is no outstanding data; otherwise the
          sequence numbers will be screwed up. */
 
+#if UIP_TCP_WINDOW > 1
+      /* If the application has closed the connection while data was
+         still in flight, our FIN goes out once all of it has been
+         acknowledged. Until then incoming data is only acknowledged,
+         as in FIN_WAIT_1. A FIN from the peer waits for the same. */
+      if(uip_connr->sndflags & SND_FIN) {
+        if(!(UIP_TCP_BUF->flags & TCP_FIN)) {
+          if(uip_len > 0) {
+            uip_add_rcv_nxt(uip_len);
+          }
+          if(uip_connr->len == 0) {
+            goto tcp_send_fin;
+          }
+          if(uip_len > 0) {
+            goto tcp_send_ack;
+          }
+          goto drop;
+        }
+        if(uip_outstanding(uip_connr)) {
+          goto drop;
+        }
+        uip_connr->sndflags = 0;
+      }
+#endif /* UIP_TCP_WINDOW > 1 */
+
       if(UIP_TCP_BUF->flags & TCP_FIN && !(uip_connr->tcpstateflags & UIP_STOPPED)) {
         if(uip_outstanding(uip_connr)) {
           goto drop;
@@ -2050,7 +2475,24 @@ uip_process(uint8_t flag)
          tmp16 == 0) {
         tmp16 = uip_connr->initialmss;
       }
+#if UIP_TCP_WINDOW > 1
+      /* The MSS must not change under an application that has yet to
+         hear about its data, as it may count what it sent by it. */
+      if(!(uip_connr->sndflags & SND_ACKED)) {
+        uip_connr->mss = tmp16;
+      }
+
+      /* Tell the application what became of its last data, once the
+         window has room for it to send more. */
+      if((uip_connr->sndflags & (SND_ACKED | SND_REFUSED)) &&
+         uip_tcp_sndroom(uip_connr) >= uip_connr->mss) {
+        uip_flags |= (uip_connr->sndflags & SND_ACKED) ?
+          UIP_ACKDATA : UIP_REXMIT;
+        uip_connr->sndflags &= ~(SND_ACKED | SND_REFUSED);
+      }
+#else /* UIP_TCP_WINDOW > 1 */
       uip_connr->mss = tmp16;
+#endif /* UIP_TCP_WINDOW > 1 */
 
       /* If this packet constitutes an ACK for outstanding data (flagged
          by the UIP_ACKDATA flag, we should call the application since it
@@ -2068,7 +2510,7 @@ uip_process(uint8_t flag)
          put into the uip_appdata and the length of the data should be
          put into uip_len. If the application don't have any data to
          send, uip_len must be set to 0. */
-      if(uip_flags & (UIP_NEWDATA | UIP_ACKDATA)) {
+      if(uip_flags & (UIP_NEWDATA | UIP_ACKDATA | UIP_REXMIT)) {
         uip_slen = 0;
         UIP_APPCALL();
 
@@ -2083,6 +2525,15 @@ uip_process(uint8_t flag)
 
         if(uip_flags & UIP_CLOSE) {
           uip_slen = 0;
+#if UIP_TCP_WINDOW > 1
+          if(uip_outstanding(uip_connr)) {
+            uip_connr->sndflags |= SND_FIN;
+            if(uip_len > 0) {
+              goto tcp_send_ack;
+            }
+            goto drop;
+          }
+#endif /* UIP_TCP_WINDOW > 1 */
           uip_connr->len = 1;
           uip_connr->tcpstateflags = UIP_FIN_WAIT_1;
           uip_connr->nrtx = 0;
@@ -2090,6 +2541,38 @@ uip_process(uint8_t flag)
           goto tcp_send_nodata;
         }
 
+#if UIP_TCP_WINDOW > 1
+        /* If uip_slen > 0, the application has data to be sent. It is
+           added to the retransmission buffer if it fits in the window. */
+        if(uip_slen > 0) {
+          if(uip_slen > uip_connr->mss) {
+            uip_slen = uip_connr->mss;
+          }
+          if(uip_slen > uip_tcp_sndroom(uip_connr)) {
+            /* No room in the window: the application is to send the
+               data again when there is. */
+            uip_connr->sndflags = (uip_connr->sndflags & ~SND_ACKED) |
+              SND_REFUSED;
+            uip_slen = 0;
+          } else {
+            if(uip_connr->len == 0 && uip_connr->nrtx == 0) {
+              uip_connr->sndflags |= SND_RTT;
+            }
+            memcpy(SNDBUF(uip_connr) + uip_connr->len, uip_sappdata, uip_slen);
+            uip_connr->len += uip_slen;
+            uip_connr->sndflags = (uip_connr->sndflags & ~SND_REFUSED) |
+              SND_ACKED;
+          }
+        }
+        uip_appdata = uip_sappdata;
+
+        /* New data goes out right away; ->len already counts it. */
+        if(uip_slen > 0) {
+          uip_len = uip_slen + UIP_TCPIP_HLEN;
+          UIP_TCP_BUF->flags = TCP_ACK | TCP_PSH;
+          goto tcp_send_noopts;
+        }
+#else /* UIP_TCP_WINDOW > 1 */
         /* If uip_slen > 0, the application has data to be sent. */
         if(uip_slen > 0) {
 
@@ -2136,6 +2619,7 @@ uip_process(uint8_t flag)
           /* Send the packet. */
           goto tcp_send_noopts;
         }
+#endif /* UIP_TCP_WINDOW > 1 */
         /* If there is no data to send, just send out a pure ACK if
            there is newdata. */
         if(uip_flags & UIP_NEWDATA) {
@@ -2211,6 +2695,50 @@ uip_process(uint8_t flag)
       }
   }
   goto drop;
+
+#if UIP_TCP_WINDOW > 1
+  /* We jump here when an established connection is polled. The
+     application is offered the room left in the send window, and
+     told what became of the data it gave us last time. */
+ tcp_offer:
+  if(uip_connr->sndflags & SND_FIN) {
+    if(uip_outstanding(uip_connr)) {
+      goto drop;
+    }
+  tcp_send_fin:
+    uip_connr->len = 1;
+    uip_connr->tcpstateflags = UIP_FIN_WAIT_1;
+    uip_connr->nrtx = 0;
+    uip_connr->sndflags = 0;
+    UIP_TCP_BUF->flags = TCP_FIN | TCP_ACK;
+    goto tcp_send_nodata;
+  }
+  if(uip_tcp_sndroom(uip_connr) < uip_connr->mss) {
+    goto drop;
+  }
+  if(uip_connr->sndflags & SND_ACKED) {
+    uip_flags = UIP_ACKDATA;
+  } else if(uip_connr->sndflags & SND_REFUSED) {
+    uip_flags = UIP_REXMIT;
+  } else {
+    uip_flags = UIP_POLL;
+  }
+  uip_connr->sndflags &= ~(SND_ACKED | SND_REFUSED);
+  uip_len = 0;
+  uip_slen = 0;
+  UIP_APPCALL();
+  goto appsend;
+
+  /* We jump here to resend the oldest data in flight. */
+ tcp_rexmit:
+  rexmit = 1;
+  uip_slen = uip_connr->len < uip_connr->mss ? uip_connr->len : uip_connr->mss;
+  uip_appdata = &uip_buf[UIP_IPTCPH_LEN + UIP_LLH_LEN];
+  memcpy(uip_appdata, SNDBUF(uip_connr), uip_slen);
+  uip_len = uip_slen + UIP_TCPIP_HLEN;
+  UIP_TCP_BUF->flags = TCP_ACK | TCP_PSH;
+  goto tcp_send_noopts;
+#endif /* UIP_TCP_WINDOW > 1 */
   
   /* We jump here when we are ready to send the packet, and just want
      to set the appropriate TCP sequence numbers in the TCP header. */
@@ -2239,6 +2767,18 @@ uip_process(uint8_t flag)
   UIP_TCP_BUF->seqno[1] = uip_connr->snd_nxt[1];
   UIP_TCP_BUF->seqno[2] = uip_connr->snd_nxt[2];
   UIP_TCP_BUF->seqno[3] = uip_connr->snd_nxt[3];
+#if UIP_TCP_WINDOW > 1
+  /* Apart from retransmissions, segments of an established connection
+     go out after the data in flight, which includes any new data in
+     this segment. */
+  if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED && !rexmit) {
+    uip_add32(UIP_TCP_BUF->seqno, uip_connr->len - (uip_len - UIP_TCPIP_HLEN));
+    UIP_TCP_BUF->seqno[0] = uip_acc32[0];
+    UIP_TCP_BUF->seqno[1] = uip_acc32[1];
+    UIP_TCP_BUF->seqno[2] = uip_acc32[2];
+    UIP_TCP_BUF->seqno[3] = uip_acc32[3];
+  }
+#endif /* UIP_TCP_WINDOW > 1 */
 
   UIP_IP_BUF->proto = UIP_PROTO_TCP;
 
@@ -2284,6 +2824,7 @@ uip_process(uint8_t flag)
  send:
   PRINTF("Sending packet with length %d (%d)\n", uip_len,
          (UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]);
+  uip_rx_chksum_len = 0;
   
   UIP_STAT(++uip_stat.ip.sent);
   /* Return and let the caller do the actual transmission. */
@@ -2293,6 +2834,7 @@ uip_process(uint8_t flag)
  drop:
   uip_len = 0;
   uip_ext_len = 0;
+  uip_rx_chksum_len = 0;
   uip_ext_bitmap = 0;
   uip_flags = 0;
   return;
@@ -203,6 +203,12 @@
 #define UIP_CONF_IPV6_REASSEMBLY      0
 #endif
 
+#ifndef UIP_CONF_IPV6_REASS_NUM
+/** Number of IPv6 packets reassembled at once, each with a buffer of
+    UIP_BUFSIZE bytes (default: 2) */
+#define UIP_CONF_IPV6_REASS_NUM       2
+#endif
+
 #ifndef UIP_CONF_NETIF_MAX_ADDRESSES
 /** Default number of IPv6 addresses associated to the node's interface */
 #define UIP_CONF_NETIF_MAX_ADDRESSES  3
@@ -398,6 +404,40 @@
 #define UIP_RECEIVE_WINDOW (UIP_CONF_RECEIVE_WINDOW)
 #endif
 
+/**
+ * The number of full-sized TCP segments a connection may have in
+ * flight (IPv6 only).
+ *
+ * With the default of one, uIP keeps a single unacknowledged segment
+ * per connection and asks the application to regenerate it when it
+ * must be retransmitted. With a larger value, sent data is kept in a
+ * per-connection retransmission buffer of UIP_TCP_WINDOW *
+ * UIP_TCP_MSS bytes, and uIP retransmits from it by itself. The
+ * application then sees its data acknowledged (uip_acked()) as soon
+ * as it has been buffered, and is never asked to retransmit.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_WINDOW
+#define UIP_TCP_WINDOW (UIP_CONF_TCP_WINDOW)
+#else
+#define UIP_TCP_WINDOW 1
+#endif
+
+/**
+ * The number of duplicate ACKs after which the oldest segment is
+ * retransmitted without waiting for the retransmission timer.
+ *
+ * Only used when UIP_TCP_WINDOW is larger than one.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_DUPACKS
+#define UIP_TCP_DUPACKS (UIP_CONF_TCP_DUPACKS)
+#else
+#define UIP_TCP_DUPACKS 3
+#endif
+
 /**
  * How long a connection should stay in the TIME_WAIT state.
  *
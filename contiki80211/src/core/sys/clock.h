@@ -124,6 +124,17 @@ void clock_set_seconds(unsigned long sec);
  */
 void clock_wait(clock_time_t t);
 
+/**
+ * Sleep until the given number of ticks have passed, or until an
+ * interrupt occurs, without taking the periodic tick meanwhile.
+ * \param t   How many ticks, at most [0 for the longest possible].
+ *
+ *             Called with interrupts disabled; returns with
+ *             interrupts enabled. Only provided by platforms
+ *             with tickless idle support.
+ */
+void clock_idle(clock_time_t t);
+
 /**
  * Delay a given number of microseconds.
  * \param dt   How many microseconds to delay.
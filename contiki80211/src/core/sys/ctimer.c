@@ -44,9 +44,40 @@
 
 #include "sys/ctimer.h"
 #include "contiki.h"
-#include "lib/list.h"
 
-LIST(ctimer_list);
+#define WHEEL_MASK (CTIMER_WHEEL_SLOTS - 1)
+#define HALF_RANGE ((clock_time_t)~0 >> 1)
+/* True if clock time a is before b. */
+#define BEFORE(a, b) ((clock_time_t)((a) - (b)) > HALF_RANGE)
+
+/*
+ * Two wheel levels: level0 has one slot per clock tick, level1 one slot
+ * per CTIMER_WHEEL_SLOTS ticks. Timers further away wait on the far
+ * list. Each slot is an unsorted list; a timer is linked in O(1), and
+ * moved down a level when the wheel reaches its level1 slot.
+ */
+static struct ctimer *level0[CTIMER_WHEEL_SLOTS];
+static struct ctimer *level1[CTIMER_WHEEL_SLOTS];
+static struct ctimer *far;
+
+/* One bit per non-empty slot, so that run() can skip the empty ones. */
+#define MAP_WORDS ((CTIMER_WHEEL_SLOTS + 31) / 32)
+static uint32_t level0_map[MAP_WORDS];
+static uint32_t level1_map[MAP_WORDS];
+
+/* The timers whose callbacks run() is calling. */
+static struct ctimer *batch;
+static char running;
+
+/* The next clock tick the wheel has to serve. */
+static clock_time_t wheel_time;
+
+/* The one etimer that drives the wheel. */
+static struct etimer wheel_etimer;
+static clock_time_t wheel_deadline;
+static char wheel_armed;
+
+static struct ctimer_stats stats;
 
 static char initialized;
 
@@ -58,30 +89,325 @@ static char initialized;
 #define PRINTF(...)
 #endif
 
-/*---------------------------------------------------------------------------*/
 PROCESS(ctimer_process, "Ctimer process");
-PROCESS_THREAD(ctimer_process, ev, data)
+/*---------------------------------------------------------------------------*/
+/* Updates the occupancy bit of a slot; other list heads are ignored. */
+static void
+slot_mark(struct ctimer **head)
+{
+  uint32_t *map;
+  unsigned int i;
+
+  if(head >= level0 && head < &level0[CTIMER_WHEEL_SLOTS]) {
+    map = level0_map;
+    i = head - level0;
+  } else if(head >= level1 && head < &level1[CTIMER_WHEEL_SLOTS]) {
+    map = level1_map;
+    i = head - level1;
+  } else {
+    return;
+  }
+  if(*head != NULL) {
+    map[i >> 5] |= (uint32_t)1 << (i & 31);
+  } else {
+    map[i >> 5] &= ~((uint32_t)1 << (i & 31));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the first non-empty slot from i on, or CTIMER_WHEEL_SLOTS. */
+static unsigned int
+next_used(const uint32_t *map, unsigned int i)
+{
+  uint32_t bits;
+
+  while(i < CTIMER_WHEEL_SLOTS) {
+    bits = map[i >> 5] & ((uint32_t)~0UL << (i & 31));
+    if(bits != 0) {
+      return (i & ~31U) + __builtin_ctz(bits);
+    }
+    i = (i & ~31U) + 32;
+  }
+  return CTIMER_WHEEL_SLOTS;
+}
+/*---------------------------------------------------------------------------*/
+static void
+slot_link(struct ctimer **head, struct ctimer *c)
+{
+  c->next = *head;
+  if(c->next != NULL) {
+    c->next->pprev = &c->next;
+  }
+  *head = c;
+  c->pprev = head;
+  slot_mark(head);
+}
+/*---------------------------------------------------------------------------*/
+static void
+slot_unlink(struct ctimer *c)
+{
+  struct ctimer **pprev = c->pprev;
+
+  *pprev = c->next;
+  if(c->next != NULL) {
+    c->next->pprev = pprev;
+  }
+  c->next = NULL;
+  c->pprev = NULL;
+  slot_mark(pprev);
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+expiration(struct ctimer *c)
+{
+  return c->etimer.timer.start + c->etimer.timer.interval;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * A pending timer carries the mark of the wheel in its etimer, which
+ * start() sets and run() and ctimer_stop() clear, and its back-pointer
+ * leads to itself. The link of a timer that was never set is followed
+ * only if the garbage carries the mark, which takes a ctimer that was
+ * released while still pending.
+ */
+static int
+is_pending(struct ctimer *c)
+{
+  return c->etimer.p == &ctimer_process && c->pprev != NULL &&
+    *c->pprev == c;
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_insert(struct ctimer *c)
+{
+  clock_time_t expires = expiration(c);
+  clock_time_t delta = expires - wheel_time;
+
+  if(delta > HALF_RANGE) {
+    /* Already due; served on the next wheel tick. */
+    slot_link(&level0[wheel_time & WHEEL_MASK], c);
+  } else if(delta < CTIMER_WHEEL_SLOTS) {
+    slot_link(&level0[expires & WHEEL_MASK], c);
+  } else if(delta < (clock_time_t)CTIMER_WHEEL_SLOTS * CTIMER_WHEEL_SLOTS) {
+    slot_link(&level1[(expires >> CTIMER_WHEEL_BITS) & WHEEL_MASK], c);
+  } else {
+    slot_link(&far, c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Take over all timers of a slot; the slot is free to take new timers.
+ */
+static void
+detach(struct ctimer **slot, struct ctimer **list)
+{
+  *list = *slot;
+  *slot = NULL;
+  if(*list != NULL) {
+    (*list)->pprev = list;
+  }
+  slot_mark(slot);
+}
+/*---------------------------------------------------------------------------*/
+static void
+cascade(struct ctimer **slot)
+{
+  struct ctimer *list, *c;
+
+  detach(slot, &list);
+  while(list != NULL) {
+    c = list;
+    slot_unlink(c);
+    wheel_insert(c);
+    stats.cascaded++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Arm the wheel etimer for the given clock time, unless it is armed for
+ * an earlier one already.
+ */
+static void
+arm(clock_time_t deadline)
+{
+  clock_time_t now;
+
+  if(!initialized || (wheel_armed && !BEFORE(deadline, wheel_deadline))) {
+    return;
+  }
+  now = clock_time();
+  if(BEFORE(deadline, now)) {
+    deadline = now;
+  }
+  wheel_armed = 1;
+  wheel_deadline = deadline;
+
+  PROCESS_CONTEXT_BEGIN(&ctimer_process);
+  etimer_set(&wheel_etimer, deadline - now);
+  PROCESS_CONTEXT_END(&ctimer_process);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Arm the wheel etimer for the next tick that has work to do: either a
+ * timer expiring, or timers to move down from level1 or the far list.
+ */
+static void
+arm_next(void)
+{
+  clock_time_t next, boundary;
+  unsigned int i;
+
+  if(stats.pending == 0) {
+    return;
+  }
+
+  /* Tick of the next level1 cascade. */
+  boundary = (wheel_time + WHEEL_MASK) & ~(clock_time_t)WHEEL_MASK;
+
+  for(i = 0; i < CTIMER_WHEEL_SLOTS; i++) {
+    if(level0[(wheel_time + i) & WHEEL_MASK] != NULL) {
+      break;
+    }
+  }
+  next = wheel_time + i;
+  if(i == CTIMER_WHEEL_SLOTS || BEFORE(boundary, next)) {
+    /* Find the first level1 slot with timers, or the far list turn. */
+    for(i = 0; i < CTIMER_WHEEL_SLOTS; i++) {
+      if(level1[((boundary >> CTIMER_WHEEL_BITS) + i) & WHEEL_MASK] != NULL) {
+        break;
+      }
+      if(far != NULL &&
+         (((boundary >> CTIMER_WHEEL_BITS) + i) & WHEEL_MASK) == 0) {
+        break;
+      }
+    }
+    boundary += (clock_time_t)i << CTIMER_WHEEL_BITS;
+    if(i < CTIMER_WHEEL_SLOTS && BEFORE(boundary, next)) {
+      next = boundary;
+    }
+  }
+  arm(next);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the first tick after wheel_time that has work to do, judging
+ * by the occupancy maps: a level0 slot with timers, or a block boundary
+ * where timers are moved down. Returns wheel_time if the wheel is empty.
+ */
+static clock_time_t
+next_work(void)
+{
+  clock_time_t block_end = (wheel_time | WHEEL_MASK) + 1;
+  unsigned int i, b;
+
+  i = next_used(level0_map, (wheel_time & WHEEL_MASK) + 1);
+  if(i < CTIMER_WHEEL_SLOTS) {
+    return (wheel_time & ~(clock_time_t)WHEEL_MASK) + i;
+  }
+  if(next_used(level0_map, 0) < CTIMER_WHEEL_SLOTS) {
+    /* Timers of the next block wait in the low slots. */
+    return block_end;
+  }
+
+  /* Level0 is empty; skip the blocks with nothing to move down. */
+  b = (block_end >> CTIMER_WHEEL_BITS) & WHEEL_MASK;
+  if(b == 0 && far != NULL) {
+    /* The far list is moved down when level1 turns over. */
+    return block_end;
+  }
+  i = next_used(level1_map, b);
+  if(i == CTIMER_WHEEL_SLOTS) {
+    if(far != NULL) {
+      i = CTIMER_WHEEL_SLOTS;
+    } else {
+      i = next_used(level1_map, 0);
+      if(i == CTIMER_WHEEL_SLOTS) {
+        return wheel_time;
+      }
+      i += CTIMER_WHEEL_SLOTS;
+    }
+  }
+  return block_end + ((clock_time_t)(i - b) << CTIMER_WHEEL_BITS);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Serve all wheel ticks up to the current time, calling the callbacks
+ * of the expired timers in one batch. Ticks without work are skipped.
+ */
+static void
+run(void)
 {
   struct ctimer *c;
-  PROCESS_BEGIN();
+  clock_time_t now = clock_time();
+  clock_time_t next;
+  unsigned int idx, fired = 0;
+  unsigned char owner;
+
+  running = 1;
+  while(!BEFORE(now, wheel_time)) {
+    idx = wheel_time & WHEEL_MASK;
+    if(idx == 0) {
+      idx = (wheel_time >> CTIMER_WHEEL_BITS) & WHEEL_MASK;
+      cascade(&level1[idx]);
+      if(idx == 0) {
+        cascade(&far);
+      }
+      idx = 0;
+    }
 
-  for(c = list_head(ctimer_list); c != NULL; c = c->next) {
-    etimer_set(&c->etimer, c->etimer.timer.interval);
+    if(level0[idx] == NULL) {
+      next = next_work();
+      if(next == wheel_time || BEFORE(now, next)) {
+        wheel_time = now + 1;
+        break;
+      }
+      wheel_time = next;
+      continue;
+    }
+
+    /* Timers set by the callbacks below go to later ticks. */
+    wheel_time++;
+
+    detach(&level0[idx], &batch);
+    while(batch != NULL) {
+      c = batch;
+      slot_unlink(c);
+      c->etimer.p = PROCESS_NONE;
+      stats.pending--;
+      fired++;
+      /* The callback runs on behalf of the process that set the timer. */
+      owner = ENERGEST_CPU_ENTER(c->p != NULL ? c->p->cpu : ENERGEST_CPU_KERNEL);
+      PROCESS_CONTEXT_BEGIN(c->p);
+      if(c->f != NULL) {
+        c->f(c->ptr);
+      }
+      PROCESS_CONTEXT_END(c->p);
+      ENERGEST_CPU_LEAVE(owner);
+    }
+  }
+  running = 0;
+
+  if(fired > 0) {
+    stats.fired += fired;
+    stats.batches++;
+    if(fired > stats.batch_max) {
+      stats.batch_max = fired;
+    }
   }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ctimer_process, ev, data)
+{
+  PROCESS_BEGIN();
+
   initialized = 1;
+  arm_next();
 
   while(1) {
     PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_TIMER);
-    for(c = list_head(ctimer_list); c != NULL; c = c->next) {
-      if(&c->etimer == data) {
-	list_remove(ctimer_list, c);
-	PROCESS_CONTEXT_BEGIN(c->p);
-	if(c->f != NULL) {
-	  c->f(c->ptr);
-	}
-	PROCESS_CONTEXT_END(c->p);
-	break;
-      }
+    if(data == &wheel_etimer) {
+      wheel_armed = 0;
+      run();
+      arm_next();
     }
   }
   PROCESS_END();
@@ -90,82 +416,124 @@ PROCESS_THREAD(ctimer_process, ev, data)
 void
 ctimer_init(void)
 {
+  unsigned int i;
+
   initialized = 0;
-  list_init(ctimer_list);
+  wheel_armed = 0;
+  for(i = 0; i < CTIMER_WHEEL_SLOTS; i++) {
+    level0[i] = level1[i] = NULL;
+  }
+  for(i = 0; i < MAP_WORDS; i++) {
+    level0_map[i] = level1_map[i] = 0;
+  }
+  far = NULL;
+  batch = NULL;
+  running = 0;
+  wheel_time = clock_time();
+  /* Callback timers drive the MAC and network stack timing. */
+  process_set_priority(&ctimer_process, PROCESS_PRIO_HIGH);
+  process_set_cpu(&ctimer_process, ENERGEST_CPU_KERNEL);
   process_start(&ctimer_process, NULL);
 }
 /*---------------------------------------------------------------------------*/
+/* Takes a timer off the wheel, if it is on it. */
+static void
+wheel_remove(struct ctimer *c)
+{
+  if(is_pending(c)) {
+    slot_unlink(c);
+    stats.pending--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+start(struct ctimer *c)
+{
+  if(stats.pending == 0 && !running) {
+    /* The wheel is empty; it need not catch up with the idle time. */
+    wheel_time = clock_time();
+  }
+  stats.pending++;
+  if(stats.pending > stats.pending_max) {
+    stats.pending_max = stats.pending;
+  }
+  /* Marks the timer as not expired for etimer_expired(). */
+  c->etimer.p = &ctimer_process;
+  wheel_insert(c);
+  arm(expiration(c));
+}
+/*---------------------------------------------------------------------------*/
 void
 ctimer_set(struct ctimer *c, clock_time_t t,
 	   void (*f)(void *), void *ptr)
 {
   PRINTF("ctimer_set %p %u\n", c, (unsigned)t);
+  wheel_remove(c);
   c->p = PROCESS_CURRENT();
   c->f = f;
   c->ptr = ptr;
-  if(initialized) {
-    PROCESS_CONTEXT_BEGIN(&ctimer_process);
-    etimer_set(&c->etimer, t);
-    PROCESS_CONTEXT_END(&ctimer_process);
-  } else {
-    c->etimer.timer.interval = t;
-  }
-
-  list_remove(ctimer_list, c);
-  list_add(ctimer_list, c);
+  timer_set(&c->etimer.timer, t);
+  start(c);
 }
 /*---------------------------------------------------------------------------*/
 void
 ctimer_reset(struct ctimer *c)
 {
-  if(initialized) {
-    PROCESS_CONTEXT_BEGIN(&ctimer_process);
-    etimer_reset(&c->etimer);
-    PROCESS_CONTEXT_END(&ctimer_process);
-  }
-
-  list_remove(ctimer_list, c);
-  list_add(ctimer_list, c);
+  wheel_remove(c);
+  /* Drift-free: the new interval starts at the previous expiration. */
+  c->etimer.timer.start += c->etimer.timer.interval;
+  start(c);
 }
 /*---------------------------------------------------------------------------*/
 void
 ctimer_restart(struct ctimer *c)
 {
-  if(initialized) {
-    PROCESS_CONTEXT_BEGIN(&ctimer_process);
-    etimer_restart(&c->etimer);
-    PROCESS_CONTEXT_END(&ctimer_process);
-  }
-
-  list_remove(ctimer_list, c);
-  list_add(ctimer_list, c);
+  wheel_remove(c);
+  c->etimer.timer.start = clock_time();
+  start(c);
 }
 /*---------------------------------------------------------------------------*/
 void
 ctimer_stop(struct ctimer *c)
 {
-  if(initialized) {
-    etimer_stop(&c->etimer);
-  } else {
-    c->etimer.next = NULL;
-    c->etimer.p = PROCESS_NONE;
-  }
-  list_remove(ctimer_list, c);
+  /* The wheel etimer stays armed; it finds nothing to do. */
+  wheel_remove(c);
+  c->etimer.p = PROCESS_NONE;
 }
 /*---------------------------------------------------------------------------*/
 int
 ctimer_expired(struct ctimer *c)
 {
-  struct ctimer *t;
-  if(initialized) {
-    return etimer_expired(&c->etimer);
+  return !is_pending(c);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned int
+count(struct ctimer *c)
+{
+  unsigned int n;
+
+  for(n = 0; c != NULL; c = c->next) {
+    n++;
   }
-  for(t = list_head(ctimer_list); t != NULL; t = t->next) {
-    if(t == c) {
-      return 0;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_get_stats(struct ctimer_stats *s)
+{
+  unsigned int i, n;
+
+  stats.level0 = stats.level1 = stats.slots_used = 0;
+  for(i = 0; i < CTIMER_WHEEL_SLOTS; i++) {
+    n = count(level0[i]);
+    stats.level0 += n;
+    if(n > 0) {
+      stats.slots_used++;
     }
+    stats.level1 += count(level1[i]);
   }
-  return 1;
+  stats.far = count(far);
+  *s = stats;
 }
 /*---------------------------------------------------------------------------*/
 /** @} */
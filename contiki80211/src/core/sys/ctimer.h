@@ -56,14 +56,46 @@
 
 #include "sys/etimer.h"
 
+/*
+ * Callback timers are kept in a hierarchical timing wheel, driven by a
+ * single etimer. The etimer member only holds the start and interval of
+ * the timer, so etimer_expired() and etimer_expiration_time() still
+ * apply to it.
+ */
+#ifdef CTIMER_CONF_WHEEL_BITS
+#define CTIMER_WHEEL_BITS CTIMER_CONF_WHEEL_BITS
+#else
+#define CTIMER_WHEEL_BITS 6
+#endif /* CTIMER_CONF_WHEEL_BITS */
+
+/* Slots per wheel level; the first level is one clock tick per slot. */
+#define CTIMER_WHEEL_SLOTS (1 << CTIMER_WHEEL_BITS)
+
 struct ctimer {
   struct ctimer *next;
+  struct ctimer **pprev;
   struct etimer etimer;
   struct process *p;
   void (*f)(void *);
   void *ptr;
 };
 
+/**
+ * \brief      Occupancy and activity of the callback timer wheel
+ */
+struct ctimer_stats {
+  unsigned int pending;        /* Timers currently set               */
+  unsigned int pending_max;    /* Highest number of timers set       */
+  unsigned int level0;         /* Timers in the first [tick] level   */
+  unsigned int level1;         /* Timers in the second level         */
+  unsigned int far;            /* Timers beyond the second level     */
+  unsigned int slots_used;     /* Non-empty first level slots        */
+  unsigned long fired;         /* Callbacks invoked                  */
+  unsigned long batches;       /* Wheel runs that invoked callbacks  */
+  unsigned int batch_max;      /* Most callbacks invoked in one run  */
+  unsigned long cascaded;      /* Timers moved to a lower level      */
+};
+
 /**
  * \brief      Reset a callback timer with the same interval as was
  *             previously set.
@@ -143,6 +175,12 @@ int ctimer_expired(struct ctimer *c);
  */
 void ctimer_init(void);
 
+/**
+ * \brief      Get the occupancy statistics of the callback timer wheel.
+ * \param stats Set to the current statistics.
+ */
+void ctimer_get_stats(struct ctimer_stats *stats);
+
 #endif /* CTIMER_H_ */
 //#endif /* __CTIMER_H__ */
 /** @} */
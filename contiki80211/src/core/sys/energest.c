@@ -50,6 +50,10 @@ energest_t energest_leveldevice_current_leveltime[ENERGEST_CONF_LEVELDEVICE_LEVE
 #endif
 unsigned char energest_current_mode[ENERGEST_TYPE_MAX];
 
+static unsigned long cpu_time[ENERGEST_CPU_MAX];
+static unsigned char cpu_owner = ENERGEST_CPU_KERNEL;
+static rtimer_clock_t cpu_since;
+
 /*---------------------------------------------------------------------------*/
 void
 energest_init(void)
@@ -64,6 +68,11 @@ energest_init(void)
     energest_leveldevice_current_leveltime[i].current = 0;
   }
 #endif
+  for(i = 0; i < ENERGEST_CPU_MAX; ++i) {
+    cpu_time[i] = 0;
+  }
+  cpu_owner = ENERGEST_CPU_KERNEL;
+  cpu_since = RTIMER_NOW();
 }
 /*---------------------------------------------------------------------------*/
 unsigned long
@@ -113,9 +122,45 @@ energest_flush(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Owners switch from interrupt handlers as well, so the switch runs with
+ * interrupts disabled. Nested switches charge the interrupted owner up
+ * to the switch and resume it on return.
+ */
+unsigned char
+energest_cpu_switch(unsigned char owner)
+{
+  rtimer_clock_t now;
+  unsigned char prev;
+
+  rtimer_arch_disable_irq();
+  now = RTIMER_NOW();
+  prev = cpu_owner;
+  cpu_time[prev] += (unsigned long)(now - cpu_since);
+  cpu_since = now;
+  if(owner < ENERGEST_CPU_MAX) {
+    cpu_owner = owner;
+  }
+  rtimer_arch_enable_irq();
+  return prev;
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+energest_cpu_time(int owner)
+{
+  if(owner >= ENERGEST_CPU_MAX) {
+    return 0;
+  }
+  /* Bring the current owner up to date. */
+  energest_cpu_switch(cpu_owner);
+  return cpu_time[owner];
+}
+/*---------------------------------------------------------------------------*/
 #else /* ENERGEST_CONF_ON */
 void energest_type_set(int type, unsigned long val) {}
 void energest_init(void) {}
 unsigned long energest_type_time(int type) { return 0; }
 void energest_flush(void) {}
+unsigned char energest_cpu_switch(unsigned char owner) { return ENERGEST_CPU_KERNEL; }
+unsigned long energest_cpu_time(int owner) { return 0; }
 #endif /* ENERGEST_CONF_ON */
@@ -64,9 +64,34 @@ enum energest_type {
 
   ENERGEST_TYPE_SERIAL,
 
+  /* 802.11 radio states; TRANSMIT and LISTEN count frames in flight and
+     the remaining awake time. */
+  ENERGEST_TYPE_WIFI_AWAKE,
+  ENERGEST_TYPE_WIFI_DOZE,
+  ENERGEST_TYPE_WIFI_ATIM,
+  ENERGEST_TYPE_WIFI_BEACON,
+
   ENERGEST_TYPE_MAX
 };
 
+/*
+ * Owners of CPU time. Run time is charged to the current owner; the
+ * owner of a process is set with process_set_cpu(), other code switches
+ * owner with ENERGEST_CPU_ENTER() and ENERGEST_CPU_LEAVE().
+ */
+enum energest_cpu {
+  ENERGEST_CPU_APP,         /* Application processes, the default */
+  ENERGEST_CPU_USB_ISR,
+  ENERGEST_CPU_DRIVER,
+  ENERGEST_CPU_IBSS,
+  ENERGEST_CPU_UIP,
+  ENERGEST_CPU_RPL,
+  ENERGEST_CPU_KERNEL,      /* Main loop, timers, event dispatch */
+  ENERGEST_CPU_IDLE,        /* Low-power mode */
+
+  ENERGEST_CPU_MAX
+};
+
 void energest_init(void);
 unsigned long energest_type_time(int type);
 #ifdef ENERGEST_CONF_LEVELDEVICE_LEVELS
@@ -75,6 +100,11 @@ unsigned long energest_leveldevice_leveltime(int powerlevel);
 void energest_type_set(int type, unsigned long value);
 void energest_flush(void);
 
+/* Charge CPU time to a new owner; returns the previous owner. */
+unsigned char energest_cpu_switch(unsigned char owner);
+/* Cumulative CPU time of an owner, in rtimer ticks. */
+unsigned long energest_cpu_time(int owner);
+
 #if ENERGEST_CONF_ON
 /*extern int energest_total_count;*/
 extern energest_t energest_total_time[ENERGEST_TYPE_MAX];
@@ -120,10 +150,15 @@ extern energest_t energest_leveldevice_current_leveltime[ENERGEST_CONF_LEVELDEVI
 #endif
 
 
+#define ENERGEST_CPU_ENTER(owner) energest_cpu_switch(owner)
+#define ENERGEST_CPU_LEAVE(prev)  (void)energest_cpu_switch(prev)
+
 #else /* ENERGEST_CONF_ON */
 #define ENERGEST_ON(type) do { } while(0)
 #define ENERGEST_OFF(type) do { } while(0)
 #define ENERGEST_OFF_LEVEL(type,level) do { } while(0)
+#define ENERGEST_CPU_ENTER(owner) ENERGEST_CPU_KERNEL
+#define ENERGEST_CPU_LEAVE(prev)  (void)(prev)
 #endif /* ENERGEST_CONF_ON */
 
 #endif /* ENERGEST_H_ */
@@ -49,41 +49,204 @@
 #include "sys/etimer.h"
 #include "sys/process.h"
 
-static struct etimer *timerlist;
-static clock_time_t next_expiration;
+/*
+ * The pending timers are kept in a binary min-heap ordered by expiration
+ * time. The heap is intrusive: each etimer links to its parent and
+ * children, so there is no limit on the number of timers. The position
+ * of the last node follows from the number of nodes, which gives
+ * O(log n) insertion and removal and O(1) access to the next timer to
+ * expire. Each node also records its position, so a timer is found by
+ * walking from the root to that position.
+ */
+static struct etimer *heap_root;
+static unsigned int heap_nelts;
 
 PROCESS(etimer_process, "Event timer");
+
+#define EXPIRATION(t) ((t)->timer.start + (t)->timer.interval)
+/* Wrap-safe ordering of expiration times. */
+#define BEFORE(a, b) \
+  ((clock_time_t)(EXPIRATION(a) - EXPIRATION(b)) > ((clock_time_t)~0 >> 1))
 /*---------------------------------------------------------------------------*/
+/* Swaps a node with one of its children, by relinking only. */
 static void
-update_time(void)
+heap_swap(struct etimer *parent, struct etimer *child)
 {
-  clock_time_t tdist;
-  clock_time_t now;
-  struct etimer *t;
+  struct etimer *grandparent = parent->parent;
+  struct etimer *left = child->left;
+  struct etimer *right = child->right;
+  unsigned int index = child->heap_index;
+
+  child->heap_index = parent->heap_index;
+  parent->heap_index = index;
+
+  if(parent->left == child) {
+    child->left = parent;
+    child->right = parent->right;
+    if(child->right != NULL) {
+      child->right->parent = child;
+    }
+  } else {
+    child->right = parent;
+    child->left = parent->left;
+    if(child->left != NULL) {
+      child->left->parent = child;
+    }
+  }
+  child->parent = grandparent;
 
-  if (timerlist == NULL) {
-    next_expiration = 0;
+  parent->parent = child;
+  parent->left = left;
+  parent->right = right;
+  if(left != NULL) {
+    left->parent = parent;
+  }
+  if(right != NULL) {
+    right->parent = parent;
+  }
+
+  if(grandparent == NULL) {
+    heap_root = child;
+  } else if(grandparent->left == parent) {
+    grandparent->left = child;
   } else {
-    now = clock_time();
-    t = timerlist;
-    /* Must calculate distance to next time into account due to wraps */
-    tdist = t->timer.start + t->timer.interval - now;
-    for(t = t->next; t != NULL; t = t->next) {
-      if(t->timer.start + t->timer.interval - now < tdist) {
-	tdist = t->timer.start + t->timer.interval - now;
+    grandparent->right = child;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the link to the n:th node [1-based, in level order]. */
+static struct etimer **
+heap_slot(unsigned int n, struct etimer ***parent)
+{
+  struct etimer **slot = &heap_root;
+  unsigned int path, depth;
+
+  /* The bits of n below the leading one spell the path from the root,
+     most significant first: 0 is left, 1 is right. */
+  for(path = 0, depth = 0; n >= 2; depth++, n >>= 1) {
+    path = (path << 1) | (n & 1);
+  }
+  *parent = slot;
+  while(depth-- > 0) {
+    *parent = slot;
+    slot = (path & 1) ? &(*slot)->right : &(*slot)->left;
+    path >>= 1;
+  }
+  return slot;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_insert(struct etimer *t)
+{
+  struct etimer **parent, **slot;
+
+  t->left = t->right = NULL;
+  slot = heap_slot(heap_nelts + 1, &parent);
+  t->parent = (slot == &heap_root) ? NULL : *parent;
+  *slot = t;
+  heap_nelts++;
+  t->heap_index = heap_nelts;
+
+  while(t->parent != NULL && BEFORE(t, t->parent)) {
+    heap_swap(t->parent, t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_remove(struct etimer *t)
+{
+  struct etimer **parent, **slot;
+  struct etimer *last, *smallest;
+
+  if(heap_nelts == 0) {
+    return;
+  }
+
+  /* Unlink the last node; it takes the place of the removed one. */
+  slot = heap_slot(heap_nelts, &parent);
+  last = *slot;
+  *slot = NULL;
+  heap_nelts--;
+
+  if(last != t) {
+    last->heap_index = t->heap_index;
+    last->left = t->left;
+    last->right = t->right;
+    last->parent = t->parent;
+    if(last->left != NULL) {
+      last->left->parent = last;
+    }
+    if(last->right != NULL) {
+      last->right->parent = last;
+    }
+    if(t->parent == NULL) {
+      heap_root = last;
+    } else if(t->parent->left == t) {
+      t->parent->left = last;
+    } else {
+      t->parent->right = last;
+    }
+
+    /* Restore the heap order, downwards or upwards. */
+    for(;;) {
+      smallest = last;
+      if(last->left != NULL && BEFORE(last->left, smallest)) {
+        smallest = last->left;
+      }
+      if(last->right != NULL && BEFORE(last->right, smallest)) {
+        smallest = last->right;
       }
+      if(smallest == last) {
+        break;
+      }
+      heap_swap(last, smallest);
+    }
+    while(last->parent != NULL && BEFORE(last, last->parent)) {
+      heap_swap(last->parent, last);
     }
-    next_expiration = now + tdist;
   }
+
+  t->parent = t->left = t->right = NULL;
+  t->heap_index = 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Checks the position the timer claims against the heap, so the timer may
+ * be one that was never set and holds garbage: only nodes in the heap are
+ * dereferenced on the way.
+ */
+static int
+heap_contains(struct etimer *t)
+{
+  struct etimer **parent;
+
+  if(t->p == PROCESS_NONE || t->heap_index == 0 ||
+     t->heap_index > heap_nelts) {
+    return 0;
+  }
+  return *heap_slot(t->heap_index, &parent) == t;
+}
+/*---------------------------------------------------------------------------*/
+static struct etimer *
+heap_find_process(struct etimer *t, struct process *p)
+{
+  struct etimer *found;
+
+  if(t == NULL || t->p == p) {
+    return t;
+  }
+  found = heap_find_process(t->left, p);
+  return found != NULL ? found : heap_find_process(t->right, p);
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(etimer_process, ev, data)
 {
-  struct etimer *t, *u;
+  struct etimer *t;
 
   PROCESS_BEGIN();
 
-  timerlist = NULL;
+  heap_root = NULL;
+  heap_nelts = 0;
   
   while(1) {
     PROCESS_YIELD();
@@ -91,51 +254,30 @@ PROCESS_THREAD(etimer_process, ev, data)
     if(ev == PROCESS_EVENT_EXITED) {
       struct process *p = data;
 
-      while(timerlist != NULL && timerlist->p == p) {
-	timerlist = timerlist->next;
-      }
-
-      if(timerlist != NULL) {
-	t = timerlist;
-	while(t->next != NULL) {
-	  if(t->next->p == p) {
-	    t->next = t->next->next;
-	  } else
-	    t = t->next;
-	}
+      while((t = heap_find_process(heap_root, p)) != NULL) {
+	heap_remove(t);
       }
       continue;
     } else if(ev != PROCESS_EVENT_POLL) {
       continue;
     }
 
-  again:
-    
-    u = NULL;
-    
-    for(t = timerlist; t != NULL; t = t->next) {
-      if(timer_expired(&t->timer)) {
-	if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
+    /* Deliver all the timers that have expired, earliest first. */
+    while(heap_root != NULL && timer_expired(&heap_root->timer)) {
+      t = heap_root;
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
 
-	  /* Reset the process ID of the event timer, to signal that the
-	     etimer has expired. This is later checked in the
-	     etimer_expired() function. */
-	  t->p = PROCESS_NONE;
-	  if(u != NULL) {
-	    u->next = t->next;
-	  } else {
-	    timerlist = t->next;
-	  }
-	  t->next = NULL;
-	  update_time();
-	  goto again;
-	} else {
-	  etimer_request_poll();
-	}
+	/* Reset the process ID of the event timer, to signal that the
+	   etimer has expired. This is later checked in the
+	   etimer_expired() function. */
+	heap_remove(t);
+	t->p = PROCESS_NONE;
+      } else {
+	/* The event queue is full; try again later. */
+	etimer_request_poll();
+	break;
       }
-      u = t;
     }
-    
   }
   
   PROCESS_END();
@@ -147,35 +289,28 @@ etimer_request_poll(void)
   process_poll(&etimer_process);
 }
 /*---------------------------------------------------------------------------*/
+/* Takes a timer out of the heap before its expiration time changes. */
+static void
+remove_timer(struct etimer *timer)
+{
+  if(heap_contains(timer)) {
+    heap_remove(timer);
+  }
+}
+/*---------------------------------------------------------------------------*/
 static void
 add_timer(struct etimer *timer)
 {
-  struct etimer *t;
-
   etimer_request_poll();
 
-  if(timer->p != PROCESS_NONE) {
-    for(t = timerlist; t != NULL; t = t->next) {
-      if(t == timer) {
-	/* Timer already on list, bail out. */
-        timer->p = PROCESS_CURRENT();
-	update_time();
-	return;
-      }
-    }
-  }
-
-  /* Timer not on list. */
   timer->p = PROCESS_CURRENT();
-  timer->next = timerlist;
-  timerlist = timer;
-
-  update_time();
+  heap_insert(timer);
 }
 /*---------------------------------------------------------------------------*/
 void
 etimer_set(struct etimer *et, clock_time_t interval)
 {
+  remove_timer(et);
   timer_set(&et->timer, interval);
   add_timer(et);
 }
@@ -183,6 +318,7 @@ etimer_set(struct etimer *et, clock_time_t interval)
 void
 etimer_reset(struct etimer *et)
 {
+  remove_timer(et);
   timer_reset(&et->timer);
   add_timer(et);
 }
@@ -190,6 +326,7 @@ etimer_reset(struct etimer *et)
 void
 etimer_restart(struct etimer *et)
 {
+  remove_timer(et);
   timer_restart(&et->timer);
   add_timer(et);
 }
@@ -197,8 +334,13 @@ etimer_restart(struct etimer *et)
 void
 etimer_adjust(struct etimer *et, int timediff)
 {
-  et->timer.start += timediff;
-  update_time();
+  if(heap_contains(et)) {
+    heap_remove(et);
+    et->timer.start += timediff;
+    heap_insert(et);
+  } else {
+    et->timer.start += timediff;
+  }
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -222,41 +364,20 @@ etimer_start_time(struct etimer *et)
 int
 etimer_pending(void)
 {
-  return timerlist != NULL;
+  return heap_root != NULL;
 }
 /*---------------------------------------------------------------------------*/
 clock_time_t
 etimer_next_expiration_time(void)
 {
-  return etimer_pending() ? next_expiration : 0;
+  return etimer_pending() ? EXPIRATION(heap_root) : 0;
 }
 /*---------------------------------------------------------------------------*/
 void
 etimer_stop(struct etimer *et)
 {
-  struct etimer *t;
-
-  /* First check if et is the first event timer on the list. */
-  if(et == timerlist) {
-    timerlist = timerlist->next;
-    update_time();
-  } else {
-    /* Else walk through the list and try to find the item before the
-       et timer. */
-    for(t = timerlist; t != NULL && t->next != et; t = t->next);
-
-    if(t != NULL) {
-      /* We've found the item before the event timer that we are about
-	 to remove. We point the items next pointer to the event after
-	 the removed item. */
-      t->next = et->next;
-
-      update_time();
-    }
-  }
+  remove_timer(et);
 
-  /* Remove the next pointer from the item to be removed. */
-  et->next = NULL;
   /* Set the timer as expired */
   et->p = PROCESS_NONE;
 }
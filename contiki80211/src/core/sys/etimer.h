@@ -75,7 +75,8 @@
  */
 struct etimer {
   struct timer timer;
-  struct etimer *next;
+  struct etimer *parent, *left, *right;
+  unsigned int heap_index;
   struct process *p;
 };
 
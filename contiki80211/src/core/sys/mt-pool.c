@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *         Pool of mt threads for blocking code.
+ */
+#include "sys/mt-pool.h"
+#include <stdio.h>
+
+struct pool_thread {
+  struct mt_thread mt;
+  void (* function)(void *);
+  void *data;
+  struct process *notify;
+  unsigned char busy, done;
+  unsigned long runs;
+  unsigned int stack_peak;
+};
+
+static struct pool_thread threads[MT_POOL_THREADS];
+static struct pool_thread *current;
+static volatile unsigned char busy_count;
+
+process_event_t mt_pool_event_done;
+
+PROCESS(mt_pool_process, "MT pool");
+
+/*---------------------------------------------------------------------------*/
+static void
+thread_main(void *ptr)
+{
+  struct pool_thread *t = ptr;
+
+  t->function(t->data);
+  t->done = 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Run every busy thread up to its next yield. Waiting threads run as
+ * well and check their condition again; a thread that finished is
+ * stopped and its requester notified.
+ */
+static void
+run_threads(void)
+{
+  struct pool_thread *t;
+  unsigned int used;
+
+  for(t = threads; t < &threads[MT_POOL_THREADS]; t++) {
+    if(!t->busy) {
+      continue;
+    }
+    current = t;
+    mt_exec(&t->mt);
+    current = NULL;
+
+    used = mtarch_stack_usage(&t->mt.thread);
+    if(used > t->stack_peak) {
+      t->stack_peak = used;
+    }
+
+    if(t->done) {
+      mt_stop(&t->mt);
+      t->busy = 0;
+      busy_count--;
+      if(t->notify != NULL) {
+        process_post(t->notify, mt_pool_event_done, t->data);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mt_pool_process, ev, data)
+{
+  PROCESS_POLLHANDLER(run_threads());
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_YIELD();
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+mt_pool_init(void)
+{
+  mt_init();
+  mt_pool_event_done = process_alloc_event();
+  process_start(&mt_pool_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+int
+mt_pool_run(void (* function)(void *), void *data, struct process *notify)
+{
+  struct pool_thread *t;
+
+  for(t = threads; t < &threads[MT_POOL_THREADS]; t++) {
+    if(!t->busy) {
+      t->function = function;
+      t->data = data;
+      t->notify = notify;
+      t->done = 0;
+      t->runs++;
+      mt_start(&t->mt, thread_main, t);
+      t->busy = 1;
+      busy_count++;
+      process_poll(&mt_pool_process);
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+mt_pool_in_thread(void)
+{
+  return current != NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+mt_pool_yield(void)
+{
+  process_poll(&mt_pool_process);
+  mt_yield();
+}
+/*---------------------------------------------------------------------------*/
+void
+mt_pool_wait(void)
+{
+  mt_yield();
+}
+/*---------------------------------------------------------------------------*/
+void
+mt_pool_wake(void)
+{
+  if(busy_count > 0) {
+    process_poll(&mt_pool_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+mt_pool_service(void)
+{
+  if(current == NULL && busy_count > 0) {
+    run_threads();
+  }
+}
+/*---------------------------------------------------------------------------*/
+unsigned int
+mt_pool_stack_peak(int thread)
+{
+  if(thread < 0 || thread >= MT_POOL_THREADS) {
+    return 0;
+  }
+  return threads[thread].stack_peak;
+}
+/*---------------------------------------------------------------------------*/
+void
+mt_pool_print_stats(void)
+{
+  int i;
+
+  for(i = 0; i < MT_POOL_THREADS; i++) {
+    printf("MT pool %d: %s, %lu runs, stack peak %u of %u bytes\n", i,
+           threads[i].busy ? "busy" : "idle", threads[i].runs,
+           threads[i].stack_peak,
+           (unsigned int)(MTARCH_STACKSIZE * sizeof(uint32_t)));
+  }
+}
+/*---------------------------------------------------------------------------*/
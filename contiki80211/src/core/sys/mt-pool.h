@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *         A small pool of mt threads for blocking code. A routine that
+ *         busy-waits on the hardware runs on a pool thread with its own
+ *         stack and yields while it waits, so that the protothread
+ *         processes keep running.
+ */
+#ifndef MT_POOL_H_
+#define MT_POOL_H_
+
+#include "contiki.h"
+#include "sys/mt.h"
+
+/* Number of pool threads; each has a stack of MTARCH_STACKSIZE words. */
+#ifdef MT_POOL_CONF_THREADS
+#define MT_POOL_THREADS MT_POOL_CONF_THREADS
+#else
+#define MT_POOL_THREADS 2
+#endif /* MT_POOL_CONF_THREADS */
+
+PROCESS_NAME(mt_pool_process);
+
+/* Posted to the process given to mt_pool_run(), with the routine's data,
+   when the routine has returned. */
+extern process_event_t mt_pool_event_done;
+
+void mt_pool_init(void);
+
+/*
+ * Run a routine on a free pool thread. The routine starts at the next
+ * scheduling round. Returns 0 if all threads are busy.
+ */
+int mt_pool_run(void (* function)(void *), void *data, struct process *notify);
+
+/* Non-zero while running on a pool thread. */
+int mt_pool_in_thread(void);
+
+/* Give up the CPU; the thread resumes at the next scheduling round. */
+void mt_pool_yield(void);
+
+/*
+ * Give up the CPU until mt_pool_wake() is called; for waiting on an
+ * event signalled by an interrupt. Wake-ups may be spurious, so the
+ * caller checks its condition again on return.
+ */
+void mt_pool_wait(void);
+
+/* Resume the waiting threads. May be called from interrupt context. */
+void mt_pool_wake(void);
+
+/*
+ * Run the busy threads up to their next yield, from process context.
+ * For a caller that must wait for something a pool thread holds; the
+ * scheduler can not run the thread while that caller blocks.
+ */
+void mt_pool_service(void);
+
+/* Highest stack use of a pool thread over all its routines, in bytes. */
+unsigned int mt_pool_stack_peak(int thread);
+
+void mt_pool_print_stats(void);
+
+#endif /* MT_POOL_H_ */
@@ -47,6 +47,8 @@
 
 #include "sys/process.h"
 #include "sys/arg.h"
+#include "sys/trace.h"
+#include "sys/energest.h"
 
 /*
  * Pointer to the currently running process structure.
@@ -65,13 +67,35 @@ struct event_data {
   struct process *p;
 };
 
-static process_num_events_t nevents, fevent;
-static struct event_data events[PROCESS_CONF_NUMEVENTS];
+/*
+ * One circular event queue per priority lane. The total number of
+ * queued events is kept in nevents.
+ */
+struct event_lane {
+  struct event_data *events;
+  process_num_events_t size, nevents, fevent;
+  unsigned long drops;
+};
+
+static struct event_data events_normal[PROCESS_CONF_NUMEVENTS];
+static struct event_data events_high[PROCESS_CONF_NUMEVENTS_HIGH];
+
+static struct event_lane lanes[PROCESS_PRIO_LEVELS] = {
+  { events_normal, PROCESS_CONF_NUMEVENTS },
+  { events_high, PROCESS_CONF_NUMEVENTS_HIGH },
+};
+
+static process_num_events_t nevents;
 
 #if PROCESS_CONF_STATS
 process_num_events_t process_maxevents;
 #endif
 
+/*
+ * Processes with a pending poll request, in the order of the requests.
+ * A process is on the list exactly when its needspoll flag is set.
+ */
+static struct process *poll_head, *poll_tail;
 static volatile unsigned char poll_requested;
 
 #define PROCESS_STATE_NONE        0
@@ -175,6 +199,10 @@ static void
 call_process(struct process *p, process_event_t ev, process_data_t data)
 {
   int ret;
+  unsigned char owner;
+#if PROCESS_CONF_ACCOUNTING
+  rtimer_clock_t start, elapsed;
+#endif /* PROCESS_CONF_ACCOUNTING */
 
 #if DEBUG
   if(p->state == PROCESS_STATE_CALLED) {
@@ -187,7 +215,20 @@ call_process(struct process *p, process_event_t ev, process_data_t data)
     PRINTF("process: calling process '%s' with event %d\n", PROCESS_NAME_STRING(p), ev);
     process_current = p;
     p->state = PROCESS_STATE_CALLED;
+    owner = ENERGEST_CPU_ENTER(p->cpu);
+#if PROCESS_CONF_ACCOUNTING
+    start = RTIMER_NOW();
+    ret = p->thread(&p->pt, ev, data);
+    elapsed = RTIMER_NOW() - start;
+    p->acct.calls++;
+    p->acct.total += elapsed;
+    if(elapsed > p->acct.max) {
+      p->acct.max = (unsigned long)elapsed;
+    }
+#else /* PROCESS_CONF_ACCOUNTING */
     ret = p->thread(&p->pt, ev, data);
+#endif /* PROCESS_CONF_ACCOUNTING */
+    ENERGEST_CPU_LEAVE(owner);
     if(ret == PT_EXITED ||
        ret == PT_ENDED ||
        ev == PROCESS_EVENT_EXIT) {
@@ -207,9 +248,16 @@ process_exit(struct process *p)
 void
 process_init(void)
 {
+  unsigned char i;
+
   lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  nevents = 0;
+  for(i = 0; i < PROCESS_PRIO_LEVELS; i++) {
+    lanes[i].nevents = lanes[i].fevent = 0;
+    lanes[i].drops = 0;
+  }
+  poll_head = poll_tail = NULL;
 #if PROCESS_CONF_STATS
   process_maxevents = 0;
 #endif /* PROCESS_CONF_STATS */
@@ -224,14 +272,28 @@ process_init(void)
 static void
 do_poll(void)
 {
-  struct process *p;
-
+  struct process *p, *list;
+  PROCESS_CONF_IRQ_FLAGS_T flags;
+
+  /* Take over the pending requests; polls requested from now on are
+     served in the next round. */
+  flags = PROCESS_CONF_IRQ_SAVE();
+  list = poll_head;
+  poll_head = poll_tail = NULL;
   poll_requested = 0;
+  PROCESS_CONF_IRQ_RESTORE(flags);
+
   /* Call the processes that needs to be polled. */
-  for(p = process_list; p != NULL; p = p->next) {
-    if(p->needspoll) {
+  while(list != NULL) {
+    p = list;
+    flags = PROCESS_CONF_IRQ_SAVE();
+    list = p->nextpoll;
+    p->needspoll = 0;
+    PROCESS_CONF_IRQ_RESTORE(flags);
+
+    /* The process may have exited since the request. */
+    if(p->state != PROCESS_STATE_NONE) {
       p->state = PROCESS_STATE_RUNNING;
-      p->needspoll = 0;
       call_process(p, PROCESS_EVENT_POLL, NULL);
     }
   }
@@ -249,6 +311,7 @@ do_event(void)
   static process_data_t data;
   static struct process *receiver;
   static struct process *p;
+  static struct event_lane *lane;
   
   /*
    * If there are any events in the queue, take the first one and walk
@@ -259,16 +322,23 @@ do_event(void)
    */
 
   if(nevents > 0) {
+
+    /* Take the event from the highest lane that has one. */
+    lane = &lanes[PROCESS_PRIO_LEVELS - 1];
+    while(lane->nevents == 0) {
+      --lane;
+    }
     
     /* There are events that we should deliver. */
-    ev = events[fevent].ev;
+    ev = lane->events[lane->fevent].ev;
     
-    data = events[fevent].data;
-    receiver = events[fevent].p;
+    data = lane->events[lane->fevent].data;
+    receiver = lane->events[lane->fevent].p;
 
     /* Since we have seen the new event, we move pointer upwards
        and decrese the number of events. */
-    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    lane->fevent = (lane->fevent + 1) % lane->size;
+    --lane->nevents;
     --nevents;
 
     /* If this is a broadcast event, we deliver it to all events, in
@@ -322,6 +392,7 @@ int
 process_post(struct process *p, process_event_t ev, process_data_t data)
 {
   static process_num_events_t snum;
+  static struct event_lane *lane;
 
   if(PROCESS_CURRENT() == NULL) {
     PRINTF("process_post: NULL process posts event %d to process '%s', nevents %d\n",
@@ -332,7 +403,27 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
 	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
   }
   
-  if(nevents == PROCESS_CONF_NUMEVENTS) {
+  if(p == PROCESS_BROADCAST || p->prio >= PROCESS_PRIO_LEVELS) {
+    lane = &lanes[PROCESS_PRIO_NORMAL];
+  } else {
+    lane = &lanes[p->prio];
+  }
+
+#if PROCESS_CONF_ACCOUNTING
+  if(process_current != NULL) {
+    process_current->acct.posts++;
+  }
+#endif /* PROCESS_CONF_ACCOUNTING */
+  
+  if(lane->nevents == lane->size) {
+    lane->drops++;
+    TRACE(TRACE_PROCESS_DROP, ev, lane - lanes);
+#if PROCESS_CONF_ACCOUNTING
+    /* Charge the drop to the poster, to tell who floods the queue. */
+    if(process_current != NULL) {
+      process_current->acct.drops++;
+    }
+#endif /* PROCESS_CONF_ACCOUNTING */
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
       printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_current));
@@ -343,10 +434,11 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
     return PROCESS_ERR_FULL;
   }
   
-  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
-  events[snum].ev = ev;
-  events[snum].data = data;
-  events[snum].p = p;
+  snum = (process_num_events_t)(lane->fevent + lane->nevents) % lane->size;
+  lane->events[snum].ev = ev;
+  lane->events[snum].data = data;
+  lane->events[snum].p = p;
+  ++lane->nevents;
   ++nevents;
 
 #if PROCESS_CONF_STATS
@@ -368,13 +460,49 @@ process_post_synch(struct process *p, process_event_t ev, process_data_t data)
 }
 /*---------------------------------------------------------------------------*/
 void
+process_set_priority(struct process *p, unsigned char prio)
+{
+  if(prio < PROCESS_PRIO_LEVELS) {
+    p->prio = prio;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+process_set_cpu(struct process *p, unsigned char owner)
+{
+  if(owner < ENERGEST_CPU_MAX) {
+    p->cpu = owner;
+  }
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+process_drops(unsigned char prio)
+{
+  return prio < PROCESS_PRIO_LEVELS ? lanes[prio].drops : 0;
+}
+/*---------------------------------------------------------------------------*/
+void
 process_poll(struct process *p)
 {
+  PROCESS_CONF_IRQ_FLAGS_T flags;
+
   if(p != NULL) {
     if(p->state == PROCESS_STATE_RUNNING ||
        p->state == PROCESS_STATE_CALLED) {
-      p->needspoll = 1;
+      flags = PROCESS_CONF_IRQ_SAVE();
+      /* Append to the poll list, unless already there. */
+      if(!p->needspoll) {
+        p->needspoll = 1;
+        p->nextpoll = NULL;
+        if(poll_tail == NULL) {
+          poll_head = p;
+        } else {
+          poll_tail->nextpoll = p;
+        }
+        poll_tail = p;
+      }
       poll_requested = 1;
+      PROCESS_CONF_IRQ_RESTORE(flags);
     }
   }
 }
@@ -385,4 +513,24 @@ process_is_running(struct process *p)
   return p->state != PROCESS_STATE_NONE;
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_ACCOUNTING
+void
+process_accounting_print(void)
+{
+  struct process *p;
+  unsigned char i;
+
+  for(i = 0; i < PROCESS_PRIO_LEVELS; i++) {
+    printf("process: lane %u, queued %u/%u, dropped %lu\n", i,
+           lanes[i].nevents, lanes[i].size, lanes[i].drops);
+  }
+  for(p = process_list; p != NULL; p = p->next) {
+    printf("process: '%s' prio %u, calls %lu, time %lu [max %lu], posts %lu [dropped %lu]\n",
+           PROCESS_NAME_STRING(p), p->prio, p->acct.calls,
+           (unsigned long)p->acct.total, p->acct.max,
+           p->acct.posts, p->acct.drops);
+  }
+}
+#endif /* PROCESS_CONF_ACCOUNTING */
+/*---------------------------------------------------------------------------*/
 /** @} */ 
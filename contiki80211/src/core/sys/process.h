@@ -89,6 +89,51 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/* Size of the event queue of the high priority lane. */
+#ifndef PROCESS_CONF_NUMEVENTS_HIGH
+#define PROCESS_CONF_NUMEVENTS_HIGH 8
+#endif /* PROCESS_CONF_NUMEVENTS_HIGH */
+
+/**
+ * \name Event priority lanes
+ *
+ * Every process has a priority, which selects the event queue [lane]
+ * holding the events posted to it. Pending events of a higher lane are
+ * always delivered first. Broadcast events use the normal lane.
+ * @{
+ */
+#define PROCESS_PRIO_NORMAL   0
+#define PROCESS_PRIO_HIGH     1
+#define PROCESS_PRIO_LEVELS   2
+/* @} */
+
+/*
+ * Poll requests may come from interrupt context, so the poll list is 
+ * updated with interrupts disabled. Platforms define these as needed.
+ */
+#ifndef PROCESS_CONF_IRQ_SAVE
+#define PROCESS_CONF_IRQ_FLAGS_T      unsigned char
+#define PROCESS_CONF_IRQ_SAVE()       0
+#define PROCESS_CONF_IRQ_RESTORE(f)   (void)(f)
+#endif /* PROCESS_CONF_IRQ_SAVE */
+
+#if PROCESS_CONF_ACCOUNTING
+#include "sys/rtimer.h"
+
+/**
+ * Per-process accounting, kept when PROCESS_CONF_ACCOUNTING is set.
+ * Run times are in rtimer ticks and include any synchronous calls to
+ * other processes.
+ */
+struct process_accounting {
+  unsigned long calls;      /* Invocations of the process thread  */
+  unsigned long posts;      /* Events posted by the process       */
+  unsigned long drops;      /* Of those, events lost to full lanes */
+  rtimer_clock_t total;     /* Cumulative run time                */
+  unsigned long max;        /* Longest single invocation          */
+};
+#endif /* PROCESS_CONF_ACCOUNTING */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -324,6 +369,11 @@ struct process {
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
   unsigned char state, needspoll;
+  unsigned char prio, cpu;
+  struct process *nextpoll;
+#if PROCESS_CONF_ACCOUNTING
+  struct process_accounting acct;
+#endif /* PROCESS_CONF_ACCOUNTING */
 };
 
 /**
@@ -365,6 +415,27 @@ CCIF void process_start(struct process *p, const char *arg);
  */
 CCIF int process_post(struct process *p, process_event_t ev, void* data);
 
+/**
+ * Set the priority of a process.
+ *
+ * \param p A pointer to the process' process structure.
+ *
+ * \param prio The priority, PROCESS_PRIO_NORMAL [the default] or
+ * PROCESS_PRIO_HIGH. Events posted to the process are queued in the
+ * lane of this priority.
+ */
+CCIF void process_set_priority(struct process *p, unsigned char prio);
+
+/**
+ * Set the owner its run time is charged to, when energest is enabled.
+ *
+ * \param p A pointer to the process' process structure.
+ *
+ * \param owner One of the ENERGEST_CPU_ owners in sys/energest.h;
+ * ENERGEST_CPU_APP is the default.
+ */
+CCIF void process_set_cpu(struct process *p, unsigned char owner);
+
 /**
  * Post a synchronous event to a process.
  *
@@ -520,6 +591,23 @@ CCIF int process_is_running(struct process *p);
  */
 int process_nevents(void);
 
+/**
+ * Number of events dropped because an event lane was full.
+ *
+ * \param prio The lane [PROCESS_PRIO_NORMAL or PROCESS_PRIO_HIGH].
+ *
+ * \return The number of events that could not be posted to the lane
+ * since the system started.
+ */
+unsigned long process_drops(unsigned char prio);
+
+#if PROCESS_CONF_ACCOUNTING
+/**
+ * Print the accounting of all running processes and the event lanes.
+ */
+void process_accounting_print(void);
+#endif /* PROCESS_CONF_ACCOUNTING */
+
 /** @} */
 
 CCIF extern struct process *process_list;
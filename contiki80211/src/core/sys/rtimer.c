@@ -55,12 +55,47 @@
 #define PRINTF(...)
 #endif
 
-static struct rtimer *next_rtimer;
+/* Pending tasks, sorted by time. */
+static struct rtimer *rtimer_list;
+/* Set while due tasks are executed; the hardware timer is then
+   programmed only once they are all done. */
+static volatile unsigned char rtimer_running;
 
+static struct rtimer_stats stats;
+
+/*---------------------------------------------------------------------------*/
+static void
+schedule(rtimer_clock_t time)
+{
+  rtimer_clock_t now = RTIMER_NOW();
+
+  /* Never program a time that has already passed. */
+  if(RTIMER_CLOCK_LT(time, now + RTIMER_GUARD_TIME)) {
+    time = now + RTIMER_GUARD_TIME;
+  }
+  rtimer_arch_schedule(time);
+}
+/*---------------------------------------------------------------------------*/
+static int
+unlink_task(struct rtimer *task)
+{
+  struct rtimer **p;
+
+  for(p = &rtimer_list; *p != NULL; p = &(*p)->next) {
+    if(*p == task) {
+      *p = task->next;
+      task->next = NULL;
+      return 1;
+    }
+  }
+  return 0;
+}
 /*---------------------------------------------------------------------------*/
 void
 rtimer_init(void)
 {
+  rtimer_list = NULL;
+  rtimer_running = 0;
   rtimer_arch_init();
 }
 /*---------------------------------------------------------------------------*/
@@ -69,39 +104,117 @@ rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
 	   rtimer_clock_t duration,
 	   rtimer_callback_t func, void *ptr)
 {
-  int first = 0;
+  struct rtimer **p;
 
   PRINTF("rtimer_set time %d\n", time);
 
-  if(next_rtimer == NULL) {
-    first = 1;
-  }
+  rtimer_arch_disable_irq();
+
+  unlink_task(rtimer);
 
   rtimer->func = func;
   rtimer->ptr = ptr;
-
   rtimer->time = time;
-  next_rtimer = rtimer;
 
-  if(first == 1) {
-    rtimer_arch_schedule(time);
+  /* Insert after the tasks with the same or an earlier time. */
+  for(p = &rtimer_list; *p != NULL && !RTIMER_CLOCK_LT(time, (*p)->time);
+      p = &(*p)->next);
+  rtimer->next = *p;
+  *p = rtimer;
+
+  if(rtimer_list == rtimer && !rtimer_running) {
+    schedule(time);
   }
+
+  rtimer_arch_enable_irq();
   return RTIMER_OK;
 }
 /*---------------------------------------------------------------------------*/
+int
+rtimer_cancel(struct rtimer *rtimer)
+{
+  int found;
+
+  /* The hardware timer is left as it is; should it expire, there is
+     nothing due and the next task is scheduled. */
+  rtimer_arch_disable_irq();
+  found = unlink_task(rtimer);
+  rtimer_arch_enable_irq();
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_is_scheduled(struct rtimer *rtimer)
+{
+  struct rtimer *t;
+
+  rtimer_arch_disable_irq();
+  for(t = rtimer_list; t != NULL && t != rtimer; t = t->next);
+  rtimer_arch_enable_irq();
+  return t != NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_next_expiration(rtimer_clock_t *time)
+{
+  int pending = 0;
+
+  rtimer_arch_disable_irq();
+  if(rtimer_list != NULL) {
+    *time = rtimer_list->time;
+    pending = 1;
+  }
+  rtimer_arch_enable_irq();
+  return pending;
+}
+/*---------------------------------------------------------------------------*/
+void
+rtimer_get_stats(struct rtimer_stats *s, int reset)
+{
+  rtimer_arch_disable_irq();
+  *s = stats;
+  if(reset) {
+    stats.runs = 0;
+    stats.late_total = 0;
+    stats.late_max = 0;
+  }
+  rtimer_arch_enable_irq();
+}
+/*---------------------------------------------------------------------------*/
 void
 rtimer_run_next(void)
 {
   struct rtimer *t;
-  if(next_rtimer == NULL) {
-    return;
+  rtimer_clock_t now;
+
+  rtimer_running = 1;
+  for(;;) {
+    rtimer_arch_disable_irq();
+    t = rtimer_list;
+    now = RTIMER_NOW();
+    if(t == NULL || RTIMER_CLOCK_LT(now, t->time)) {
+      rtimer_arch_enable_irq();
+      break;
+    }
+    rtimer_list = t->next;
+    t->next = NULL;
+    t->late = now - t->time;
+    stats.runs++;
+    stats.late_total += t->late;
+    if(t->late > stats.late_max) {
+      stats.late_max = t->late;
+    }
+    rtimer_arch_enable_irq();
+
+    /* The task may set itself, or other tasks, again. */
+    t->func(t, t->ptr);
   }
-  t = next_rtimer;
-  next_rtimer = NULL;
-  t->func(t, t->ptr);
-  if(next_rtimer != NULL) {
-    rtimer_arch_schedule(next_rtimer->time);
+  rtimer_running = 0;
+
+  rtimer_arch_disable_irq();
+  if(rtimer_list != NULL) {
+    schedule(rtimer_list->time);
   }
-  return;
+  rtimer_arch_enable_irq();
 }
 /*---------------------------------------------------------------------------*/
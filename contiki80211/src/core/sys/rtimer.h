@@ -85,8 +85,28 @@ struct rtimer {
   rtimer_clock_t time;
   rtimer_callback_t func;
   void *ptr;
+  struct rtimer *next;
+  /* How late the task last ran, relative to its time */
+  rtimer_clock_t late;
 };
 
+/**
+ * \brief      Lateness statistics of all executed real-time tasks
+ */
+struct rtimer_stats {
+  unsigned long runs;
+  rtimer_clock_t late_total;
+  rtimer_clock_t late_max;
+};
+
+/* Minimum lead time when programming the hardware timer. Tasks posted
+   for an earlier time run as soon as possible. */
+#ifdef RTIMER_CONF_GUARD_TIME
+#define RTIMER_GUARD_TIME RTIMER_CONF_GUARD_TIME
+#else
+#define RTIMER_GUARD_TIME 4
+#endif /* RTIMER_CONF_GUARD_TIME */
+
 enum {
   RTIMER_OK,
   RTIMER_ERR_FULL,
@@ -101,25 +121,62 @@ enum {
  * \param duration Unused argument.
  * \param func A function to be called when the task is executed.
  * \param ptr An opaque pointer that will be supplied as an argument to the callback function.
- * \return     Non-zero (true) if the task could be scheduled, zero
- *             (false) if the task could not be scheduled.
+ * \return     RTIMER_OK if the task could be scheduled.
  *
  *             This function schedules a real-time task at a specified
- *             time in the future.
+ *             time in the future. Any number of tasks may be pending;
+ *             they are kept sorted by time. Setting a task that is
+ *             already pending reschedules it.
  *
  */
 int rtimer_set(struct rtimer *task, rtimer_clock_t time,
 	       rtimer_clock_t duration, rtimer_callback_t func, void *ptr);
 
+/**
+ * \brief      Cancel a pending real-time task
+ * \param task The task
+ * \return     Non-zero if the task was pending
+ *
+ */
+int rtimer_cancel(struct rtimer *task);
+
+/**
+ * \brief      Check whether a real-time task is pending
+ * \param task The task
+ * \return     Non-zero if the task is pending
+ *
+ */
+int rtimer_is_scheduled(struct rtimer *task);
+
+/**
+ * \brief      Get the lateness statistics of the real-time tasks
+ * \param reset Non-zero to clear the statistics after reading them
+ * \param stats Set to the statistics since the last reset
+ *
+ */
+void rtimer_get_stats(struct rtimer_stats *stats, int reset);
+
 /**
  * \brief      Execute the next real-time task and schedule the next task, if any
  *
  *             This function is called by the architecture dependent
- *             code to execute and schedule the next real-time task.
+ *             code to execute all the real-time tasks that are due
+ *             and schedule the next one, if any.
  *
  */
 void rtimer_run_next(void);
 
+/**
+ * \brief      Get the time of the next real-time task
+ * \param time Set to the time of the next task, if there is one
+ * \return     Non-zero if a real-time task is scheduled
+ *
+ *             This function is used by the idle loop to bound the
+ *             time it may sleep.
+ *
+ */
+int rtimer_next_expiration(rtimer_clock_t *time);
+
 /**
  * \brief      Get the current clock time
  * \return     The current time
@@ -145,8 +202,19 @@ void rtimer_run_next(void);
  */
 #define RTIMER_TIME(task) ((task)->time)
 
+/**
+ * \brief      Get how late a task last was executed
+ * \param task The task
+ * \return     The time between the scheduled and the actual execution
+ *
+ * \hideinitializer
+ */
+#define RTIMER_LATE(task) ((task)->late)
+
 void rtimer_arch_init(void);
 void rtimer_arch_schedule(rtimer_clock_t t);
+void rtimer_arch_disable_irq(void);
+void rtimer_arch_enable_irq(void);
 /*rtimer_clock_t rtimer_arch_now(void);*/
 
 #define RTIMER_SECOND RTIMER_ARCH_SECOND
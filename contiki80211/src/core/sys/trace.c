@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *         Binary trace ring.
+ */
+#include "sys/trace.h"
+#include "sys/rtimer.h"
+#include <stdio.h>
+
+#if (TRACE_SIZE & (TRACE_SIZE - 1)) != 0
+#error TRACE_CONF_SIZE must be a power of two
+#endif
+
+static struct trace_record ring[TRACE_SIZE];
+
+/* Sequence number of the next record; also selects its slot. */
+static volatile uint32_t next_seq;
+
+static volatile unsigned char enabled = 1;
+
+/*---------------------------------------------------------------------------*/
+void
+trace_write(uint16_t id, uint32_t a, uint32_t b)
+{
+  struct trace_record *r;
+  uint32_t seq;
+
+  if(!enabled) {
+    return;
+  }
+  /* Claim a slot without locking; an interrupting writer simply claims
+     the next one. The oldest records are overwritten. */
+  seq = __sync_fetch_and_add(&next_seq, 1);
+  r = &ring[seq & (TRACE_SIZE - 1)];
+
+  r->time = (uint32_t)RTIMER_NOW();
+  r->id = id;
+  r->a = a;
+  r->b = b;
+  r->seq = (uint16_t)seq;
+}
+/*---------------------------------------------------------------------------*/
+void
+trace_enable(int on)
+{
+  enabled = on;
+}
+/*---------------------------------------------------------------------------*/
+void
+trace_dump(void)
+{
+  struct trace_record *r;
+  uint32_t seq, first, last;
+  unsigned char was_enabled = enabled;
+
+  enabled = 0;
+
+  last = next_seq;
+  first = last > TRACE_SIZE ? last - TRACE_SIZE : 0;
+
+  printf("TRACE BEGIN %lu %lu\n", (unsigned long)RTIMER_SECOND,
+         (unsigned long)(last - first));
+  for(seq = first; seq != last; seq++) {
+    r = &ring[seq & (TRACE_SIZE - 1)];
+    printf("TR %08lx %04x %04x %08lx %08lx\n", (unsigned long)r->time,
+           r->id, r->seq, (unsigned long)r->a, (unsigned long)r->b);
+  }
+  printf("TRACE END\n");
+
+  enabled = was_enabled;
+  TRACE(TRACE_DUMP, last - first, 0);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *         Binary trace ring: fixed-size event records with a real-time
+ *         timestamp, for tracing the stack without printf.
+ */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "contiki-conf.h"
+#include <stdint.h>
+
+/*
+ * Trace classes. Only the classes in TRACE_CONF_CLASSES are compiled
+ * in; the probes of the others cost nothing.
+ */
+#define TRACE_CLASS_KERNEL      0x01
+#define TRACE_CLASS_DRIVER      0x02
+#define TRACE_CLASS_PSM         0x04
+#define TRACE_CLASS_IBSS        0x08
+#define TRACE_CLASS_USB         0x10
+#define TRACE_CLASS_UIP         0x20
+#define TRACE_CLASS_RPL         0x40
+#define TRACE_CLASS_ALL         0xff
+
+#ifdef TRACE_CONF_CLASSES
+#define TRACE_CLASSES TRACE_CONF_CLASSES
+#else
+#define TRACE_CLASSES 0
+#endif /* TRACE_CONF_CLASSES */
+
+/* Number of records in the ring; a power of two. */
+#ifdef TRACE_CONF_SIZE
+#define TRACE_SIZE TRACE_CONF_SIZE
+#else
+#define TRACE_SIZE 128
+#endif /* TRACE_CONF_SIZE */
+
+/*
+ * Event identifiers. The upper byte is the bit number of the class, the
+ * lower byte the event within the class. The host decoder reads the
+ * names and argument meanings from this list.
+ */
+#define TRACE_ID(class_bit, n)  (((class_bit) << 8) | (n))
+#define TRACE_CLASS_OF(id)      (1 << ((id) >> 8))
+
+enum {
+  /* Kernel */
+  TRACE_PROCESS_DROP      = TRACE_ID(0, 1), /* a: event, b: priority lane */
+  TRACE_DUMP              = TRACE_ID(0, 2), /* a: records dumped */
+  /* AR9170 driver */
+  TRACE_RX_MPDU           = TRACE_ID(1, 1), /* a: length, b: MAC status */
+  TRACE_TX_SUBMIT         = TRACE_ID(1, 2), /* a: length, b: queue */
+  TRACE_TX_STATUS         = TRACE_ID(1, 3), /* a: cookie, b: success */
+  TRACE_CMD_RSP           = TRACE_ID(1, 4), /* a: command, b: length */
+  /* Power-save management */
+  TRACE_PSM_PRETBTT       = TRACE_ID(2, 1), /* a: anchor [low 32 bits], b: observed - anchor */
+  TRACE_PSM_ATIM_START    = TRACE_ID(2, 2), /* a: lateness [ticks], b: PSM state */
+  TRACE_PSM_ATIM_END      = TRACE_ID(2, 3), /* a: lateness [ticks], b: PSM state */
+  TRACE_PSM_SOFT_BCN      = TRACE_ID(2, 4), /* a: lateness [ticks], b: PSM state */
+  TRACE_PSM_STATE         = TRACE_ID(2, 5), /* a: RF on, b: off override */
+  /* IBSS */
+  TRACE_IBSS_BEACON       = TRACE_ID(3, 1), /* a: TSF [low 32 bits], b: joined BSSID */
+  TRACE_IBSS_JOIN         = TRACE_ID(3, 2), /* a: frequency, b: created */
+  /* USB */
+  TRACE_USB_TX            = TRACE_ID(4, 1), /* a: length, b: endpoint */
+  TRACE_USB_RX            = TRACE_ID(4, 2), /* a: length, b: status */
+  /* uIP */
+  TRACE_UIP_IN            = TRACE_ID(5, 1), /* a: length, b: next header */
+  TRACE_UIP_OUT           = TRACE_ID(5, 2), /* a: length, b: next header */
+  /* RPL */
+  TRACE_RPL_DIO_IN        = TRACE_ID(6, 1), /* a: rank, b: version */
+  TRACE_RPL_DIO_OUT       = TRACE_ID(6, 2), /* a: rank, b: unicast */
+  TRACE_RPL_DAO_IN        = TRACE_ID(6, 3), /* a: lifetime, b: sequence */
+  TRACE_RPL_DAO_OUT       = TRACE_ID(6, 4), /* a: lifetime, b: sequence */
+};
+
+/*
+ * Trace record, little-endian in the dump. The timestamp is the low 32 
+ * bits of the rtimer clock; the sequence number lets the decoder spot
+ * lost or torn records.
+ */
+struct trace_record {
+  uint32_t time;
+  uint16_t id;
+  uint16_t seq;
+  uint32_t a;
+  uint32_t b;
+};
+
+/*
+ * Record an event, if its class is compiled in. Safe to use from any
+ * context, interrupt handlers included.
+ */
+#define TRACE(id, a, b) do {                            \
+    if((TRACE_CLASSES & TRACE_CLASS_OF(id)) != 0) {     \
+      trace_write((id), (uint32_t)(a), (uint32_t)(b));  \
+    }                                                   \
+  } while(0)
+
+void trace_write(uint16_t id, uint32_t a, uint32_t b);
+
+/* Pause or resume recording; the ring keeps its content. */
+void trace_enable(int on);
+
+/*
+ * Print the ring on the console, oldest record first, for the host
+ * decoder [tools/trace_decode.py]. Recording pauses meanwhile.
+ */
+void trace_dump(void);
+
+#endif /* TRACE_H_ */
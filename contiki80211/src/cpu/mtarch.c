@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Multithreading support for the ARM Cortex-M3.
+ *
+ * A thread runs on its own stack through the process stack pointer.
+ * Switching saves the callee-saved registers on the stack that is left
+ * and restores them from the one that is entered; the kernel keeps the
+ * main stack throughout. Exceptions taken while a thread runs stack
+ * their 8-word frame on the thread stack and then run on the main stack.
+ * There is no preemption: threads give up the CPU with mt_yield().
+ */
+#include "contiki.h"
+#include "sys/mt.h"
+#include <string.h>
+
+/* Words saved by a context switch: r4-r12 [r12 keeps the stack 8-byte
+ * aligned] and the return address.
+ */
+#define MTARCH_FRAME_WORDS		10
+
+/* Pattern filling unused stack, for the high-water measurement. */
+#define MTARCH_STACK_FILL		0xA5A5A5A5
+
+/* Thread currently switched in, if any. */
+static struct mtarch_thread *running;
+
+/*---------------------------------------------------------------------------*/
+/* Switch from the kernel [main stack] to the thread stack at sp. Returns 
+ * when the thread switches out.
+ */
+static void __attribute__((naked, noinline)) mtarch_switch_in(uint32_t *sp)
+{
+	__asm volatile (
+		"push	{r4-r12, lr}	\n"
+		"msr	psp, r0			\n"
+		"mrs	r1, control		\n"
+		"orr	r1, r1, #2		\n"
+		"msr	control, r1		\n"
+		"isb					\n"
+		"pop	{r4-r12, pc}	\n"
+	);
+}
+/*---------------------------------------------------------------------------*/
+/* Switch from the running thread back to the kernel, saving the thread
+ * stack pointer in *sp. Returns when the thread is switched in again.
+ */
+static void __attribute__((naked, noinline)) mtarch_switch_out(uint32_t **sp)
+{
+	__asm volatile (
+		"push	{r4-r12, lr}	\n"
+		"mov	r1, sp			\n"
+		"str	r1, [r0]		\n"
+		"mrs	r1, control		\n"
+		"bic	r1, r1, #2		\n"
+		"msr	control, r1		\n"
+		"isb					\n"
+		"pop	{r4-r12, pc}	\n"
+	);
+}
+/*---------------------------------------------------------------------------*/
+/* First code a thread runs; the thread ends through mt_exit(). */
+static void mtarch_thread_entry(void)
+{
+	running->function(running->data);
+	mt_exit();
+}
+/*---------------------------------------------------------------------------*/
+void mtarch_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void mtarch_remove(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void mtarch_start(struct mtarch_thread *thread, void (* function)(void *data), void *data)
+{
+	int i;
+	
+	for (i = 0; i < MTARCH_STACKSIZE; i++) {
+		thread->stack[i] = MTARCH_STACK_FILL;
+	}
+	thread->function = function;
+	thread->data = data;
+	
+	/* Initial frame, as if the thread had switched out: zeroed registers
+	 * and the entry function as the return address.
+	 */
+	thread->sp = &thread->stack[MTARCH_STACKSIZE - MTARCH_FRAME_WORDS];
+	memset(thread->sp, 0, MTARCH_FRAME_WORDS * sizeof(uint32_t));
+	thread->sp[MTARCH_FRAME_WORDS - 1] = (uint32_t)mtarch_thread_entry;
+}
+/*---------------------------------------------------------------------------*/
+void mtarch_exec(struct mtarch_thread *thread)
+{
+	running = thread;
+	mtarch_switch_in(thread->sp);
+	running = NULL;
+}
+/*---------------------------------------------------------------------------*/
+void mtarch_yield(void)
+{
+	mtarch_switch_out(&running->sp);
+}
+/*---------------------------------------------------------------------------*/
+void mtarch_stop(struct mtarch_thread *thread)
+{
+	UNUSED(thread);
+}
+/*---------------------------------------------------------------------------*/
+void mtarch_pstart(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void mtarch_pstop(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+unsigned int mtarch_stack_usage(struct mtarch_thread *thread)
+{
+	int i;
+	
+	/* The stack grows downwards; count the words never written. */
+	for (i = 0; i < MTARCH_STACKSIZE && thread->stack[i] == MTARCH_STACK_FILL; i++);
+	
+	return (MTARCH_STACKSIZE - i) * sizeof(uint32_t);
+}
+/*---------------------------------------------------------------------------*/
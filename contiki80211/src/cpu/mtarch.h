@@ -36,25 +36,37 @@
  */
 
 /*
- * Implementation of multithreading in ARM Cortex-M3. To do.
+ * Multithreading support for the ARM Cortex-M3. Threads run on the
+ * process stack pointer [PSP], so interrupts keep using the main stack
+ * and a thread stack only has to hold the thread's own frames.
  */
 
 
 #ifndef MTARCH_H_
 #define MTARCH_H_
 
-struct mtarch_thread {
-  short mt_thread;
-};
-
-#endif /* MTARCH_H_ */
-//#endif /* __MTARCH_H__ */
-/** @} */ 
-
-
-
-
+#include <stdint.h>
 
+/* Thread stack size, in 32-bit words. */
+#ifdef MTARCH_CONF_STACKSIZE
+#define MTARCH_STACKSIZE MTARCH_CONF_STACKSIZE
+#else
+#define MTARCH_STACKSIZE 256
+#endif
 
+struct mtarch_thread {
+  /* Must be 8-byte aligned, as the AAPCS requires for the stack. */
+  uint32_t stack[MTARCH_STACKSIZE] __attribute__((aligned(8)));
+  uint32_t *sp;
+  void (* function)(void *);
+  void *data;
+};
 
+/*
+ * Stack high-water mark of a thread, in bytes: the deepest the thread
+ * has used its stack since it was started.
+ */
+unsigned int mtarch_stack_usage(struct mtarch_thread *thread);
 
+#endif /* MTARCH_H_ */
+/** @} */
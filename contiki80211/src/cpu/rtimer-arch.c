@@ -71,6 +71,12 @@ uint64_t time_msb = 0;
 /* Time of the next rtimer event. Initially set to the maximum value. */
 rtimer_clock_t next_rtimer_time = 0;
 
+/* Nesting depth of rtimer_arch_disable_irq(), and the interrupt state
+ * to restore when the outermost section ends.
+ */
+static volatile uint32_t irq_nesting = 0;
+static irqflags_t irq_saved_flags;
+
 
 /************************************************************************/
 /* Interrupt handler for the ID_TC0 Interrupt								
@@ -98,7 +104,8 @@ void TC0_Handler(void)
 		
 		rtimer_clock_t clock_to_wait = next_rtimer_time - now;
 		
-		if(clock_to_wait <= 0x100000000 && clock_to_wait > 0)
+		/* The auxiliary timer counts 32 bits. */
+		if(clock_to_wait <= 0xffffffff && clock_to_wait > 0)
 		{ 
 			// We must set now the Timer Compare Register.
 			
@@ -197,23 +204,44 @@ rtimer_arch_init(void)
 }
 
 /*---------------------------------------------------------------------------*/
-void rtimer_arch_disable_irq(void) // XXX Not PORTED!
+/* Protects the rtimer task queue. The sections nest, and may be entered
+ * from any context, including the rtimer callbacks.
+ */
+void rtimer_arch_disable_irq(void)
 {
-	//ATOMIC(
-	//saved_TIM1CFG = INT_TIM1CFG;
-	//INT_TIM1CFG = 0;
-	//)
+	irqflags_t flags = cpu_irq_save();
+	
+	if (irq_nesting++ == 0) {
+		irq_saved_flags = flags;
+	}
 }
 /*---------------------------------------------------------------------------*/
-void rtimer_arch_enable_irq(void) // XXX Not PORTED!
+void rtimer_arch_enable_irq(void)
 {
-	//INT_TIM1CFG = saved_TIM1CFG;
+	if (--irq_nesting == 0) {
+		cpu_irq_restore(irq_saved_flags);
+	}
 }
 /*---------------------------------------------------------------------------*/
 rtimer_clock_t rtimer_arch_now(void)
 {
-	/* Modified, as now time is 64 bit */
-	return  ((rtimer_clock_t)time_msb << 32)|(uint64_t)tc_read_tc(TC0,0);
+	uint64_t msb;
+	uint32_t lsb;
+	irqflags_t flags = cpu_irq_save();
+	
+	/* Modified, as now time is 64 bit. The most significant bits 
+	 * are updated by the overflow interrupt, which may be pending
+	 * if interrupts are disabled; in such a case the 32-bit counter
+	 * has already wrapped.
+	 */
+	msb = time_msb;
+	lsb = tc_read_tc(TC0,0);
+	if (NVIC_GetPendingIRQ((IRQn_Type) ID_TC0) && lsb < 0x80000000) {
+		msb++;
+	}
+	cpu_irq_restore(flags);
+	
+	return ((rtimer_clock_t)msb << 32)|(uint64_t)lsb;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -230,12 +258,17 @@ rtimer_arch_schedule(rtimer_clock_t t)
 	rtimer_clock_t now = rtimer_arch_now();
 	
 	rtimer_clock_t clock_to_wait = t - now;
+	
+	/* The rtimer core never schedules a time in the past. */
+	if (clock_to_wait == 0 || clock_to_wait > 0x7fffffffffffffffULL) {
+		clock_to_wait = 1;
+	}
 		
-	if(clock_to_wait <= 0x100000000){ // We must set now the Timer Compare Register.
+	if(clock_to_wait <= 0xffffffff){ // We must set now the Timer Compare Register.
 	
 		// Set the auxiliary timer (TC0,1) at the write time interrupt
-		// [clock_to_wait] TODO Check the standard drift and perhaps remove it from the waiting time
-		tc_write_rc(TC0,1,(uint32_t)(t-rtimer_arch_now())); 
+		// [clock_to_wait], as a 32-bit delay from a single reading of the time
+		tc_write_rc(TC0,1,(uint32_t)clock_to_wait); 
 		// Set and enable interrupt on RC compare
 		tc_enable_interrupt(TC0,1,TC_IER_CPCS);
 		// Start the auxiliary timer
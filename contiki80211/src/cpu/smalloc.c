@@ -39,9 +39,176 @@
  * POSSIBILITY OF SUCH DAMAGE.
 */
 #include "smalloc.h"
+
+/* The profiled names map onto this layer; use the library ones here. */
+#undef smalloc
+#undef malloc
+#undef free
+
 #include <stddef.h>
+#include <string.h>
+#include <malloc.h>
 #include "interrupt\interrupt_sam_nvic.h"
+#include "sys/clock.h"
+#include "sys/rtimer.h"
+
+/* End of RAM; the heap grows from the end of the stack section towards it. */
+#define SMALLOC_RAM_END		(IRAM1_ADDR + IRAM1_SIZE)
+
+/* Heap break, as moved by the system calls. */
+extern char* _sbrk(int incr);
+
+#if SMALLOC_PROFILE
+#define SMALLOC_MAGIC		0x5a3c
+
+/* Header in front of every profiled block; keeps the payload 8-aligned. */
+struct smalloc_block {
+	struct smalloc_block* next;
+	struct smalloc_block* prev;
+	uint32_t size;
+	uint32_t stamp;			/* clock_seconds() at allocation */
+	uint16_t site;
+	uint16_t magic;
+} __attribute__((aligned(8)));
+
+struct smalloc_site {
+	const char* file;
+	uint16_t line;
+	uint16_t live_blocks;
+	uint32_t live_bytes;
+	uint32_t peak_bytes;
+	uint32_t allocs;
+	uint16_t fails;
+	uint16_t lat_max;		/* rtimer ticks, saturated */
+};
 
+static struct smalloc_block* live_list;
+static struct smalloc_site sites[SMALLOC_PROFILE_SITES];
+static struct smalloc_stats totals;
+static uint32_t lat_sum;
+
+/*---------------------------------------------------------------------------*/
+/* Find or claim the entry of a call site. Called with interrupts off. */
+static uint16_t site_index(const char* file, int line)
+{
+	uint16_t i;
+	
+	for (i=0; i<SMALLOC_PROFILE_SITES-1; i++) {
+		if (sites[i].file == NULL) {
+			sites[i].file = file;
+			sites[i].line = line;
+			return i;
+		}
+		if (sites[i].file == file && sites[i].line == line) {
+			return i;
+		}
+	}
+	/* Table full; account to the overflow entry. */
+	return SMALLOC_PROFILE_SITES-1;
+}
+/*---------------------------------------------------------------------------*/
+void* smalloc_site(size_t _size, const char* file, int line)
+{
+	struct smalloc_block* b;
+	struct smalloc_site* s;
+	rtimer_clock_t t0, lat;
+	
+	irqflags_t _flags = cpu_irq_save();
+	
+	t0 = RTIMER_NOW();
+	b = malloc(sizeof(struct smalloc_block) + _size);
+	lat = RTIMER_NOW() - t0;
+	
+	s = &sites[site_index(file, line)];
+	if (b == NULL) {
+		totals.fails++;
+		s->fails++;
+		cpu_irq_restore(_flags);
+		return NULL;
+	}
+	b->size = _size;
+	b->stamp = clock_seconds();
+	b->site = s - sites;
+	b->magic = SMALLOC_MAGIC;
+	b->prev = NULL;
+	b->next = live_list;
+	if (live_list != NULL) {
+		live_list->prev = b;
+	}
+	live_list = b;
+	
+	totals.allocs++;
+	totals.live_blocks++;
+	totals.live_bytes += _size;
+	if (totals.live_bytes > totals.peak_bytes) {
+		totals.peak_bytes = totals.live_bytes;
+	}
+	if (lat > totals.lat_max) {
+		totals.lat_max = lat;
+	}
+	lat_sum += lat;
+	
+	s->allocs++;
+	s->live_blocks++;
+	s->live_bytes += _size;
+	if (s->live_bytes > s->peak_bytes) {
+		s->peak_bytes = s->live_bytes;
+	}
+	if (lat > s->lat_max) {
+		s->lat_max = lat > 0xffff ? 0xffff : lat;
+	}
+	
+	cpu_irq_restore(_flags);
+	return b + 1;
+}
+/*---------------------------------------------------------------------------*/
+void* smalloc(size_t _size)
+{
+	/* Calls through a pointer, or from files built without the header. */
+	return smalloc_site(_size, "?", 0);
+}
+/*---------------------------------------------------------------------------*/
+void sfree(void* ptr) {
+	
+	struct smalloc_block* b;
+	struct smalloc_site* s;
+	
+	if (ptr == NULL) {
+		return;
+	}
+	b = (struct smalloc_block*)ptr - 1;
+	
+	irqflags_t _flags = cpu_irq_save();
+	
+	if (b->magic != SMALLOC_MAGIC) {
+		/* Not ours, or freed twice; releasing it would corrupt the heap. */
+		totals.bad_frees++;
+		cpu_irq_restore(_flags);
+		printf("ERROR: sfree of unknown block %p.\n", ptr);
+		return;
+	}
+	b->magic = 0;
+	if (b->prev != NULL) {
+		b->prev->next = b->next;
+	} else {
+		live_list = b->next;
+	}
+	if (b->next != NULL) {
+		b->next->prev = b->prev;
+	}
+	
+	s = &sites[b->site];
+	s->live_blocks--;
+	s->live_bytes -= b->size;
+	totals.frees++;
+	totals.live_blocks--;
+	totals.live_bytes -= b->size;
+	
+	free(b);
+	cpu_irq_restore(_flags);
+}
+/*---------------------------------------------------------------------------*/
+#else /* SMALLOC_PROFILE */
 
 void* smalloc(size_t _size)
 {
@@ -61,3 +228,159 @@ void sfree(void* ptr) {
 	cpu_irq_restore(_flags);
 	
 }
+#endif /* SMALLOC_PROFILE */
+/*---------------------------------------------------------------------------*/
+#if SMALLOC_PROFILE
+/* Free chunk and bin layout of the newlib allocator [mallocr.c]. Each
+ * bin is a pair of list pointers in __malloc_av_, addressed as the fd
+ * and bk fields of a fake chunk; the size field keeps two flag bits.
+ */
+struct malloc_chunk {
+	size_t prev_size;
+	size_t size;
+	struct malloc_chunk* fd;
+	struct malloc_chunk* bk;
+};
+extern struct malloc_chunk* __malloc_av_[];
+
+#define MALLOC_NAV				128
+#define MALLOC_MINSIZE			sizeof(struct malloc_chunk)
+#define malloc_bin_at(i)		((struct malloc_chunk*)((char*)&__malloc_av_[2*(i)+2] - 2*sizeof(size_t)))
+#define malloc_chunksize(c)		((c)->size & ~(size_t)0x3)
+/*---------------------------------------------------------------------------*/
+/* Largest payload that a free chunk of a bin can serve. */
+static uint32_t bin_largest(int i)
+{
+	struct malloc_chunk* bin = malloc_bin_at(i);
+	struct malloc_chunk* c;
+	uint32_t size, best = 0;
+	
+	for (c = bin->fd; c != bin; c = c->fd) {
+		size = malloc_chunksize(c) - sizeof(size_t);
+		if (size > best) {
+			best = size;
+		}
+	}
+	return best;
+}
+/*---------------------------------------------------------------------------*/
+/* Size of the largest block that fits in the heap as it is, read from the
+ * bins of the newlib allocator. Bin 0 points at the top chunk and bin 1
+ * holds the last remainder. Bins 2 and up hold disjoint, increasing size
+ * ranges, so only the highest used one is walked. Nothing is allocated,
+ * so the heap and the break stay as they are. Called with interrupts off.
+ */
+static uint32_t largest_free_block(void)
+{
+	uint32_t size, best = 0;
+	int i;
+	
+	/* The top chunk must keep MINSIZE bytes after a split. */
+	size = malloc_chunksize(__malloc_av_[2]);
+	if (size >= MALLOC_MINSIZE + sizeof(size_t)) {
+		best = size - MALLOC_MINSIZE - sizeof(size_t);
+	}
+	size = bin_largest(1);
+	if (size > best) {
+		best = size;
+	}
+	for (i = MALLOC_NAV-1; i >= 2; i--) {
+		if (malloc_bin_at(i)->fd != malloc_bin_at(i)) {
+			size = bin_largest(i);
+			if (size > best) {
+				best = size;
+			}
+			break;
+		}
+	}
+	return best;
+}
+#endif /* SMALLOC_PROFILE */
+/*---------------------------------------------------------------------------*/
+void smalloc_get_stats(struct smalloc_stats* stats)
+{
+	struct mallinfo mi;
+	
+	irqflags_t _flags = cpu_irq_save();
+	
+	#if SMALLOC_PROFILE
+	*stats = totals;
+	stats->lat_mean = totals.allocs ? lat_sum / totals.allocs : 0;
+	#else
+	memset(stats, 0, sizeof(struct smalloc_stats));
+	#endif
+	mi = mallinfo();
+	stats->heap_size = mi.arena;
+	stats->heap_free = mi.fordblks;
+	#if SMALLOC_PROFILE
+	stats->largest_free = largest_free_block();
+	#else
+	/* The top chunk, which must keep a minimum chunk [four words] after
+	 * a split; the free lists are not walked.
+	 */
+	stats->largest_free = mi.keepcost > 5 * sizeof(size_t) ? 
+		mi.keepcost - 5 * sizeof(size_t) : 0;
+	#endif
+	stats->unused = SMALLOC_RAM_END - (uint32_t)_sbrk(0);
+	
+	cpu_irq_restore(_flags);
+}
+/*---------------------------------------------------------------------------*/
+void smalloc_print_stats(void)
+{
+	struct smalloc_stats st;
+	
+	smalloc_get_stats(&st);
+	
+	#if SMALLOC_PROFILE
+	printf("Heap: %lu bytes, %lu free, largest free block %lu [%lu%% fragmented], %lu unused above.\n",
+		st.heap_size, st.heap_free, st.largest_free,
+		st.heap_free ? 100 - (st.largest_free * 100) / st.heap_free : 0,
+		st.unused);
+	#else
+	printf("Heap: %lu bytes, %lu free, %lu at the top, %lu unused above.\n",
+		st.heap_size, st.heap_free, st.largest_free, st.unused);
+	#endif /* SMALLOC_PROFILE */
+	#if SMALLOC_PROFILE
+	printf("Heap: %lu live in %lu blocks, peak %lu; %lu allocs, %lu frees, %lu failed, %lu bad frees.\n",
+		st.live_bytes, st.live_blocks, st.peak_bytes,
+		st.allocs, st.frees, st.fails, st.bad_frees);
+	printf("Heap: allocation mean %lu us, max %lu us.\n",
+		(unsigned long)(st.lat_mean * 1000000ULL / RTIMER_SECOND),
+		(unsigned long)(st.lat_max * 1000000ULL / RTIMER_SECOND));
+	
+	int i;
+	for (i=0; i<SMALLOC_PROFILE_SITES; i++) {
+		struct smalloc_site* s = &sites[i];
+		if (s->allocs == 0 && s->fails == 0) {
+			continue;
+		}
+		printf("  %s:%u%s live %lu/%u peak %lu allocs %lu fails %u max %lu us\n",
+			s->file, s->line, i == SMALLOC_PROFILE_SITES-1 ? "+" : "",
+			s->live_bytes, s->live_blocks, s->peak_bytes, s->allocs, s->fails,
+			(unsigned long)(s->lat_max * 1000000ULL / RTIMER_SECOND));
+	}
+	#endif /* SMALLOC_PROFILE */
+}
+/*---------------------------------------------------------------------------*/
+void smalloc_dump(void)
+{
+	#if SMALLOC_PROFILE
+	struct smalloc_block* b;
+	unsigned long now = clock_seconds();
+	unsigned int n = 0;
+	
+	/* Printing is slow; walk with interrupts enabled and accept that a
+	 * block freed meanwhile by an interrupt handler may end the walk early.
+	 */
+	printf("Outstanding heap blocks [newest first]:\n");
+	for (b = live_list; b != NULL && b->magic == SMALLOC_MAGIC; b = b->next) {
+		printf("  %p %5lu bytes, %6lu s old, %s:%u\n", (void*)(b + 1),
+			b->size, now - b->stamp, sites[b->site].file, sites[b->site].line);
+		n++;
+	}
+	printf("%u blocks.\n", n);
+	#else
+	printf("Heap profiling disabled [SMALLOC_CONF_PROFILE].\n");
+	#endif /* SMALLOC_PROFILE */
+}
@@ -39,13 +39,38 @@
  * POSSIBILITY OF SUCH DAMAGE.
 */
 #include <stddef.h>
+#include <stdint.h>
 #include "stdlib.h"
 #include "stdio.h"
+#include "contiki-conf.h"
 
 
 #ifndef SMALLOC_H_
 #define SMALLOC_H_
 
+/* Heap profiling. When enabled, every block carries a small header and
+ * is accounted to the call site that allocated it. Raw malloc and free
+ * in files including this header are routed through the same layer, so
+ * every file that allocates or frees driver buffers must include it. A
+ * block must be released on the side it was allocated on: calloc and
+ * realloc are not routed, and code built without this header [newlib,
+ * the ASF USB host stack] frees its own blocks only. The largest free
+ * block is then read from the bins of the full newlib allocator, which
+ * newlib-nano does not have.
+ */
+#ifdef SMALLOC_CONF_PROFILE
+#define SMALLOC_PROFILE SMALLOC_CONF_PROFILE
+#else
+#define SMALLOC_PROFILE 0
+#endif /* SMALLOC_CONF_PROFILE */
+
+/* Number of call sites tracked; the last one collects the rest. */
+#ifdef SMALLOC_CONF_PROFILE_SITES
+#define SMALLOC_PROFILE_SITES SMALLOC_CONF_PROFILE_SITES
+#else
+#define SMALLOC_PROFILE_SITES 32
+#endif /* SMALLOC_CONF_PROFILE_SITES */
+
 //************************************
 // Method:    smalloc	
 // FullName:  smalloc
@@ -57,4 +82,37 @@
 void* smalloc(size_t _size);
 void sfree(void* ptr);
 
-#endif /* SMALLOC_H_ */
\ No newline at end of file
+/* Heap summary. Fragmentation compares the largest block that can be
+ * allocated without growing the heap with the free space inside it.
+ */
+struct smalloc_stats {
+	uint32_t live_bytes;	/* Bytes held by live blocks */
+	uint32_t peak_bytes;	/* Highest live_bytes seen */
+	uint32_t live_blocks;
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t fails;			/* Allocations that returned NULL */
+	uint32_t bad_frees;		/* Frees of unknown or already freed blocks */
+	uint32_t lat_max;		/* Slowest allocation [rtimer ticks] */
+	uint32_t lat_mean;		/* Mean allocation time [rtimer ticks] */
+	uint32_t heap_size;		/* Bytes obtained from sbrk */
+	uint32_t heap_free;		/* Free bytes inside the heap */
+	uint32_t largest_free;	/* Largest block allocatable inside the heap; without
+							 * profiling, the top chunk only [a lower bound] */
+	uint32_t unused;		/* RAM above the heap not yet obtained */
+};
+
+void smalloc_get_stats(struct smalloc_stats* stats);
+void smalloc_print_stats(void);
+void smalloc_dump(void);
+
+#if SMALLOC_PROFILE
+/* Declare the library allocator before its names are taken over. */
+#include <malloc.h>
+void* smalloc_site(size_t _size, const char* file, int line);
+#define smalloc(s)	smalloc_site((s), __FILE__, __LINE__)
+#define malloc(s)	smalloc_site((s), __FILE__, __LINE__)
+#define free(p)		sfree(p)
+#endif /* SMALLOC_PROFILE */
+
+#endif /* SMALLOC_H_ */
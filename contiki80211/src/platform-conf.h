@@ -71,6 +71,21 @@
 #define WITH_AR9170_WIFI_SUPPORT
 /* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* ------------------------------ TELEMETRY ------------------------------ */
+/* Collect per-period channel, queue and heap records in a RAM ring. */
+//#define WITH_TELEMETRY
+/* Export records as SLIP frames on the serial line and/or over UDP. */
+//#define TELEMETRY_CONF_EXPORT_SLIP	1
+//#define TELEMETRY_CONF_UDP_PORT		5690
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* ---------------------------- TICKLESS IDLE ---------------------------- */
+/* Sleep between events, stretching the system tick up to the next timer. */
+//#define WITH_TICKLESS_IDLE
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
 /* Enable IPv6 */
 #define WITH_UIP6			1 
 
@@ -85,6 +100,10 @@
  * larger than the default Contiki 802.15.4 ones
  */
 #define PACKETBUF_CONF_SIZE		512
+/* A second packet buffer, so that received frames are parsed
+ * without touching the one selected for transmission.
+ */
+#define PACKETBUF_CONF_NUM		2
 
 #define STRING_EOL    "\r"
 #define STRING_HEADER "-- Contiki OS on SAM3X8E --\r\n" \
@@ -126,7 +145,10 @@ typedef unsigned long clock_time_t;
 #define CLOCK_CONF_SECOND 1000
 
 
-#define RTIMER_CLOCK_LT(a,b)     ((signed short)((a)-(b)) < 0)
+#define RTIMER_CLOCK_LT(a,b)     ((signed long long)((a)-(b)) < 0)
+
+/* Minimum lead time [10 us] when programming the real-time timer. */
+#define RTIMER_CONF_GUARD_TIME   105
 
 /* LEDs ports MB8xxx */
 #define LED_ORANGE				LED0_GPIO
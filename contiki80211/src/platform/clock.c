@@ -52,27 +52,55 @@ static volatile clock_time_t count;
 static volatile unsigned long current_seconds = 0;
 static unsigned int second_countdown = CLOCK_SECOND;
 
+#ifdef WITH_TICKLESS_IDLE
+/* Core clock cycles per tick, and the longest idle period [in ticks]
+ * that fits the 24-bit SysTick reload register.
+ */
+static uint32_t cycles_per_tick;
+static clock_time_t max_idle_ticks;
+/* Ticks covered by the stretched SysTick period; cleared when it expires. */
+static volatile clock_time_t idle_ticks;
+#endif
 
+/*---------------------------------------------------------------------------*/
+static void clock_advance(clock_time_t ticks)
+{
+	count += ticks;
+	
+	while (ticks >= second_countdown) {
+		ticks -= second_countdown;
+		current_seconds++;
+		second_countdown = CLOCK_SECOND;
+	}
+	second_countdown -= ticks;
+	
+	/* The next expiration is known in O(1), so only poll the etimer
+	 * process when its earliest timer is due. 
+	 */
+	if(etimer_pending() && 
+		(clock_time_t)(count - etimer_next_expiration_time()) <= ((clock_time_t)~0 >> 1)) {
+		etimer_request_poll();
+	}
+}
 
 /*---------------------------------------------------------------------------*/
 void SysTick_Handler(void)
 {	
-	count++;
-	
 /*	
 	if(button_sensor.status(SENSORS_READY)){
 		button_sensor.value(0); // sensors_changed is called inside this function.
 	}
 */
-	if(etimer_pending()) {
-		etimer_request_poll();
-	}
-	
-	if (--second_countdown == 0) {
-		current_seconds++;
-		second_countdown = CLOCK_SECOND;
+#ifdef WITH_TICKLESS_IDLE
+	if (idle_ticks) {
+		/* A stretched idle period has expired. */
+		clock_time_t ticks = idle_ticks;
+		idle_ticks = 0;
+		clock_advance(ticks);
+		return;
 	}
-	
+#endif
+	clock_advance(1);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -92,7 +120,97 @@ void clock_init(void)
 		puts("-F- Systick configuration error\r");
 		while (1);
 	}
+#ifdef WITH_TICKLESS_IDLE
+	cycles_per_tick = sysclk_get_cpu_hz() / 1000;
+	max_idle_ticks = (SysTick_LOAD_RELOAD_Msk / cycles_per_tick) - 1;
+#endif
+}
+
+#ifdef WITH_TICKLESS_IDLE
+/*---------------------------------------------------------------------------*/
+/*
+ * Sleeps for at most the given number of ticks [0 for as long as possible],
+ * or until an interrupt occurs, and corrects the tick count on wake-up. The
+ * SysTick period is stretched to cover the whole sleep, so no tick wakes up
+ * the CPU meanwhile. Must be called with interrupts disabled; it returns 
+ * with interrupts enabled.
+ *
+ * Only the core clock is stopped [plain WFI], so the SysTick and all the
+ * peripherals keep running. This is the shallowest sleep mode of the sleep
+ * manager; the caller checks that it is not locked ACTIVE.
+ */
+void clock_idle(clock_time_t ticks)
+{
+	uint32_t first, reload, elapsed, completed;
+	
+	if (ticks == 0 || ticks > max_idle_ticks) {
+		ticks = max_idle_ticks;
+	}
+	
+	if (ticks >= 2) {
+		/* Stop the SysTick; the rest of the current tick counts too. */
+		SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+		if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+			/* A tick is already pending; it would wake us up anyway. */
+			SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+			cpu_irq_enable();
+			return;
+		}
+		first = SysTick->VAL;
+		reload = first + (ticks - 1) * cycles_per_tick;
+		
+		idle_ticks = ticks;
+		SysTick->LOAD = reload - 1;
+		SysTick->VAL = 0;
+		SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+	}
+	
+	/* Sleep mode is entered with interrupts masked, since pmc_sleep() would unmask them
+	 * before the WFI and a poll from an interrupt could then be missed. A
+	 * pending interrupt still ends the WFI.
+	 */
+	PMC->PMC_FSMR &= (uint32_t)~PMC_FSMR_LPM;
+	SCB->SCR &= (uint32_t)~SCB_SCR_SLEEPDEEP_Msk;
+	__DSB();
+	__WFI();
+	
+	if (ticks >= 2) {
+		SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+		
+		if (idle_ticks && !(SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)) {
+			/* Woken up early by another interrupt. Account for the whole
+			 * ticks that have elapsed, and resume with the rest of the 
+			 * current one.
+			 */
+			elapsed = reload - SysTick->VAL;
+			if (elapsed < first) {
+				completed = 0;
+				SysTick->LOAD = first - elapsed - 1;
+			} else {
+				elapsed -= first;
+				completed = 1 + elapsed / cycles_per_tick;
+				SysTick->LOAD = cycles_per_tick - (elapsed % cycles_per_tick) - 1;
+			}
+			idle_ticks = 0;
+			if (completed > 0) {
+				clock_advance(completed);
+			}
+			SysTick->VAL = 0;
+			SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+			SysTick->LOAD = cycles_per_tick - 1;
+			
+		} else {
+			/* The stretched period has expired; the SysTick handler 
+			 * accounts for it as soon as interrupts are enabled.
+			 */
+			SysTick->LOAD = cycles_per_tick - 1;
+			SysTick->VAL = 0;
+			SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+		}
+	}
+	cpu_irq_enable();
 }
+#endif
 
 /*---------------------------------------------------------------------------*/
 
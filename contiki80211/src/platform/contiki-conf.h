@@ -110,7 +110,7 @@
 
 /* Other (RAM saving) */
 #define ENERGEST_CONF_ON                        0
-#define QUEUEBUF_CONF_NUM                       2
+#define QUEUEBUF_CONF_NUM                       4
 #define QUEUEBUF_CONF_REF_NUM                   0
 #define NBR_TABLE_CONF_MAX_NEIGHBORS            4
 #define UIP_CONF_MAX_ROUTES						4
@@ -118,6 +118,23 @@
 #define RPL_CONF_MAX_INSTANCES                  1
 #define RPL_CONF_MAX_DAG_PER_INSTANCE           1
 #define PROCESS_CONF_NUMEVENTS                  16
+#define PROCESS_CONF_NUMEVENTS_HIGH             8
+/* Per-process run time and event accounting [1 to enable]. */
+#define PROCESS_CONF_ACCOUNTING                 0
+/* Polls are requested from interrupt handlers. */
+#define PROCESS_CONF_IRQ_FLAGS_T                irqflags_t
+#define PROCESS_CONF_IRQ_SAVE()                 cpu_irq_save()
+#define PROCESS_CONF_IRQ_RESTORE(f)             cpu_irq_restore(f)
+/* Binary trace ring; e.g. TRACE_CLASS_ALL to enable [see sys/trace.h]. */
+#define TRACE_CONF_CLASSES                      0
+#define TRACE_CONF_SIZE                         128
+/* Pool threads for blocking driver routines, with 2 KB stacks. */
+#define MT_POOL_CONF_THREADS                    2
+#define MTARCH_CONF_STACKSIZE                   512
+/* Heap profiler with per-call-site accounting [1 to enable, see cpu/smalloc.h]. */
+#define SMALLOC_CONF_PROFILE                    0
+/* Occupancy counters for memb pools [1 to enable, see lib/memb.h]. */
+#define MEMB_CONF_STATS                         0
 
 /* IEEE80211 config */
 #ifdef WITH_AR9170_WIFI_SUPPORT
@@ -50,6 +50,7 @@
 #include "compiler.h"
 #include "skbuff.h"
 #include "linked_list.h"
+#include "rtimer.h"
 
 
 #ifndef AR9170_H_
@@ -215,6 +216,16 @@ struct ar9170 {
 	unsigned int tx_ack_failures;
 	unsigned int tx_fcs_errors;
 	unsigned int rx_dropped;
+	struct {
+		U32 tx;
+		U32 retry;
+		U32 drop;
+	} txq_stats[__AR9170_NUM_TXQ];
+	U32 rx_frames;
+	U32 rx_queue_full;
+	/* Set by the telemetry collector; served by the scheduler. */
+	bool tally_request;
+	bool tally_valid;
 	
 	/* EEPROM*/
 	struct ar9170_eeprom eeprom;
@@ -245,6 +256,12 @@ struct ar9170 {
 	completion_t cmd_wait;	
 	completion_t cmd_buf_lock;	
 	struct ar9170_send_list* cmd_list;
+	/* Held for the whole of a command and its response; cmd, readbuf
+	 * and cmd_wait are shared by all callers, on pool threads or not.
+	 */
+	completion_t cmd_mutex;
+	/* Set while a pool thread issues commands for the scheduler. */
+	bool cmd_thread_busy;
 	
 	/* TX */
 	completion_t tx_async_lock;
@@ -302,9 +319,14 @@ struct ar9170 {
 
 #ifdef CONFIG_AR9170_HWRNG
 # define AR9170_HWRNG_CACHE_SIZE	AR9170_MAX_CMD_PAYLOAD_LEN
+/* Refill the cache once this many words or fewer are left unread. */
+# define AR9170_HWRNG_LOW_WATERMARK	(AR9170_HWRNG_CACHE_SIZE / (4 * sizeof(U16)))
+/* Words folded into the Contiki PRNG on each reseed. */
+# define AR9170_HWRNG_STIR_WORDS	4
 	struct {
 		struct hwrng rng;
 		bool initialized;
+		bool refill_pending;
 		char name[30 + 1];
 		U16 cache[AR9170_HWRNG_CACHE_SIZE / sizeof(U16)];
 		unsigned int cache_idx;
@@ -333,6 +355,24 @@ struct ar9170 {
 		bool psm_transit_to_wake;
 		U8	last_ATIM_DA[ETH_ALEN];
 		U8  last_ATIM_A3[ETH_ALEN];
+		/* Estimated local time of the last pre-TBTT and beacon period. */
+		rtimer_clock_t tbtt_anchor;
+		rtimer_clock_t tbtt_period;
+		bool tbtt_synced;
+		/* Drift estimator: phase of each pre-TBTT against the nominal
+		 * period, counted in beacon intervals since tbtt_ref. The least
+		 * delayed event of each window is compared with the one of the
+		 * previous window.
+		 */
+		rtimer_clock_t tbtt_ref;
+		unsigned int tbtt_index;
+		unsigned int tbtt_win_events;
+		long long tbtt_win_min;
+		unsigned int tbtt_win_min_index;
+		long long tbtt_prev_min;
+		unsigned int tbtt_prev_min_index;
+		bool tbtt_prev_valid;
+		rtimer_clock_t soft_bcn_deadline;
 		
 	} ps_mgr;
 
@@ -384,6 +424,8 @@ int ar9170_update_beacon(struct ar9170 *ar, bool submit);
 void ar9170_tx_rate_tpc_chains(struct ar9170 *ar, struct ieee80211_tx_info *info, struct ieee80211_tx_rate *txrate, unsigned int *phyrate, unsigned int *tpc, unsigned int *chains);
 /* RNG */
 int ar9170_register_hwrng(struct ar9170 *ar);
+int ar9170_rng_get(struct ar9170 *ar);
+void ar9170_rng_stir(struct ar9170 *ar);
 
 struct ieee80211_vif *ar9170_get_main_vif(struct ar9170 *ar);
 int ar9170_init_interface(struct ar9170 *ar, struct ieee80211_vif *vif);
@@ -48,9 +48,11 @@
 #include "ar9170_debug.h"
 #include "cfg80211.h"
 #include "ar9170.h"
+#include "ar9170_psm.h"
 #include "compiler.h"
 #include <time.h>
 #include "delay.h"
+#include "smalloc.h"
 
 
 COMPILER_WORD_ALIGNED uint8_t echo_test_command[4] = {0x4a, 0x11, 0x01, 0x23};
@@ -167,6 +169,11 @@ bool ar9170_exec_cmd(struct ar9170* ar, const enum carl9170_cmd_oids cmd, unsign
 {	
 	bool result;	
 	
+	/* A pool thread gives up the CPU while it waits for the response;
+	 * nobody else may use the shared command state until it is back.
+	 */
+	__mutex_acquire(&ar->cmd_mutex);
+	
 	ar->cmd.hdr.len = plen;
 	ar->cmd.hdr.cmd = cmd;
 	ar->cmd.hdr.seq = 0;	
@@ -196,6 +203,7 @@ bool ar9170_exec_cmd(struct ar9170* ar, const enum carl9170_cmd_oids cmd, unsign
 	printf("DEBUG: Command executed.\n");
 	#endif
 	
+	__mutex_release(&ar->cmd_mutex);
 	return result; 
 }
 
@@ -471,6 +479,9 @@ int ar9170_powersave(struct ar9170 *ar, const bool ps)
 	}	
 	#endif
 	
+	/* The RF state is accounted from the command on. */
+	ar9170_psm_energest_update(ar);
+	
 	/* Free command buffer */
 	free(cmd);
 	
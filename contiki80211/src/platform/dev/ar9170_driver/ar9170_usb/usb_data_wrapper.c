@@ -56,11 +56,7 @@
 void ar9170_usb_tx( struct ar9170* ar, struct sk_buff* skb )
 {
 	struct ar9170_stream *tx_stream;
-	uint8_t *data = (uint8_t*)smalloc(skb->len);
-	if (data == NULL) {
-		printf("ERROR: Could not allocate memory for data transmission.\n");
-		return;
-	}
+	uint8_t *data;
 	uint32_t len;
 
 	if (!IS_STARTED(ar)) {
@@ -76,6 +72,11 @@ void ar9170_usb_tx( struct ar9170* ar, struct sk_buff* skb )
 		tx_stream->length = cpu_to_le16(len);
 		tx_stream->tag = cpu_to_le16(AR9170_TX_STREAM_TAG);
 		data = (void*)tx_stream;
+		
+		if (len > BULK_ENDPOINT_MAX_OUT_SIZE) {
+			printf("ERROR: Data chunk is too large [%u]. Drop.\n",len);
+			goto err_drop;
+		}
 	} else {
 		#if USB_DATA_WRAPPER_DEBUG_DEEP
 		printf("DEBUG: No stream supported [default].\n");
@@ -84,16 +85,20 @@ void ar9170_usb_tx( struct ar9170* ar, struct sk_buff* skb )
 			printf("ERROR: Finally, packet data is null.\n");
 			return;
 		}
-		memcpy(data ,skb->data, skb->len);
 		len = skb->len;
-	}
-
-	/* 
-	 * Prepare the tx request to be sent down as a bulk data request.
-	 */
-	if (len > BULK_ENDPOINT_MAX_OUT_SIZE) {
-		printf("ERROR: Data chunk is too large [%u]. Drop.\n",len);
-		goto err_drop;
+		
+		/* 
+		 * Prepare the tx request to be sent down as a bulk data request.
+		 */
+		if (len > BULK_ENDPOINT_MAX_OUT_SIZE) {
+			printf("ERROR: Data chunk is too large [%u]. Drop.\n",len);
+			goto err_drop;
+		}
+		/* The USB layer frees the frame once the transfer is over,
+		 * so it is handed over as it is instead of being copied.
+		 */
+		data = skb->data;
+		skb->data = NULL;
 	}
 	
 	if(!ar9170_write_data(data, (uint16_t)len, ZERO_PACKET_FLAG)) {
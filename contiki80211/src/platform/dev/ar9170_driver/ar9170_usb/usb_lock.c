@@ -44,6 +44,7 @@
 #include <stdint-gcc.h>
 #include "compiler.h"
 #include "ar9170.h"
+#include "sys/mt-pool.h"
 
 
 static volatile bool ar9170_usb_semaphore;
@@ -461,6 +462,8 @@ void __complete( completion_t* flag )
 		#if USB_LOCK_DEBUG
 		printf("DEBUG: Task completed.\n");
 		#endif
+		/* Resume pool threads blocked on a completion. */
+		mt_pool_wake();
 	}
 }
 
@@ -471,7 +474,20 @@ void __wait_for_completion( completion_t* flag )
 	printf("DEBUG: Must wait for command completion...\n");
 	#endif
 	do {
-		sleepmgr_enter_sleep();
+		/* On a pool thread, let the other processes run meanwhile. */
+		if (mt_pool_in_thread()) {
+			mt_pool_wait();
+		} else {
+			/* The flag is checked again with interrupts masked, so a
+			 * completion right before the WFI still wakes us up.
+			 */
+			cpu_irq_disable();
+			if (*flag == true && sleepmgr_get_sleep_mode() != SLEEPMGR_ACTIVE) {
+				__DSB();
+				__WFI();
+			}
+			cpu_irq_enable();
+		}
 		completion_t not_ready = *flag;
 		if (not_ready == false) {
 			break;
@@ -480,6 +496,29 @@ void __wait_for_completion( completion_t* flag )
 }
 
 
+/* A holder in process context never yields, so a waiter only ever finds
+ * the mutex held by a pool thread: another pool thread yields to it, and
+ * process context runs the pool threads itself until it is released.
+ */
+void __mutex_acquire( completion_t* mutex )
+{
+	while (*mutex == true) {
+		if (mt_pool_in_thread()) {
+			mt_pool_yield();
+		} else {
+			mt_pool_service();
+		}
+	}
+	*mutex = true;
+}
+
+
+void __mutex_release( completion_t* mutex )
+{
+	*mutex = false;
+}
+
+
 void __start(completion_t* flag )
 {
 	if (not_expected(*flag == true)) {
@@ -66,6 +66,10 @@ void __wait_for_completion(completion_t* flag);
 void __start(completion_t* flag);
 void __reset(completion_t* flag);
 
+/* Mutual exclusion between process context and pool threads. */
+void __mutex_acquire(completion_t* mutex);
+void __mutex_release(completion_t* mutex);
+
 void __read_lock();
 void __read_unlock();
 
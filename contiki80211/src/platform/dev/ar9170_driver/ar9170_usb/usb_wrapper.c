@@ -57,6 +57,8 @@
 #include <stdint-gcc.h>
 #include "cc.h"
 #include "smalloc.h"
+#include "sys/trace.h"
+#include "sys/energest.h"
 
 
 //************************************
@@ -184,6 +186,7 @@ void ar9170_interrupt_in_transfer_done( usb_add_t add, usb_ep_t ep, uhd_trans_st
 	#endif
 	bool reschedule_flag = false;
 	uint8_t* buffer = NULL;
+	unsigned char owner = ENERGEST_CPU_ENTER(ENERGEST_CPU_USB_ISR);
 		
 	switch (status)
 	{
@@ -236,7 +239,7 @@ void ar9170_interrupt_in_transfer_done( usb_add_t add, usb_ep_t ep, uhd_trans_st
 		struct ar9170* ar = ar9170_get_device();
 		ar9170_handle_command_response(ar, buffer, (uint32_t)nb_transfered);
 	}
-	
+	ENERGEST_CPU_LEAVE(owner);
 }
 
 
@@ -265,6 +268,10 @@ void ar9170_bulk_in_transfer_done( usb_add_t add, usb_ep_t ep, uhd_trans_status_
 {	
 	
 	int i;
+	unsigned char owner = ENERGEST_CPU_ENTER(ENERGEST_CPU_USB_ISR);
+	
+	TRACE(TRACE_USB_RX, nb_transfered, status);
+	
 	switch (status)
 	{ 
 		case UHD_TRANS_NOERROR:
@@ -280,6 +287,7 @@ void ar9170_bulk_in_transfer_done( usb_add_t add, usb_ep_t ep, uhd_trans_status_
 				printf("ERROR: Cannot handle such large response.\n");			
 				/* Just reschedule. However, I think here the program will crash, anyway. */
 				ar9170_listen_on_bulk_in();
+				ENERGEST_CPU_LEAVE(owner);
 				return;
 			}
 			/* Copy response to an available buffer */	
@@ -319,6 +327,7 @@ void ar9170_bulk_in_transfer_done( usb_add_t add, usb_ep_t ep, uhd_trans_status_
 		default:
 			printf("ERROR: Unrecognized status response: %d.\n",status);
 	}	
+	ENERGEST_CPU_LEAVE(owner);
 	return;
 	
 handle_ok:	
@@ -336,6 +345,7 @@ handle_ok:
 	 * but not the received packets.
 	 */	
 	__ar9170_rx(ar9170_get_device(),(uint8_t*)(&bulk_in_buffer_pool[0][0]), (uint32_t)nb_transfered);
+	ENERGEST_CPU_LEAVE(owner);
 }
 
                                       
@@ -582,9 +592,12 @@ bool ar9170_write_data( uint8_t* data, uint16_t tx_len, bool zero_packet_flag )
 
 	if (tx_len > BULK_ENDPOINT_MAX_OUT_SIZE) {
 		printf("ERROR: Data exceeds maximum length: %d.\n",tx_len);
+		free(data);
 		return false;
 	}
 	
+	TRACE(TRACE_USB_TX, tx_len, 0);
+	
 	struct ar9170* ar = ar9170_get_device();
 	/* Lock access to the tx buffer. */
 	__start(&ar->tx_buf_lock);
@@ -594,6 +607,7 @@ bool ar9170_write_data( uint8_t* data, uint16_t tx_len, bool zero_packet_flag )
 		if(ar->tx_list->next_send_chunk != NULL) {
 			printf("ERROR: TX buffer is null while next tx chunk is not.\n");
 			__complete(&ar->tx_buf_lock);
+			free(data);
 			return false;
 		}
 		/*
@@ -624,6 +638,21 @@ bool ar9170_write_data( uint8_t* data, uint16_t tx_len, bool zero_packet_flag )
 
 		if(result == false) {
 			printf("ERROR: Data could not be submitted correctly.\n");
+			/* No callback will free the chunk; take it off the list,
+			 * so that the next one is not queued behind it forever.
+			 */
+			__start(&ar->tx_buf_lock);
+			if (ar->tx_list->buffer == data) {
+				ar->tx_list->buffer = NULL;
+				ar->tx_list->send_chunk_len = 0;
+				struct ar9170_send_list* next_data = ar->tx_list->next_send_chunk;
+				if (next_data != NULL) {
+					free(ar->tx_list);
+					ar->tx_list = next_data;
+				}
+			}
+			__complete(&ar->tx_buf_lock);
+			free(data);
 			/* Release asynchronous TX process, because we normally 
 			 * do not expect the callback to be called and release 
 			 * the asynchronous transmission flag.
@@ -645,6 +674,7 @@ bool ar9170_write_data( uint8_t* data, uint16_t tx_len, bool zero_packet_flag )
 		if (next_pos->next_send_chunk == NULL) {
 			printf("ERROR: Could not allocate memory for data bulk transfer.\n");
 			__complete(&ar->tx_buf_lock);
+			free(data);
 			return false;
 		
 		} else {
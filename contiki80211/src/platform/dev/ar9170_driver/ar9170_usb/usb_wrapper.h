@@ -97,6 +97,7 @@ void ar9170_listen_on_ctrl_in();
 // Parameter: uint16_t cmd_len
 //************************************
 bool ar9170_usb_write_reg(completion_t* lock, uint8_t* cmd, uint16_t cmd_len );
+/* Takes over data: it is freed once transferred, or here on failure. */
 bool ar9170_write_data( uint8_t* data, uint16_t len, bool zero_packet_flag );
 
 // Callback functions
@@ -81,6 +81,9 @@
 #include "ieee80211_psm.h"
 #include "if_ether.h"
 #include "etherdevice.h"
+#include "ieee80211_tx.h"
+#include "lib/random.h"
+#include "sys/trace.h"
 
 
 
@@ -162,6 +165,8 @@ struct ar9170* ar9170_alloc(struct ar9170** ar_pt)
 	athr->cmd_async_lock = 0;
 	athr->cmd_wait = 0;
 	athr->cmd_buf_lock = 0;
+	athr->cmd_mutex = 0;
+	athr->cmd_thread_busy = false;
 	athr->state_lock = 0;
 	athr->mutex_lock = 0;
 	athr->tx_async_lock = 0;
@@ -704,7 +709,7 @@ out:
 #ifdef CONFIG_AR9170_HWRNG
 int ar9170_rng_get(struct ar9170 *ar)
 {
-	#if AR9170_MAIN_DEBUG
+	#if AR9170_MAIN_DEBUG_DEEP
 	printf("DEBUG: Getting hw rng...\n");
 	#endif
 	#define RW	(AR9170_MAX_CMD_PAYLOAD_LEN / (3*sizeof(U32))) // XXX - /3 in order to fit
@@ -730,7 +735,9 @@ int ar9170_rng_get(struct ar9170 *ar)
 	count = ARRAY_SIZE(ar->rng.cache);
 	
 	while (count) {
+		#if AR9170_MAIN_DEBUG_DEEP
 		printf("count: %d.\n",count);
+		#endif
 		result = ar9170_exec_cmd(ar, CARL9170_CMD_RREG,
 		RB, (U8 *) rng_load,
 		RB, (U8 *) buf);
@@ -748,6 +755,7 @@ int ar9170_rng_get(struct ar9170 *ar)
 	}
 
 	ar->rng.cache_idx = 0;
+	ar->rng.refill_pending = false;
 
 	#undef RW
 	#undef RB
@@ -771,11 +779,43 @@ int ar9170_rng_read(struct hwrng *rng, U32 *data)
 	}
 
 	*data = ar->rng.cache[ar->rng.cache_idx++];
+	
+	/* Let the scheduler refill the cache before it runs dry. */
+	if (ARRAY_SIZE(ar->rng.cache) - ar->rng.cache_idx <= AR9170_HWRNG_LOW_WATERMARK)
+		ar->rng.refill_pending = true;
 	__lock_release(&ar->mutex);//mutex_unlock(&ar->mutex);
 
 	return sizeof(U16);
 }
 
+/*
+ * Fold the unused part of the hardware RNG cache into the Contiki PRNG.
+ * The consumed words are not handed out again; the scheduler refills the
+ * cache once it drops below the low watermark.
+ */
+void ar9170_rng_stir(struct ar9170 *ar)
+{
+	unsigned int avail;
+	
+	if (!ar->rng.initialized)
+		return;
+	
+	avail = ARRAY_SIZE(ar->rng.cache) - ar->rng.cache_idx;
+	if (avail > AR9170_HWRNG_STIR_WORDS)
+		avail = AR9170_HWRNG_STIR_WORDS;
+	
+	if (avail == 0) {
+		ar->rng.refill_pending = true;
+		return;
+	}
+	
+	random_add_entropy(&ar->rng.cache[ar->rng.cache_idx], avail * sizeof(U16));
+	ar->rng.cache_idx += avail;
+	
+	if (ARRAY_SIZE(ar->rng.cache) - ar->rng.cache_idx <= AR9170_HWRNG_LOW_WATERMARK)
+		ar->rng.refill_pending = true;
+}
+
 void ar9170_unregister_hwrng(struct ar9170 *ar)
 {
 	if (ar->rng.initialized) {
@@ -811,6 +851,9 @@ int ar9170_register_hwrng(struct ar9170 *ar)
 		ar9170_unregister_hwrng(ar);
 		return err;
 	}
+	
+	/* Seed the Contiki PRNG from the hardware straight away. */
+	ar9170_rng_stir(ar);
 
 	#if AR9170_MAIN_DEBUG
 	printf("DEBUG: hw rng registered successfully.\n");
@@ -1192,6 +1235,7 @@ int ar9170_ps_update(struct ar9170 *ar)
 		#if AR9170_MAIN_DEBUG_DEEP
 		printf("DEBUG: PS State must change to: %d.\n", ps);
 		#endif
+		TRACE(TRACE_PSM_STATE, !ps, ar->ps.off_override);
 		ar9170_psm_schedule_powersave(ar, ps);
 	
 		if (ar->ps.state && !ps) {
@@ -1244,10 +1288,6 @@ int ar9170_ps_update(struct ar9170 *ar)
 
 int ar9170_update_survey(struct ar9170 *ar, bool flush, bool noise)
 {
-	#if AR9170_MAIN_DEBUG_DEEP
-	printf("DEBUG: ar9170_update_survey.\n");
-	#endif
-	
 	int err = 0;
 
 	if (noise) {
@@ -1659,6 +1699,7 @@ bool ar9170_async_tx_soft_beacon(struct ar9170* ar) {
 		beacon_buffer->data = smalloc(ibss_info->ibss_beacon_buf->len);
 		if (beacon_buffer->data == NULL) {
 			printf("ERROR: Could not allocate memory for beacon buffer data.\n");
+			sfree(beacon_buffer);
 			return false;
 		}
 		
@@ -1667,15 +1708,21 @@ bool ar9170_async_tx_soft_beacon(struct ar9170* ar) {
 			(uint32_t*)(ibss_info->ibss_beacon_buf->data), DIV_ROUND_UP(ibss_info->ibss_beacon_buf->len,4));
 					
 		/* Prepare and transmit the soft beacon. */		
-		if (ar9170_op_tx(hw, beacon_buffer) == false) {
-			
-			printf("WARNING: Packet could not be prepared/transmitted.\n");
-			return false;
+		bool result = ar9170_op_tx(hw, beacon_buffer);
 		
-		} else {
-			
-			return true;
+		/* The USB layer owns the superframe once it is handed over and
+		 * clears the data pointer; whatever is left was not handed over.
+		 * The socket buffer itself is only needed for the handoff.
+		 */
+		if (beacon_buffer->data != NULL) {
+			sfree(beacon_buffer->data);
 		}
+		sfree(beacon_buffer);
+		
+		if (result == false) {
+			printf("WARNING: Packet could not be prepared/transmitted.\n");
+		}
+		return result;
 		
 	} else {
 		/* We can not transmit it yet. Line seems to be busy. */
@@ -1737,9 +1784,20 @@ ar9170_tx_queue* ar9170_async_tx( struct ar9170* ar, ar9170_tx_queue* tx_queue )
 			}			
 		}			
 						
+		/* The frame is handed to the USB layer on transmission, so
+		 * keep its destination for the airtime accounting.
+		 */
+		uint8_t tx_da[ETH_ALEN];
+		memcpy(tx_da, ((struct ieee80211_hdr*)(next_skb->data))->addr1, ETH_ALEN);
+		
 		/* Prepare and transmit the first packet */
 		result = ar9170_op_tx(hw, next_skb);
 		
+		/* Charge the airtime of the data frame to its destination. */
+		if (is_data_queue && result == true) {
+			ieee80211_airtime_account(tx_da, next_skb->len);
+		}
+		
 		/* We have now transmitted the packet. However, this still remains
 		 * in the packet pending queue and it is dangerous if an interrupt
 		 * occurs that browses this queue. So the whole operation shall be
@@ -1748,13 +1806,11 @@ ar9170_tx_queue* ar9170_async_tx( struct ar9170* ar, ar9170_tx_queue* tx_queue )
 		irqflags_t _flags = cpu_irq_save();
 		
 		if (next_skb->data != NULL) {
-			/* Socket buffer will be freed when the list element will be removed. */
+			/* Not handed to the USB layer. Socket buffer will be
+			 * freed when the list element will be removed.
+			 */
 			free(next_skb->data);
 			next_skb->data = NULL;
-			
-		
-		} else {
-			printf("Why is it already NULL?\n");
 		}
 		/* If there are more packets in the queue, point the root
 		 * to the next packet, i.e. remove the first element. We 
@@ -1936,5 +1992,11 @@ void ar9170_op_scheduler(struct ar9170* ar) {
 	 * If the pending RX queue is non-empty, we should proceed
 	 * with the handling of the next packet immediately.
 	 */
-	ar9170_sch_async_rx_check(ar);			
+	ar9170_sch_async_rx_check(ar);
+	
+	/* -------- Hardware RNG refill and PRNG reseed -------- */
+	ar9170_sch_rng_check(ar);
+	
+	/* -------- Channel tally collection for telemetry -------- */
+	ar9170_sch_tally_check(ar);
 }
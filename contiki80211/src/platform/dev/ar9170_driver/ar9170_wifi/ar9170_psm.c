@@ -59,21 +59,200 @@
 #include "contiki-main.h"
 #include "compiler.h"
 #include "wire_digital.h"
+#include "smalloc.h"
+#include "interrupt\interrupt_sam_nvic.h"
+#include "sys/trace.h"
+#include "sys/energest.h"
 
 
-/* Real time timer to schedule real time events */
-struct rtimer* real_time_timer;
+/* PSM deadlines; the rtimer queue keeps them apart. */
+static struct ar9170_psm_timer psm_timers[AR9170_PSM_TIMER_NUM];
+
+/* Lateness histogram bucket upper bounds [us]. The last bucket is open. */
+static const U16 psm_late_bounds_us[AR9170_PSM_LATE_BUCKETS - 1] = {
+	10, 50, 100, 500, 1000, 5000
+};
+
+/* Trace events of the PSM deadline types. */
+static const U16 psm_trace_ids[AR9170_PSM_TIMER_NUM] = {
+	TRACE_PSM_ATIM_START, TRACE_PSM_ATIM_END, TRACE_PSM_SOFT_BCN
+};
+
+#if ENERGEST_CONF_ON
+/* Energest types of the radio states, one per bit of the state mask. */
+static const U8 psm_energest_types[] = {
+	ENERGEST_TYPE_WIFI_AWAKE, ENERGEST_TYPE_WIFI_DOZE, ENERGEST_TYPE_TRANSMIT,
+	ENERGEST_TYPE_LISTEN, ENERGEST_TYPE_WIFI_ATIM, ENERGEST_TYPE_WIFI_BEACON
+};
+#endif
+
+/* Real time task callback; accounts how late the deadline was served. */
+static void ar9170_psm_timer_expired(struct rtimer* timer, void* ptr)
+{
+	struct ar9170_psm_timer* t = (struct ar9170_psm_timer*)ptr;
+	U32 late_us = (U32)((RTIMER_LATE(timer) * 1000000) / RTIMER_SECOND);
+	int i;
+	
+	for (i = 0; i < AR9170_PSM_LATE_BUCKETS - 1; i++) {
+		if (late_us < psm_late_bounds_us[i])
+			break;
+	}
+	t->late_hist[i]++;
+	if (late_us > t->late_max_us)
+		t->late_max_us = late_us;
+	
+	TRACE(psm_trace_ids[t - psm_timers], RTIMER_LATE(timer), 
+		ar9170_get_device() ? ar9170_get_device()->ps_mgr.psm_state : 0);
+	
+	t->func(timer, NULL);
+}
+
+/* Schedule a PSM deadline; replaces a pending deadline of the same type. */
+static void ar9170_psm_timer_set(enum ar9170_psm_timer_type type, rtimer_clock_t deadline,
+	rtimer_callback_t func)
+{
+	psm_timers[type].func = func;
+	
+	if (rtimer_set(&psm_timers[type].rt, deadline, 0, ar9170_psm_timer_expired, 
+		&psm_timers[type]) != RTIMER_OK) {
+		printf("ERROR: PSM; Could not set the real time timer.\n");
+	}
+}
+
+const struct ar9170_psm_timer* ar9170_psm_get_timer_stats(enum ar9170_psm_timer_type type)
+{
+	return &psm_timers[type];
+}
+
+void ar9170_psm_print_timer_stats(void)
+{
+	static const char* const names[AR9170_PSM_TIMER_NUM] = {
+		"ATIM start", "ATIM end", "Soft BCN"
+	};
+	int i, j;
+	
+	for (i = 0; i < AR9170_PSM_TIMER_NUM; i++) {
+		printf("PSM timer %-10s late [us] <10:%lu <50:%lu <100:%lu <500:%lu <1k:%lu <5k:%lu >=5k:%lu max:%lu\n",
+			names[i],
+			psm_timers[i].late_hist[0], psm_timers[i].late_hist[1], 
+			psm_timers[i].late_hist[2], psm_timers[i].late_hist[3], 
+			psm_timers[i].late_hist[4], psm_timers[i].late_hist[5],
+			psm_timers[i].late_hist[6], psm_timers[i].late_max_us);
+		for (j = 0; j < AR9170_PSM_LATE_BUCKETS; j++)
+			psm_timers[i].late_hist[j] = 0;
+		psm_timers[i].late_max_us = 0;
+	}
+}
+
+/* 
+ * Estimate the local time of the current pre-TBTT from the observed
+ * arrival time of the pre-TBTT event. The event reaches us after a
+ * variable USB and interrupt latency, which only ever delays it, so the
+ * anchor follows early observations immediately and late ones slowly.
+ * The beacon period, in local rtimer ticks, is tracked alongside, which
+ * compensates for drift between the AR9170 TSF and the SAM3X clock.
+ * Latency would bias a period fitted to every sample, so the drift is
+ * taken from the least delayed event of each window only.
+ */
+static void ar9170_psm_tbtt_drift(struct ar9170* ar, rtimer_clock_t observed, 
+	rtimer_clock_t nominal, unsigned int n)
+{
+	long long phase;
+	long long target;
+	
+	ar->ps_mgr.tbtt_index += n;
+	phase = (long long)(observed - ar->ps_mgr.tbtt_ref) - 
+		(long long)ar->ps_mgr.tbtt_index * (long long)nominal;
+	
+	if (ar->ps_mgr.tbtt_win_events == 0 || phase < ar->ps_mgr.tbtt_win_min) {
+		ar->ps_mgr.tbtt_win_min = phase;
+		ar->ps_mgr.tbtt_win_min_index = ar->ps_mgr.tbtt_index;
+	}
+	if (++ar->ps_mgr.tbtt_win_events < AR9170_PSM_TBTT_WINDOW) {
+		return;
+	}
+	
+	if (ar->ps_mgr.tbtt_prev_valid && 
+		ar->ps_mgr.tbtt_win_min_index > ar->ps_mgr.tbtt_prev_min_index) {
+		/* Slope of the minimum-latency phase: period error per interval. */
+		target = (long long)nominal + 
+			(ar->ps_mgr.tbtt_win_min - ar->ps_mgr.tbtt_prev_min) / 
+			(long long)(ar->ps_mgr.tbtt_win_min_index - ar->ps_mgr.tbtt_prev_min_index);
+		ar->ps_mgr.tbtt_period = (rtimer_clock_t)((long long)ar->ps_mgr.tbtt_period +
+			(target - (long long)ar->ps_mgr.tbtt_period) / AR9170_PSM_TBTT_PERIOD_GAIN);
+		
+		/* Bounded to +/- 1000 ppm of the nominal period. */
+		if (ar->ps_mgr.tbtt_period > nominal + nominal / 1000) {
+			ar->ps_mgr.tbtt_period = nominal + nominal / 1000;
+		} else if (ar->ps_mgr.tbtt_period < nominal - nominal / 1000) {
+			ar->ps_mgr.tbtt_period = nominal - nominal / 1000;
+		}
+	}
+	
+	/* Re-base at the window minimum; phases are unchanged by this. */
+	ar->ps_mgr.tbtt_ref += (rtimer_clock_t)ar->ps_mgr.tbtt_win_min_index * nominal;
+	ar->ps_mgr.tbtt_index -= ar->ps_mgr.tbtt_win_min_index;
+	ar->ps_mgr.tbtt_prev_min = ar->ps_mgr.tbtt_win_min;
+	ar->ps_mgr.tbtt_prev_min_index = 0;
+	ar->ps_mgr.tbtt_prev_valid = true;
+	ar->ps_mgr.tbtt_win_events = 0;
+}
+
+static rtimer_clock_t ar9170_psm_tbtt_anchor(struct ar9170* ar, rtimer_clock_t observed)
+{
+	rtimer_clock_t nominal = AR9170_PSM_KUS_TO_TICKS(ar->global_beacon_int);
+	rtimer_clock_t predicted;
+	long long err;
+	unsigned int n;
+	
+	if (!ar->ps_mgr.tbtt_synced || nominal == 0 || observed <= ar->ps_mgr.tbtt_anchor) {
+		goto resync;
+	}
+	
+	/* Account for pre-TBTT events we may have missed. */
+	n = (unsigned int)((observed - ar->ps_mgr.tbtt_anchor + ar->ps_mgr.tbtt_period / 2) / 
+		ar->ps_mgr.tbtt_period);
+	if (n == 0) {
+		n = 1;
+	}
+	predicted = ar->ps_mgr.tbtt_anchor + n * ar->ps_mgr.tbtt_period;
+	err = (long long)(observed - predicted);
+	
+	if (err > (long long)(nominal / 4) || -err > (long long)(nominal / 4)) {
+		/* Lost track; e.g. after a re-join with a different TSF. */
+		goto resync;
+	}
+	
+	if (err < 0) {
+		/* Less latency than predicted; trust the observation. */
+		ar->ps_mgr.tbtt_anchor = observed;
+	} else {
+		ar->ps_mgr.tbtt_anchor = predicted + err / AR9170_PSM_TBTT_ANCHOR_GAIN;
+	}
+	
+	ar9170_psm_tbtt_drift(ar, observed, nominal, n);
+	return ar->ps_mgr.tbtt_anchor;
+	
+resync:
+	ar->ps_mgr.tbtt_synced = true;
+	ar->ps_mgr.tbtt_anchor = observed;
+	ar->ps_mgr.tbtt_period = nominal;
+	ar->ps_mgr.tbtt_ref = observed;
+	ar->ps_mgr.tbtt_index = 0;
+	ar->ps_mgr.tbtt_win_events = 0;
+	ar->ps_mgr.tbtt_prev_valid = false;
+	return observed;
+}
 
 
 /* This is a call-back function fire when the Soft Beacon transmission time expires. */
 static void ar9170_psm_soft_beacon_tx(struct rtimer* timer, void* ptr) {
 	
-	rtimer_clock_t current_time = RTIMER_NOW();
 	UNUSED(timer);
 	UNUSED(ptr);
 	
 	#if AR9170_PSM_DEBUG_DEEP
-	printf("[%llu] Soft TBTT.\n",current_time);
+	printf("[%llu] Soft TBTT.\n",RTIMER_NOW());
 	#endif
 	
 	struct ar9170* ar = ar9170_get_device(); 
@@ -87,14 +266,12 @@ static void ar9170_psm_soft_beacon_tx(struct rtimer* timer, void* ptr) {
 		/* Enable the flag that tells the scheduler to transmit a soft beacon. */
 		ar->ps_mgr.send_soft_bcn_flag = true;
 		
-		/* Schedule next soft beacon transmission time interrupt. */
-		if (rtimer_set(real_time_timer, current_time +
-			RTIMER_MILLISECOND * (unique_vif->bss_conf.soft_beacon_int),
-			0,
-			ar9170_psm_soft_beacon_tx, NULL)) {
-			
-			printf("ERROR: PSM; Could not set timer for Soft beaconing.\n");
-		}
+		/* Schedule next soft beacon transmission time interrupt, relative
+		 * to the previous deadline so that callback latency does not add up.
+		 */
+		ar->ps_mgr.soft_bcn_deadline += AR9170_PSM_KUS_TO_TICKS(unique_vif->bss_conf.soft_beacon_int);
+		ar9170_psm_timer_set(AR9170_PSM_TIMER_SOFT_BCN, ar->ps_mgr.soft_bcn_deadline,
+			ar9170_psm_soft_beacon_tx);
 		
 	} else {
 		
@@ -103,7 +280,7 @@ static void ar9170_psm_soft_beacon_tx(struct rtimer* timer, void* ptr) {
 }
 
 /* This function is called inside interrupt context. */
-void ar9170_psm_start_soft_beaconing( struct ar9170* ar, rtimer_clock_t current_time ) 
+void ar9170_psm_start_soft_beaconing( struct ar9170* ar, rtimer_clock_t start_time ) 
 {
 	#if AR9170_PSM_DEBUG_DEEP
 	printf("DEBUG: PSM; Soft beaconing.\n");
@@ -114,16 +291,14 @@ void ar9170_psm_start_soft_beaconing( struct ar9170* ar, rtimer_clock_t current_
 	 * packets.
 	 */
 	ar->ps_mgr.psm_state = AR9170_SOFT_BCN_WINDOW;
+	ar9170_psm_energest_update(ar);
 	
 	
 	/* Schedule next soft-beacon transmission. */
-	if (rtimer_set(real_time_timer, current_time +
-		RTIMER_MILLISECOND * (unique_vif->bss_conf.soft_beacon_int),
-		0,
-		ar9170_psm_soft_beacon_tx, NULL)) {
-			
-			printf("ERROR: PSM; Could not set timer for Soft beaconing.\n");
-	}
+	ar->ps_mgr.soft_bcn_deadline = start_time + 
+		AR9170_PSM_KUS_TO_TICKS(unique_vif->bss_conf.soft_beacon_int);
+	ar9170_psm_timer_set(AR9170_PSM_TIMER_SOFT_BCN, ar->ps_mgr.soft_bcn_deadline,
+		ar9170_psm_soft_beacon_tx);
 	
 	/* FIXME - schedule immediate power-saving. */
 	//ar9170_psm_schedule_powersave(ar, true);
@@ -133,12 +308,11 @@ void ar9170_psm_start_soft_beaconing( struct ar9170* ar, rtimer_clock_t current_
 /* This is a call-back function fired when the ATIM Window expires. */
 static void ar9170_psm_atim_window_end(struct rtimer* timer, void* ptr) {
 	
-	rtimer_clock_t current_time = RTIMER_NOW();	
 	UNUSED(timer);
 	UNUSED(ptr);
 	
 	#if AR9170_PSM_DEBUG_DEEP
-	printf("[%llu] AE\n",current_time);
+	printf("[%llu] AE\n",RTIMER_NOW());
 	#endif	
 		
 	// TODO - move ar9170 pointer to the arguments' list.
@@ -158,7 +332,7 @@ static void ar9170_psm_atim_window_end(struct rtimer* timer, void* ptr) {
 		 * transmission, so we are allowed to transit to the soft
 		 * beaconing state [semi-doze].
 		 */
-		ar9170_psm_start_soft_beaconing(ar, current_time);
+		ar9170_psm_start_soft_beaconing(ar, RTIMER_TIME(&psm_timers[AR9170_PSM_TIMER_ATIM_END].rt));
 		return;
 	} 
 	
@@ -172,6 +346,7 @@ static void ar9170_psm_atim_window_end(struct rtimer* timer, void* ptr) {
 		printf("WARNING: AR9170 device should have been in ATIM Window [%u].\n",ar->ps_mgr.psm_state);
 	}
 	ar->ps_mgr.psm_state = AR9170_TX_WINDOW;	
+	ar9170_psm_energest_update(ar);
 
 	/* Schedule power-save transition. Notice that this MIGHT NOT be 
 	 * executed due to beacon transmission in this beacon interval, 
@@ -188,12 +363,11 @@ static void ar9170_psm_atim_window_end(struct rtimer* timer, void* ptr) {
  */
 static void ar9170_psm_atim_window_start(struct rtimer* timer, void* ptr)
 {
+	UNUSED(timer);
 	UNUSED(ptr);
-	/* Store the current time. */
-	rtimer_clock_t current_time = RTIMER_NOW();
 	
 	#if AR9170_PSM_DEBUG_DEEP	
-	printf("[%llu] ATIMW Start.\n",current_time);
+	printf("[%llu] ATIMW Start.\n",RTIMER_NOW());
 	#endif
 	
 	struct ar9170* ar = ar9170_get_device(); 
@@ -208,6 +382,7 @@ static void ar9170_psm_atim_window_start(struct rtimer* timer, void* ptr)
 		
 		/* Device PSM state transits to the ATIM Window. */
 		ar->ps_mgr.psm_state = AR9170_ATIM_WINDOW;	
+		ar9170_psm_energest_update(ar);
 	
 	} else if (ar->ps_mgr.psm_state == AR9170_ATIM_WINDOW) {
 		
@@ -218,14 +393,13 @@ static void ar9170_psm_atim_window_start(struct rtimer* timer, void* ptr)
 		printf("WARNING: AR9170 device should have only been in either pre-TBTT or ATIM Window!\n");
 	}
 	
-	/* Set rtimer to the due time of the ATIM Window End. */
-	if(rtimer_set(real_time_timer, current_time + 
-			RTIMER_MILLISECOND * (unique_vif->bss_conf.atim_window-AR9170_ATIM_WINDOW_OFFSET_KUS),
-			0, 
-			ar9170_psm_atim_window_end, NULL)) {
-				
-		printf("ERROR: PSM; Could not set timer for ATIM Window End.\n");
-	}
+	/* A new beacon interval starts; close the airtime accounting period. */
+	ieee80211_airtime_new_interval();
+	
+	/* Set the ATIM Window End deadline, relative to the anchored TBTT. */
+	ar9170_psm_timer_set(AR9170_PSM_TIMER_ATIM_END, ar->ps_mgr.tbtt_anchor +
+		AR9170_PSM_KUS_TO_TICKS(AR9170_PRETBTT_KUS + unique_vif->bss_conf.atim_window),
+		ar9170_psm_atim_window_end);
 	
 	/* Update the override flag, if there is some data to transmit in the current beacon interval. */
 	if (!linked_list_is_empty(ar->tx_pending_pkts)) {
@@ -256,33 +430,91 @@ static void ar9170_bcn_control(struct rtimer* timer, void* ptr)
 */
 
 
-/* Schedule an interrupt to mark the ATIM Window End. 
+/* Schedule an interrupt to mark the ATIM Window Start. 
  * The function is called from interrupt context, so 
  * it needs to be executed fast.
  */
-void ar9170_psm_schedule_atim_window_start_interrupt(rtimer_clock_t pre_tbtt_time)
+void ar9170_psm_schedule_atim_window_start_interrupt(struct ar9170* ar, rtimer_clock_t pre_tbtt_time)
 {	
+	rtimer_clock_t anchor;
+	
 	#if AR9170_PSM_DEBUG_DEEP
 	printf("DEBUG: PSM; Scheduling ATIM start interrupt...\n");
 	#endif
 	
+	/* Anchor the beacon interval to the estimated pre-TBTT rather than to
+	 * the (late) arrival of the pre-TBTT event.
+	 */
+	anchor = ar9170_psm_tbtt_anchor(ar, pre_tbtt_time);
+	TRACE(TRACE_PSM_PRETBTT, anchor, pre_tbtt_time - anchor);
+	
+	/* A new beacon interval starts; drop deadlines left from the last one. */
+	rtimer_cancel(&psm_timers[AR9170_PSM_TIMER_SOFT_BCN].rt);
+	rtimer_cancel(&psm_timers[AR9170_PSM_TIMER_ATIM_END].rt);
+	
 	/* Set rtimer to the due time of the ATIM Window Start. Note that this 
 	 * may well be canceled by an earlier "BCN Sent" response or a Beacon 
 	 * reception from a neighbor.
 	 */ 
-	int err = rtimer_set(real_time_timer, pre_tbtt_time + (RTIMER_MILLISECOND  *
-								(AR9170_PRETBTT_KUS+AR9170_ATIM_WINDOW_OFFSET_KUS)), 
-								0, 
-								ar9170_psm_atim_window_start, NULL); 
-	if (err) {
-		printf("ERROR: PSM; Could not set timer for ATIM Window End.\n");
-	}	
+	ar9170_psm_timer_set(AR9170_PSM_TIMER_ATIM_START, anchor + 
+		AR9170_PSM_KUS_TO_TICKS(AR9170_PRETBTT_KUS + AR9170_ATIM_WINDOW_OFFSET_KUS),
+		ar9170_psm_atim_window_start);
 }
 
 
 void ar9170_psm_init_rtimer() {
-	real_time_timer = smalloc(sizeof(struct rtimer));
-	memset(real_time_timer,0,sizeof(struct rtimer));
+	int i;
+	
+	for (i = 0; i < AR9170_PSM_TIMER_NUM; i++) {
+		rtimer_cancel(&psm_timers[i].rt);
+	}
+	memset(psm_timers, 0, sizeof(psm_timers));
+}
+
+/* Bring the energest radio states in line with the device power-save
+ * and PSM state. Called, from any context, after each transition.
+ */
+void ar9170_psm_energest_update(struct ar9170* ar)
+{
+#if ENERGEST_CONF_ON
+	static U8 radio_states;
+	U8 states = 0, changed;
+	irqflags_t flags;
+	bool awake, tx;
+	unsigned int i;
+	
+	if (ar != NULL) {
+		awake = !ar->ps.state;
+		tx = awake && (ar->tx_data_wait || ar->tx_atim_wait);
+		
+		states |= awake ? BIT(0) : BIT(1);
+		if (tx)
+			states |= BIT(2);
+		if (awake && !tx)
+			states |= BIT(3);
+		if (awake && ar->ps_mgr.psm_state == AR9170_ATIM_WINDOW)
+			states |= BIT(4);
+		if (ar->ps_mgr.psm_state == AR9170_PRE_TBTT || 
+			ar->ps_mgr.psm_state == AR9170_SOFT_BCN_WINDOW)
+			states |= BIT(5);
+	}
+	
+	flags = cpu_irq_save();
+	changed = states ^ radio_states;
+	for (i = 0; i < sizeof(psm_energest_types); i++) {
+		if (!(changed & BIT(i)))
+			continue;
+		if (states & BIT(i)) {
+			ENERGEST_ON(psm_energest_types[i]);
+		} else {
+			ENERGEST_OFF(psm_energest_types[i]);
+		}
+	}
+	radio_states = states;
+	cpu_irq_restore(flags);
+#else
+	UNUSED(ar);
+#endif /* ENERGEST_CONF_ON */
 }
 
 /* This function is called within interrupt context. */
@@ -366,6 +598,7 @@ void ar9170_psm_async_tx_data( struct ar9170* ar )
 		if ( queue != NULL) {
 			
 			__start(&(ar->tx_data_wait));		
+			ar9170_psm_energest_update(ar);
 			
 			/* Assign the list reference to the pending packets queue. */
 			if (queue != ar->tx_pending_pkts) {
@@ -425,6 +658,7 @@ void ar9170_psm_async_tx_mgmt( struct ar9170* ar )
 		}
 		/* Set the waiting flag for ATIM response. */
 		__start(&(ar->tx_atim_wait));
+		ar9170_psm_energest_update(ar);
 		
 		/* Save the current DA under ATIM transmission. It
 		 * will be used for updating the list of neighbors,
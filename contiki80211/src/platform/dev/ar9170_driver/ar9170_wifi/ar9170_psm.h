@@ -80,14 +80,45 @@ enum ar9170_op_state {
 #define	AR9170_ATIM_RECV	= BIT(3)
 #define	AR9170_DATA_RECV	= BIT(4)
 
+/* Conversion of firmware time units [1024 us] to rtimer ticks. */
+#define AR9170_PSM_KUS_TO_TICKS(kus)	((rtimer_clock_t)(kus) * (RTIMER_SECOND / 1000) * 1024 / 1000)
+
+/* Gains [1/x] of the pre-TBTT anchor and beacon period estimators. */
+#define AR9170_PSM_TBTT_ANCHOR_GAIN		8
+#define AR9170_PSM_TBTT_PERIOD_GAIN		4
+
+/* Pre-TBTT events per window of the minimum-latency drift estimator. */
+#define AR9170_PSM_TBTT_WINDOW			16
+
+/* PSM deadline types, each with its own real time task. */
+enum ar9170_psm_timer_type {
+	AR9170_PSM_TIMER_ATIM_START,
+	AR9170_PSM_TIMER_ATIM_END,
+	AR9170_PSM_TIMER_SOFT_BCN,
+	AR9170_PSM_TIMER_NUM
+};
+
+#define AR9170_PSM_LATE_BUCKETS			7
+
+struct ar9170_psm_timer {
+	struct rtimer rt;
+	rtimer_callback_t func;
+	/* Lateness histogram: <10, <50, <100, <500, <1000, <5000, >=5000 us */
+	U32 late_hist[AR9170_PSM_LATE_BUCKETS];
+	U32 late_max_us;
+};
+
 /*
 ar9170_tx_queue* ar9170_psm_can_send_first_pkt( struct ar9170* ar );
 bool ar9170_psm_has_sent_beacon(struct ar9170*);
 */
-void ar9170_psm_schedule_atim_window_start_interrupt(rtimer_clock_t pre_tbtt_time);
+void ar9170_psm_schedule_atim_window_start_interrupt(struct ar9170* ar, rtimer_clock_t pre_tbtt_time);
 void ar9170_psm_init_rtimer();
 void ar9170_psm_schedule_powersave(struct ar9170* ar, bool new_state);
 void ar9170_psm_async_tx_data( struct ar9170* ar );
 void ar9170_psm_async_tx_mgmt( struct ar9170* ar );
-void ar9170_psm_start_soft_beaconing( struct ar9170* ar, rtimer_clock_t current_time );
+void ar9170_psm_start_soft_beaconing( struct ar9170* ar, rtimer_clock_t start_time );
+void ar9170_psm_energest_update(struct ar9170* ar);
+const struct ar9170_psm_timer* ar9170_psm_get_timer_stats(enum ar9170_psm_timer_type type);
+void ar9170_psm_print_timer_stats(void);
 #endif /* AR9170_PSM_H_ */
\ No newline at end of file
@@ -54,6 +54,8 @@
 #include "wire_digital.h"
 #include "linked_list.h"
 #include "rtimer.h"
+#include "lib/random.h"
+#include "sys/mt-pool.h"
 
 
 void ar9170_sch_erase_nodes_check( struct ar9170* ar )
@@ -375,3 +377,94 @@ void ar9170_sch_async_tx_check( struct ar9170* ar )
 	}
 		
 }
+
+#ifdef CONFIG_AR9170_HWRNG
+/* Runs on a pool thread, so the register reads yield to the other
+ * processes while they wait for the device.
+ */
+static void ar9170_sch_rng_refill( void* data )
+{
+	struct ar9170* ar = data;
+	
+	if (ar9170_rng_get(ar)) {
+		#if AR9170_SCHEDULER_DEBUG
+		printf("WARNING: AR9170 Scheduler could not refill the hw rng.\n");
+		#endif
+	}
+	ar->cmd_thread_busy = false;
+}
+#endif /* CONFIG_AR9170_HWRNG */
+
+void ar9170_sch_rng_check( struct ar9170* ar )
+{
+#ifdef CONFIG_AR9170_HWRNG
+	if (!ar->rng.initialized) {
+		return;
+	}
+	
+	/* Reseed the Contiki PRNG from the cached hardware entropy. */
+	if (not_expected(random_entropy_needed())) {
+		ar9170_rng_stir(ar);
+	}
+	
+	/* Refill the cache from the device once it drops below the low
+	 * watermark. The register reads are handed to a pool thread, out
+	 * of the pre-TBTT window and only while the command lock is free.
+	 */
+	if (not_expected(ar->rng.refill_pending == true)) {
+		
+		if (ar->ps_mgr.psm_state == AR9170_PRE_TBTT) {
+			return;
+		}
+		if ((ar->cmd_thread_busy == true) || (ar->cmd_async_lock == true) || 
+			!IS_ACCEPTING_CMD(ar)) {
+			return;
+		}
+		ar->cmd_thread_busy = true;
+		if (!mt_pool_run(ar9170_sch_rng_refill, ar, NULL)) {
+			/* No free thread; try again in the next round. */
+			ar->cmd_thread_busy = false;
+		}
+	}
+#endif /* CONFIG_AR9170_HWRNG */
+}
+
+/* Runs on a pool thread, like the hw rng refill. */
+static void ar9170_sch_tally_collect( void* data )
+{
+	struct ar9170* ar = data;
+	
+	if (ar9170_update_survey(ar, false, true)) {
+		#if AR9170_SCHEDULER_DEBUG
+		printf("WARNING: AR9170 Scheduler could not collect the tally.\n");
+		#endif
+	} else {
+		ar->tally_valid = true;
+	}
+	ar->cmd_thread_busy = false;
+}
+
+void ar9170_sch_tally_check( struct ar9170* ar )
+{
+	if (not_expected(ar->tally_request == true)) {
+		
+		/* Tally and noise floor are both register round-trips; keep
+		 * them out of the pre-TBTT window and off a busy command lock,
+		 * and let a pool thread wait for them.
+		 */
+		if (ar->ps_mgr.psm_state == AR9170_PRE_TBTT) {
+			return;
+		}
+		if ((ar->cmd_thread_busy == true) || (ar->cmd_async_lock == true) || 
+			!IS_ACCEPTING_CMD(ar)) {
+			return;
+		}
+		
+		ar->cmd_thread_busy = true;
+		if (!mt_pool_run(ar9170_sch_tally_collect, ar, NULL)) {
+			ar->cmd_thread_busy = false;
+			return;
+		}
+		ar->tally_request = false;
+	}
+}
@@ -54,6 +54,8 @@ void ar9170_sch_rx_filter_disable_check(struct ar9170* ar);
 void ar9170_sch_async_cmd_check(struct ar9170* ar);
 void ar9170_sch_async_rx_check(struct ar9170* ar);
 void ar9170_sch_async_tx_check(struct ar9170* ar);
+void ar9170_sch_rng_check(struct ar9170* ar);
+void ar9170_sch_tally_check(struct ar9170* ar);
 
 #endif /* AR9170_SCHEDULER_H_ */
 
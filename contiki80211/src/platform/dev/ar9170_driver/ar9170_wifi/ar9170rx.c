@@ -68,9 +68,11 @@
 #include "ar9170.h"
 #include "ar9170_psm.h"
 #include "smalloc.h"
+#include "ibss_cache.h"
 #include <stdint-gcc.h>
 #include "wire_digital.h"
 #include "pio.h"
+#include "sys/trace.h"
 
 
 
@@ -442,6 +444,8 @@ void ar9170_handle_command_response(struct ar9170 *ar, void* buf, uint32_t len)
 	struct ieee80211_vif *vif;
 	struct ar9170_rsp *cmd = buf;
 	
+	TRACE(TRACE_CMD_RSP, cmd->hdr.cmd, len);
+	
 	if (ar9170_check_sequence(ar, cmd->hdr.seq)) {
 		printf("ERROR: Command Sequence numbers broken!\n");
 		/* Restart? */
@@ -597,7 +601,7 @@ void ar9170_handle_command_response(struct ar9170 *ar, void* buf, uint32_t len)
 				 * the ATIM Window. We use the current time, so we are 
 				 * not expecting to have time drifts in this function.
 				 */										
-				ar9170_psm_schedule_atim_window_start_interrupt(current_time);
+				ar9170_psm_schedule_atim_window_start_interrupt(ar, current_time);
 				
 				/* Update device PSM State to pre-TBTT Window. This 
 				 * is fast, and, also, time-critical, so we change 
@@ -716,6 +720,7 @@ void ar9170_handle_command_response(struct ar9170 *ar, void* buf, uint32_t len)
 					__start(&ar->clear_tx_async_lock_at_next_tbtt);
 				}
 			}
+			ar9170_psm_energest_update(ar);
 			#if AR9170_RX_DEBUG_DEEP
 			printf("%u %u\n",linked_list_get_len(ar->tx_pending_atims), linked_list_get_len(ar->tx_pending_pkts));
 			#endif
@@ -959,6 +964,7 @@ void ar9170_handle_ps(struct ar9170 *ar, struct ar9170_rsp *rsp)
 		/* We were not waiting for psm transition. This is an error. */
 		printf("ERROR: We were not waiting for PSM transition.\n");
 	}	
+	ar9170_psm_energest_update(ar);
 			
 	#if AR9170_RX_DEBUG_DEEP
 	printf("Power-saving state updated to %d.\n",ar->ps.state);
@@ -1017,6 +1023,7 @@ void ar9170_schedule_handle_mpdu( struct ar9170* ar, U8 *buf, int len )
 	 * lose unnecessary time.
 	 */ 
 	if (linked_list_get_len(ar->rx_pending_pkts) >= AR9170_MAX_PENDING_RX_PKT_QUEUE_LEN) {
+		ar->rx_queue_full++;
 		#if AR9170_RX_DEBUG_DEEP
 		printf("WARNING: The packet list is full. Received packet is dropped.\n");
 		#endif
@@ -1045,10 +1052,15 @@ void ar9170_schedule_handle_mpdu( struct ar9170* ar, U8 *buf, int len )
 			if(!ar9170_op_add_pending_pkt(ar, &ar->rx_pending_pkts, skb, false)) {
 				
 				printf("ERROR: received packet could not be added in the pending RX packets queue.\n");
+				free(skb->data);
+				free(skb);
+			} else {
+				ar->rx_frames++;
 			}
 		} else {
 			
 			printf("ERROR: Could not allocate memory for packet contents.\n");
+			free(skb);
 		}	
 	
 	} else {
@@ -1178,6 +1190,8 @@ void ar9170_handle_mpdu(struct ar9170 *ar, U8 *buf, int len)
 	mac = (void *)(buf + mpdu_len);
 	mac_status = mac->status;
 	
+	TRACE(TRACE_RX_MPDU, mpdu_len, mac_status);
+	
 	switch (mac_status & AR9170_RX_STATUS_MPDU) {
 	case AR9170_RX_STATUS_MPDU_FIRST:
 		/* Aggregated MPDUs start with an PLCP header */
@@ -1302,9 +1316,15 @@ void ar9170_handle_mpdu(struct ar9170 *ar, U8 *buf, int len)
 	if (!ar9170_ampdu_check(ar, buf, mac_status))
 		goto drop;
 
-	if (phy)
+	if (phy) {
 		ar9170_rx_phy_status(ar, phy, &status);
-
+		
+		/* The signal strength is only known here, so the IBSS cache
+		 * gets the beacon RSSI straight from the interrupt context.
+		 */
+		if (ieee80211_is_beacon(((struct ieee80211_hdr*)buf)->frame_control))
+			ibss_cache_update_rssi(((struct ieee80211_mgmt*)buf)->bssid, status.signal);
+	}
 	ar9170_ps_beacon(ar, buf, mpdu_len);
 /*
 	carl9170_ba_check(ar, buf, mpdu_len);
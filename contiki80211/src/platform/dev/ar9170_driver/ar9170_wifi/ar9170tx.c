@@ -59,7 +59,10 @@
 #include "string.h"
 #include "dsc.h"
 #include "ieee80211_rx.h"
+#include "ieee80211_tx.h"
 #include "etherdevice.h"
+#include "sys/trace.h"
+#include "smalloc.h"
 
 
 int ar9170_op_tx( struct ieee80211_hw *hw, struct sk_buff *skb )
@@ -88,6 +91,7 @@ int ar9170_op_tx( struct ieee80211_hw *hw, struct sk_buff *skb )
 	}
 		
 	/* Send frame down to the tx queue */
+	TRACE(TRACE_TX_SUBMIT, skb->len, 0);
 	ar9170_tx(skb);
 	
 	return true;
@@ -855,9 +859,22 @@ void __ar9170_tx_process_status(struct ar9170 *ar,const uint8_t cookie, const ui
 
 	r = (info & AR9170_TX_STATUS_RIX) >> AR9170_TX_STATUS_RIX_S;
 	t = (info & AR9170_TX_STATUS_TRIES) >> AR9170_TX_STATUS_TRIES_S;
+	
+	TRACE(TRACE_TX_STATUS, cookie, success);
+	
+	/* Per-queue counters for the telemetry stream. */
+	ar->txq_stats[q].tx++;
+	ar->txq_stats[q].retry += t;
+	if (!success)
+		ar->txq_stats[q].drop++;
+	
+	/* Retransmissions of a data frame also count as its airtime. */
+	if (ar->tx_data_wait)
+		ieee80211_airtime_account_retries(t);
 
 	//carl9170_tx_fill_rateinfo(ar, r, t, txinfo);
 	__ar9170_tx_status(ar, skb, success);
+	ar9170_psm_energest_update(ar);
 }
 
 
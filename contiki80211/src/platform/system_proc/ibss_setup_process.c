@@ -46,6 +46,10 @@
 #include "platform-conf.h"
 #include "ieee80211_mh_psm.h"
 #include "ieee80211_iface_setup_process.h"
+#include "ibss_cache.h"
+#ifdef WITH_TELEMETRY
+#include "telemetry_process.h"
+#endif
 
 #define DEBUG_PROC	1
 #include "contiki-main.h"
@@ -59,6 +63,9 @@ struct etimer et_ibss_setup_proc;
 /* Flag indicating whether the IBSS setup [join/create] has been completed. */
 static volatile bool ibss_setup_process_completed_flag;
 
+/* Flag indicating that the last joined IBSS is being rejoined. */
+static bool ibss_setup_process_rejoin_flag;
+
 /*---------------------------------------------------------------------------*/
 bool is_ibss_setup_completed() {
 	
@@ -76,9 +83,10 @@ static void ibss_setup_process_poll_handler()
 			process_post(&ibss_setup_process, PROCESS_EVENT_EXIT, NULL);
 		
 		} else {
-			#ifdef WITH_STATISTICS_COLLECTION
-			/* Signal an event to the statistics collector to start displaying statistics. */
-			process_post(&stats_display_process, PROCESS_EVENT_CONTINUE, NULL);
+			#ifdef WITH_TELEMETRY
+			/* (Re)start the telemetry collector and signal it to start recording. */
+			process_start(&telemetry_process, NULL);
+			process_post(&telemetry_process, PROCESS_EVENT_CONTINUE, NULL);
 			#endif
 			/* Network setup is completed successfully. Time to schedule the 
 			 * IBSS creation, unless join comes first. 
@@ -115,6 +123,8 @@ PROCESS_THREAD(ibss_setup_process, ev, data)
 	
 	PRINTF("IBSS_SETUP_PROCESS\n");
 	
+	process_set_cpu(&ibss_setup_process, ENERGEST_CPU_IBSS);
+	
 	/* Initialize indicator flag that IBSS can start. */
 	ibss_setup_process_completed_flag = false;
 	
@@ -133,21 +143,44 @@ PROCESS_THREAD(ibss_setup_process, ev, data)
 		goto err_exit;
 	}
 	
+	/* If the IBSS we were part of has been heard recently [e.g. before a USB
+	 * replug], the interface has already been tuned to its cached channel.
+	 * Skip most of the initial delay and listen there for its next beacon.
+	 */
+	ibss_setup_process_rejoin_flag = ibss_cache_is_fresh();
+	
 	/* Wait some time until we can start scanning for the IBSS. */
-	etimer_set(&et_ibss_setup_proc, IBSS_PROC_INIT_DELAY);
+	etimer_set(&et_ibss_setup_proc, ibss_setup_process_rejoin_flag ? 
+		IBSS_PROC_REJOIN_DELAY : IBSS_PROC_INIT_DELAY);
 	PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et_ibss_setup_proc));
 	/* Enable scanning. */
 	ieee80211_enable_scanning();
+	
+	if (ibss_setup_process_rejoin_flag) {
+		
+		PRINTF("INFO: IBSS; Waiting for a beacon from the cached IBSS.\n");
+		/* The first beacon heard joins [posts a "CONTINUE" event]. */
+		etimer_set(&et_ibss_setup_proc, IBSS_PROC_REJOIN_TIMEOUT);
 		
-	PRINTF("INFO: IBSS; Start scanning for default IBSS.\n");
-	/* Passive scanning for the default network. Implemented as follows:
-	 * The device is waiting for parsing beacons from the default IBSS;
-	 * If no beacons arrive, the node proceeds with creating the default
-	 * IBSS. Otherwise, the device PASSIVELY joins the default IBSS.
-	*/
-	etimer_set(&et_ibss_setup_proc, IBSS_PROC_SCAN_TIMEOUT);
-	
-	PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et_ibss_setup_proc)|| (ev == PROCESS_EVENT_CONTINUE));
+		PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et_ibss_setup_proc)|| (ev == PROCESS_EVENT_CONTINUE));
+		
+		if (!ieee80211_is_ibss_joined()) {
+			PRINTF("INFO: IBSS; Cached IBSS not heard. Falling back to scanning.\n");
+		}
+	}
+	
+	if (!ieee80211_is_ibss_joined()) {
+	
+		PRINTF("INFO: IBSS; Start scanning for default IBSS.\n");
+		/* Passive scanning for the default network. Implemented as follows:
+		 * The device is waiting for parsing beacons from the default IBSS;
+		 * If no beacons arrive, the node proceeds with creating the default
+		 * IBSS. Otherwise, the device PASSIVELY joins the default IBSS.
+		*/
+		etimer_set(&et_ibss_setup_proc, IBSS_PROC_SCAN_TIMEOUT);
+	
+		PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et_ibss_setup_proc)|| (ev == PROCESS_EVENT_CONTINUE));
+	}
 	
 	/* Timer expired or default IBSS joined [posts a "CONTINUE" event]. */
 	if (ieee80211_is_ibss_joined()) {
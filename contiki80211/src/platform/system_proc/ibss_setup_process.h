@@ -48,6 +48,14 @@
 
 #define IBSS_PROC_INIT_DELAY		3 * CLOCK_SECOND
 
+/* Initial delay when rejoining the cached IBSS after a device reset. */
+#define IBSS_PROC_REJOIN_DELAY		CLOCK_SECOND / 4
+
+/* Time to wait for a beacon of the cached IBSS, before falling back to a
+ * full scan. It covers a few beacon intervals.
+ */
+#define IBSS_PROC_REJOIN_TIMEOUT	CLOCK_SECOND
+
 /* Beacon period */
 #define BEACON_INTERVAL			200u
 
@@ -48,6 +48,7 @@
 #include "mac80211.h"
 #include "ar9170_main.h"
 #include "ieee80211_ibss.h"
+#include "ibss_cache.h"
 #include "usb_cmd_wrapper.h"
 #include "usb_fw_wrapper.h"
 #include "clock.h"
@@ -59,6 +60,9 @@
 #include "ibss_setup_process.h"
 #include "net_scheduler_process.h"
 #include "netstack.h"
+#include "sys/mt-pool.h"
+#include "tcpip.h"
+#include "resolv.h"
 
 #define DEBUG_PROC	1
 #include "contiki-main.h"
@@ -66,29 +70,105 @@
 
 PROCESS(ieee80211_iface_setup_process, "Network Setup Process");
 
+/* Bring-up stage timestamps, in clock ticks since power-on. */
+static clock_time_t stage_begin[BRINGUP_NUM_STAGES];
+static clock_time_t stage_end[BRINGUP_NUM_STAGES];
+static bool bringup_reported;
+
+/* Stage the poll handler is driving; the device stages after
+ * BRINGUP_USB_ENUM run on a pool thread, which hands BRINGUP_UIP_INIT
+ * back to the poll handler.
+ */
+static enum ieee80211_bringup_stage bringup_stage;
+
+/* Set by the bring-up thread once the PHY is configured; the poll handler
+ * then starts the IBSS processes. Starting a process runs its first
+ * slice and whatever it starts in turn, on the stack of the caller; this
+ * keeps that off the 2 KB pool thread stack.
+ */
+static bool ibss_ready;
+
+static const char* const stage_names[BRINGUP_NUM_STAGES] = {
+	"fw-verify",
+	"usb-enum",
+	"fw-upload",
+	"eeprom",
+	"dev-start",
+	"uip-init",
+	"phy-config",
+	"ibss-join",
+	"first-tx",
+};
+/*---------------------------------------------------------------------------*/
+void ieee80211_bringup_stage_begin(enum ieee80211_bringup_stage stage)
+{
+	stage_begin[stage] = clock_time();
+	stage_end[stage] = 0;
+}
+/*---------------------------------------------------------------------------*/
+void ieee80211_bringup_stage_end(enum ieee80211_bringup_stage stage)
+{
+	/* Only the first completion counts; later calls are no-ops, so
+	 * the transmit path may call this for every packet.
+	 */
+	if (stage_end[stage] != 0) {
+		return;
+	}
+	stage_end[stage] = clock_time();
+	if (stage_end[stage] == 0) {
+		stage_end[stage] = 1;
+	}
+	if (stage == BRINGUP_FIRST_TX && !bringup_reported) {
+		bringup_reported = true;
+		ieee80211_bringup_report();
+	}
+}
+/*---------------------------------------------------------------------------*/
+void ieee80211_bringup_report(void)
+{
+	int i;
+	
+	printf("Bring-up stages [ms]:\n");
+	for (i=0; i<BRINGUP_NUM_STAGES; i++) {
+		if (stage_end[i] == 0) {
+			printf("  %-10s %6lu      -\n", stage_names[i],
+				(unsigned long)stage_begin[i]);
+		} else {
+			printf("  %-10s %6lu %6lu\n", stage_names[i],
+				(unsigned long)stage_begin[i],
+				(unsigned long)(stage_end[i] - stage_begin[i]));
+		}
+	}
+	if (stage_end[BRINGUP_FIRST_TX] != 0) {
+		printf("Time to first packet: %lu ms\n",
+			(unsigned long)stage_end[BRINGUP_FIRST_TX]);
+	}
+	/* Stack use of the bring-up thread, against MTARCH_STACKSIZE. */
+	mt_pool_print_stats();
+}
+/*---------------------------------------------------------------------------*/
+
 int add_network_interface(struct ar9170* ar) {
 	
 	U32 bss_info_changed_flag = 0;
 		
 	PRINTF("IEEE80211_IFACE_SETUP_PROCESS: Enable 802.11 wireless networking.\n");
 	
-	/* Parse the given device firmware */
-	if (ar9170_parse_firmware(ar)) {
-		printf("ERROR: Parsing device firmware returned errors.\n");
-		return -EINVAL;
-	}
-	
 	/* Initialize AR9170 device */
+	ieee80211_bringup_stage_begin(BRINGUP_FW_UPLOAD);
 	if (!ar9170_init_device(ar)) {
 		printf("ERROR: Device could not be initialized.\n");
 		return -ENXIO;
 	}
+	ieee80211_bringup_stage_end(BRINGUP_FW_UPLOAD);
 	
 	/* Register device */
+	ieee80211_bringup_stage_begin(BRINGUP_EEPROM);
 	if (!ar9170_register_device(ar)) {
 		printf("ERROR: Device could not be registered.\n");
 		return -ENXIO;
 	}
+	ieee80211_bringup_stage_end(BRINGUP_EEPROM);
 
 	// EXTRA FIXME - put it somewhere better than just here
 	ar->common.regulatory.country_code = CTRY_SWITZERLAND;
@@ -100,6 +180,7 @@ int add_network_interface(struct ar9170* ar) {
 	ar->ps.off_override = 0;
 		
 	/* Start device */
+	ieee80211_bringup_stage_begin(BRINGUP_DEVICE_START);
 	if (!ar9170_op_start(ar)) {
 		printf("ERROR: Device could not start!\n");
 		return -ENXIO;
@@ -122,6 +203,7 @@ int add_network_interface(struct ar9170* ar) {
 	 * module.
 	 */
 	NETSTACK_NETWORK.init();					
+	ieee80211_bringup_stage_end(BRINGUP_DEVICE_START);
 	/* All OK */					
 	return 0; 
 }
@@ -208,6 +290,9 @@ static int allocate_mac_resources()
 		PRINTF("ERROR: Could not allocate memory for the IEEE80211 HW struct.\n");
 		return -ENOMEM;
 	}
+	/* Override the defaults with the last joined IBSS, if recently heard. */
+	ibss_cache_apply();
+	
 	/* Copy the network SSID */
 	memcpy(ar->common.curbssid, ibss_info->ibss_bssid, ETH_ALEN);
 	
@@ -231,11 +316,105 @@ static int allocate_mac_resources()
 	return 0;
 }
 /*---------------------------------------------------------------------------*/
-
-
-
+/* Allocate the driver state and verify the firmware image. Neither needs
+ * the device, so this runs while the USB host is still enumerating it.
+ */
+static int prepare_device(void)
+{
+	ieee80211_bringup_stage_begin(BRINGUP_FW_VERIFY);
+	
+	if (allocate_mac_resources()) {
+		PRINTF("ERROR: MAC resources allocation returned errors.\n");
+		return -ENOMEM;
+	}
+	
+	/* Parse the given device firmware */
+	if (ar9170_parse_firmware(ar9170_get_device())) {
+		printf("ERROR: Parsing device firmware returned errors.\n");
+		return -EINVAL;
+	}
+	ieee80211_bringup_stage_end(BRINGUP_FW_VERIFY);
+	return 0;
+}
 /*---------------------------------------------------------------------------*/
-static void ieee80211_iface_setup_process_poll_handler(void)
+/* Start uIP and RPL ahead of the IBSS. The link-local address is derived
+ * from uip_lladdr when tcpip_process starts, so this waits for nullnet to
+ * pick up the device MAC address. Whatever they send before the IBSS is up
+ * is held by the MAC driver and released once beaconing starts.
+ */
+static void start_upper_layers(void)
+{
+	ieee80211_bringup_stage_begin(BRINGUP_UIP_INIT);
+	#ifndef WITH_SLIP
+	#if WITH_UIP6
+	/* Network stack events are served before application ones. */
+	process_set_priority(&tcpip_process, PROCESS_PRIO_HIGH);
+	process_set_cpu(&tcpip_process, ENERGEST_CPU_UIP);
+	process_start(&tcpip_process, NULL);
+	process_start(&resolv_process, NULL);
+	#endif
+	#endif /* WITH_SLIP */
+	ieee80211_bringup_stage_end(BRINGUP_UIP_INIT);
+}
+/*---------------------------------------------------------------------------*/
+/* Upload the firmware, initialize the device and configure the PHY. Runs
+ * on a pool thread; on success the poll handler starts the IBSS, otherwise
+ * the outcome is posted to the setup process.
+ */
+static void bring_up_device(void *ptr)
+{
+	struct ar9170* ar = ptr;
+	
+	/* Initialize and add the network interface. */
+	if (add_network_interface(ar)) {
+		printf("ERROR: AR9170 device could not be added!\n");
+		process_post(&ieee80211_iface_setup_process, PROCESS_EVENT_EXIT, NULL);
+		return;
+	}
+	
+	/* The MAC address is known now; let the poll handler start uIP
+	 * while this thread configures the PHY and joins the IBSS.
+	 */
+	bringup_stage = BRINGUP_UIP_INIT;
+	process_poll(&ieee80211_iface_setup_process);
+	
+	/* Start network setup operation. */
+	ieee80211_bringup_stage_begin(BRINGUP_PHY_CONFIG);
+	if (!start_network_setup_operation()) {
+		
+		ieee80211_bringup_stage_end(BRINGUP_PHY_CONFIG);
+		
+		/* The poll handler starts the IBSS processes. */
+		ibss_ready = true;
+		process_poll(&ieee80211_iface_setup_process);
+		return;
+	}				
+	/* Signal an event for the process to continue. */
+	process_post(&ieee80211_iface_setup_process, PROCESS_EVENT_CONTINUE, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Runs in process context, once the bring-up thread is done with the PHY. */
+static void start_ibss(void)
+{
+	ieee80211_bringup_stage_begin(BRINGUP_IBSS_JOIN);
+	
+	/* Start the processes of IBSS initialization
+	 * and networking schedulers. 
+	 */
+	process_start(&ibss_setup_process, NULL);
+	process_start(&net_scheduler_process, NULL);
+	
+	/* If the network operation was successfully 
+	 * started, we can update the AR9170 status
+	 * to ADDED. 
+	 */
+	ar9170_set_wlan_device_added();
+	
+	/* Signal an event for the process to continue. */
+	process_post(&ieee80211_iface_setup_process, PROCESS_EVENT_CONTINUE, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void wait_for_device(void)
 {
 	if (ar9170_is_mass_storage_device_plugged()) {
 		/* The MSC device has been plugged-in. Check whether the WLAN USB 
@@ -300,14 +479,11 @@ static void ieee80211_iface_setup_process_poll_handler(void)
 			 * printout here.
 			 */	
 	
-			/* We should now allocate the required resources and run the default 
-			 * network configuration. 
-			 */	
-			if(allocate_mac_resources()) {
-	
-				PRINTF("ERROR: MAC resources allocation returned errors.\n");
-				goto _err_out;		
-			}
+			ieee80211_bringup_stage_end(BRINGUP_USB_ENUM);
+			
+			/* The resources were allocated and the firmware verified while
+			 * the device was enumerating; see prepare_device().
+			 */
 			/* Update the flag indicating that the device is allocated. */
 			ar9170_set_wlan_device_allocated();
 				
@@ -321,29 +497,14 @@ static void ieee80211_iface_setup_process_poll_handler(void)
 				goto _err_out;
 			}
 
-			/* Initialize and add the network interface. */
-			if (add_network_interface(ar)) {
-				printf("ERROR: AR9170 device could not be added!\n");
-				goto _err_out;
+			/* Bring-up blocks on USB command responses; run it on a pool
+			 * thread so that the other processes keep running meanwhile.
+			 */
+			bringup_stage = BRINGUP_FW_UPLOAD;
+			if (!mt_pool_run(bring_up_device, ar, NULL)) {
+				/* No thread free; block the scheduler instead. */
+				bring_up_device(ar);
 			}
-	
-			/* Start network setup operation. */
-			if (!start_network_setup_operation()) {
-				
-				/* Start the processes of IBSS initialization
-				 * and networking schedulers. 
-				 */
-				process_start(&ibss_setup_process, NULL);
-				process_start(&net_scheduler_process, NULL);
-				
-				/* If the network operation was successfully 
-				 * started, we can update the AR9170 status
-				 * to ADDED. 
-				 */
-				ar9170_set_wlan_device_added();
-			}				
-			/* Signal an event for the process to continue. */
-			process_post(&ieee80211_iface_setup_process, PROCESS_EVENT_CONTINUE, NULL);
 			
 			/* Do not poll the process again. */
 			return;
@@ -362,6 +523,49 @@ static void ieee80211_iface_setup_process_poll_handler(void)
 	process_poll(&ieee80211_iface_setup_process);
 }
 /*---------------------------------------------------------------------------*/
+/* Each poll runs one stage, so that other processes are served between
+ * them. The stages ahead of BRINGUP_USB_ENUM do not need the device.
+ */
+static void ieee80211_iface_setup_process_poll_handler(void)
+{
+	switch (bringup_stage) {
+	case BRINGUP_FW_VERIFY:
+		if (prepare_device()) {
+			PRINTF("ERROR: Device preparation failed.\n");
+			process_post(&ieee80211_iface_setup_process, PROCESS_EVENT_EXIT, NULL);
+			return;
+		}
+		bringup_stage = BRINGUP_USB_ENUM;
+		break;
+		
+	case BRINGUP_USB_ENUM:
+		/* Re-polls by itself until the device stages are started. */
+		wait_for_device();
+		return;
+		
+	case BRINGUP_UIP_INIT:
+		/* Posted by the bring-up thread once the interface is added. */
+		start_upper_layers();
+		bringup_stage = BRINGUP_PHY_CONFIG;
+		/* The PHY may be configured already; the two polls merge. */
+		break;
+		
+	case BRINGUP_PHY_CONFIG:
+		/* Polled again by the bring-up thread when it is done. */
+		if (ibss_ready) {
+			ibss_ready = false;
+			bringup_stage = BRINGUP_IBSS_JOIN;
+			start_ibss();
+		}
+		return;
+		
+	default:
+		/* The device stages run on a pool thread. */
+		return;
+	}
+	process_poll(&ieee80211_iface_setup_process);
+}
+/*---------------------------------------------------------------------------*/
 
 
 static void ieee80211_iface_setup_process_exit_handler(void)
@@ -379,6 +583,11 @@ static void ieee80211_iface_setup_process_init() {
 	
 	/* Release the CTRL endpoint lock flag. */
 	ar9170_usb_ctrl_out_init_lock();
+	
+	/* A re-plugged device gets a fresh report. */
+	memset(stage_end, 0, sizeof(stage_end));
+	bringup_reported = false;
+	ibss_ready = false;
 }
 /*---------------------------------------------------------------------------*/
 
@@ -394,9 +603,15 @@ PROCESS_THREAD(ieee80211_iface_setup_process, ev, data)
 	/* Start process */
 	PROCESS_BEGIN();
 	
+	process_set_cpu(&ieee80211_iface_setup_process, ENERGEST_CPU_DRIVER);
+	
 	PRINTF("IEEE80211_IFACE_SETUP_PROCESS: Waiting for device connection...\n");
 	
 	ieee80211_iface_setup_process_init();
+	
+	/* The USB host enumerates the device from here on. */
+	ieee80211_bringup_stage_begin(BRINGUP_USB_ENUM);
+	bringup_stage = BRINGUP_FW_VERIFY;
 				
 	/* Poll the process for the first time. */
 	process_poll(&ieee80211_iface_setup_process);
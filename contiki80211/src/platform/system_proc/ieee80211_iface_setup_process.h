@@ -47,4 +47,28 @@
 /*---------------------------------------------------------------------------*/
 PROCESS_NAME(ieee80211_iface_setup_process);
 /*---------------------------------------------------------------------------*/
+
+/* Stages of the network bring-up. The firmware verification does not need
+ * the device and overlaps the wait for USB enumeration; the device stages
+ * run in sequence on a pool thread. uIP needs the MAC address, so it starts
+ * once the interface is added and overlaps the PHY setup and IBSS join.
+ * Time-to-first-packet is the end of the last stage, counted from power-on.
+ */
+enum ieee80211_bringup_stage {
+	BRINGUP_FW_VERIFY,		/* Allocate driver state, verify and parse firmware */
+	BRINGUP_USB_ENUM,		/* Wait for the WLAN device to enumerate */
+	BRINGUP_FW_UPLOAD,		/* Upload and boot the device firmware */
+	BRINGUP_EEPROM,			/* Read and parse the EEPROM */
+	BRINGUP_DEVICE_START,	/* Start the MAC and add the interface */
+	BRINGUP_UIP_INIT,		/* Start uIP/RPL; the MAC holds their packets */
+	BRINGUP_PHY_CONFIG,		/* Queue parameters, channel and PHY tables */
+	BRINGUP_IBSS_JOIN,		/* Join or create the IBSS, until beaconing */
+	BRINGUP_FIRST_TX,		/* First packet handed to the driver queue */
+	BRINGUP_NUM_STAGES
+};
+
+void ieee80211_bringup_stage_begin(enum ieee80211_bringup_stage stage);
+void ieee80211_bringup_stage_end(enum ieee80211_bringup_stage stage);
+void ieee80211_bringup_report(void);
+/*---------------------------------------------------------------------------*/
 #endif /* IEEE80211_IFACE_SETUP_PROCESS_H_ */
\ No newline at end of file
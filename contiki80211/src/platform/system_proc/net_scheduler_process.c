@@ -46,11 +46,14 @@
 #include "ibss_main.h"
 #include "ibss_setup_process.h"
 #include "compiler.h"
-#include "tcpip.h"
-#include "resolv.h"
+#include "net/mac/ieee80211_driver.h"
 #include "platform-conf.h"
 #include "ieee80211_iface_setup_process.h"
 #include "uart1.h"
+#include "smalloc.h"
+#ifdef WITH_TELEMETRY
+#include "telemetry_process.h"
+#endif
 
 #define DEBUG_PROC	1
 #include "contiki-main.h"
@@ -63,12 +66,22 @@ PROCESS(net_scheduler_process, "Network Scheduler Process");
 /*---------------------------------------------------------------------------*/
 static void net_scheduler_process_poll_handler(void)
 {	
+	unsigned char owner;
+	
 	/* Check first if the device has been plugged. */
 	if (ar9170_is_wlan_device_plugged()) {
 		
+		#ifdef WITH_TELEMETRY
+		rtimer_clock_t sched_start = RTIMER_NOW();
+		#endif
+		
 		/* AR9170 driver scheduler */
 		ar9170_op_scheduler(ar9170_get_device());
 		
+		#ifdef WITH_TELEMETRY
+		telemetry_sched_loop(RTIMER_NOW() - sched_start);
+		#endif
+		
 	} else {
 		/* Maybe the AR9170 has just been disconnected. We can 
 		 * check this by examining whether the device is still
@@ -84,12 +97,11 @@ static void net_scheduler_process_poll_handler(void)
 				*ar9170_get_device_pt() = NULL;
 			}
 		
-			#ifdef WITH_STATISTICS_COLLECTION
-			/* Signal an exit of statistics display, as well. FIXME - move 
-			 * this to the scheduler, so the USB host does not need to care
-			 * about statistics display.
+			#ifdef WITH_TELEMETRY
+			/* Signal an exit of telemetry collection, as well. It is started
+			 * again by the IBSS setup once the device is back.
 			 */
-			process_post(&stats_display_process, PROCESS_EVENT_EXIT, NULL); 
+			process_post(&telemetry_process, PROCESS_EVENT_EXIT, NULL); 
 			#endif
 			process_post(&net_scheduler_process, PROCESS_EVENT_EXIT, NULL);
 			
@@ -130,12 +142,13 @@ static void net_scheduler_process_poll_handler(void)
 			 * regardless of whether we generate packets, as the relaying is handled by
 			 * the same Contiki process.
 			 */
-			#ifndef WITH_SLIP
-			#if WITH_UIP6			
-			process_start(&tcpip_process, NULL);
-			process_start(&resolv_process, NULL);
-			#endif
-			#else /* WITH_SLIP */
+			ieee80211_bringup_stage_end(BRINGUP_IBSS_JOIN);
+			ieee80211_bringup_stage_begin(BRINGUP_FIRST_TX);
+			/* uIP was started during the bring-up; send what it queued
+			 * while the IBSS was not there yet.
+			 */
+			ieee80211_driver_release_held();
+			#ifdef WITH_SLIP
 			/* For SLIP-radio, we now enable the interrupting on the 
 			 * UART receiving line; we have not done this before, as
 			 * the link-layer was still in the initialization phase.
@@ -146,7 +159,9 @@ static void net_scheduler_process_poll_handler(void)
 		}
 		
 		/* IEEE80211 net scheduler */
+		owner = ENERGEST_CPU_ENTER(ENERGEST_CPU_IBSS);
 		ieee80211_op_scheduler(ar9170_get_device());
+		ENERGEST_CPU_LEAVE(owner);
 	
 	} else {
 		/* TODO - Operations performed upon IBSS disconnection. 
@@ -195,6 +210,10 @@ PROCESS_THREAD(net_scheduler_process, ev, data)
 	
 	PRINTF("NET_SCHEDULER_PROCESS\n");
 	
+	/* Driver events are served before application ones. */
+	process_set_priority(&net_scheduler_process, PROCESS_PRIO_HIGH);
+	process_set_cpu(&net_scheduler_process, ENERGEST_CPU_DRIVER);
+	
 	process_poll(&net_scheduler_process);
 	
 	/* Wait until the process needs to terminate (triggered externally). */
@@ -0,0 +1,368 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "contiki.h"
+#include "contiki-net.h"
+#include "telemetry_process.h"
+#include "ar9170.h"
+#include "ieee80211_ibss.h"
+#include "usb_lock.h"
+#include "compiler.h"
+#include <string.h>
+#include "smalloc.h"
+#include "mt-pool.h"
+
+#if TELEMETRY_CONF_EXPORT_SLIP
+#include "dev/slip.h"
+#endif
+#if TELEMETRY_UDP_PORT
+#include "simple-udp.h"
+#endif
+
+#define DEBUG_PROC	1
+#include "contiki-main.h"
+
+PROCESS(telemetry_process, "Telemetry Process");
+
+/* Ring of records not yet exported. */
+static struct telemetry_record ring[TELEMETRY_RING_LEN];
+static uint8_t ring_head;
+static uint8_t ring_count;
+static bool ring_overflow;
+
+static U16 seqno;
+
+/* Counter snapshots taken at the previous collection. */
+static struct {
+	U64 active;
+	U64 cca;
+	U64 tx_time;
+	U64 rx_total;
+	U64 rx_overrun;
+	U32 rx_frames;
+	U32 rx_queue_full;
+	U32 tx[TELEMETRY_NUM_TXQ];
+	U32 retry[TELEMETRY_NUM_TXQ];
+	U32 drop[TELEMETRY_NUM_TXQ];
+} last;
+
+/* Scheduler loop accounting; updated from the net scheduler poll handler. */
+static U16 sched_loops;
+static rtimer_clock_t sched_max;
+
+static U32 heap_peak;
+
+#if ENERGEST_CONF_ON
+/* Energest types reported in the radio fields, in record order. */
+static const U8 radio_types[TELEMETRY_NUM_RADIO] = {
+	ENERGEST_TYPE_WIFI_AWAKE, ENERGEST_TYPE_WIFI_DOZE, ENERGEST_TYPE_TRANSMIT,
+	ENERGEST_TYPE_LISTEN, ENERGEST_TYPE_WIFI_ATIM, ENERGEST_TYPE_WIFI_BEACON
+};
+
+/* Energest snapshots taken at the previous collection [rtimer ticks]. */
+static struct {
+	rtimer_clock_t time;
+	unsigned long radio[TELEMETRY_NUM_RADIO];
+	unsigned long cpu[TELEMETRY_NUM_CPU];
+} last_energest;
+#endif
+
+#if TELEMETRY_UDP_PORT
+static struct simple_udp_connection telemetry_conn;
+static bool telemetry_conn_registered;
+#endif
+
+static struct etimer et_telemetry;
+
+/*---------------------------------------------------------------------------*/
+void
+telemetry_sched_loop(rtimer_clock_t duration)
+{
+	if (sched_loops < 0xFFFF)
+		sched_loops++;
+	if (duration > sched_max)
+		sched_max = duration;
+}
+/*---------------------------------------------------------------------------*/
+bool
+telemetry_read(struct telemetry_record *rec)
+{
+	uint8_t tail;
+	
+	if (ring_count == 0)
+		return false;
+	
+	tail = (ring_head + TELEMETRY_RING_LEN - ring_count) % TELEMETRY_RING_LEN;
+	memcpy(rec, &ring[tail], sizeof(struct telemetry_record));
+	ring_count--;
+	return true;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+telemetry_count(void)
+{
+	return ring_count;
+}
+/*---------------------------------------------------------------------------*/
+static U16
+sat16(U64 v)
+{
+	return (v > 0xFFFF) ? 0xFFFF : (U16)v;
+}
+/*---------------------------------------------------------------------------*/
+/* Difference of a 32-bit driver counter; modular, so a wrap between two
+ * records still gives the number of events in the period.
+ */
+static U16
+delta16(U32 now, U32 before)
+{
+	return sat16((U32)(now - before));
+}
+/*---------------------------------------------------------------------------*/
+/* The firmware tally accumulators only grow, but are zeroed when the
+ * survey is flushed on a channel change; count from zero after that.
+ */
+static U64
+tally_delta(U64 now, U64 before)
+{
+	return (now >= before) ? (now - before) : now;
+}
+/*---------------------------------------------------------------------------*/
+static U16
+permille(U64 part, U64 whole)
+{
+	if (whole == 0)
+		return 0;
+	if (part > whole)
+		part = whole;
+	return (U16)((part * 1000) / whole);
+}
+/*---------------------------------------------------------------------------*/
+/* Radio state and CPU owner shares of the period since the last record. */
+static void
+telemetry_collect_energest(struct telemetry_record *rec)
+{
+#if ENERGEST_CONF_ON
+	rtimer_clock_t now;
+	U64 period;
+	unsigned long t;
+	int i;
+	
+	energest_flush();
+	now = RTIMER_NOW();
+	period = now - last_energest.time;
+	last_energest.time = now;
+	
+	for (i = 0; i < TELEMETRY_NUM_RADIO; i++) {
+		t = energest_type_time(radio_types[i]);
+		rec->radio[i] = permille(t - last_energest.radio[i], period);
+		last_energest.radio[i] = t;
+	}
+	for (i = 0; i < TELEMETRY_NUM_CPU; i++) {
+		t = energest_cpu_time(i);
+		rec->cpu[i] = permille(t - last_energest.cpu[i], period);
+		last_energest.cpu[i] = t;
+	}
+#else
+	rec->flags |= TELEMETRY_FLAG_NO_ENERGEST;
+#endif /* ENERGEST_CONF_ON */
+}
+/*---------------------------------------------------------------------------*/
+static void
+telemetry_collect(struct ar9170* ar)
+{
+	struct telemetry_record *rec;
+	struct smalloc_stats heap;
+	unsigned int stack;
+	int i;
+	
+	rec = &ring[ring_head];
+	memset(rec, 0, sizeof(struct telemetry_record));
+	
+	rec->version = TELEMETRY_RECORD_VERSION;
+	rec->seqno = seqno++;
+	rec->timestamp = clock_time();
+	
+	if (ring_overflow) {
+		rec->flags |= TELEMETRY_FLAG_OVERFLOW;
+		ring_overflow = false;
+	}
+	
+	if (ar == NULL) {
+		rec->flags |= TELEMETRY_FLAG_NO_DEVICE;
+		
+	} else {
+		if (ar->tally_valid) {
+			U64 active = tally_delta(ar->tally.active, last.active);
+			
+			rec->chan_busy = permille(tally_delta(ar->tally.cca, last.cca), active);
+			rec->chan_tx = permille(tally_delta(ar->tally.tx_time, last.tx_time), active);
+			rec->rx_total = sat16(tally_delta(ar->tally.rx_total, last.rx_total));
+			rec->rx_overrun = sat16(tally_delta(ar->tally.rx_overrun, last.rx_overrun));
+			
+			last.active = ar->tally.active;
+			last.cca = ar->tally.cca;
+			last.tx_time = ar->tally.tx_time;
+			last.rx_total = ar->tally.rx_total;
+			last.rx_overrun = ar->tally.rx_overrun;
+		} else {
+			rec->flags |= TELEMETRY_FLAG_NO_TALLY;
+		}
+		rec->noise = (S16)ar->noise[0];
+		
+		rec->rx_frames = delta16(ar->rx_frames, last.rx_frames);
+		rec->rx_queue_full = delta16(ar->rx_queue_full, last.rx_queue_full);
+		last.rx_frames = ar->rx_frames;
+		last.rx_queue_full = ar->rx_queue_full;
+		
+		for (i = 0; i < TELEMETRY_NUM_TXQ; i++) {
+			rec->txq[i].tx = delta16(ar->txq_stats[i].tx, last.tx[i]);
+			rec->txq[i].retry = delta16(ar->txq_stats[i].retry, last.retry[i]);
+			rec->txq[i].drop = delta16(ar->txq_stats[i].drop, last.drop[i]);
+			last.tx[i] = ar->txq_stats[i].tx;
+			last.retry[i] = ar->txq_stats[i].retry;
+			last.drop[i] = ar->txq_stats[i].drop;
+		}
+		
+		/* Ask the driver scheduler for a fresh tally for the next record. */
+		ar->tally_valid = false;
+		ar->tally_request = true;
+	}
+	
+	rec->sched_loops = sched_loops;
+	rec->sched_max_us = (U16)min((U64)0xFFFF, ((U64)sched_max * 1000000) / RTIMER_SECOND);
+	sched_loops = 0;
+	sched_max = 0;
+	
+	smalloc_get_stats(&heap);
+	rec->heap_used = heap.heap_size - heap.heap_free;
+	rec->heap_free = heap.heap_free;
+	rec->heap_largest = heap.largest_free;
+	if (rec->heap_used > heap_peak)
+		heap_peak = rec->heap_used;
+	rec->heap_peak = heap_peak;
+	
+	for (i = 0; i < MT_POOL_THREADS; i++) {
+		stack = mt_pool_stack_peak(i);
+		if (stack > rec->mt_stack_peak)
+			rec->mt_stack_peak = (U16)stack;
+	}
+	
+	telemetry_collect_energest(rec);
+	
+	ring_head = (ring_head + 1) % TELEMETRY_RING_LEN;
+	if (ring_count < TELEMETRY_RING_LEN) {
+		ring_count++;
+	} else {
+		/* The oldest record was overwritten. */
+		ring_overflow = true;
+	}
+}
+/*---------------------------------------------------------------------------*/
+static void
+telemetry_export(void)
+{
+#if TELEMETRY_CONF_EXPORT_SLIP || TELEMETRY_UDP_PORT
+	struct telemetry_record rec;
+	
+#if TELEMETRY_UDP_PORT
+	uip_ipaddr_t addr;
+	
+	/* Hold records in the ring until the IBSS is up and uIP runs. */
+	if (!ieee80211_is_ibss_joined() || !process_is_running(&tcpip_process))
+		return;
+	
+	if (!telemetry_conn_registered) {
+		simple_udp_register(&telemetry_conn, TELEMETRY_UDP_PORT, NULL,
+			TELEMETRY_UDP_PORT, NULL);
+		telemetry_conn_registered = true;
+	}
+	uip_create_linklocal_allnodes_mcast(&addr);
+#endif
+	
+	while (telemetry_read(&rec)) {
+#if TELEMETRY_CONF_EXPORT_SLIP
+		slip_write(&rec, sizeof(rec));
+#endif
+#if TELEMETRY_UDP_PORT
+		simple_udp_sendto(&telemetry_conn, &rec, sizeof(rec), &addr);
+#endif
+	}
+#endif /* TELEMETRY_CONF_EXPORT_SLIP || TELEMETRY_UDP_PORT */
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(telemetry_process, ev, data)
+{
+	PROCESS_BEGIN();
+	
+	PRINTF("TELEMETRY_PROCESS\n");
+	
+	/* Wait until the network setup signals that the device is up. */
+	PROCESS_WAIT_EVENT_UNTIL((ev == PROCESS_EVENT_CONTINUE) || (ev == PROCESS_EVENT_EXIT));
+	
+	if (ev == PROCESS_EVENT_EXIT)
+		PROCESS_EXIT();
+	
+	memset(&last, 0, sizeof(last));
+	#if ENERGEST_CONF_ON
+	/* The first record covers the time since this snapshot. */
+	telemetry_collect_energest(&ring[ring_head]);
+	#endif
+	if (ar9170_get_device() != NULL)
+		ar9170_get_device()->tally_request = true;
+	
+	etimer_set(&et_telemetry, TELEMETRY_PERIOD);
+	
+	while(1) {
+		PROCESS_WAIT_EVENT_UNTIL((ev == PROCESS_EVENT_TIMER) || (ev == PROCESS_EVENT_EXIT));
+		
+		if (ev == PROCESS_EVENT_EXIT)
+			break;
+		
+		etimer_reset(&et_telemetry);
+		
+		telemetry_collect(ar9170_is_wlan_device_plugged() ? ar9170_get_device() : NULL);
+		telemetry_export();
+	}
+	
+	PRINTF("TELEMETRY_PROCESS ended.\n");
+	PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
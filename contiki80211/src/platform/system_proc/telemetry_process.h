@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2013, Calipso project consortium
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Calipso nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific
+ * prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "contiki.h"
+#include "compiler.h"
+#include "rtimer.h"
+#include "ar9170_wlan.h"
+
+#ifndef TELEMETRY_PROCESS_H_
+#define TELEMETRY_PROCESS_H_
+
+/* Record collection period. */
+#ifdef TELEMETRY_CONF_PERIOD
+#define TELEMETRY_PERIOD			TELEMETRY_CONF_PERIOD
+#else
+#define TELEMETRY_PERIOD			CLOCK_SECOND
+#endif
+
+/* Number of records kept in RAM until they are exported. */
+#ifdef TELEMETRY_CONF_RING_LEN
+#define TELEMETRY_RING_LEN			TELEMETRY_CONF_RING_LEN
+#else
+#define TELEMETRY_RING_LEN			16
+#endif
+
+/* Export each record as a binary SLIP frame on the serial line. */
+#ifndef TELEMETRY_CONF_EXPORT_SLIP
+#define TELEMETRY_CONF_EXPORT_SLIP	0
+#endif
+
+/* Export each record as a UDP datagram; 0 disables UDP export. */
+#ifdef TELEMETRY_CONF_UDP_PORT
+#define TELEMETRY_UDP_PORT			TELEMETRY_CONF_UDP_PORT
+#else
+#define TELEMETRY_UDP_PORT			0
+#endif
+
+#define TELEMETRY_RECORD_VERSION	4
+#define TELEMETRY_NUM_TXQ			__AR9170_NUM_TXQ
+/* Radio states: awake, doze, TX, listen, ATIM window, beacon. */
+#define TELEMETRY_NUM_RADIO			6
+/* CPU owners, in the order of enum energest_cpu. */
+#define TELEMETRY_NUM_CPU			ENERGEST_CPU_MAX
+
+/* 
+ * Fixed-size telemetry record, little-endian on the wire. Counters are
+ * deltas over one collection period; channel figures are in per-mille
+ * of the time the radio was active during the period.
+ */
+struct telemetry_txq {
+	U16 tx;
+	U16 retry;
+	U16 drop;
+} __attribute__((packed));
+
+struct telemetry_record {
+	U8 version;
+	U8 flags;
+	U16 seqno;
+	U32 timestamp;				/* clock_time() at collection */
+	U16 chan_busy;				/* CCA busy, per-mille */
+	U16 chan_tx;				/* Own TX time, per-mille */
+	S16 noise;					/* Noise floor, chain 0 [dBm] */
+	U16 rx_total;				/* Frames seen by the firmware */
+	U16 rx_overrun;				/* Firmware RX overruns */
+	U16 rx_frames;				/* Frames handed to the driver */
+	U16 rx_queue_full;			/* Frames dropped on a full RX queue */
+	struct telemetry_txq txq[TELEMETRY_NUM_TXQ];
+	U16 sched_loops;			/* Driver scheduler iterations */
+	U16 sched_max_us;			/* Longest scheduler iteration */
+	U32 heap_used;				/* Bytes currently allocated */
+	U32 heap_peak;				/* High-water mark since boot */
+	U32 heap_free;				/* Free bytes inside the heap */
+	U32 heap_largest;			/* Largest block allocatable inside the heap,
+								 * the top chunk only without SMALLOC_PROFILE */
+	U16 mt_stack_peak;			/* Deepest MT pool thread stack since boot [bytes] */
+	U16 radio[TELEMETRY_NUM_RADIO];	/* Radio state time, per-mille */
+	U16 cpu[TELEMETRY_NUM_CPU];	/* CPU time per owner, per-mille */
+} __attribute__((packed));
+
+/* Record flags */
+#define TELEMETRY_FLAG_NO_DEVICE	0x01	/* AR9170 not plugged */
+#define TELEMETRY_FLAG_NO_TALLY		0x02	/* Tally not collected in time */
+#define TELEMETRY_FLAG_OVERFLOW		0x04	/* Older records were overwritten */
+#define TELEMETRY_FLAG_NO_ENERGEST	0x08	/* Energest compiled out */
+
+/*---------------------------------------------------------------------------*/
+PROCESS_NAME(telemetry_process);
+
+/* Account one iteration of the driver scheduler, in rtimer ticks. */
+void telemetry_sched_loop(rtimer_clock_t duration);
+
+/* Pop the oldest record from the ring; returns false if empty. */
+bool telemetry_read(struct telemetry_record *rec);
+
+/* Number of records currently held in the ring. */
+uint8_t telemetry_count(void);
+/*---------------------------------------------------------------------------*/
+#endif /* TELEMETRY_PROCESS_H_ */
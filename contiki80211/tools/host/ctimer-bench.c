@@ -0,0 +1,321 @@
+/*
+ * Host property test and benchmark of the ctimer timing wheel.
+ *
+ * The test drives core/sys/ctimer.c with random set, stop, reset and
+ * restart calls against a model of each timer's expiration time. The
+ * callbacks change other timers, possibly ones in the same batch. The
+ * clock crosses its wrap, and idle gaps of more than half its range are
+ * inserted. Never-set timers hold garbage. Checked after each step:
+ *  - a callback never runs early, nor for a timer that is not set;
+ *  - a due timer has run, unless it was set during the current tick;
+ *  - the wheel etimer is armed no later than the next expiration;
+ *  - ctimer_expired() agrees with the model.
+ *
+ * The benchmark times ctimer_set() and ctimer_stop() with thousands of
+ * timers pending, and the cost per callback of running the wheel.
+ */
+#include "contiki.h"
+#include "sys/ctimer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Stubs of the clock, the wheel etimer and the process module. */
+static clock_time_t now;
+struct process *process_current;
+static struct etimer *armed_et;
+static clock_time_t armed_start, armed_interval;
+static int armed;
+
+clock_time_t
+clock_time(void)
+{
+  return now;
+}
+
+void
+etimer_set(struct etimer *et, clock_time_t interval)
+{
+  armed_et = et;
+  armed_start = now;
+  armed_interval = interval;
+  armed = 1;
+}
+
+void
+process_start(struct process *p, const char *arg)
+{
+  process_current = p;
+  p->thread(&p->pt, PROCESS_EVENT_INIT, (void *)arg);
+}
+
+void
+process_set_priority(struct process *p, unsigned char priority)
+{
+}
+
+void
+process_set_cpu(struct process *p, unsigned char cpu)
+{
+}
+
+extern struct process ctimer_process;
+
+static uint32_t rnd_state = 2463534242u;
+
+static uint32_t
+rnd(void)
+{
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 17;
+  rnd_state ^= rnd_state << 5;
+  return rnd_state;
+}
+
+/* Runs the wheel while its etimer is due. A timer set for the current
+   tick from a callback is served on a later run. */
+static void
+run_wheel(void)
+{
+  int k;
+
+  for(k = 0; k < 4 && armed &&
+        (clock_time_t)(now - armed_start) >= armed_interval; k++) {
+    armed = 0;
+    process_current = &ctimer_process;
+    ctimer_process.thread(&ctimer_process.pt, PROCESS_EVENT_TIMER, armed_et);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#define N      64
+#define STEPS  3000000L
+
+static struct ctimer ct[N];
+
+static struct {
+  clock_time_t expiration;
+  clock_time_t changed;
+  char pending;
+  char initialized;
+} model[N];
+
+static long fired, checks;
+static int failed;
+
+static void
+fail(const char *what, int i)
+{
+  if(!failed) {
+    printf("timer %d %s, now %lu\n", i, what, (unsigned long)now);
+  }
+  failed = 1;
+}
+
+static void change(int i, int kind);
+
+static void
+callback(void *ptr)
+{
+  int i = (int)(long)ptr;
+
+  if(!model[i].pending) {
+    fail("fired while not set", i);
+  }
+  if((int32_t)(now - model[i].expiration) < 0) {
+    fail("fired early", i);
+  }
+  model[i].pending = 0;
+  fired++;
+
+  if(rnd() % 3 == 0) {
+    change(rnd() % N, rnd() % 5);
+  }
+}
+
+static void
+change(int i, int kind)
+{
+  clock_time_t interval;
+
+  model[i].changed = now;
+  switch(kind) {
+  case 0: case 1:
+    interval = (rnd() % 4 == 0) ? rnd() % 20000 : rnd() % 300;
+    ctimer_set(&ct[i], interval, callback, (void *)(long)i);
+    model[i].expiration = now + interval;
+    model[i].pending = 1;
+    model[i].initialized = 1;
+    break;
+  case 2:
+    ctimer_stop(&ct[i]);
+    model[i].pending = 0;
+    break;
+  case 3:
+    /* Reset is only meaningful once the timer has fired. */
+    if(model[i].initialized && !model[i].pending &&
+       (int32_t)(now - model[i].expiration) >= 0) {
+      ctimer_reset(&ct[i]);
+      model[i].expiration += ct[i].etimer.timer.interval;
+      model[i].pending = 1;
+    }
+    break;
+  case 4:
+    if(model[i].initialized) {
+      ctimer_restart(&ct[i]);
+      model[i].expiration = now + ct[i].etimer.timer.interval;
+      model[i].pending = 1;
+    }
+    break;
+  }
+}
+
+static void
+check(void)
+{
+  clock_time_t next = 0, due;
+  int i, any = 0;
+
+  for(i = 0; i < N; i++) {
+    if(!model[i].pending) {
+      continue;
+    }
+    if(model[i].changed != now && (int32_t)(now - model[i].expiration) >= 0) {
+      fail("due but not fired", i);
+    }
+    if(!any || (int32_t)(model[i].expiration - next) < 0) {
+      next = model[i].expiration;
+    }
+    any = 1;
+  }
+  if(any) {
+    due = (int32_t)(next - now) <= 0 ? now + 1 : next;
+    if(!armed || (int32_t)(armed_start + armed_interval - due) > 0) {
+      fail("not served in time by the wheel etimer", -1);
+    }
+  }
+}
+
+static int
+property_test(void)
+{
+  long step;
+  int i;
+
+  for(i = 0; i < N; i++) {
+    memset(&ct[i], 0xa5 ^ i, sizeof(ct[i]));
+  }
+  now = (clock_time_t)-65536;
+  ctimer_init();
+
+  for(step = 0; step < STEPS && !failed; step++) {
+    int r = rnd() % 100;
+
+    if(r < 40) {
+      change(rnd() % N, rnd() % 5);
+    } else if(r < 42) {
+      i = rnd() % N;
+      if(model[i].initialized && ctimer_expired(&ct[i]) == model[i].pending) {
+        fail("ctimer_expired() is wrong", i);
+      }
+      checks++;
+    } else if(r == 42) {
+      /* Stop everything and stay idle for more than half the clock range. */
+      for(i = 0; i < N; i++) {
+        if(model[i].initialized) {
+          ctimer_stop(&ct[i]);
+          model[i].pending = 0;
+        }
+      }
+      run_wheel();
+      now += 0x90000000u + rnd() % 0x1000000;
+      run_wheel();
+    } else {
+      now += rnd() % 40;
+      run_wheel();
+    }
+    check();
+  }
+  if(failed) {
+    return 0;
+  }
+  for(i = 0; i < N; i++) {
+    if(model[i].initialized) {
+      ctimer_stop(&ct[i]);
+    }
+  }
+  printf("property test: %ld steps, %ld callbacks, %ld ctimer_expired() checks\n",
+         STEPS, fired, checks);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static double
+seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+count_callback(void *ptr)
+{
+  (*(long *)ptr)++;
+}
+
+static void
+benchmark(unsigned int n)
+{
+  struct ctimer *timers = calloc(n, sizeof(struct ctimer));
+  const long ops = 2000000;
+  long k, calls = 0;
+  double t0, t_set, t_stop, t_run;
+
+  for(k = 0; k < n; k++) {
+    ctimer_set(&timers[k], 1 + rnd() % 20000, count_callback, &calls);
+  }
+
+  t0 = seconds();
+  for(k = 0; k < ops; k++) {
+    ctimer_set(&timers[rnd() % n], 1 + rnd() % 20000, count_callback, &calls);
+  }
+  t_set = seconds() - t0;
+
+  t0 = seconds();
+  for(k = 0; k < ops; k++) {
+    ctimer_stop(&timers[rnd() % n]);
+  }
+  t_stop = seconds() - t0;
+
+  /* Let every timer fire once, a tick at a time. */
+  for(k = 0; k < n; k++) {
+    ctimer_set(&timers[k], 1 + rnd() % 20000, count_callback, &calls);
+  }
+  t0 = seconds();
+  for(k = 0; k <= 20000; k++) {
+    now++;
+    run_wheel();
+  }
+  t_run = seconds() - t0;
+
+  printf("%6u timers: set %5.1f ns, stop %5.1f ns, %5.1f ns per callback\n",
+         n, t_set / ops * 1e9, t_stop / ops * 1e9, t_run / calls * 1e9);
+  free(timers);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  unsigned int n;
+
+  if(!property_test()) {
+    printf("FAIL\n");
+    return 1;
+  }
+  for(n = 1024; n <= 16384; n *= 4) {
+    benchmark(n);
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * Host property test and benchmark of the etimer heap.
+ *
+ * The test drives core/sys/etimer.c with random set, stop, reset,
+ * restart and adjust calls across the clock wrap, against a model that
+ * keeps the start and interval of each timer. After each poll the timers
+ * delivered must be exactly the expired ones of the model, earliest
+ * first. Some timers are never set and hold garbage, as stack timers do.
+ *
+ * The benchmark times etimer_stop() of pending timers in random order,
+ * and etimer_set() of stopped ones, with up to 16384 timers pending;
+ * both should grow as log n.
+ */
+#include "sys/etimer.h"
+#include "sys/process.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Stubs of the clock and the process module. */
+static clock_time_t now;
+struct process *process_current;
+static struct etimer *posted[4096];
+static int nposted;
+
+clock_time_t
+clock_time(void)
+{
+  return now;
+}
+
+int
+process_post(struct process *p, process_event_t ev, void *data)
+{
+  posted[nposted++] = data;
+  return PROCESS_ERR_OK;
+}
+
+void
+process_poll(struct process *p)
+{
+}
+
+static uint32_t rnd_state = 2463534242u;
+
+static uint32_t
+rnd(void)
+{
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 17;
+  rnd_state ^= rnd_state << 5;
+  return rnd_state;
+}
+
+static void
+run_etimer_process(process_event_t ev, void *data)
+{
+  process_current = &etimer_process;
+  nposted = 0;
+  etimer_process.thread(&etimer_process.pt, ev, data);
+}
+
+/*---------------------------------------------------------------------------*/
+#define N      48
+#define NPROC  3
+#define STEPS  2000000L
+
+static struct etimer et[N];
+static struct process procs[NPROC];
+
+static struct {
+  clock_time_t start, interval;
+  struct process *p;
+  char pending;
+  char expired;
+  char fired;
+  char initialized;
+  char touched;
+} model[N];
+
+static int
+check(long step)
+{
+  int i, k, expect = 0;
+  char seen[N];
+
+  for(k = 1; k < nposted; k++) {
+    if((int32_t)(etimer_expiration_time(posted[k]) -
+                 etimer_expiration_time(posted[k - 1])) < 0) {
+      printf("step %ld: delivered out of order\n", step);
+      return 0;
+    }
+  }
+  memset(seen, 0, sizeof(seen));
+  for(k = 0; k < nposted; k++) {
+    i = posted[k] - et;
+    if(i < 0 || i >= N || seen[i] || !model[i].pending ||
+       (clock_time_t)(now - model[i].start) < model[i].interval) {
+      printf("step %ld: timer %d delivered early or twice\n", step, i);
+      return 0;
+    }
+    seen[i] = 1;
+    model[i].pending = 0;
+    model[i].expired = 1;
+    model[i].fired = 1;
+  }
+  for(i = 0; i < N; i++) {
+    if(model[i].pending &&
+       (clock_time_t)(now - model[i].start) >= model[i].interval) {
+      expect++;
+    }
+  }
+  if(expect != 0) {
+    printf("step %ld: %d expired timers not delivered\n", step, expect);
+    return 0;
+  }
+  for(i = 0; i < N; i++) {
+    if(model[i].touched && etimer_expired(&et[i]) != model[i].expired) {
+      printf("step %ld: timer %d etimer_expired() is wrong\n", step, i);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int
+property_test(void)
+{
+  long step, delivered = 0;
+  int i, j, d;
+  clock_time_t iv;
+
+  /* Timers never set hold garbage, except for a null process. */
+  for(i = 0; i < N; i++) {
+    memset(&et[i], 0xa5, sizeof(et[i]));
+    et[i].heap_index = rnd() % (N + 2);
+  }
+  run_etimer_process(PROCESS_EVENT_INIT, NULL);
+  now = (clock_time_t)-4096;
+
+  for(step = 0; step < STEPS; step++) {
+    i = rnd() % N;
+    iv = rnd() % 200;
+    process_current = &procs[i % NPROC];
+
+    switch(rnd() % 12) {
+    case 0: case 1: case 2:
+      etimer_set(&et[i], iv);
+      model[i].start = now;
+      model[i].interval = iv;
+      model[i].p = process_current;
+      model[i].pending = 1;
+      model[i].expired = 0;
+      model[i].fired = 0;
+      model[i].initialized = 1;
+      model[i].touched = 1;
+      break;
+    case 3:
+      etimer_stop(&et[i]);
+      model[i].pending = 0;
+      model[i].expired = 1;
+      model[i].fired = 0;
+      model[i].touched = 1;
+      break;
+    case 4:
+      if(model[i].fired) {
+        /* Reset is only meaningful once the timer has fired. */
+        etimer_reset(&et[i]);
+        model[i].start += model[i].interval;
+        model[i].p = process_current;
+        model[i].pending = 1;
+        model[i].expired = 0;
+        model[i].fired = 0;
+      }
+      break;
+    case 5:
+      if(model[i].initialized) {
+        etimer_restart(&et[i]);
+        model[i].start = now;
+        model[i].p = process_current;
+        model[i].pending = 1;
+        model[i].expired = 0;
+        model[i].fired = 0;
+      }
+      break;
+    case 6:
+      if(model[i].initialized) {
+        d = -(int)(rnd() % 25);
+        etimer_adjust(&et[i], d);
+        model[i].start += d;
+      }
+      break;
+    case 7:
+      if(rnd() % 64 == 0) {
+        /* A process exits; its timers are dropped without expiring. */
+        run_etimer_process(PROCESS_EVENT_EXITED, &procs[i % NPROC]);
+        for(j = 0; j < N; j++) {
+          if(model[j].pending && model[j].p == &procs[i % NPROC]) {
+            model[j].pending = 0;
+          }
+        }
+      }
+      break;
+    default:
+      now += rnd() % 30;
+      run_etimer_process(PROCESS_EVENT_POLL, NULL);
+      if(!check(step)) {
+        return 0;
+      }
+      delivered += nposted;
+      break;
+    }
+  }
+  printf("property test: %ld steps, %ld timers delivered\n", STEPS, delivered);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static double
+seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+benchmark(unsigned int n)
+{
+  struct etimer *timers = calloc(n, sizeof(struct etimer));
+  unsigned int *order = malloc(n * sizeof(unsigned int));
+  const long ops = 2000000;
+  double t0, stop_time = 0, set_time = 0;
+  unsigned int k, j, tmp;
+  long done;
+
+  now = 0;
+  process_current = &procs[0];
+  for(k = 0; k < n; k++) {
+    order[k] = k;
+    etimer_set(&timers[k], 1000 + rnd() % 100000);
+  }
+
+  /* Each pass stops every pending timer once, in random order, and
+     sets them all again. */
+  for(done = 0; done < ops; done += n) {
+    for(k = n - 1; k > 0; k--) {
+      j = rnd() % (k + 1);
+      tmp = order[k];
+      order[k] = order[j];
+      order[j] = tmp;
+    }
+    t0 = seconds();
+    for(k = 0; k < n; k++) {
+      etimer_stop(&timers[order[k]]);
+    }
+    stop_time += seconds() - t0;
+    t0 = seconds();
+    for(k = 0; k < n; k++) {
+      etimer_set(&timers[order[k]], 1000 + rnd() % 100000);
+    }
+    set_time += seconds() - t0;
+  }
+  printf("%6u timers: stop %6.1f ns, set %6.1f ns\n", n,
+         stop_time / done * 1e9, set_time / done * 1e9);
+
+  run_etimer_process(PROCESS_EVENT_EXITED, &procs[0]);
+  free(order);
+  free(timers);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  unsigned int n;
+
+  if(!property_test()) {
+    printf("FAIL\n");
+    return 1;
+  }
+  for(n = 256; n <= 16384; n *= 4) {
+    benchmark(n);
+  }
+  printf("PASS\n");
+  return 0;
+}
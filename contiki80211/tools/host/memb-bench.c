@@ -0,0 +1,192 @@
+/*
+ * Host property test and microbenchmark of the memb block allocator.
+ *
+ * The test runs random allocations and frees on pools of 1, 31, 32, 33
+ * and 100 blocks, around the 32-bit words of the bitmap, against a model
+ * of the blocks in use. Checked after each step:
+ *  - an allocation returns the lowest free block, or NULL when full;
+ *  - no block is handed out twice;
+ *  - double, misaligned and out-of-range frees leave the pool intact;
+ *  - with MEMB_CONF_STATS, the in-use, peak and failure counters.
+ *
+ * The benchmark times memb_alloc() plus memb_free() when filling and
+ * draining a pool, and under random churn at half occupancy.
+ */
+#include "lib/memb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint32_t rnd_state = 2463534242u;
+
+static uint32_t
+rnd(void)
+{
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 17;
+  rnd_state ^= rnd_state << 5;
+  return rnd_state;
+}
+
+struct block33 {
+  char c[33];
+};
+
+MEMB(pool1, int, 1);
+MEMB(pool31, short, 31);
+MEMB(pool32, long, 32);
+MEMB(pool33, struct block33, 33);
+MEMB(pool100, int, 100);
+MEMB(pool256, int, 256);
+
+#define STEPS 1000000L
+/*---------------------------------------------------------------------------*/
+static int
+property_test(struct memb *m, const char *name)
+{
+  void **held = calloc(m->num, sizeof(void *));
+  char *used = calloc(m->num, 1);
+  int n = 0, peak = 0, fails = 0, i, j, h;
+  long step;
+  void *p;
+
+  memb_init(m);
+  for(step = 0; step < STEPS; step++) {
+    if(rnd() % 2 == 0) {
+      p = memb_alloc(m);
+      if(n == m->num) {
+        if(p != NULL) {
+          printf("%s: allocation from a full pool\n", name);
+          return 0;
+        }
+        fails++;
+        continue;
+      }
+      if(p == NULL || !memb_inmemb(m, p)) {
+        printf("%s: allocation failed with %d of %d blocks in use\n",
+               name, n, m->num);
+        return 0;
+      }
+      i = ((char *)p - (char *)m->mem) / m->size;
+      if(used[i]) {
+        printf("%s: block %d handed out twice\n", name, i);
+        return 0;
+      }
+      for(j = 0; j < i; j++) {
+        if(!used[j]) {
+          printf("%s: block %d handed out, %d is free\n", name, i, j);
+          return 0;
+        }
+      }
+      used[i] = 1;
+      held[n++] = p;
+      if(n > peak) {
+        peak = n;
+      }
+    } else if(n > 0) {
+      h = rnd() % n;
+      p = held[h];
+      i = ((char *)p - (char *)m->mem) / m->size;
+      if(memb_free(m, p) != 0) {
+        printf("%s: free of block %d failed\n", name, i);
+        return 0;
+      }
+      /* Neither a double nor a misaligned free may change the pool. */
+      memb_free(m, p);
+      if(m->size > 1 && memb_free(m, (char *)p + 1) != -1) {
+        printf("%s: misaligned free accepted\n", name);
+        return 0;
+      }
+      used[i] = 0;
+      held[h] = held[--n];
+    }
+#if MEMB_STATS
+    /* The failure counter is 16 bits wide and wraps. */
+    if(m->inuse != n || m->peak != peak ||
+       m->fails != (unsigned short)fails) {
+      printf("%s: counters %u/%u/%u, expected %d/%d/%d\n", name,
+             m->inuse, m->peak, m->fails, n, peak, fails);
+      return 0;
+    }
+#endif /* MEMB_STATS */
+  }
+  if(memb_free(m, (char *)m->mem + m->size * m->num) != -1) {
+    printf("%s: out-of-range free accepted\n", name);
+    return 0;
+  }
+  printf("%-8s %ld steps, peak %d of %d, %d failed\n", name, STEPS,
+         peak, m->num, fails);
+  free(held);
+  free(used);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static double
+seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+benchmark(struct memb *m, const char *name)
+{
+  void **held = calloc(m->num, sizeof(void *));
+  const long ops = 20000000;
+  double t0, fill, churn;
+  long k;
+  int i, n;
+
+  memb_init(m);
+  t0 = seconds();
+  for(k = 0; k < ops; k += m->num) {
+    for(i = 0; i < m->num; i++) {
+      held[i] = memb_alloc(m);
+    }
+    for(i = 0; i < m->num; i++) {
+      memb_free(m, held[i]);
+    }
+  }
+  fill = (seconds() - t0) / k;
+
+  /* Half full; free a random block and allocate one, in turns. */
+  memb_init(m);
+  for(n = 0; n < m->num / 2; n++) {
+    held[n] = memb_alloc(m);
+  }
+  t0 = seconds();
+  for(k = 0; k < ops; k++) {
+    i = rnd() % n;
+    memb_free(m, held[i]);
+    held[i] = memb_alloc(m);
+  }
+  churn = (seconds() - t0) / ops;
+
+  printf("%-8s fill and drain %5.1f ns, churn %5.1f ns per alloc+free\n",
+         name, fill * 1e9, churn * 1e9);
+  free(held);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  if(!property_test(&pool1, "pool1") ||
+     !property_test(&pool31, "pool31") ||
+     !property_test(&pool32, "pool32") ||
+     !property_test(&pool33, "pool33") ||
+     !property_test(&pool100, "pool100")) {
+    printf("FAIL\n");
+    return 1;
+  }
+#if MEMB_STATS
+  memb_print_stats();
+#endif /* MEMB_STATS */
+  benchmark(&pool32, "pool32");
+  benchmark(&pool100, "pool100");
+  benchmark(&pool256, "pool256");
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Host property test and benchmark of the managed memory allocator.
+ *
+ * The test drives core/lib/mmem.c with random allocations and frees of
+ * 1 to 200 bytes, and runs slices of the compaction process at random
+ * points. Checked after each step:
+ *  - every live block still holds the bytes written into it;
+ *  - mmem_free() moves no live block;
+ *  - mmem_alloc() succeeds whenever the free space is large enough,
+ *    even when it is split across holes;
+ *  - mmem_get_stats() agrees with the blocks the test holds.
+ *
+ * The benchmark times mmem_alloc() plus mmem_free() under random churn,
+ * and reports the most bytes that a single mmem_alloc() had to move.
+ */
+#include "contiki.h"
+#include "lib/mmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern unsigned int avail_memory;
+extern struct process mmem_compact_process;
+
+/* Stubs of the process module; posted events are only counted. */
+struct process *process_current;
+static int running, pending;
+
+void
+process_start(struct process *p, const char *arg)
+{
+  running = 1;
+  PT_INIT(&p->pt);
+  process_current = p;
+  p->thread(&p->pt, PROCESS_EVENT_INIT, (void *)arg);
+}
+
+int
+process_is_running(struct process *p)
+{
+  return running;
+}
+
+int
+process_post(struct process *p, process_event_t ev, void *data)
+{
+  pending++;
+  return PROCESS_ERR_OK;
+}
+
+/* Delivers one queued event to the compaction process. */
+static int
+run_compaction(void)
+{
+  if(pending == 0) {
+    return 0;
+  }
+  pending--;
+  process_current = &mmem_compact_process;
+  mmem_compact_process.thread(&mmem_compact_process.pt,
+                              PROCESS_EVENT_CONTINUE, NULL);
+  return 1;
+}
+
+static uint32_t rnd_state = 2463534242u;
+
+static uint32_t
+rnd(void)
+{
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 17;
+  rnd_state ^= rnd_state << 5;
+  return rnd_state;
+}
+
+/* The arena footprint of a request, as mmem.c rounds it. */
+static unsigned int
+footprint(unsigned int size)
+{
+  const unsigned int hdr = sizeof(struct { void *o; unsigned int s; });
+  unsigned int need = (size + hdr + 7) & ~7u;
+
+  return need < hdr + 2 * sizeof(void *) ? hdr + 2 * sizeof(void *) : need;
+}
+/*---------------------------------------------------------------------------*/
+#define N      64
+#define STEPS  2000000L
+
+static struct mmem m[N];
+static char live[N];
+static unsigned char tag[N];
+static unsigned int held[N];
+static unsigned int arena_size;
+
+static int
+verify(long step)
+{
+  struct mmem_stats stats;
+  unsigned int used = 0, live_blocks = 0, i, j;
+  unsigned char *p;
+
+  for(i = 0; i < N; i++) {
+    if(!live[i]) {
+      continue;
+    }
+    p = m[i].ptr;
+    for(j = 0; j < m[i].size; j++) {
+      if(p[j] != tag[i]) {
+        printf("step %ld: block %u corrupted\n", step, i);
+        return 0;
+      }
+    }
+    used += held[i];
+    live_blocks++;
+  }
+  /* A block may take in a remainder too small to be a hole. */
+  mmem_get_stats(&stats);
+  if(stats.used < used || stats.used > used + live_blocks * footprint(1) ||
+     stats.used + stats.free != arena_size || stats.largest > stats.free) {
+    printf("step %ld: stats %u used, %u free, largest %u; expected %u used\n",
+           step, stats.used, stats.free, stats.largest, used);
+    return 0;
+  }
+  return 1;
+}
+
+static int
+property_test(void)
+{
+  void *before[N];
+  long step, compacted = 0, full = 0;
+  unsigned int size;
+  int i, j;
+
+  mmem_init();
+  arena_size = avail_memory;
+  for(step = 0; step < STEPS; step++) {
+    i = rnd() % N;
+    if(rnd() % 8 == 0) {
+      while(run_compaction());
+    } else if(rnd() % 3 == 0) {
+      run_compaction();
+    }
+
+    for(j = 0; j < N; j++) {
+      before[j] = m[j].ptr;
+    }
+    if(live[i]) {
+      mmem_free(&m[i]);
+      live[i] = 0;
+      for(j = 0; j < N; j++) {
+        if(live[j] && m[j].ptr != before[j]) {
+          printf("step %ld: block %d moved by mmem_free()\n", step, j);
+          return 0;
+        }
+      }
+    } else {
+      size = 1 + rnd() % 200;
+      if(!mmem_alloc(&m[i], size)) {
+        if(avail_memory >= footprint(size)) {
+          printf("step %ld: %u bytes refused with %u free\n", step,
+                 footprint(size), avail_memory);
+          return 0;
+        }
+        full++;
+        continue;
+      }
+      for(j = 0; j < N; j++) {
+        if(live[j] && m[j].ptr != before[j]) {
+          compacted++;
+          break;
+        }
+      }
+      live[i] = 1;
+      held[i] = footprint(size);
+      tag[i] = rnd();
+      memset(m[i].ptr, tag[i], size);
+    }
+    if(!verify(step)) {
+      return 0;
+    }
+  }
+  printf("property test: %ld steps, %ld allocations compacted, %ld refused when full\n",
+         STEPS, compacted, full);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static double
+seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Random churn over N handles; returns the most bytes moved by one
+   mmem_alloc() if track is set, which slows the loop down. */
+static unsigned long
+churn(long ops, unsigned int max_size, int track, long *refused)
+{
+  struct mmem_stats stats;
+  unsigned long moved = 0, worst = 0;
+  long k;
+  int i, ok;
+
+  mmem_init();
+  memset(live, 0, sizeof(live));
+  pending = 0;
+  *refused = 0;
+  for(k = 0; k < ops; k++) {
+    i = rnd() % N;
+    if(k % 16 == 0) {
+      run_compaction();
+    }
+    if(live[i]) {
+      mmem_free(&m[i]);
+      live[i] = 0;
+      continue;
+    }
+    if(track) {
+      mmem_get_stats(&stats);
+      moved = stats.moved;
+    }
+    ok = mmem_alloc(&m[i], 1 + rnd() % max_size);
+    live[i] = ok;
+    *refused += !ok;
+    if(track) {
+      mmem_get_stats(&stats);
+      if(stats.moved - moved > worst) {
+        worst = stats.moved - moved;
+      }
+    }
+  }
+  return worst;
+}
+
+static void
+benchmark(unsigned int max_size)
+{
+  const long ops = 5000000;
+  unsigned long worst;
+  long refused;
+  double t0, t;
+
+  t0 = seconds();
+  churn(ops, max_size, 0, &refused);
+  t = seconds() - t0;
+  worst = churn(ops / 10, max_size, 1, &refused);
+  printf("blocks of 1-%3u bytes: %5.1f ns per call, %4.1f%% refused, "
+         "at most %lu bytes moved by one mmem_alloc()\n", max_size,
+         t / ops * 1e9, 100.0 * refused / (ops / 10), worst);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  if(!property_test()) {
+    printf("FAIL\n");
+    return 1;
+  }
+  benchmark(64);
+  benchmark(200);
+  printf("PASS\n");
+  return 0;
+}
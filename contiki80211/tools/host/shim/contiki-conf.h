@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for the platform configuration, with the types of the
+ * SAM3X build: a 32-bit clock_time_t and a 64-bit rtimer clock.
+ */
+#ifndef CONTIKI_CONF_H_
+#define CONTIKI_CONF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CCIF
+#define CLIF
+
+typedef uint32_t clock_time_t;
+#define CLOCK_CONF_SECOND 1000
+
+typedef unsigned long long rtimer_clock_t;
+#define RTIMER_CLOCK_LT(a,b) ((signed long long)((a)-(b)) < 0)
+
+#endif /* CONTIKI_CONF_H_ */
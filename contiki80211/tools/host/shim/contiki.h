@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for contiki.h: only the modules that the tested sources
+ * use, the rest being stubbed by each test.
+ */
+#ifndef CONTIKI_H_
+#define CONTIKI_H_
+
+#include "contiki-conf.h"
+#include "sys/process.h"
+#include "sys/etimer.h"
+#include "sys/energest.h"
+
+#endif /* CONTIKI_H_ */
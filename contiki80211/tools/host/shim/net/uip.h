@@ -0,0 +1,16 @@
+/*
+ * Host stand-in for net/uip.h: only the byte order macros, taken from
+ * the compiler's idea of the host byte order.
+ */
+#ifndef UIP_H_
+#define UIP_H_
+
+#include <stdint.h>
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define UIP_HTONS(n) (n)
+#else
+#define UIP_HTONS(n) (uint16_t)((((uint16_t) (n)) << 8) | (((uint16_t) (n)) >> 8))
+#endif
+
+#endif /* UIP_H_ */
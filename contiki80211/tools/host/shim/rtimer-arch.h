@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for the SAM3X rtimer architecture header.
+ */
+#ifndef RTIMER_ARCH_H_
+#define RTIMER_ARCH_H_
+
+#define RTIMER_ARCH_SECOND 10500000
+
+rtimer_clock_t rtimer_arch_now(void);
+
+#endif /* RTIMER_ARCH_H_ */
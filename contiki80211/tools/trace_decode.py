@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""
+Decoder for the binary trace ring [src/core/sys/trace.c].
+
+Reads a console log containing one or more dumps of the ring:
+
+    TRACE BEGIN <rtimer ticks per second> <records>
+    TR <time> <id> <seq> <a> <b>
+    ...
+    TRACE END
+
+and prints a timeline, or writes a Chrome trace [chrome://tracing,
+Perfetto] with --chrome. Event names and argument meanings are read
+from src/core/sys/trace.h, so the two never go out of step.
+
+usage: trace_decode.py [--header trace.h] [--chrome out.json] [log]
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                      '..', 'src', 'core', 'sys', 'trace.h')
+
+CLASSES = ['kernel', 'driver', 'psm', 'ibss', 'usb', 'uip', 'rpl']
+
+
+def read_events(header):
+    """Map event id to (name, [argument names]) from the enum in trace.h."""
+    events = {}
+    pattern = re.compile(r'^\s*TRACE_(\w+)\s*=\s*TRACE_ID\((\d+),\s*(\d+)\),'
+                         r'\s*(?:/\*(.*)\*/)?')
+    with open(header) as f:
+        for line in f:
+            m = pattern.match(line)
+            if not m:
+                continue
+            name, cls, n, comment = m.groups()
+            args = []
+            for part in (comment or '').split(','):
+                if ':' in part:
+                    args.append(part.split(':', 1)[1].strip())
+            events[(int(cls) << 8) | int(n)] = (name.lower(), args)
+    return events
+
+
+def read_dumps(lines):
+    """Yield (ticks per second, [records]) for each complete dump."""
+    rate = None
+    records = []
+    for line in lines:
+        line = line.strip()
+        if line.startswith('TRACE BEGIN'):
+            fields = line.split()
+            rate = int(fields[2])
+            records = []
+        elif line.startswith('TRACE END') and rate is not None:
+            yield rate, records
+            rate = None
+        elif line.startswith('TR ') and rate is not None:
+            fields = line.split()
+            if len(fields) != 6:
+                continue
+            try:
+                records.append(tuple(int(x, 16) for x in fields[1:]))
+            except ValueError:
+                continue
+
+
+def unwrap(records, rate):
+    """Extend the 32-bit timestamps and flag sequence gaps.
+
+    Records come oldest first, but a record written by an interrupt
+    between the slot claim and the timestamp of the previous record is
+    timestamped slightly before it. Each timestamp is therefore taken as
+    the signed 32-bit step from the previous one: only a step back of
+    more than 2^31 ticks is a wrap of the low 32 bits of the rtimer clock.
+    """
+    out = []
+    ext = None
+    last_time = None
+    last_seq = None
+    for time, id, seq, a, b in records:
+        if last_time is None:
+            ext = time
+        else:
+            ext += ((time - last_time + (1 << 31)) & 0xffffffff) - (1 << 31)
+        gap = 0
+        if last_seq is not None:
+            gap = (seq - last_seq - 1) & 0xffff
+        last_time = time
+        last_seq = seq
+        out.append((ext * 1000000.0 / rate, id, seq, a, b, gap))
+    return out
+
+
+def describe(events, id):
+    if id in events:
+        return events[id]
+    return ('event_%04x' % id, [])
+
+
+def print_timeline(events, dumps, out):
+    for n, (rate, records) in enumerate(dumps):
+        out.write('# dump %d: %d records, %d ticks/s\n'
+                  % (n, len(records), rate))
+        prev = None
+        for us, id, seq, a, b, gap in records:
+            if gap:
+                out.write('# %d records lost before seq %d\n' % (gap, seq))
+            name, args = describe(events, id)
+            delta = us - prev if prev is not None else 0.0
+            prev = us
+            argv = []
+            for i, v in enumerate((a, b)):
+                label = args[i] if i < len(args) else 'ab'[i]
+                argv.append('%s=%d' % (label, v))
+            out.write('%14.1f %+10.1f %5d %-7s %-16s %s\n'
+                      % (us, delta, seq, CLASSES[id >> 8]
+                         if (id >> 8) < len(CLASSES) else '?',
+                         name, ', '.join(argv)))
+
+
+def write_chrome(events, dumps, path):
+    trace = []
+    offset = 0.0
+    for rate, records in dumps:
+        if not records:
+            continue
+        # Lay consecutive dumps out one after the other.
+        start = records[0][0]
+        for us, id, seq, a, b, gap in records:
+            name, args = describe(events, id)
+            cls = id >> 8
+            argd = {'seq': seq}
+            for i, v in enumerate((a, b)):
+                argd[args[i] if i < len(args) else 'ab'[i]] = v
+            if gap:
+                argd['lost'] = gap
+            trace.append({'name': name, 'ph': 'i', 's': 't',
+                          'ts': offset + us - start, 'pid': 0, 'tid': cls,
+                          'args': argd})
+        offset += records[-1][0] - start + 1000.0
+    for cls, name in enumerate(CLASSES):
+        trace.append({'name': 'thread_name', 'ph': 'M', 'pid': 0,
+                      'tid': cls, 'args': {'name': name}})
+    with open(path, 'w') as f:
+        json.dump({'traceEvents': trace, 'displayTimeUnit': 'ns'}, f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode trace ring dumps.')
+    parser.add_argument('log', nargs='?', help='console log [stdin]')
+    parser.add_argument('--header', default=HEADER, help='path to trace.h')
+    parser.add_argument('--chrome', metavar='FILE',
+                        help='write a Chrome trace instead of a timeline')
+    opts = parser.parse_args()
+
+    events = read_events(opts.header)
+    if opts.log:
+        with open(opts.log, errors='replace') as f:
+            dumps = list(read_dumps(f))
+    else:
+        dumps = list(read_dumps(sys.stdin))
+    dumps = [(rate, unwrap(records, rate)) for rate, records in dumps]
+
+    if not dumps:
+        sys.stderr.write('no trace dump found\n')
+        return 1
+    if opts.chrome:
+        write_chrome(events, dumps, opts.chrome)
+    else:
+        print_timeline(events, dumps, sys.stdout)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())